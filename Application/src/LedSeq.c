@@ -99,8 +99,11 @@ static int state[LEDn][SEQ_NUM];
 static int activeSeq[LEDn];
 
 static xTimerHandle timer[LEDn];
+STATIC_MEM_TIMER_ALLOC(ledLTimer);
+STATIC_MEM_TIMER_ALLOC(ledRTimer);
 
 static xSemaphoreHandle LedseqSem;
+STATIC_MEM_SEMAPHORE_ALLOC(LedseqSem);
 
 static bool isInit = false;
 
@@ -128,10 +131,13 @@ void LedseqInit(void)
   }
   
   //Initialise the soft timers that runs the led sequences for each leds.
-  for(i=0; i<LEDn; i++)
-    timer[i] = xTimerCreate((const char *)"ledseqTimer", pdMS_TO_TICKS(1000), pdFALSE, (void*)i, RunLedseq);
+  timer[LEDL] = STATIC_MEM_TIMER_CREATE(ledLTimer, "ledseqTimer", pdMS_TO_TICKS(1000), pdFALSE,
+                                        (void*)LEDL, RunLedseq);
+  timer[LEDR] = STATIC_MEM_TIMER_CREATE(ledRTimer, "ledseqTimer", pdMS_TO_TICKS(1000), pdFALSE,
+                                        (void*)LEDR, RunLedseq);
   
-  vSemaphoreCreateBinary(LedseqSem);
+  LedseqSem = STATIC_MEM_BINARY_CREATE(LedseqSem);
+  xSemaphoreGive(LedseqSem);
   
   isInit = true;
 }
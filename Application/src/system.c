@@ -6,6 +6,9 @@ static bool isInit;
 
 /* System wide synchronisation */
 xSemaphoreHandle StartMutex;
+STATIC_MEM_SEMAPHORE_ALLOC(StartMutex);
+
+STATIC_MEM_TASK_ALLOC(systemTask, SYSTEM_TASK_STACKSIZE);
 
 /* Private functions */
 static void systemInit(void);
@@ -16,9 +19,8 @@ static void systemStart(void);
 /* Public functions */
 void systemLaunch(void)
 {
-	xTaskCreate(systemTask,SYSTEM_TASK_NAME,
-                SYSTEM_TASK_STACKSIZE, NULL,
-                SYSTEM_TASK_PRI      , NULL);
+	STATIC_MEM_TASK_CREATE(systemTask, systemTask, SYSTEM_TASK_NAME,
+                         NULL, SYSTEM_TASK_PRI);
 }
 
 //This must be the first module to be initialized!
@@ -26,11 +28,25 @@ static void systemInit(void)
 {
   if(isInit)
     return;
-  StartMutex = xSemaphoreCreateMutex();
+  StartMutex = STATIC_MEM_MUTEX_CREATE(StartMutex);
   xSemaphoreTake(StartMutex, portMAX_DELAY);
   HardwarePeripheralInit();
+  configblockInit();
   LedseqInit();
+#ifdef BPRINTF_DEFERRED
+  bprintfInit();
+#endif
   ComModuleInit();
+  logInit();
+  paramInit();
+  blackboxInit();
+  monitorInit();
+#ifdef TRACE_RECORDER
+  traceInit();
+#endif
+#ifdef MEMDMA_BENCH
+  memDmaBench();
+#endif
   isInit = true;
 }
 
@@ -38,8 +54,20 @@ static bool systemTest(void)
 {
   bool pass=isInit;
   
+  pass &= configblockTest();
   pass &= LedseqTest();
+  pass &= memDmaTest();
+#ifdef BPRINTF_DEFERRED
+  pass &= bprintfTest();
+#endif
   pass &= ComModuleTest();
+  pass &= logTest();
+  pass &= paramTest();
+  pass &= blackboxTest();
+  pass &= monitorTest();
+#ifdef TRACE_RECORDER
+  pass &= traceTest();
+#endif
   return pass;
 }
 
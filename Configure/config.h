@@ -72,6 +72,8 @@
 // Task priorities. Higher number higher priority
 #define STABILIZER_TASK_PRI     4
 #define ADC_TASK_PRI            3
+#define MAG_SAMPLER_TASK_PRI    3
+#define BARO_TASK_PRI           3
 #define SYSTEM_TASK_PRI         2
 #define CRTP_TX_TASK_PRI        2
 #define CRTP_RX_TASK_PRI        2
@@ -79,6 +81,10 @@
 #define LOG_TASK_PRI            1
 #define MEM_TASK_PRI            1
 #define PARAM_TASK_PRI          1
+#define BLACKBOX_TASK_PRI       1
+#define BPRINTF_TASK_PRI        0
+#define MONITOR_TASK_PRI        0
+#define TRACE_TASK_PRI          0
 #define PROXIMITY_TASK_PRI      0
 #define PM_TASK_PRI             0
 
@@ -108,6 +114,10 @@
 #define LOG_TASK_NAME           "LOG"
 #define MEM_TASK_NAME           "MEM"
 #define PARAM_TASK_NAME         "PARAM"
+#define BPRINTF_TASK_NAME       "BPRINTF"
+#define BLACKBOX_TASK_NAME      "BLACKBOX"
+#define MONITOR_TASK_NAME       "MONITOR"
+#define TRACE_TASK_NAME         "TRACE"
 #define STABILIZER_TASK_NAME    "STABILIZER"
 #define NRF24LINK_TASK_NAME     "NRF24LINK"
 #define ESKYLINK_TASK_NAME      "ESKYLINK"
@@ -116,6 +126,8 @@
 #define PROXIMITY_TASK_NAME     "PROXIMITY"
 #define EXTRX_TASK_NAME         "EXTRX"
 #define UART_RX_TASK_NAME       "UART"
+#define MAG_SAMPLER_TASK_NAME   "MAGSAMPLER"
+#define BARO_TASK_NAME          "BARO"
 
 //Task stack sizes
 #define SYSTEM_TASK_STACKSIZE         (2* configMINIMAL_STACK_SIZE)
@@ -127,6 +139,10 @@
 #define LOG_TASK_STACKSIZE            configMINIMAL_STACK_SIZE
 #define MEM_TASK_STACKSIZE            configMINIMAL_STACK_SIZE
 #define PARAM_TASK_STACKSIZE          configMINIMAL_STACK_SIZE
+#define BPRINTF_TASK_STACKSIZE        configMINIMAL_STACK_SIZE
+#define BLACKBOX_TASK_STACKSIZE       (3 * configMINIMAL_STACK_SIZE)
+#define MONITOR_TASK_STACKSIZE        (2 * configMINIMAL_STACK_SIZE)
+#define TRACE_TASK_STACKSIZE          (2 * configMINIMAL_STACK_SIZE)
 #define STABILIZER_TASK_STACKSIZE     (3 * configMINIMAL_STACK_SIZE)
 #define NRF24LINK_TASK_STACKSIZE      configMINIMAL_STACK_SIZE
 #define ESKYLINK_TASK_STACKSIZE       configMINIMAL_STACK_SIZE
@@ -135,12 +151,20 @@
 #define PROXIMITY_TASK_STACKSIZE      configMINIMAL_STACK_SIZE
 #define EXTRX_TASK_STACKSIZE          configMINIMAL_STACK_SIZE
 #define UART_RX_TASK_STACKSIZE        configMINIMAL_STACK_SIZE
+#define MAG_SAMPLER_TASK_STACKSIZE    (4 * configMINIMAL_STACK_SIZE)    // The calibration solve: 1.5KB in double
+#define BARO_TASK_STACKSIZE           (2 * configMINIMAL_STACK_SIZE)
 
-//The radio channel. From 0 to 125
-#define RADIO_CHANNEL 80
-#define RADIO_DATARATE RADIO_RATE_250K
+//The radio channel. From 0 to 125. As set by RadioLink.c
+#define RADIO_CHANNEL 40
+#define RADIO_DATARATE RADIO_RATE_1M
 #define RADIO_ADDRESS 0xE7E7E7E7E7ULL
 
+// Config block: the last sector of the 1MB flash, out of the application
+// image. Written as a log of records, erased only when full.
+#define CONFIG_BLOCK_FLASH_ADDRESS  0x080E0000
+#define CONFIG_BLOCK_FLASH_SECTOR   FLASH_Sector_11
+#define CONFIG_BLOCK_FLASH_SIZE     (128 * 1024)
+
 /**
  * \def ACTIVATE_AUTO_SHUTDOWN
  * Will automatically shot of system if no radio activity
@@ -162,6 +186,49 @@
  */
 //#define PRINT_OS_DEBUG_INFO
 
+/**
+ * \def BPRINTF_DEFERRED
+ * BPRINTF() sends the format id and the raw arguments to a ring buffer
+ * drained by a low priority task instead of formatting on the copter.
+ * The console output must then be decoded by Tools/bprintf/bprintf_decode.
+ */
+//#define BPRINTF_DEFERRED
+
+/**
+ * \def CRTP_OVER_UART
+ * Route the CRTP traffic to the wired link on UARTLINK_COM (UartLink.c,
+ * 2Mbaud) instead of the nRF24 radio. Tools/uartlink talks to it.
+ */
+//#define CRTP_OVER_UART
+
+/**
+ * \def BLACKBOX_AUTOSTART
+ * Start a blackbox recording on the SD card at boot, without waiting for
+ * the blackbox.enable parameter.
+ */
+//#define BLACKBOX_AUTOSTART
+
+/**
+ * \def MEMDMA_BENCH
+ * Print at boot the cycles taken by the byte loops, mymemcpy/mymemset and
+ * the memory to memory DMA on 4KB.
+ */
+//#define MEMDMA_BENCH
+
+/**
+ * \def SPI_BUS_DMA
+ * Move the data bytes of the sensor bus transactions of SPI_BUS_DMA_MIN_SIZE
+ * bytes and more by DMA: the reading task sleeps instead of polling.
+ */
+//#define SPI_BUS_DMA
+
+/**
+ * \def IMU_DUAL
+ * Read an MPU9250 on IMU2_SPI_nCS with the ICM20601 every sample and fuse
+ * the two, see imu_fusion.h. A failing one is left out.
+ */
+//#define IMU_DUAL
+
 
 //Debug defines
 //#define BRUSHLESS_MOTORCONTROLLER
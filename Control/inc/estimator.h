@@ -31,5 +31,7 @@
 void stateEstimatorInit(void);
 bool stateEstimatorTest(void);
 void stateEstimator(state_t *state, const sensorData_t *sensorData, const uint32_t tick);
+/* From the control of the previous loop: thrust not 0 */
+void stateEstimatorSetFlying(bool isFlying);
 
 #endif //__ESTIMATOR_H__
@@ -32,6 +32,9 @@ void sensfusion6Init(void);
 bool sensfusion6Test(void);
 
 void sensfusion6UpdateQ(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+/* Heading only, from a calibrated magnetometer sample, dt since the previous one.
+ * isFlying: the first heading is then reached at a limited rate, not at once */
+void sensfusion6UpdateHeading(float mx, float my, float mz, float dt, bool isFlying);
 void sensfusion6GetEulerRPY(float* roll, float* pitch, float* yaw);
 float sensfusion6GetAccZWithoutGravity(const float ax, const float ay, const float az);
 float sensfusion6GetInvThrustCompensationForTilt();
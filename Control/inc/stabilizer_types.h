@@ -85,7 +85,9 @@ typedef struct baro_s {
 typedef struct sensorData_s {
   Axis3f acc;
   Axis3f gyro;
+  uint32_t imuTimestamp;  // DWT cycles at the read of acc and gyro
   Axis3f mag;
+  uint32_t magTimestamp;  // DRDY tick of mag, 0 while it is not calibrated
   baro_t baro;
   point_t position;
 } sensorData_t;
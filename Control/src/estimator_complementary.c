@@ -5,17 +5,29 @@
 #include "sensfusion6.h"
 #include "position_estimator.h"
 
-#define ATTITUDE_UPDATE_RATE RATE_250_HZ
-#define ATTITUDE_UPDATE_DT 1.0/ATTITUDE_UPDATE_RATE
+#define ATTITUDE_NOMINAL_DT (1.0f / RATE_500_HZ)  // s, the IMU read rate, for the first sample
+#define ATTITUDE_MAX_DT 0.05f                     // s, a longer gap in the IMU samples is clamped
 
 #define POS_UPDATE_RATE RATE_100_HZ
 #define POS_UPDATE_DT 1.0/POS_UPDATE_RATE
 
+#define HEADING_MAX_DT 0.1f   // s, a longer gap in the magnetometer samples is clamped
+
+static uint32_t imuTimestamp;
+static bool isImuTimestampValid = false;
+static uint32_t magTimestamp;
+static bool isFlying;
+
 void stateEstimatorInit(void)
 {
   sensfusion6Init();
 }
 
+void stateEstimatorSetFlying(bool flying)
+{
+  isFlying = flying;
+}
+
 bool stateEstimatorTest(void)
 {
   bool pass = true;
@@ -27,17 +39,43 @@ bool stateEstimatorTest(void)
 
 void stateEstimator(state_t *state, const sensorData_t *sensorData, const uint32_t tick)
 {
-  if (RATE_DO_EXECUTE(ATTITUDE_UPDATE_RATE, tick)) {
+  // At the magnetometer's own rate, each new calibrated sample once
+  if (sensorData->magTimestamp != magTimestamp) {
+    float dt = HEADING_MAX_DT;
+
+    if (magTimestamp != 0 && sensorData->magTimestamp != 0) {
+      dt = T2M(sensorData->magTimestamp - magTimestamp) / 1000.0f;
+      if (dt > HEADING_MAX_DT)
+        dt = HEADING_MAX_DT;
+    }
+    if (sensorData->magTimestamp != 0) {
+      sensfusion6UpdateHeading(sensorData->mag.x, sensorData->mag.y, sensorData->mag.z, dt, isFlying);
+    }
+    magTimestamp = sensorData->magTimestamp;
+  }
+
+  // Each new IMU sample once, over the time measured since the previous one
+  if (sensorData->imuTimestamp != imuTimestamp) {
+    float dt = ATTITUDE_NOMINAL_DT;
+
+    if (isImuTimestampValid) {
+      dt = (float)(sensorData->imuTimestamp - imuTimestamp) / SystemCoreClock;
+      if (dt > ATTITUDE_MAX_DT)
+        dt = ATTITUDE_MAX_DT;
+    }
+    imuTimestamp = sensorData->imuTimestamp;
+    isImuTimestampValid = true;
+
     sensfusion6UpdateQ(sensorData->gyro.x, sensorData->gyro.y, sensorData->gyro.z,
                        sensorData->acc.x, sensorData->acc.y, sensorData->acc.z,
-                       ATTITUDE_UPDATE_DT);
+                       dt);
     sensfusion6GetEulerRPY(&state->attitude.roll, &state->attitude.pitch, &state->attitude.yaw);
 
     state->acc.z = sensfusion6GetAccZWithoutGravity(sensorData->acc.x,
                                                     sensorData->acc.y,
                                                     sensorData->acc.z);
 
-    positionUpdateVelocity(state->acc.z, ATTITUDE_UPDATE_DT);
+    positionUpdateVelocity(state->acc.z, dt);
   }
 
   if (RATE_DO_EXECUTE(POS_UPDATE_RATE, tick)) {
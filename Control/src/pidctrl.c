@@ -25,15 +25,9 @@
  */
  
 /* FreeRtos includes */
-#include "pidctrl.h"
+#include <string.h>
 
-extern PidObject pidRollRate;
-extern PidObject pidPitchRate;
-extern PidObject pidYawRate;
-extern PidObject pidRoll;
-extern PidObject pidPitch;
-extern PidObject pidYaw;
-extern PidObject altHoldPID;
+#include "pidctrl.h"
 
 typedef enum {
   pidCtrl_RPValues  = 0x01,
@@ -49,66 +43,107 @@ struct pidValues
   float attKp;
   float attKi;
   float attKd;
-}__packed *pPid;
-  
+}__packed;
+
+/* The gains are parameters: they are written through the param system so
+ * that the stabilizer picks them up between two control loops.
+ */
+typedef enum {
+  PID_RATE_ROLL = 0,
+  PID_RATE_PITCH,
+  PID_RATE_YAW,
+  PID_ATT_ROLL,
+  PID_ATT_PITCH,
+  PID_ATT_YAW,
+  PID_ALT,
+  PID_NBR_OF_LOOPS
+} PIDLoop;
+
+static const struct {
+  char * group;
+  char * kp;
+  char * ki;
+  char * kd;
+} pidParamNames[PID_NBR_OF_LOOPS] = {
+  [PID_RATE_ROLL]  = {"pid_rate",     "roll_kp",  "roll_ki",  "roll_kd"},
+  [PID_RATE_PITCH] = {"pid_rate",     "pitch_kp", "pitch_ki", "pitch_kd"},
+  [PID_RATE_YAW]   = {"pid_rate",     "yaw_kp",   "yaw_ki",   "yaw_kd"},
+  [PID_ATT_ROLL]   = {"pid_attitude", "roll_kp",  "roll_ki",  "roll_kd"},
+  [PID_ATT_PITCH]  = {"pid_attitude", "pitch_kp", "pitch_ki", "pitch_kd"},
+  [PID_ATT_YAW]    = {"pid_attitude", "yaw_kp",   "yaw_ki",   "yaw_kd"},
+  [PID_ALT]        = {"posCtlPid",    "zKp",      "zKi",      "zKd"},
+};
+
+static int pidParamIds[PID_NBR_OF_LOOPS][3];
+
 void pidCrtlTask(void *param);
 
+STATIC_MEM_TASK_ALLOC(pidCrtlTask, configMINIMAL_STACK_SIZE);
+
 void pidCtrlInit()
 {
-  xTaskCreate(pidCrtlTask, ( char*)"PIDCrtl",
-              configMINIMAL_STACK_SIZE, NULL, /*priority*/2, NULL);
+  STATIC_MEM_TASK_CREATE(pidCrtlTask, pidCrtlTask, ( char*)"PIDCrtl",
+                         NULL, /*priority*/2);
   //setup the pid channel
   crtpInitTaskQueue(CRTP_PORT_PID);
 }
 
+static void pidCtrlSetGains(PIDLoop loop, float kp, float ki, float kd)
+{
+  paramSetValue(pidParamIds[loop][0], &kp);
+  paramSetValue(pidParamIds[loop][1], &ki);
+  paramSetValue(pidParamIds[loop][2], &kd);
+}
+
 void pidCrtlTask(void *param)
 {
   CRTPPacket p;
+  struct pidValues pid;
+  int i;
+
+  systemWaitStart();
+
+  for (i=0; i<PID_NBR_OF_LOOPS; i++)
+  {
+    pidParamIds[i][0] = paramGetVarId(pidParamNames[i].group, pidParamNames[i].kp);
+    pidParamIds[i][1] = paramGetVarId(pidParamNames[i].group, pidParamNames[i].ki);
+    pidParamIds[i][2] = paramGetVarId(pidParamNames[i].group, pidParamNames[i].kd);
+  }
+
   while (true)
   {
     if (crtpReceivePacketBlock(CRTP_PORT_PID, &p) == pdTRUE)
     {
       PIDCrtlNbr pidNbr = (PIDCrtlNbr) p.channel;
+
+      if (p.size < sizeof(struct pidValues))
+        continue;
+      memcpy(&pid, p.data, sizeof(struct pidValues));
+
+      //All the gains of one packet are applied in the same control loop
+      paramSetHold(true);
       switch (pidNbr)
       {
         case pidCtrl_RPValues:
-          pPid = (struct pidValues *)p.data;
-          pidSetKp(&pidRollRate, pPid->rateKp);
-          pidSetKi(&pidRollRate, pPid->rateKi);
-          pidSetKd(&pidRollRate, pPid->rateKd);
-          pidSetKp(&pidRoll, pPid->attKp);
-          pidSetKi(&pidRoll, pPid->attKi);
-          pidSetKd(&pidRoll, pPid->attKd);
-                      
-          pidSetKp(&pidPitchRate, pPid->rateKp);
-          pidSetKi(&pidPitchRate, pPid->rateKi);
-          pidSetKd(&pidPitchRate, pPid->rateKd);
-          pidSetKp(&pidPitch, pPid->attKp);
-          pidSetKi(&pidPitch, pPid->attKi);
-          pidSetKd(&pidPitch, pPid->attKd);
+          pidCtrlSetGains(PID_RATE_ROLL,  pid.rateKp, pid.rateKi, pid.rateKd);
+          pidCtrlSetGains(PID_ATT_ROLL,   pid.attKp,  pid.attKi,  pid.attKd);
+          pidCtrlSetGains(PID_RATE_PITCH, pid.rateKp, pid.rateKi, pid.rateKd);
+          pidCtrlSetGains(PID_ATT_PITCH,  pid.attKp,  pid.attKi,  pid.attKd);
         break;
           
         case pidCtrl_YValues:
-          pPid = (struct pidValues *)p.data;
-          pidSetKp(&pidYawRate, pPid->rateKp);
-          pidSetKi(&pidYawRate, pPid->rateKi);
-          pidSetKd(&pidYawRate, pPid->rateKd);
-          pidSetKp(&pidYaw, pPid->attKp);
-          pidSetKi(&pidYaw, pPid->attKi);
-          pidSetKd(&pidYaw, pPid->attKd);
+          pidCtrlSetGains(PID_RATE_YAW, pid.rateKp, pid.rateKi, pid.rateKd);
+          pidCtrlSetGains(PID_ATT_YAW,  pid.attKp,  pid.attKi,  pid.attKd);
         break;
         
         case pidCtrl_ALTValues:
-          pPid = (struct pidValues *)p.data;
-          pidSetKp(&altHoldPID, pPid->rateKp);
-          pidSetKi(&altHoldPID, pPid->rateKi);
-          pidSetKd(&altHoldPID, pPid->rateKd);
-		break;
+          pidCtrlSetGains(PID_ALT, pid.rateKp, pid.rateKi, pid.rateKd);
+        break;
 					
         default:
           break;
       } 
+      paramSetHold(false);
     }
   }
 }
-
@@ -97,6 +97,15 @@ static float runPid(float input, struct pidAxis_s *axis, mode_t mode,
   }
   axis->previousMode = mode;
 
+  // Gains written to posCtlPid while enabled (the PID port zKp/zKi/zKd too)
+  // apply from this loop on, the integral is kept
+  if (axis->pid.kp != axis->init.kp)
+    pidSetKp(&axis->pid, axis->init.kp);
+  if (axis->pid.ki != axis->init.ki)
+    pidSetKi(&axis->pid, axis->init.ki);
+  if (axis->pid.kd != axis->init.kd)
+    pidSetKd(&axis->pid, axis->init.kd);
+
   // This is a position controller so if the setpoint is in velocity we
   // integrate it to get a position setpoint
   if (mode == modeAbs) {
@@ -129,31 +138,31 @@ void positionController(float* thrust, attitude_t *attitude, const state_t *stat
 }
 
 
-//LOG_GROUP_START(posCtlAlt)
-//LOG_ADD(LOG_FLOAT, targetX, &this.pidX.setpoint)
-//LOG_ADD(LOG_FLOAT, targetY, &this.pidY.setpoint)
-//LOG_ADD(LOG_FLOAT, targetZ, &this.pidZ.setpoint)
-//
-//LOG_ADD(LOG_FLOAT, p, &this.pidZ.pid.outP)
-//LOG_ADD(LOG_FLOAT, i, &this.pidZ.pid.outI)
-//LOG_ADD(LOG_FLOAT, d, &this.pidZ.pid.outD)
-//LOG_GROUP_STOP(posCtlAlt)
-//
-//PARAM_GROUP_START(posCtlPid)
-//
-//PARAM_ADD(PARAM_FLOAT, xKp, &this.pidX.init.kp)
-//PARAM_ADD(PARAM_FLOAT, xKi, &this.pidX.init.ki)
-//PARAM_ADD(PARAM_FLOAT, xKd, &this.pidX.init.kd)
-//
-//PARAM_ADD(PARAM_FLOAT, yKp, &this.pidY.init.kp)
-//PARAM_ADD(PARAM_FLOAT, yKi, &this.pidY.init.ki)
-//PARAM_ADD(PARAM_FLOAT, yKd, &this.pidY.init.kd)
-//
-//PARAM_ADD(PARAM_FLOAT, zKp, &this.pidZ.init.kp)
-//PARAM_ADD(PARAM_FLOAT, zKi, &this.pidZ.init.ki)
-//PARAM_ADD(PARAM_FLOAT, zKd, &this.pidZ.init.kd)
-//
-//PARAM_ADD(PARAM_UINT16, thrustBase, &this.thrustBase)
-//
-//PARAM_ADD(PARAM_FLOAT, rpLimit, &rpLimit)
-//PARAM_GROUP_STOP(posCtlPid)
+LOG_GROUP_START(posCtlAlt)
+LOG_ADD(LOG_FLOAT, targetX, &this.pidX.setpoint)
+LOG_ADD(LOG_FLOAT, targetY, &this.pidY.setpoint)
+LOG_ADD(LOG_FLOAT, targetZ, &this.pidZ.setpoint)
+
+LOG_ADD(LOG_FLOAT, p, &this.pidZ.pid.outP)
+LOG_ADD(LOG_FLOAT, i, &this.pidZ.pid.outI)
+LOG_ADD(LOG_FLOAT, d, &this.pidZ.pid.outD)
+LOG_GROUP_STOP(posCtlAlt)
+
+PARAM_GROUP_START(posCtlPid)
+
+PARAM_ADD(PARAM_FLOAT, xKp, &this.pidX.init.kp)
+PARAM_ADD(PARAM_FLOAT, xKi, &this.pidX.init.ki)
+PARAM_ADD(PARAM_FLOAT, xKd, &this.pidX.init.kd)
+
+PARAM_ADD(PARAM_FLOAT, yKp, &this.pidY.init.kp)
+PARAM_ADD(PARAM_FLOAT, yKi, &this.pidY.init.ki)
+PARAM_ADD(PARAM_FLOAT, yKd, &this.pidY.init.kd)
+
+PARAM_ADD(PARAM_FLOAT, zKp, &this.pidZ.init.kp)
+PARAM_ADD(PARAM_FLOAT, zKi, &this.pidZ.init.ki)
+PARAM_ADD(PARAM_FLOAT, zKd, &this.pidZ.init.kd)
+
+PARAM_ADD(PARAM_UINT16, thrustBase, &this.thrustBase)
+
+PARAM_ADD(PARAM_FLOAT, rpLimit, &rpLimit)
+PARAM_GROUP_STOP(posCtlPid)
@@ -71,14 +71,14 @@ static void positionUpdateVelocityInternal(float accWZ, float dt, struct selfSta
   state->velocityZ *= state->velZAlpha;
 }
 
-//LOG_GROUP_START(posEstimatorAlt)
-//LOG_ADD(LOG_FLOAT, estimatedZ, &state.estimatedZ)
-//LOG_ADD(LOG_FLOAT, velocityZ, &state.velocityZ)
-//LOG_GROUP_STOP(posEstimatorAlt)
-//
-//PARAM_GROUP_START(posEst)
-//PARAM_ADD(PARAM_FLOAT, estAlpha, &state.estAlpha)
-//PARAM_ADD(PARAM_FLOAT, velFactor, &state.velocityFactor)
-//PARAM_ADD(PARAM_FLOAT, velZAlpha, &state.velZAlpha)
-//PARAM_ADD(PARAM_FLOAT, vAccDeadband, &state.vAccDeadband)
-//PARAM_GROUP_STOP(posEstimatorAlt)
+LOG_GROUP_START(posEstimatorAlt)
+LOG_ADD(LOG_FLOAT, estimatedZ, &state.estimatedZ)
+LOG_ADD(LOG_FLOAT, velocityZ, &state.velocityZ)
+LOG_GROUP_STOP(posEstimatorAlt)
+
+PARAM_GROUP_START(posEst)
+PARAM_ADD(PARAM_FLOAT, estAlpha, &state.estAlpha)
+PARAM_ADD(PARAM_FLOAT, velFactor, &state.velocityFactor)
+PARAM_ADD(PARAM_FLOAT, velZAlpha, &state.velZAlpha)
+PARAM_ADD(PARAM_FLOAT, vAccDeadband, &state.vAccDeadband)
+PARAM_GROUP_STOP(posEst)
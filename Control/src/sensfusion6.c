@@ -36,6 +36,14 @@
     #define TWO_KI_DEF  (2.0f * 0.001f) // 2 * integral gain
 #endif
 
+// Heading correction from the magnetometer, at its own rate. Off until the
+// magnetometer axes (MAG_AXIS_n in IMU.c) are checked on the board: mirrored,
+// the correction drives the yaw away. Then 0.5 and 0.01
+#define MAG_KP_DEF          0.0f    // rad/s per rad of heading error
+#define MAG_KI_DEF          0.0f    // Gyro z bias, rad/s per rad.s (Mahony only)
+#define MAG_MIN_HORIZONTAL  0.2f    // Horizontal part of the field over its norm
+#define MAG_MAX_RATE        0.1f    // rad/s, the heading correction in flight
+
 #ifdef MADWICK_QUATERNION_IMU
   float beta = BETA_DEF;     // 2 * proportional gain (Kp)
 #else // MAHONY_QUATERNION_IMU
@@ -46,6 +54,9 @@
   float integralFBz = 0.0f;  // integral error terms scaled by Ki
 #endif
 
+float magKp = MAG_KP_DEF;
+float magKi = MAG_KI_DEF;
+
 float q0 = 1.0f;
 float q1 = 0.0f;
 float q2 = 0.0f;
@@ -62,9 +73,13 @@ static bool isInit;
 
 static bool isCalibrated = false;
 
+static bool isHeadingInit = false;
+static float headingError;  // rad, of the last magnetometer sample
+
 static void sensfusion6UpdateQImpl(float gx, float gy, float gz, float ax, float ay, float az, float dt);
 static float sensfusion6GetAccZ(const float ax, const float ay, const float az);
 static void estimatedGravityDirection(float* gx, float* gy, float* gz);
+static void rotateAroundEarthZ(float angle);
 
 // TODO: Make math util file
 static float invSqrt(float x);
@@ -93,6 +108,63 @@ void sensfusion6UpdateQ(float gx, float gy, float gz, float ax, float ay, float
   }
 }
 
+/*
+ * Yaw only: the field is rotated in the earth frame by the current estimate
+ * and the angle of its horizontal part from x, magnetic north, is the
+ * heading error. The estimate turns around the earth z axis by it, scaled by
+ * magKp and dt; roll and pitch stay the accelerometer's. While both gains
+ * are 0 the error is only logged, to check the magnetometer axes.
+ *
+ * The first sample takes the heading as is, but only while not flying: the
+ * controller then takes its yaw setpoint from the estimate. In flight, the
+ * first correction comes when the calibration converges or the gains are
+ * raised, and the controller holds an absolute yaw: the error is removed at
+ * MAG_MAX_RATE at most, and the gyro bias is only learnt once it is small.
+ */
+void sensfusion6UpdateHeading(float mx, float my, float mz, float dt, bool isFlying)
+{
+  float hx, hy, norm2;
+  float rate;
+  bool isLimited;
+
+  // Earth frame x and y of the field
+  hx = (q0*q0 + q1*q1 - q2*q2 - q3*q3) * mx + 2 * (q1*q2 - q0*q3) * my + 2 * (q1*q3 + q0*q2) * mz;
+  hy = 2 * (q1*q2 + q0*q3) * mx + (q0*q0 - q1*q1 + q2*q2 - q3*q3) * my + 2 * (q2*q3 - q0*q1) * mz;
+
+  // Field near the vertical (or no sample): no heading in it
+  norm2 = mx * mx + my * my + mz * mz;
+  if (norm2 == 0.0f ||
+      hx * hx + hy * hy < MAG_MIN_HORIZONTAL * MAG_MIN_HORIZONTAL * norm2)
+    return;
+
+  headingError = atan2f(hy, hx);
+
+  if (magKp <= 0.0f && magKi <= 0.0f)
+    return;
+
+  if (!isHeadingInit && !isFlying) {
+    rotateAroundEarthZ(headingError);
+    isHeadingInit = true;
+    return;
+  }
+
+  rate = magKp * headingError;
+  isLimited = fabsf(rate) > MAG_MAX_RATE;
+  if (isLimited)
+    rate = rate > 0.0f ? MAG_MAX_RATE : -MAG_MAX_RATE;
+
+#ifndef MADWICK_QUATERNION_IMU
+  // Gyro z bias: the earth z axis in the body frame is the gravity direction
+  if (magKi > 0.0f && !isLimited) {
+    integralFBx -= magKi * headingError * gravX * dt;
+    integralFBy -= magKi * headingError * gravY * dt;
+    integralFBz -= magKi * headingError * gravZ * dt;
+  }
+#endif
+
+  rotateAroundEarthZ(rate * dt);
+}
+
 #ifdef MADWICK_QUATERNION_IMU
 // Implementation of Madgwick's IMU and AHRS algorithms.
 // See: http://www.x-io.co.uk/open-source-ahrs-with-x-imu
@@ -275,18 +347,30 @@ float sensfusion6GetInvThrustCompensationForTilt()
   return gravZ;
 }
 
+// q = (cos(-angle/2), 0, 0, sin(-angle/2)) x q: the heading decreases by angle
+static void rotateAroundEarthZ(float angle)
+{
+  float c = cosf(0.5f * angle);
+  float s = sinf(0.5f * angle);
+  float qa = q0, qb = q1, qc = q2, qd = q3;
+
+  q0 = c * qa + s * qd;
+  q1 = c * qb + s * qc;
+  q2 = c * qc - s * qb;
+  q3 = c * qd - s * qa;
+}
+
 //---------------------------------------------------------------------------------------------------
 // Fast inverse square-root
 // See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
 float invSqrt(float x)
 {
   float halfx = 0.5f * x;
-  float y = x;
-  long i = *(long*)&y;
-  i = 0x5f3759df - (i>>1);
-  y = *(float*)&i;
-  y = y * (1.5f - (halfx * y * y));
-  return y;
+  union { float f; int32_t i; } y;  // 32 bits on the host too, no aliasing
+  y.f = x;
+  y.i = 0x5f3759df - (y.i>>1);
+  y.f = y.f * (1.5f - (halfx * y.f * y.f));
+  return y.f;
 }
 
 static float sensfusion6GetAccZ(const float ax, const float ay, const float az)
@@ -302,3 +386,15 @@ static void estimatedGravityDirection(float* gx, float* gy, float* gz)
   *gy = 2 * (q0 * q1 + q2 * q3);
   *gz = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
 }
+
+LOG_GROUP_START(sensfusion6)
+LOG_ADD(LOG_FLOAT, headingErr, &headingError)
+#ifndef MADWICK_QUATERNION_IMU
+LOG_ADD(LOG_FLOAT, biasZ, &integralFBz)
+#endif
+LOG_GROUP_STOP(sensfusion6)
+
+PARAM_GROUP_START(sensfusion6)
+PARAM_ADD(PARAM_FLOAT, magKp, &magKp)
+PARAM_ADD(PARAM_FLOAT, magKi, &magKi)
+PARAM_GROUP_STOP(sensfusion6)
@@ -49,7 +49,8 @@ bool sensorsTest(void)
 void sensorsAcquire(sensorData_t *sensors, const uint32_t tick)
 {
   if (RATE_DO_EXECUTE(IMU_RATE, tick)) {
-    imu9Read(&sensors->gyro, &sensors->acc, &sensors->mag);
+    imu9Read(&sensors->gyro, &sensors->acc, &sensors->mag, &sensors->magTimestamp);
+    sensors->imuTimestamp = imu6Timestamp();
   }
 
  if (RATE_DO_EXECUTE(BARO_RATE, tick) && imuHasBarometer()) {
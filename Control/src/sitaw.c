@@ -28,8 +28,8 @@
 #include <stdlib.h>
 #include <math.h>
 
-//#include "log.h"
-//#include "param.h"
+#include "log.h"
+#include "param.h"
 #include "trigger.h"
 #include "sitaw.h"
 #include "commander.h"
@@ -35,6 +35,8 @@ static bool isInit;
 
 static void stabilizerTask(void* param);
 
+STATIC_MEM_TASK_ALLOC(stabilizerTask, STABILIZER_TASK_STACKSIZE);
+
 void stabilizerInit(void)
 {
   if(isInit)
@@ -49,9 +51,8 @@ void stabilizerInit(void)
   sitAwInit();
 #endif
 
-  xTaskCreate(stabilizerTask, STABILIZER_TASK_NAME,
-              STABILIZER_TASK_STACKSIZE , NULL, 
-              STABILIZER_TASK_PRI , NULL);
+  STATIC_MEM_TASK_CREATE(stabilizerTask, stabilizerTask, STABILIZER_TASK_NAME,
+                         NULL, STABILIZER_TASK_PRI);
   
   isInit = true;
 }
@@ -90,6 +91,9 @@ static void stabilizerTask(void* param)
   while(1) {
     vTaskDelayUntil(&lastWakeTime, F2T(RATE_MAIN_LOOP));
 
+    // Safe point: new parameters take effect before the control loop runs
+    paramApplyPending();
+
     sensorsAcquire(&sensorData, tick);
 
     stateEstimator(&state, &sensorData, tick);
@@ -98,12 +102,49 @@ static void stabilizerTask(void* param)
     sitAwUpdateSetpoint(&setpoint, &sensorData, &state);
 
     stateController(&control, &sensorData, &state, &setpoint, tick);
+    // Thrust 0: the controller takes its yaw setpoint from the estimate
+    stateEstimatorSetFlying(control.thrust != 0);
     powerDistribution(&control);
 
+    blackboxRecord(&sensorData, &state, &setpoint, &control, tick);
+
+    logRunBlocks(tick);
+
     tick++;
   }
 }
 
+LOG_GROUP_START(stabilizer)
+LOG_ADD(LOG_FLOAT, roll, &state.attitude.roll)
+LOG_ADD(LOG_FLOAT, pitch, &state.attitude.pitch)
+LOG_ADD(LOG_FLOAT, yaw, &state.attitude.yaw)
+LOG_ADD(LOG_FLOAT, thrust, &control.thrust)
+LOG_GROUP_STOP(stabilizer)
+
+LOG_GROUP_START(acc)
+LOG_ADD(LOG_FLOAT, x, &sensorData.acc.x)
+LOG_ADD(LOG_FLOAT, y, &sensorData.acc.y)
+LOG_ADD(LOG_FLOAT, z, &sensorData.acc.z)
+LOG_GROUP_STOP(acc)
+
+LOG_GROUP_START(gyro)
+LOG_ADD(LOG_FLOAT, x, &sensorData.gyro.x)
+LOG_ADD(LOG_FLOAT, y, &sensorData.gyro.y)
+LOG_ADD(LOG_FLOAT, z, &sensorData.gyro.z)
+LOG_GROUP_STOP(gyro)
+
+LOG_GROUP_START(mag)
+LOG_ADD(LOG_FLOAT, x, &sensorData.mag.x)
+LOG_ADD(LOG_FLOAT, y, &sensorData.mag.y)
+LOG_ADD(LOG_FLOAT, z, &sensorData.mag.z)
+LOG_GROUP_STOP(mag)
+
+LOG_GROUP_START(baro)
+LOG_ADD(LOG_FLOAT, asl, &sensorData.baro.asl)
+LOG_ADD(LOG_FLOAT, temp, &sensorData.baro.temperature)
+LOG_ADD(LOG_FLOAT, pressure, &sensorData.baro.pressure)
+LOG_GROUP_STOP(baro)
+
 //static void stabilizerTask(void* param)
 //{
 //  uint32_t lastWakeTime;
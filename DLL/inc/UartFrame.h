@@ -0,0 +1,76 @@
+/**
+ * UartFrame.h - Packet framing of the wired UART CRTP link
+ *
+ * Frame on the wire:
+ *   UART_FRAME_SYNC1, UART_FRAME_SYNC2, length, payload, crc (2 bytes, LSB first)
+ * The length is the payload size (1..UART_FRAME_MAX_PAYLOAD). The crc is
+ * the CRC-16/CCITT-FALSE of the length byte and of the payload. A frame with
+ * a bad length or crc is dropped and the decoder hunts for the next sync.
+ *
+ * The payload of the CRTP link is the raw CRTP packet: header then data.
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host tool (Tools/uartlink).
+ */
+#ifndef __UARTFRAME_H__
+#define __UARTFRAME_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define UART_FRAME_SYNC1        0xBC
+#define UART_FRAME_SYNC2        0xCF
+#define UART_FRAME_MAX_PAYLOAD  32
+#define UART_FRAME_OVERHEAD     5     // 2 sync, length, 2 crc
+#define UART_FRAME_MAX_LENGTH   (UART_FRAME_MAX_PAYLOAD + UART_FRAME_OVERHEAD)
+
+#define UART_FRAME_CRC_INIT     0xFFFF
+
+typedef struct
+{
+  uint8_t state;
+  uint8_t length;
+  uint8_t index;
+  uint16_t crc;
+  uint8_t payload[UART_FRAME_MAX_PAYLOAD];
+  /* Statistics */
+  uint32_t frames;
+  uint32_t crcErrors;
+  uint32_t lengthErrors;
+} uartFrameDecoder_t;
+
+/*************************************************************************
+ *@brief  update a CRC-16/CCITT-FALSE (poly 0x1021, no reflection)
+ *@param  crc: UART_FRAME_CRC_INIT or the result of the previous call
+ *@param  *data: the bytes
+ *@param  len: the number of bytes
+ *@retval the updated crc
+ *************************************************************************/
+uint16_t uartFrameCrc16(uint16_t crc, const uint8_t * data, uint32_t len);
+
+/*************************************************************************
+ *@brief  build a frame
+ *@param  *frame: output, UART_FRAME_MAX_LENGTH bytes at least
+ *@param  *payload: the payload
+ *@param  len: the payload size, 1..UART_FRAME_MAX_PAYLOAD
+ *@retval the frame size, 0 if len is out of range
+ *************************************************************************/
+uint32_t uartFrameEncode(uint8_t * frame, const uint8_t * payload, uint32_t len);
+
+void uartFrameDecoderInit(uartFrameDecoder_t * dec);
+
+/*************************************************************************
+ *@brief  feed one received byte to the decoder
+ *@param  *dec: the decoder
+ *@param  byte: the received byte
+ *@retval the payload size when a valid frame has been completed, the
+ *        payload is then in dec->payload until the next call. Otherwise 0
+ *************************************************************************/
+uint32_t uartFrameDecode(uartFrameDecoder_t * dec, uint8_t byte);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
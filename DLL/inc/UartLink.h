@@ -0,0 +1,47 @@
+#ifndef _UARTLINK_H_
+#define _UARTLINK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include "main.h"
+#include "CRTP_Type.h"
+
+#define UARTLINK_BAUDRATE        2000000   // USART6 is on APB2 (84MHz): exact
+#define UARTLINK_IRQ_PRIORITY    6         // Gives semaphores: >= configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+
+typedef struct {
+  uint32_t rxFrames;
+  uint32_t rxCrcErrors;
+  uint32_t rxLengthErrors;
+  uint32_t rxDropped;        // rx queue full or link disabled
+  uint32_t txFrames;
+  uint32_t txBytes;
+} UartLinkStats;
+
+/*************************************************************************
+ *@brief  initialize the wired CRTP link on UARTLINK_COM
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void uartlinkInit(void);
+
+/**********************************************************************
+ *@brief test the uartlink whether is initialised
+ *@param None
+ *@retval if it is initialise then return one,otherwise return zero.
+ **********************************************************************/
+bool uartlinkTest(void);
+
+struct crtpLinkOperations * uartlinkGetLink(void);
+
+void uartlinkGetStats(UartLinkStats * stats);
+
+/* To be called from the UARTLINK_COM interrupt handlers */
+void uartlinkIsr(void);
+void uartlinkRxDmaIsr(void);
+void uartlinkTxDmaIsr(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -57,12 +57,21 @@ static struct crtpLinkOperations *link = &nopLink;
 //define the number of the Port(˿ں)
 #define CRTP_NBR_OF_PORTS  16
 #define CRTP_TX_QUEUE_SIZE 20
+#define CRTP_TASK_QUEUES   6     // Ports with a queue: commander, log, param, pid, spares
 #define CRTP_RX_QUEUE_SIZE 2
 
 /*define the queue variable*/
 static xQueueHandle  crtp_txQueue;
 static xQueueHandle  queues[CRTP_NBR_OF_PORTS];
 
+STATIC_MEM_QUEUE_ALLOC(txQueue, CRTP_TX_QUEUE_SIZE, sizeof(CRTPPacket));
+static StaticQueue_t taskQueueBuffers[CRTP_TASK_QUEUES];
+static uint8_t taskQueueStorage[CRTP_TASK_QUEUES][sizeof(CRTPPacket)];
+static int taskQueuesUsed;
+
+STATIC_MEM_TASK_ALLOC(crtpTxTask, CRTP_TX_TASK_STACKSIZE);
+STATIC_MEM_TASK_ALLOC(crtpRxTask, CRTP_RX_TASK_STACKSIZE);
+
 static volatile CrtpCallback callbacks[CRTP_NBR_OF_PORTS];
 
 /*function declare*/
@@ -79,14 +88,12 @@ void crtpInit(void)
   if(isInit)
     return;
 
-  crtp_txQueue = xQueueCreate(CRTP_TX_QUEUE_SIZE, sizeof(CRTPPacket));
+  crtp_txQueue = STATIC_MEM_QUEUE_CREATE(txQueue);
   /* Start Rx/Tx tasks */
-  xTaskCreate(crtpTxTask, CRTP_TX_TASK_NAME,
-              CRTP_TX_TASK_STACKSIZE, NULL, 
-              CRTP_TX_TASK_PRI, NULL);
-  xTaskCreate(crtpRxTask, CRTP_RX_TASK_NAME,
-              CRTP_RX_TASK_STACKSIZE, NULL,
-              CRTP_RX_TASK_PRI, NULL);  
+  STATIC_MEM_TASK_CREATE(crtpTxTask, crtpTxTask, CRTP_TX_TASK_NAME,
+                         NULL, CRTP_TX_TASK_PRI);
+  STATIC_MEM_TASK_CREATE(crtpRxTask, crtpRxTask, CRTP_RX_TASK_NAME,
+                         NULL, CRTP_RX_TASK_PRI);
   isInit = true;
 }
 
@@ -114,7 +121,12 @@ bool crtpTest(void)
  ***********************************************************/
 void crtpInitTaskQueue(CRTPPort portId)
 { 
-  queues[portId] = xQueueCreate(1, sizeof(CRTPPacket));
+  //One packet queue per port, from a static pool
+  configASSERT(taskQueuesUsed < CRTP_TASK_QUEUES);
+  queues[portId] = xQueueCreateStatic(1, sizeof(CRTPPacket),
+                                      taskQueueStorage[taskQueuesUsed],
+                                      &taskQueueBuffers[taskQueuesUsed]);
+  taskQueuesUsed++;
 }
 
 /**********************************************************************
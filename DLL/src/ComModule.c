@@ -22,13 +22,21 @@ void ComModuleInit(void)
   return;
   //nRF24L01 confiure
   radiolinkInit();
+#ifdef CRTP_OVER_UART
+  //Wired link on UARTLINK_COM
+  uartlinkInit();
+#endif
   //base on the CRTP type to decode the data
   crtpInit();
   //reister the callback function,progress the remote data
   commanderInit();
   
   //link the channel to the radio module nRF24L01
+#ifdef CRTP_OVER_UART
+  crtpSetLink(uartlinkGetLink());
+#else
   crtpSetLink(radiolinkGetLink());
+#endif
 
   isInit = true;
 }
@@ -36,6 +44,9 @@ void ComModuleInit(void)
 bool ComModuleTest(void)
 {
   isInit &= radiolinkTest();
+#ifdef CRTP_OVER_UART
+  isInit &= uartlinkTest();
+#endif
   isInit &= crtpTest();
   isInit &= commanderTest();
   
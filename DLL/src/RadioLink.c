@@ -1,6 +1,7 @@
 #include "RadioLink.h"
 
 #define RADIO_CONNECTED_TIMEOUT   pdMS_TO_TICKS(2000)
+#define RADIO_STARTUP_MS          5     // nRF24L01+ power down to standby, 4.5ms max
 
 static bool isInit;
 
@@ -26,6 +27,11 @@ static struct {
  bool enabled;
 }state;
 
+STATIC_MEM_SEMAPHORE_ALLOC(dataRdy);
+STATIC_MEM_QUEUE_ALLOC(rxQueue, 3, sizeof(RadioPacket));
+STATIC_MEM_QUEUE_ALLOC(txQueue, 3, sizeof(RadioPacket));
+STATIC_MEM_TASK_ALLOC(RadioTask, NRF24LINK_TASK_STACKSIZE);
+
 
 enum {
   RX_1=0,
@@ -269,7 +275,7 @@ static void radiolinkInitNRF24L01P(uint8_t modle)
   }
   RADIO_EN_CE;
 
-  vTaskDelay( pdMS_TO_TICKS( 100 ) ); //Wait for the chip to be ready
+  vTaskDelay( pdMS_TO_TICKS( RADIO_STARTUP_MS ) ); //Wait for the chip to be ready
 }
 
 /****************************************************************************************
@@ -325,16 +331,16 @@ void radiolinkInit(void)
   vTaskSetApplicationTaskTag(0, (pdTASK_HOOK_CODE)TASK_RADIO_ID_NBR);
 
   // Initialise the semaphores 
-  vSemaphoreCreateBinary(dataRdy);
+  dataRdy = STATIC_MEM_BINARY_CREATE(dataRdy);
+  xSemaphoreGive(dataRdy);
   // Queue init 
-  rxQueue = xQueueCreate(3, sizeof(RadioPacket));
-  txQueue = xQueueCreate(3, sizeof(RadioPacket));
+  rxQueue = STATIC_MEM_QUEUE_CREATE(rxQueue);
+  txQueue = STATIC_MEM_QUEUE_CREATE(txQueue);
   //init the nrf24l01
   radiolinkInitNRF24L01P(RX_2);	//6.24
   // Launch the Radio link task 		
-  xTaskCreate(RadioTask,NRF24LINK_TASK_NAME,
-			  NRF24LINK_TASK_STACKSIZE, NULL, 
-              NRF24LINK_TASK_PRI, NULL);
+  STATIC_MEM_TASK_CREATE(RadioTask, RadioTask, NRF24LINK_TASK_NAME,
+                         NULL, NRF24LINK_TASK_PRI);
   isInit = true;
 }
 
@@ -0,0 +1,326 @@
+/**
+******************************************************************************
+* @file    UartLink.c
+* @brief   Wired CRTP link over UARTLINK_COM, alternative to the radio
+******************************************************************************
+* The packets are framed by UartFrame (sync, length, payload, CRC-16).
+*
+* RX: the DMA runs in circular mode on rxBuffer. The half/complete transfer
+* and the UART idle line interrupts wake the RX task, which decodes the
+* bytes between its read position and the DMA write position.
+*
+* TX: sendPacket encodes the frame in one of two buffers and starts the DMA
+* on it once the previous frame is out, so the next frame is encoded while
+* the current one is on the wire.
+******************************************************************************
+*/
+#include <string.h>
+
+#include "UartLink.h"
+#include "UartFrame.h"
+
+#define UARTLINK_CONNECTED_TIMEOUT  M2T(2000)
+#define UARTLINK_RX_BUFFER_SIZE     1024     // 5ms of data at 2Mbaud
+#define UARTLINK_RX_QUEUE_SIZE      16
+#define UARTLINK_RX_POLL_MS         10       // RX wake up if an interrupt is missed
+
+static bool isInit = false;
+static bool enabled = false;
+
+static xSemaphoreHandle rxReady;
+static xSemaphoreHandle txDone;
+static xQueueHandle rxQueue;
+
+static uint8_t rxBuffer[UARTLINK_RX_BUFFER_SIZE];
+static uint8_t txFrame[2][UART_FRAME_MAX_LENGTH];
+static uint8_t txIndex;
+
+static uartFrameDecoder_t decoder;
+static uint32_t lastPacketTick;
+static UartLinkStats stats;
+
+static void uartlinkRxTask(void * prm);
+
+STATIC_MEM_SEMAPHORE_ALLOC(rxReady);
+STATIC_MEM_SEMAPHORE_ALLOC(txDone);
+STATIC_MEM_QUEUE_ALLOC(rxQueue, UARTLINK_RX_QUEUE_SIZE, sizeof(CRTPPacket));
+STATIC_MEM_TASK_ALLOC(uartlinkRxTask, UART_RX_TASK_STACKSIZE);
+
+static int uartlinkSetEnable(bool enable)
+{
+  enabled = enable;
+  return 0;
+}
+
+/*****************************************************************************
+ *@brief  frame the packet and send it
+ *@param  *pk: the packet to send
+ *@retval true, the packet is sent or dropped (link disabled)
+ *****************************************************************************/
+static int uartlinkSendPacket(CRTPPacket * pk)
+{
+  uint8_t * frame = txFrame[txIndex];
+  uint32_t len;
+
+  if (!enabled)
+    return true;
+
+  len = uartFrameEncode(frame, pk->raw, pk->size + 1);
+  if (len == 0)
+    return true;
+
+  //Wait for the previous frame, the other buffer
+  xSemaphoreTake(txDone, portMAX_DELAY);
+
+  DMA_ClearFlag(UARTLINK_COM_TX_DMA_STREAM, UARTLINK_COM_TX_DMA_FLAG_ALL);
+  UARTLINK_COM_TX_DMA_STREAM->M0AR = (uint32_t)frame;
+  UARTLINK_COM_TX_DMA_STREAM->NDTR = len;
+  DMA_Cmd(UARTLINK_COM_TX_DMA_STREAM, ENABLE);
+
+  txIndex ^= 1;
+  stats.txFrames++;
+  stats.txBytes += len;
+
+  return true;
+}
+
+/*********************************************************************************************
+ *@brief	  wait for a received packet
+ *@param[out] *pk: the packet
+ *@retval	  zero
+ *********************************************************************************************/
+static int uartlinkReceivePacket(CRTPPacket * pk)
+{
+  xQueueReceive(rxQueue, pk, portMAX_DELAY);
+
+  return 0;
+}
+
+static bool uartlinkIsConnected(void)
+{
+  if ((xTaskGetTickCount() - lastPacketTick) > UARTLINK_CONNECTED_TIMEOUT)
+    return false;
+
+  return true;
+}
+
+static struct crtpLinkOperations uartlinkOp =
+{
+  uartlinkSetEnable,                  //int (*setEnable)(bool enable);
+  uartlinkSendPacket,                 //int (*sendPacket)(CRTPPacket *pk);
+  uartlinkReceivePacket,              //int (*receivePacket)(CRTPPacket *pk);
+  uartlinkIsConnected,                //bool (*isConnected)(void);
+  NULL                                //void (*reset)(void); nothing queued on the TX side
+};
+
+static void uartlinkHardwareInit(void)
+{
+  GPIO_InitTypeDef  GPIO_InitStructure;
+  USART_InitTypeDef USART_InitStructure;
+  DMA_InitTypeDef   DMA_InitStructure;
+  NVIC_InitTypeDef  NVIC_InitStructure;
+
+  RCC_APB2PeriphClockCmd(UARTLINK_COM_CLK, ENABLE);
+  RCC_AHB1PeriphClockCmd(UARTLINK_COM_TX_GPIO_CLK | UARTLINK_COM_RX_GPIO_CLK |
+                         UARTLINK_COM_DMA_CLK, ENABLE);
+
+  GPIO_PinAFConfig(UARTLINK_COM_TX_GPIO_PORT, UARTLINK_COM_TX_SOURCE, UARTLINK_COM_TX_AF);
+  GPIO_PinAFConfig(UARTLINK_COM_RX_GPIO_PORT, UARTLINK_COM_RX_SOURCE, UARTLINK_COM_RX_AF);
+
+  GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
+  GPIO_InitStructure.GPIO_PuPd  = GPIO_PuPd_UP;
+  GPIO_InitStructure.GPIO_Mode  = GPIO_Mode_AF;
+  GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+  GPIO_InitStructure.GPIO_Pin   = UARTLINK_COM_TX_PIN;
+  GPIO_Init(UARTLINK_COM_TX_GPIO_PORT, &GPIO_InitStructure);
+  GPIO_InitStructure.GPIO_Pin   = UARTLINK_COM_RX_PIN;
+  GPIO_Init(UARTLINK_COM_RX_GPIO_PORT, &GPIO_InitStructure);
+
+  USART_InitStructure.USART_BaudRate    = UARTLINK_BAUDRATE;
+  USART_InitStructure.USART_WordLength  = USART_WordLength_8b;
+  USART_InitStructure.USART_StopBits    = USART_StopBits_1;
+  USART_InitStructure.USART_Parity      = USART_Parity_No;
+  USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+  USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
+  USART_Init(UARTLINK_COM, &USART_InitStructure);
+
+  //Common DMA settings
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&UARTLINK_COM->DR;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+  DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+  DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+  DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+
+  //TX: one normal transfer per frame
+  DMA_DeInit(UARTLINK_COM_TX_DMA_STREAM);
+  DMA_InitStructure.DMA_Channel = UARTLINK_COM_TX_DMA_CHANNEL;
+  DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)txFrame[0];
+  DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+  DMA_InitStructure.DMA_BufferSize = 1;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+  DMA_Init(UARTLINK_COM_TX_DMA_STREAM, &DMA_InitStructure);
+  DMA_ITConfig(UARTLINK_COM_TX_DMA_STREAM, DMA_IT_TC, ENABLE);
+
+  //RX: circular, never stopped
+  DMA_DeInit(UARTLINK_COM_RX_DMA_STREAM);
+  DMA_InitStructure.DMA_Channel = UARTLINK_COM_RX_DMA_CHANNEL;
+  DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)rxBuffer;
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+  DMA_InitStructure.DMA_BufferSize = UARTLINK_RX_BUFFER_SIZE;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+  DMA_Init(UARTLINK_COM_RX_DMA_STREAM, &DMA_InitStructure);
+  DMA_ITConfig(UARTLINK_COM_RX_DMA_STREAM, DMA_IT_HT | DMA_IT_TC, ENABLE);
+
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = UARTLINK_IRQ_PRIORITY;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_InitStructure.NVIC_IRQChannel = UARTLINK_COM_IRQn;
+  NVIC_Init(&NVIC_InitStructure);
+  NVIC_InitStructure.NVIC_IRQChannel = UARTLINK_COM_TX_DMA_IRQn;
+  NVIC_Init(&NVIC_InitStructure);
+  NVIC_InitStructure.NVIC_IRQChannel = UARTLINK_COM_RX_DMA_IRQn;
+  NVIC_Init(&NVIC_InitStructure);
+
+  USART_ITConfig(UARTLINK_COM, USART_IT_IDLE, ENABLE);
+  USART_DMACmd(UARTLINK_COM, USART_DMAReq_Tx | USART_DMAReq_Rx, ENABLE);
+  DMA_Cmd(UARTLINK_COM_RX_DMA_STREAM, ENABLE);
+  USART_Cmd(UARTLINK_COM, ENABLE);
+}
+
+/*************************************************************************
+ *@brief  initialize the wired CRTP link
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void uartlinkInit(void)
+{
+  if(isInit)
+    return;
+
+  uartFrameDecoderInit(&decoder);
+
+  rxReady = STATIC_MEM_BINARY_CREATE(rxReady);
+  xSemaphoreGive(rxReady);
+  txDone = STATIC_MEM_BINARY_CREATE(txDone);
+  xSemaphoreGive(txDone);           //Given: no frame in flight
+  rxQueue = STATIC_MEM_QUEUE_CREATE(rxQueue);
+
+  uartlinkHardwareInit();
+
+  STATIC_MEM_TASK_CREATE(uartlinkRxTask, uartlinkRxTask, UART_RX_TASK_NAME,
+                         NULL, UART_RX_TASK_PRI);
+
+  isInit = true;
+}
+
+bool uartlinkTest(void)
+{
+  return isInit;
+}
+
+struct crtpLinkOperations * uartlinkGetLink(void)
+{
+  return &uartlinkOp;
+}
+
+void uartlinkGetStats(UartLinkStats * s)
+{
+  *s = stats;
+  s->rxFrames = decoder.frames;
+  s->rxCrcErrors = decoder.crcErrors;
+  s->rxLengthErrors = decoder.lengthErrors;
+}
+
+/*************************************************************************
+ *@brief  decode the bytes written by the RX DMA and queue the packets
+ *@param  *prm: not used
+ *@retval None
+ *************************************************************************/
+static void uartlinkRxTask(void * prm)
+{
+  uint32_t readPos = 0;
+  uint32_t writePos;
+  uint32_t len;
+  CRTPPacket pk;
+
+  while(1)
+  {
+    xSemaphoreTake(rxReady, M2T(UARTLINK_RX_POLL_MS));
+
+    writePos = UARTLINK_RX_BUFFER_SIZE - UARTLINK_COM_RX_DMA_STREAM->NDTR;
+    if (writePos == UARTLINK_RX_BUFFER_SIZE)
+      writePos = 0;
+
+    while (readPos != writePos)
+    {
+      len = uartFrameDecode(&decoder, rxBuffer[readPos]);
+      readPos = (readPos + 1) & (UARTLINK_RX_BUFFER_SIZE-1);
+
+      if (len == 0 || len > CRTP_MAX_DATA_SIZE + 1)
+        continue;
+
+      lastPacketTick = xTaskGetTickCount();
+      pk.size = len - 1;
+      memcpy(pk.raw, decoder.payload, len);
+
+      if (!enabled || CRTP_IS_NULL_PACKET(pk) ||
+          xQueueSend(rxQueue, &pk, 0) != pdTRUE)
+        stats.rxDropped++;
+    }
+  }
+}
+
+/*************************************************************************
+ *@brief  idle line: the sender paused, decode what has been received
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void uartlinkIsr(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  if (USART_GetITStatus(UARTLINK_COM, USART_IT_IDLE) != RESET)
+  {
+    //Cleared by reading SR then DR
+    (void)USART_ReceiveData(UARTLINK_COM);
+    xSemaphoreGiveFromISR(rxReady, &xHigherPriorityTaskWoken);
+  }
+
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void uartlinkRxDmaIsr(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  DMA_ClearFlag(UARTLINK_COM_RX_DMA_STREAM, UARTLINK_COM_RX_DMA_FLAG_ALL);
+  xSemaphoreGiveFromISR(rxReady, &xHigherPriorityTaskWoken);
+
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void uartlinkTxDmaIsr(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  if (DMA_GetFlagStatus(UARTLINK_COM_TX_DMA_STREAM, UARTLINK_COM_TX_DMA_FLAG_TCIF) == RESET)
+    return;
+
+  DMA_ClearFlag(UARTLINK_COM_TX_DMA_STREAM, UARTLINK_COM_TX_DMA_FLAG_TCIF);
+  xSemaphoreGiveFromISR(txDone, &xHigherPriorityTaskWoken);
+
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+LOG_GROUP_START(uartlink)
+LOG_ADD(LOG_UINT32, rxFrames, &decoder.frames)
+LOG_ADD(LOG_UINT32, rxCrcErr, &decoder.crcErrors)
+LOG_ADD(LOG_UINT32, rxDropped, &stats.rxDropped)
+LOG_ADD(LOG_UINT32, txFrames, &stats.txFrames)
+LOG_GROUP_STOP(uartlink)
@@ -0,0 +1,78 @@
+/*-----------------------------------------------------------------------/
+/  Write-back sector cache between FatFs and a disk driver
+/-----------------------------------------------------------------------*/
+/* FatFs writes the FAT and directory sectors one at a time, and with
+/  _FS_TINY 0 the file data of small appends too. The cache keeps the last
+/  DISK_CACHE_SECTORS sectors used and writes the dirty ones on CTRL_SYNC
+/  (f_sync, f_close) or when a line is needed, sorted by sector so that
+/  adjacent sectors go out in one multi-block write.
+/
+/  Transfers of DISK_CACHE_BYPASS sectors or more (the blackbox buffers)
+/  go straight to the driver, the cached copies are kept coherent.
+/
+/  No dependency on the RTOS or the hardware: also used by the host disk
+/  backend (Tools/fatfs_host). Not reentrant, as the FatFs volume with
+/  _FS_REENTRANT 0.
+/-----------------------------------------------------------------------*/
+
+#ifndef _DISKCACHE_DEFINED
+#define _DISKCACHE_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "integer.h"
+#include "diskio.h"
+
+#ifndef DISK_CACHE_SECTORS
+#define DISK_CACHE_SECTORS	8		/* 0: no cache, transfers go to the driver */
+#endif
+#ifndef DISK_CACHE_BYPASS
+#define DISK_CACHE_BYPASS	4		/* Smallest transfer not cached */
+#endif
+
+#define DISK_CACHE_SS		512
+
+/* Driver functions under the cache. buff is a cache line (4 bytes aligned)
+   or, for the transfers not cached, the FatFs buffer */
+typedef DRESULT (*DCACHE_READ) (BYTE* buff, DWORD sector, UINT count);
+typedef DRESULT (*DCACHE_WRITE) (const BYTE* buff, DWORD sector, UINT count);
+
+/* Cache statistics, in sectors unless noted */
+typedef struct {
+	DWORD readHits;
+	DWORD readMisses;
+	DWORD writeHits;		/* Written to a sector already cached */
+	DWORD sectorsIn;		/* Written by FatFs */
+	DWORD sectorsOut;		/* Written to the driver, sectorsOut / sectorsIn is the write amplification */
+	DWORD writesOut;		/* Write commands to the driver */
+	DWORD flushes;
+} DCSTATS;
+
+typedef struct {
+	DCACHE_READ read;
+	DCACHE_WRITE write;
+	DWORD clock;			/* LRU time */
+#if DISK_CACHE_SECTORS
+	DWORD sector[DISK_CACHE_SECTORS];
+	DWORD used[DISK_CACHE_SECTORS];		/* clock of the last access, 0: empty line */
+	BYTE dirty[DISK_CACHE_SECTORS];
+	DWORD data[DISK_CACHE_SECTORS][DISK_CACHE_SS / sizeof(DWORD)];
+#endif
+	DCSTATS stats;
+} DCACHE;
+
+void disk_cache_init (DCACHE* dc, DCACHE_READ read, DCACHE_WRITE write);
+DRESULT disk_cache_read (DCACHE* dc, BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_cache_write (DCACHE* dc, const BYTE* buff, DWORD sector, UINT count);
+DRESULT disk_cache_sync (DCACHE* dc);
+
+/* Implemented by the disk backends */
+void disk_get_cache_stats (BYTE pdrv, DCSTATS* st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
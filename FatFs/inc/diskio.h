@@ -25,6 +25,21 @@ typedef enum {
 } DRESULT;
 
 
+/* Transfer statistics of a drive */
+typedef struct {
+	DWORD reads;			/* disk_read calls */
+	DWORD writes;			/* disk_write calls */
+	DWORD sectorsRead;
+	DWORD sectorsWritten;
+	DWORD bounced;			/* Sectors copied through the bounce buffer (unaligned buffers) */
+	DWORD errors;
+	DWORD readTimeTotal;	/* us, the time the calling task waited */
+	DWORD readTimeMax;		/* us */
+	DWORD writeTimeTotal;	/* us */
+	DWORD writeTimeMax;		/* us */
+} DSTATS;
+
+
 /*---------------------------------------*/
 /* Prototypes for disk control functions */
 
@@ -34,6 +49,7 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+void disk_get_stats (BYTE pdrv, DSTATS* st);
 
 
 /* Disk Status Bits (DSTATUS) */
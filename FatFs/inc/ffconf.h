@@ -43,11 +43,13 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
+#ifndef _USE_FASTSEEK		/* May be set by the build (host tests) */
 #define	_USE_FASTSEEK	1
+#endif
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define	_USE_EXPAND		0
+#define	_USE_EXPAND		1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
@@ -202,7 +204,9 @@
 / System Configurations
 /---------------------------------------------------------------------------*/
 
+#ifndef _FS_TINY		/* May be set by the build (host tests) */
 #define	_FS_TINY	0
+#endif
 /* This option switches tiny buffer configuration. (0:Normal or 1:Tiny)
 /  At the tiny configuration, size of file object (FIL) is reduced _MAX_SS bytes.
 /  Instead of private sector buffer eliminated from the file object, common sector
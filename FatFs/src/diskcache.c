@@ -0,0 +1,249 @@
+/*-----------------------------------------------------------------------*/
+/* Write-back sector cache between FatFs and a disk driver               */
+/*-----------------------------------------------------------------------*/
+/* A line is one sector. The lines are searched linearly, the cache is   */
+/* small. When dirty lines are written they are first moved to the front */
+/* of the cache sorted by sector, so a run of adjacent sectors is also   */
+/* contiguous in memory and goes out in one driver write.                */
+/*-----------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "diskcache.h"
+
+void disk_cache_init (
+	DCACHE* dc,			/* Cache object */
+	DCACHE_READ read,	/* Driver read function */
+	DCACHE_WRITE write	/* Driver write function */
+)
+{
+	memset(dc, 0, sizeof(DCACHE));
+	dc->read = read;
+	dc->write = write;
+}
+
+#if DISK_CACHE_SECTORS
+
+/* Line holding a sector, -1 if not cached */
+static int find (DCACHE* dc, DWORD sector)
+{
+	int i;
+
+	for (i = 0; i < DISK_CACHE_SECTORS; i++) {
+		if (dc->used[i] && dc->sector[i] == sector)
+			return i;
+	}
+	return -1;
+}
+
+static void touch (DCACHE* dc, int i)
+{
+	int j;
+
+	if (++dc->clock == 0) {		/* Wrapped: keep the lines used but forget their order */
+		for (j = 0; j < DISK_CACHE_SECTORS; j++) {
+			if (dc->used[j])
+				dc->used[j] = 1;
+		}
+		dc->clock = 2;
+	}
+	dc->used[i] = dc->clock;
+}
+
+static void swap_lines (DCACHE* dc, int a, int b)
+{
+	DWORD t;
+	BYTE d;
+	int i;
+
+	t = dc->sector[a]; dc->sector[a] = dc->sector[b]; dc->sector[b] = t;
+	t = dc->used[a]; dc->used[a] = dc->used[b]; dc->used[b] = t;
+	d = dc->dirty[a]; dc->dirty[a] = dc->dirty[b]; dc->dirty[b] = d;
+	for (i = 0; i < (int)(DISK_CACHE_SS / sizeof(DWORD)); i++) {
+		t = dc->data[a][i]; dc->data[a][i] = dc->data[b][i]; dc->data[b][i] = t;
+	}
+}
+
+/* Write all the dirty lines, adjacent sectors in one write */
+static DRESULT flush (DCACHE* dc)
+{
+	DRESULT res;
+	int n, i, j, best;
+
+	/* Selection sort of the dirty lines to the front */
+	for (n = 0; ; n++) {
+		best = -1;
+		for (j = n; j < DISK_CACHE_SECTORS; j++) {
+			if (dc->dirty[j] && (best < 0 || dc->sector[j] < dc->sector[best]))
+				best = j;
+		}
+		if (best < 0)
+			break;
+		if (best != n)
+			swap_lines(dc, n, best);
+	}
+	if (n == 0)
+		return RES_OK;
+
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && dc->sector[j] == dc->sector[j - 1] + 1; j++) ;
+
+		res = dc->write((const BYTE*)dc->data[i], dc->sector[i], j - i);
+		if (res != RES_OK)
+			return res;
+		dc->stats.sectorsOut += j - i;
+		dc->stats.writesOut++;
+		memset(&dc->dirty[i], 0, j - i);
+	}
+	dc->stats.flushes++;
+
+	return RES_OK;
+}
+
+/* Free line for a new sector, -1 on a write error */
+static int alloc (DCACHE* dc)
+{
+	int i, lru = 0;
+
+	for (i = 0; i < DISK_CACHE_SECTORS; i++) {
+		if (!dc->used[i])
+			return i;
+		if (dc->used[i] < dc->used[lru])
+			lru = i;
+	}
+	if (!dc->dirty[lru])
+		return lru;
+
+	/* Write them all while at it: more sectors per write. Moves the lines */
+	if (flush(dc) != RES_OK)
+		return -1;
+	for (i = 0; i < DISK_CACHE_SECTORS; i++) {
+		if (dc->used[i] < dc->used[lru])
+			lru = i;
+	}
+	return lru;
+}
+
+DRESULT disk_cache_read (
+	DCACHE* dc,		/* Cache object */
+	BYTE* buff,		/* Data buffer to store read data */
+	DWORD sector,	/* Start sector in LBA */
+	UINT count		/* Number of sectors to read */
+)
+{
+	DRESULT res;
+	UINT n;
+	int i;
+
+	if (count >= DISK_CACHE_BYPASS) {
+		res = dc->read(buff, sector, count);
+		if (res != RES_OK)
+			return res;
+		/* The dirty lines are newer than the card */
+		for (i = 0; i < DISK_CACHE_SECTORS; i++) {
+			if (dc->dirty[i] && dc->sector[i] - sector < count)
+				memcpy(buff + (dc->sector[i] - sector) * DISK_CACHE_SS, dc->data[i], DISK_CACHE_SS);
+		}
+		return RES_OK;
+	}
+
+	for (n = 0; n < count; n++, sector++, buff += DISK_CACHE_SS) {
+		i = find(dc, sector);
+		if (i >= 0) {
+			dc->stats.readHits++;
+		}
+		else {
+			dc->stats.readMisses++;
+			i = alloc(dc);
+			if (i < 0)
+				return RES_ERROR;
+			dc->used[i] = 0;
+			res = dc->read((BYTE*)dc->data[i], sector, 1);
+			if (res != RES_OK)
+				return res;
+			dc->sector[i] = sector;
+			dc->dirty[i] = 0;
+		}
+		touch(dc, i);
+		memcpy(buff, dc->data[i], DISK_CACHE_SS);
+	}
+	return RES_OK;
+}
+
+DRESULT disk_cache_write (
+	DCACHE* dc,			/* Cache object */
+	const BYTE* buff,	/* Data to be written */
+	DWORD sector,		/* Start sector in LBA */
+	UINT count			/* Number of sectors to write */
+)
+{
+	DRESULT res;
+	UINT n;
+	int i;
+
+	dc->stats.sectorsIn += count;
+
+	if (count >= DISK_CACHE_BYPASS) {
+		res = dc->write(buff, sector, count);
+		if (res != RES_OK)
+			return res;
+		dc->stats.sectorsOut += count;
+		dc->stats.writesOut++;
+		/* Cached copies of these sectors are now clean */
+		for (i = 0; i < DISK_CACHE_SECTORS; i++) {
+			if (dc->used[i] && dc->sector[i] - sector < count) {
+				memcpy(dc->data[i], buff + (dc->sector[i] - sector) * DISK_CACHE_SS, DISK_CACHE_SS);
+				dc->dirty[i] = 0;
+			}
+		}
+		return RES_OK;
+	}
+
+	for (n = 0; n < count; n++, sector++, buff += DISK_CACHE_SS) {
+		i = find(dc, sector);
+		if (i >= 0) {
+			dc->stats.writeHits++;
+		}
+		else {
+			i = alloc(dc);
+			if (i < 0)
+				return RES_ERROR;
+			dc->sector[i] = sector;
+		}
+		memcpy(dc->data[i], buff, DISK_CACHE_SS);
+		dc->dirty[i] = 1;
+		touch(dc, i);
+	}
+	return RES_OK;
+}
+
+DRESULT disk_cache_sync (
+	DCACHE* dc		/* Cache object */
+)
+{
+	return flush(dc);
+}
+
+#else	/* No cache: straight to the driver */
+
+DRESULT disk_cache_read (DCACHE* dc, BYTE* buff, DWORD sector, UINT count)
+{
+	dc->stats.readMisses += count;
+	return dc->read(buff, sector, count);
+}
+
+DRESULT disk_cache_write (DCACHE* dc, const BYTE* buff, DWORD sector, UINT count)
+{
+	dc->stats.sectorsIn += count;
+	dc->stats.sectorsOut += count;
+	dc->stats.writesOut++;
+	return dc->write(buff, sector, count);
+}
+
+DRESULT disk_cache_sync (DCACHE* dc)
+{
+	(void)dc;
+	return RES_OK;
+}
+
+#endif
@@ -7,13 +7,28 @@
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 
+#include <string.h>
+
 #include "diskio.h"		/* FatFs lower layer API */
+#include "diskcache.h"
 #include "main.h"
 
 /* Definitions of physical drive number for each drive */
 #define DEV_TF		0	/* Example: Map MMC/SD card to physical drive 1 */
 #define DEV_USB		1	/* Example: Map USB MSD to physical drive 2 */
 
+#define SECTOR_SIZE			512
+#define SD_READY_TIMEOUT_MS	500		/* Max card programming time */
+
+/* The SDIO DMA needs 4 bytes aligned buffers */
+static DWORD bounce[SECTOR_SIZE / 4];
+
+static DSTATS stats;
+static DCACHE cache;
+
+static DRESULT tf_read (BYTE *buff, DWORD sector, UINT count);
+static DRESULT tf_write (const BYTE *buff, DWORD sector, UINT count);
+
 
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
@@ -45,12 +60,132 @@ DSTATUS disk_initialize (
 	DSTATUS stat;
 	switch (pdrv) {
 	case DEV_TF :
+		/* Cycle counter for the transfer times */
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+		disk_cache_init(&cache, tf_read, tf_write);
 		stat = SD_Init();
 		return stat;
 	}
 	return STA_NOINIT;
 }
 
+/*-----------------------------------------------------------------------*/
+/* SD card transfers                                                     */
+/*-----------------------------------------------------------------------*/
+
+/* Wait for the card to leave the programming state. The calling task
+   sleeps between two CMD13, it does not spin on the card latency. */
+static DRESULT sd_wait_ready (void)
+{
+	TickType_t start = xTaskGetTickCount();
+	SDTransferState state;
+
+	while ((state = SD_GetStatus()) != SD_TRANSFER_OK) {
+		if (state == SD_TRANSFER_ERROR)
+			return RES_ERROR;
+		if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+			if (xTaskGetTickCount() - start > M2T(SD_READY_TIMEOUT_MS))
+				return RES_ERROR;
+			vTaskDelay(1);
+		}
+	}
+	return RES_OK;
+}
+
+/* buff must be 4 bytes aligned (SDIO DMA) */
+static DRESULT sd_read (BYTE *buff, DWORD sector, UINT count)
+{
+	SD_Error err;
+
+	err = SD_ReadMultiBlocks((uint8_t *)buff, (uint64_t)sector << 9, SECTOR_SIZE, count);
+	if (err == SD_OK)
+		err = SD_WaitReadOperation();
+	if (err != SD_OK)
+		return RES_ERROR;
+	return sd_wait_ready();
+}
+
+static DRESULT sd_write (const BYTE *buff, DWORD sector, UINT count)
+{
+	SD_Error err;
+
+	err = SD_WriteMultiBlocks((uint8_t *)buff, (uint64_t)sector << 9, SECTOR_SIZE, count);
+	if (err == SD_OK)
+		err = SD_WaitWriteOperation();
+	if (err != SD_OK)
+		return RES_ERROR;
+	return sd_wait_ready();
+}
+
+/* Microseconds elapsed since the cycle count start */
+static DWORD elapsed_us (DWORD start)
+{
+	return (DWT->CYCCNT - start) / (SystemCoreClock / 1000000);
+}
+
+static void update_time (DWORD *total, DWORD *max, DWORD t)
+{
+	*total += t;
+	if (t > *max)
+		*max = t;
+}
+
+
+
+/* Driver side of the cache: the SD card transfers, timed */
+static DRESULT tf_read (BYTE *buff, DWORD sector, UINT count)
+{
+	DRESULT res = RES_OK;
+	DWORD start = DWT->CYCCNT;
+	UINT i;
+
+	if ((DWORD)buff % 4 == 0) {
+		res = sd_read(buff, sector, count);
+	}
+	else {
+		/* Unaligned FatFs buffer: one sector at a time through the bounce buffer */
+		for (i = 0; i < count && res == RES_OK; i++) {
+			res = sd_read((BYTE *)bounce, sector + i, 1);
+			memcpy(buff + i * SECTOR_SIZE, bounce, SECTOR_SIZE);
+		}
+		stats.bounced += count;
+	}
+	stats.reads++;
+	stats.sectorsRead += count;
+	if (res != RES_OK)
+		stats.errors++;
+	update_time(&stats.readTimeTotal, &stats.readTimeMax, elapsed_us(start));
+	return res;
+}
+
+static DRESULT tf_write (const BYTE *buff, DWORD sector, UINT count)
+{
+	DRESULT res = RES_OK;
+	DWORD start = DWT->CYCCNT;
+	UINT i;
+
+	if ((DWORD)buff % 4 == 0) {
+		res = sd_write(buff, sector, count);
+	}
+	else {
+		/* Unaligned FatFs buffer: one sector at a time through the bounce buffer */
+		for (i = 0; i < count && res == RES_OK; i++) {
+			memcpy(bounce, buff + i * SECTOR_SIZE, SECTOR_SIZE);
+			res = sd_write((const BYTE *)bounce, sector + i, 1);
+		}
+		stats.bounced += count;
+	}
+	stats.writes++;
+	stats.sectorsWritten += count;
+	if (res != RES_OK)
+		stats.errors++;
+	update_time(&stats.writeTimeTotal, &stats.writeTimeMax, elapsed_us(start));
+	return res;
+}
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
@@ -62,24 +197,9 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
-	DRESULT res;  
 	switch (pdrv) {
-	case DEV_TF :   
-      
-//      res = SD_ReadDisk((uint8_t *)buff, sector, count);
-    if((DWORD)buff%4!=0)
-    {      
-      /* Read block of many bytes from address 0 */
-      res = (DRESULT)SD_ReadMultiBlocks((uint8_t *)buff,( sector << 9 ) + sector, 512, count);  
-    }
-    else
-    {
-      res = (DRESULT)SD_ReadMultiBlocks((uint8_t *)buff, ( sector << 9 ), 512, count);  
-    }
-    /* Check if the Transfer is finished */
-    res = (DRESULT)SD_WaitReadOperation();
-    while(SD_GetStatus() != SD_TRANSFER_OK);
-    return res;
+	case DEV_TF :
+		return disk_cache_read(&cache, buff, sector, count);
 	}
 	return RES_PARERR;
 }
@@ -95,27 +215,39 @@ DRESULT disk_write (
 	UINT count			/* Number of sectors to write */
 )
 {
-	DRESULT res;
 	switch (pdrv) {
-	case DEV_TF : 
-//      res = SD_WriteDisk((uint8_t*)buff, sector, count);
-      /* Write multiple block of many bytes on address 0 */
-      if((DWORD)buff%4!=0)
-      {
-        res = (DRESULT)SD_WriteMultiBlocks((uint8_t*)buff, ( sector << 9 ) + sector, 512, count);
-      }
-      else
-      {
-        res = (DRESULT)SD_WriteMultiBlocks((uint8_t*)buff, ( sector << 9 ), 512, count);
-      }
-      /* Check if the Transfer is finished */
-      res = (DRESULT)SD_WaitWriteOperation();
-      while(SD_GetStatus() != SD_TRANSFER_OK);  
-      return res;
+	case DEV_TF :
+		return disk_cache_write(&cache, buff, sector, count);
 	}
 	return RES_PARERR;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Transfer statistics                                                   */
+/*-----------------------------------------------------------------------*/
+
+void disk_get_stats (
+	BYTE pdrv,		/* Physical drive nmuber (0..) */
+	DSTATS *st		/* Statistics copy */
+)
+{
+	if (pdrv == DEV_TF)
+		*st = stats;
+	else
+		memset(st, 0, sizeof(DSTATS));
+}
+
+void disk_get_cache_stats (
+	BYTE pdrv,		/* Physical drive nmuber (0..) */
+	DCSTATS *st		/* Statistics copy */
+)
+{
+	if (pdrv == DEV_TF)
+		*st = cache.stats;
+	else
+		memset(st, 0, sizeof(DCSTATS));
+}
+
 /*-----------------------------------------------------------------------*/
 /* Miscellaneous Functions                                               */
 /*-----------------------------------------------------------------------*/
@@ -133,7 +265,7 @@ DRESULT disk_ioctl (
       switch(cmd)
       {
           case CTRL_SYNC:
-              res = RES_OK; 
+              res = disk_cache_sync(&cache);
               break;	 
           case GET_SECTOR_SIZE:
               *(DWORD*)buff = 512; 
@@ -172,4 +304,17 @@ void *ff_memalloc (UINT size)
 void ff_memfree (void* mf)		 
 {
 	myfree(SRAMIN,mf);
-}
\ No newline at end of file
+}
+
+LOG_GROUP_START(sd)
+LOG_ADD(LOG_UINT32, reads, &stats.reads)
+LOG_ADD(LOG_UINT32, writes, &stats.writes)
+LOG_ADD(LOG_UINT32, errors, &stats.errors)
+LOG_ADD(LOG_UINT32, bounced, &stats.bounced)
+LOG_ADD(LOG_UINT32, rdMaxUs, &stats.readTimeMax)
+LOG_ADD(LOG_UINT32, wrMaxUs, &stats.writeTimeMax)
+LOG_ADD(LOG_UINT32, cRdHits, &cache.stats.readHits)
+LOG_ADD(LOG_UINT32, cRdMiss, &cache.stats.readMisses)
+LOG_ADD(LOG_UINT32, cWrIn, &cache.stats.sectorsIn)
+LOG_ADD(LOG_UINT32, cWrOut, &cache.stats.sectorsOut)
+LOG_GROUP_STOP(sd)
@@ -52,10 +52,11 @@ extern "C" {
 void IMU_Init(void); 
 bool IMU_Test(void);
 void imu6Read(Axis3f *gyro,Axis3f *acc);
+uint32_t imu6Timestamp(void);
 bool imu6IsCalibrated(void);
 bool imuHasBarometer(void);
 bool imuHasMangnetometer(void);
-void imu9Read(Axis3f *gyro,Axis3f *acc,Axis3f *mag);
+void imu9Read(Axis3f *gyro,Axis3f *acc,Axis3f *mag,uint32_t *magTimestamp);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,52 @@
+/**
+ * gyro_temp_model.h - Gyro bias against the sensor temperature
+ *
+ * The temperature range is cut in bins of GYRO_TEMP_BIN_WIDTH. Each bin
+ * holds the mean bias of the stationary windows seen in it, with their mean
+ * temperature: the average of the first GYRO_TEMP_MAX_WEIGHT windows, then
+ * a moving average which follows the ageing of the sensor.
+ *
+ * The bias at a temperature is interpolated between the two learnt bins
+ * around it. Out of the learnt range it is the one of the nearest bin, up
+ * to GYRO_TEMP_MAX_EXTRAPOLATION away, and unknown further.
+ *
+ * The model is saved as is in the config block. Has no dependency on the
+ * RTOS or the hardware.
+ */
+#ifndef __GYRO_TEMP_MODEL_H__
+#define __GYRO_TEMP_MODEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define GYRO_TEMP_BINS              20
+#define GYRO_TEMP_MIN               (-10.0f)  // Celsius, low edge of the first bin
+#define GYRO_TEMP_BIN_WIDTH         4.0f      // Celsius, up to 70 C
+#define GYRO_TEMP_MAX_WEIGHT        16        // Windows
+#define GYRO_TEMP_MAX_EXTRAPOLATION 5.0f      // Celsius
+
+typedef struct
+{
+  float temperature[GYRO_TEMP_BINS];  // Mean of the windows of the bin
+  float bias[GYRO_TEMP_BINS][3];      // Raw LSB
+  uint8_t count[GYRO_TEMP_BINS];      // Windows, up to GYRO_TEMP_MAX_WEIGHT. 0: empty
+} gyroTempModel_t;
+
+void gyroTempModelReset(gyroTempModel_t * model);
+
+/**
+ * Adds the mean bias of a stationary window.
+ * @return true when it is the first of its bin, false otherwise or out of range
+ */
+bool gyroTempModelUpdate(gyroTempModel_t * model, float temperature, const float bias[3]);
+
+/**
+ * The bias at a temperature.
+ * @return false when no bin was learnt near it, bias is not written
+ */
+bool gyroTempModelGet(const gyroTempModel_t * model, float temperature, float bias[3]);
+
+/* Learnt bins */
+uint32_t gyroTempModelBins(const gyroTempModel_t * model);
+
+#endif //__GYRO_TEMP_MODEL_H__
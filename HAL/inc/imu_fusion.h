@@ -0,0 +1,103 @@
+/**
+ * imu_fusion.h - Two IMUs fused into one gyro and accel stream
+ *
+ * Both units are given in the frame and the raw LSB of unit 0, the primary.
+ * Unit 1 is brought to the bias of unit 0 by their offset, the mean of
+ * x1 - x0: the motion is the same for both on a rigid frame and cancels, so
+ * the offset is tracked in flight too. The output keeps the bias of unit 0
+ * and the bias estimation and temperature model of unit 0 still apply.
+ *
+ * Each channel is the inverse-variance weighted mean of the two:
+ *
+ *   out = x0 + n0 / (n0 + n1) * (x1 - offset - x0)
+ *
+ * n0 + n1 is the variance of x1 - offset - x0, tracked. n0 is the variance
+ * of unit 0 when the caller tells it is at rest (imuFusionAtRest), or given
+ * (imuFusionSetNoise): n1 is the rest. Until then the weights are equal.
+ * With equal noises the noise of the output is 1/sqrt(2) of the one of a
+ * unit.
+ *
+ * A unit is excluded when it fails to read, when all its values stay the
+ * same (dead or disconnected), or when the two disagree by more than the
+ * limit of a channel for IMU_FUSION_DISAGREE_SAMPLES. Two units tell a
+ * disagreement but not always which one is wrong: the one whose first
+ * difference went rough (spikes, noise) is excluded, unit 1 when neither
+ * did. It is used again after IMU_FUSION_RECOVER_SAMPLES of agreement.
+ *
+ * Has no dependency on the RTOS or the hardware.
+ */
+#ifndef __IMU_FUSION_H__
+#define __IMU_FUSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IMU_FUSION_UNITS            2
+#define IMU_FUSION_CHANNELS         6     // Gyro x, y, z then accel x, y, z
+#define IMU_FUSION_GYRO             0     // First channel of the gyro
+#define IMU_FUSION_ACC              3     // First channel of the accel
+
+#define IMU_FUSION_OFFSET_SAMPLES   500   // Plain mean of the first ones, unit 1 unused
+#define IMU_FUSION_OFFSET_TC        2500  // Samples, moving mean after
+#define IMU_FUSION_ROUGH_TC         16    // Samples, first difference energy
+#define IMU_FUSION_QUIET_TC         256   // Samples, variance of unit 0
+#define IMU_FUSION_STUCK_SAMPLES    25
+#define IMU_FUSION_DISAGREE_SAMPLES 5
+#define IMU_FUSION_RECOVER_SAMPLES  500
+#define IMU_FUSION_ROUGH_RATIO      4.0f  // Rough: above that times the other
+#define IMU_FUSION_MIN_NOISE_RATIO  0.1f  // n1 never below that times n0
+
+/* Why a unit is excluded */
+#define IMU_FUSION_FAULT_READ       0x01
+#define IMU_FUSION_FAULT_STUCK      0x02
+#define IMU_FUSION_FAULT_DISAGREE   0x04
+
+typedef struct
+{
+  float limit[IMU_FUSION_CHANNELS];     // Disagreement, raw LSB
+  float offset[IMU_FUSION_CHANNELS];    // Unit 1 - unit 0
+  float diffVar[IMU_FUSION_CHANNELS];   // n0 + n1
+  float noise0[IMU_FUSION_CHANNELS];    // n0, 0 until set
+  float mean0[IMU_FUSION_CHANNELS];     // Moving mean and variance of unit 0
+  float var0[IMU_FUSION_CHANNELS];
+  float rough[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS];
+  float last[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS];
+  uint32_t offsetSamples;
+  uint16_t stuckCount[IMU_FUSION_UNITS];
+  uint16_t recoverCount[IMU_FUSION_UNITS];
+  uint16_t disagreeCount;
+  uint8_t fault[IMU_FUSION_UNITS];      // IMU_FUSION_FAULT_x, 0: in use
+  uint8_t hasLast[IMU_FUSION_UNITS];
+  uint16_t exclusions;                  // Units excluded since the reset
+} imuFusion_t;
+
+/**
+ * @param gyroLimit, accLimit  Largest normal disagreement, raw LSB
+ */
+void imuFusionReset(imuFusion_t * fusion, float gyroLimit, float accLimit);
+
+/**
+ * The noise variance of unit 0 on the channels from first.
+ */
+void imuFusionSetNoise(imuFusion_t * fusion, uint32_t first, const float variance[3]);
+
+/**
+ * The last IMU_FUSION_QUIET_TC samples or more were at rest: n0 is their
+ * variance on unit 0.
+ */
+void imuFusionAtRest(imuFusion_t * fusion);
+
+/**
+ * Fuses one sample of each unit.
+ * @param x     The samples, unit 1 already in the frame and LSB of unit 0
+ * @param isRead  false when the read of the unit failed, its sample is not used
+ * @param out   Fused, with the bias of unit 0
+ * @return The units in use, bit n for unit n
+ */
+uint8_t imuFusionUpdate(imuFusion_t * fusion, const float x[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS],
+                        const bool isRead[IMU_FUSION_UNITS], float out[IMU_FUSION_CHANNELS]);
+
+/* The weight of unit 1 on a channel, 0 when it is not in use */
+float imuFusionWeight(const imuFusion_t * fusion, uint32_t channel);
+
+#endif //__IMU_FUSION_H__
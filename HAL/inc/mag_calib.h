@@ -0,0 +1,87 @@
+/**
+ * mag_calib.h - Hard and soft iron calibration of the magnetometer
+ *
+ * The samples m lie on an ellipsoid, m = S h + c: h the field of the place,
+ * of constant norm, c the hard iron offset, S the soft iron and the scale
+ * errors. It is fitted by least squares on the quadric
+ *
+ *   a0 x^2 + a1 y^2 + a2 z^2 + 2 a3 xy + 2 a4 xz + 2 a5 yz
+ *                            + 2 a6 x + 2 a7 y + 2 a8 z = 1
+ *
+ * linear in a. A sample adds its terms to the normal equations, the old
+ * ones fading by MAG_CALIB_WINDOW: constant time, whatever the count. Only
+ * the samples MAG_CALIB_MIN_STEP away from the last one added are used, the
+ * equations weigh the directions seen and not the time spent in each.
+ *
+ * Every MAG_CALIB_SOLVE_SAMPLES added, the equations are solved into the
+ * offset c and the symmetric W which brings the ellipsoid back to a sphere
+ * of its mean radius: h = W (m - c), in gauss. The solution is taken only
+ * when the samples cover the directions (their spread on the narrowest
+ * axis), fit an ellipsoid (the residual) and it is plausible: field of the
+ * Earth, axis ratio, offset. Else the one in use stays.
+ *
+ * The result is saved as is in the config block. Has no dependency on the
+ * RTOS or the hardware.
+ */
+#ifndef __MAG_CALIB_H__
+#define __MAG_CALIB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAG_CALIB_TERMS           9
+#define MAG_CALIB_NORMAL_SIZE     ((MAG_CALIB_TERMS * (MAG_CALIB_TERMS + 1)) / 2)
+
+#define MAG_CALIB_WINDOW          1000    // Samples added, time constant of the fading
+#define MAG_CALIB_MIN_STEP        0.02f   // Gauss from the last sample added
+#define MAG_CALIB_MIN_SAMPLES     200     // Weight before the first solve
+#define MAG_CALIB_SOLVE_SAMPLES   50      // Samples added between two solves
+#define MAG_CALIB_MIN_FIELD       0.15f   // Gauss, radius
+#define MAG_CALIB_MAX_FIELD       0.8f
+#define MAG_CALIB_MAX_OFFSET      2.0f    // Gauss, on each axis
+#define MAG_CALIB_MAX_ASPECT      1.5f    // Longest over shortest axis
+#define MAG_CALIB_MIN_SPREAD      0.1f    // Narrowest deviation over the radius, 0.58 on a sphere
+#define MAG_CALIB_MAX_RESIDUAL    0.05f   // Rms of the quadric, about twice the radius error
+
+typedef struct
+{
+  float offset[3];      // Gauss
+  float soft[3][3];     // Symmetric
+  float radius;         // Gauss, 0: not calibrated
+} magCalibResult_t;
+
+typedef struct
+{
+  float normal[MAG_CALIB_NORMAL_SIZE];  // Sum of t t', upper triangle by rows
+  float sum[MAG_CALIB_TERMS];           // Sum of t
+  float weight;                         // Sum of the weights
+  float center[3];                      // Origin of the sums, gauss
+  float last[3];                        // Last sample added
+  uint32_t added;                       // Since the last solve
+  bool hasLast;
+  magCalibResult_t result;              // In use
+  float residual;                       // Of the last solve
+  float spread;
+  uint16_t solutions;                   // Taken since the reset
+  uint16_t rejections;
+} magCalib_t;
+
+void magCalibReset(magCalib_t * calib);
+
+/* Uses a stored result until the samples give a new one */
+void magCalibRestore(magCalib_t * calib, const magCalibResult_t * result);
+
+/**
+ * Adds a sample, solves when it is time.
+ * @param m  Gauss
+ * @return true when a new solution was taken
+ */
+bool magCalibUpdate(magCalib_t * calib, const float m[3]);
+
+/* h = W (m - c), m itself when not calibrated. h and m may be the same */
+void magCalibApply(const magCalibResult_t * result, const float m[3], float h[3]);
+
+/* A field of the offset or the soft iron matrix moved more than minDiff */
+bool magCalibDiffers(const magCalibResult_t * a, const magCalibResult_t * b, float minDiff);
+
+#endif //__MAG_CALIB_H__
@@ -0,0 +1,40 @@
+/**
+ * mag_sampler.h - Magnetometer sampled on its data ready line
+ *
+ * A task reads each HMC5983 sample when DRDY falls, feeds the hard and soft
+ * iron calibration (mag_calib.h) and keeps the last calibrated field with
+ * the tick of its DRDY. The calibration is restored from the config block,
+ * and saved when it changed from magSamplerAtRest().
+ */
+#ifndef __MAG_SAMPLER_H__
+#define __MAG_SAMPLER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "imu_types.h"
+
+#define MAG_SAMPLER_TIMEOUT_MS      10      // Two periods at 220Hz, then the status is polled
+#define MAG_SAMPLER_STORE_MIN_DIFF  0.01f   // Gauss of offset, or of the soft iron matrix
+
+/* Starts the task, once the HMC5983 is configured */
+void magSamplerInit(void);
+bool magSamplerTest(void);
+
+/**
+ * The last sample, calibrated once the calibration is known, in gauss.
+ * @param tick  Its DRDY, may be NULL
+ * @return true when it is new since the previous call
+ */
+bool magSamplerRead(Axis3f * mag, uint32_t * tick);
+
+/* The hard and soft iron are corrected */
+bool magSamplerIsCalibrated(void);
+
+/* Called at rest: saves the calibration when it changed. The flash write stalls */
+void magSamplerAtRest(void);
+
+/* To be called from HMC5983_DRDY_IRQHandler */
+void magSamplerIsr(void);
+
+#endif //__MAG_SAMPLER_H__
@@ -1,7 +1,13 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "IMU.h"
+#ifdef IMU_DUAL
+#include "MPU9250.h"
+#include "imu_fusion.h"
+#endif
 
 
-#define IMU_STARTUP_TIME_MS   1000
 #define IMU_ENABLE_MAG_HMC5983
 //#define IMU_ENABLE_PRESSURE_MS5611
 
@@ -16,7 +22,6 @@
 
 #define MAG_GAUSS_PER_LSB     666.7f
 
-#define IMU_STARTUP_TIME_MS   1000
 
 #define GYRO_NBR_OF_AXES 3
 #define GYRO_X_SIGN      (-1)
@@ -28,18 +33,69 @@
 #define IMU_TAKE_ACCEL_BIAS   
 #define IMU_NBR_OF_BIAS_SAMPLES  1024
 
+// A stored bias is used at boot within this distance of its temperature
+#define IMU_BIAS_TEMP_TOLERANCE       5.0f      // Celsius
+// A new bias closer than this to the stored one is not written
+#define IMU_GYRO_BIAS_STORE_MIN_DIFF  3         // LSB, 0.2 deg/s
+#define IMU_ACCEL_BIAS_STORE_MIN_DIFF 16        // LSB, 8 mg
+
+#define IMU_TEMP_LPF_ALPHA            0.01f     // Temperature low pass, 0.2 s
+#define IMU_TEMP_MODEL_UPDATE_SAMPLES 50        // Model bias evaluated at 10 Hz
+// The model is saved when a bin is learnt, or else at most that often
+#define IMU_TEMP_MODEL_SAVE_PERIOD_MS (10 * 60 * 1000)
+
+/* The HMC5983 in the frame of the estimator: body axis n is MAG_SIGN_n times
+ * axis MAG_AXIS_n of HMC5983_ReadRaw(). Set as the ICM20601 (x negated by
+ * imu6Read()), not checked on the board yet: with sensfusion6.magKp at 0,
+ * level, turned slowly around z, sensfusion6.headingErr must stay constant.
+ * It moves at twice the rate of the turn when an axis is mirrored. */
+#define MAG_AXIS_X        0
+#define MAG_AXIS_Y        1
+#define MAG_AXIS_Z        2
+#define MAG_SIGN_X        (-1.0f)
+#define MAG_SIGN_Y        1.0f
+#define MAG_SIGN_Z        1.0f
+
+#ifdef IMU_DUAL
+/* The MPU9250 in the frame and the LSB of the ICM20601: axis n of the
+ * ICM20601 is IMU2_SIGN_n times axis IMU2_AXIS_n of the MPU9250, as they
+ * are mounted on the board */
+#define IMU2_AXIS_X       0
+#define IMU2_AXIS_Y       1
+#define IMU2_AXIS_Z       2
+#define IMU2_SIGN_X       1.0f
+#define IMU2_SIGN_Y       1.0f
+#define IMU2_SIGN_Z       1.0f
+#define IMU2_GYRO_SCALE   (MPU9250G_2000dps / IMU_DEG_PER_LSB_CFG)
+#define IMU2_ACCEL_SCALE  (MPU9250A_16g / IMU_G_PER_LSB_CFG)
+
+// The two disagree by more than that only if one fails
+#define IMU_FUSION_GYRO_LIMIT   (20.0f / IMU_DEG_PER_LSB_CFG)   // 20 deg/s
+#define IMU_FUSION_ACCEL_LIMIT  (0.3f / IMU_G_PER_LSB_CFG)      // 0.3 g
+#endif
+
 #define GYRO_VARIANCE_BASE        3000
 #define GYRO_VARIANCE_THRESHOLD_X (GYRO_VARIANCE_BASE)
 #define GYRO_VARIANCE_THRESHOLD_Y (GYRO_VARIANCE_BASE)
 #define GYRO_VARIANCE_THRESHOLD_Z (GYRO_VARIANCE_BASE)
 
+/**
+ * Sliding window of the last IMU_NBR_OF_BIAS_SAMPLES samples with its running
+ * sums: a sample costs one add and one remove, whatever the window length.
+ * The window is allocated from the mymalloc() pool and released once the
+ * bias is found. Without it, consecutive windows are summed instead.
+ */
 typedef struct
 {
   Axis3i16   bias;
   bool       isBiasValueFound;
+  bool       isBiasRestored;  // From the config block, until one is found
   bool       isBufferFilled;
-  Axis3i16*  bufHead;
-  Axis3i16   buffer[IMU_NBR_OF_BIAS_SAMPLES];
+  Axis3i16*  buffer;        // NULL: no window memory
+  uint32_t   bufHead;
+  uint32_t   count;
+  int32_t    sum[GYRO_NBR_OF_AXES];
+  int64_t    sumSq[GYRO_NBR_OF_AXES];
 } BiasObj;
 
 static BiasObj    gyroBias;
@@ -55,6 +111,27 @@ static Axis3i32   accelStoredFilterValues;
 static uint8_t    imuAccLpfAttFactor;
 static bool       isHmc5983lPresent;
 static bool       isMs5611Present;
+static configImuCalib_t storedCalib;
+static bool       isCalibStored;
+
+// Gyro bias against temperature, learnt at rest, see gyro_temp_model.h
+static gyroTempModel_t gyroTempModel;
+static Axis3f     gyroBiasApplied;
+static int16_t    temperatureRaw;
+static float      imuTemperature;
+static float      learnTempSum;
+static uint32_t   modelSampleCount;
+static uint32_t   sampleTimestamp;    // DWT cycles, enabled by spiBusInit()
+static uint32_t   modelSaveTick;
+static uint8_t    modelBins;
+
+#ifdef IMU_DUAL
+// ICM20601 and MPU9250 fused, see imu_fusion.h
+static imuFusion_t imuFusion;
+static bool       isMpu9250Present;
+static Axis3f     gyroFused;    // Raw LSB of the ICM20601, with its fraction
+static uint8_t    imuUnitsInUse;
+#endif
 
 //Pre-calculated values for accelerometer alignment
 static float cosPitch;
@@ -68,6 +145,14 @@ static bool isInit = false;
  * it will cause the test to fail.
  */
 static void imuBiasInit(BiasObj* bias);
+static void imuBiasReset(BiasObj* bias);
+static void imuBiasRelease(BiasObj* bias);
+static bool imuBiasIsPending(BiasObj* bias);
+static void imuBiasRestore(void);
+static void imuBiasStore(void);
+static void imuGyroTempLearn(float temperature, const Axis3f* bias);
+static void imuGyroTempLearnAtRest(void);
+static void imuGyroBiasApply(void);
 static void imuCalculateBiasMean(BiasObj* bias, Axis3i32* meanOut);
 static void imuCalculateVarianceAndMean(BiasObj* bias, Axis3f* varOut, Axis3f* meanOut);
 static bool imuFindBiasValue(BiasObj* bias);
@@ -75,6 +160,77 @@ static void imuAddBiasValue(BiasObj* bias, Axis3i16* dVal);
 static void imuAccIIRLPFilter(Axis3i16* in, Axis3i16* out,
                               Axis3i32* storedValues, int32_t attenuation);
 static void imuAccAlignToGravity(Axis3i16* in, Axis3i16* out);
+#ifdef IMU_DUAL
+static void imuDualRead(bool isIcmRead);
+#endif
+
+/* Bring-up steps of the sensors for initseq.h, presence test first */
+static int32_t imuGyroAccInitStep(uint32_t step)
+{
+  if (step == 0)
+  {
+    //Use the SPI Bus to connect the ICM20601
+    if (ICM20601_TestConnection() == SUCCESS)
+    {
+      LedseqRun(LEDR,seq_linkup);
+    }
+    else
+    {
+      LedseqRun(LEDL,seq_linkup);
+    }
+  }
+  return ICM20601_InitStep(step);
+}
+
+#ifdef IMU_ENABLE_MAG_HMC5983
+static int32_t imuMagInitStep(uint32_t step)
+{
+  if (step == 0)
+  {
+    if (HMC5983_TestConnection() == true)
+    {
+      isHmc5983lPresent = true;
+      LedseqRun(LEDR,seq_linkup);
+    }
+    else
+    {
+      LedseqRun(LEDL, seq_linkup);
+    }
+  }
+  return HMC5983_InitStep(step);
+}
+#endif
+
+#ifdef IMU_DUAL
+static int32_t imuGyroAcc2InitStep(uint32_t step)
+{
+  if (step == 0)
+  {
+    isMpu9250Present = MPU9250_TestConnection();
+    if (isMpu9250Present)
+    {
+      LedseqRun(LEDR, seq_linkup);
+    }
+    else
+    {
+      LedseqRun(LEDL, seq_linkup);
+      return INIT_SEQ_DONE;
+    }
+  }
+  return MPU9250_InitStep(step);
+}
+#endif
+
+static initSeqDevice_t imuSensors[] =
+{
+  { "ICM20601", imuGyroAccInitStep },
+#ifdef IMU_ENABLE_MAG_HMC5983
+  { "HMC5983", imuMagInitStep },
+#endif
+#ifdef IMU_DUAL
+  { "MPU9250", imuGyroAcc2InitStep },
+#endif
+};
 
 void IMU_Init(void)
 {
@@ -84,35 +240,25 @@ void IMU_Init(void)
  isHmc5983lPresent = false;
  isMs5611Present   = false;
 
-  // Wait for sensors to startup,about one second startup
-  while (xTaskGetTickCount() < pdMS_TO_TICKS(IMU_STARTUP_TIME_MS));
   //hardware Inintial the io port
-  SPI1_Init(); 
-  printf("Sensors SPI Init Finish\n");
-  
-  //Use the SPI Bus to connect the ICM20601
-  if (ICM20601_TestConnection() == SUCCESS)
-  {		
-    LedseqRun(LEDR,seq_linkup);
-  }
-  else
-  {
-    LedseqRun(LEDL,seq_linkup);
-  }
-  ICM20601_Init();
-  
+  spiBusInit();
+  BPRINTF("Sensors SPI Init Finish\n");
+
+  //The sensors on SPI1 come up together, from their power on
+  imuSensors[0].notBefore = SENSOR_POWER_ON_TICK() + M2T(ICM20601_STARTUP_MS);
 #ifdef IMU_ENABLE_MAG_HMC5983
-  if (HMC5983_TestConnection() == true)
-  {
-    isHmc5983lPresent = true;
-    LedseqRun(LEDR,seq_linkup);
-  }
-  else
+  imuSensors[1].notBefore = imuSensors[0].notBefore;
+#endif
+#ifdef IMU_DUAL
+  imuSensors[sizeof(imuSensors) / sizeof(imuSensors[0]) - 1].notBefore = imuSensors[0].notBefore;
+  imuFusionReset(&imuFusion, IMU_FUSION_GYRO_LIMIT, IMU_FUSION_ACCEL_LIMIT);
+#endif
+  initSeqRun(imuSensors, sizeof(imuSensors) / sizeof(imuSensors[0]));
+#ifdef IMU_ENABLE_MAG_HMC5983
+  if (isHmc5983lPresent)
   {
-    LedseqRun(LEDL, seq_linkup);
+    magSamplerInit();
   }
-  HMC5983_Configure();
-  vTaskDelay(pdMS_TO_TICKS(100));
 #endif
 
 #ifdef IMU_ENABLE_PRESSURE_MS5611
@@ -120,6 +266,7 @@ void IMU_Init(void)
   if (MS5611_SelfTest() == true)
   {
     isMs5611Present = true;
+    MS5611_Start();
     LedseqRun(LEDR,seq_linkup);
   }
   else
@@ -131,6 +278,10 @@ void IMU_Init(void)
 #ifdef IMU_TAKE_ACCEL_BIAS
   imuBiasInit(&accelBias);
 #endif
+  imuTemperature = ICM20601_GetTemperature();
+  imuBiasRestore();
+  imuGyroBiasApply();
+  modelSaveTick = xTaskGetTickCount();
   
   varianceSampleTime = (int32_t)(-GYRO_MIN_BIAS_TIMEOUT_MS + 1);
   imuAccLpfAttFactor = IMU_ACC_IIR_LPF_ATT_FACTOR;
@@ -150,27 +301,65 @@ bool IMU_Test(void)
 
 void imu6Read(Axis3f *gyro,Axis3f *acc)
 {
-  ICM20601GetSixAxisData(&accelMpu.x,&accelMpu.y,&accelMpu.z,&gyroMpu.x,&gyroMpu.y,&gyroMpu.z);
-  imuAddBiasValue(&gyroBias, &gyroMpu);
+  bool isIcmRead;
+
+  sampleTimestamp = DWT->CYCCNT;
+  //A failed read leaves the last sample in accelMpu and gyroMpu
+  isIcmRead = ICM20601GetSixAxisData(&accelMpu.x,&accelMpu.y,&accelMpu.z,
+                                     &gyroMpu.x,&gyroMpu.y,&gyroMpu.z, &temperatureRaw);
+  if (isIcmRead)
+  {
+    imuTemperature += (ICM20601_TEMP_DEGC(temperatureRaw) - imuTemperature) * IMU_TEMP_LPF_ALPHA;
+  }
+#ifdef IMU_DUAL
+  imuDualRead(isIcmRead);
+#endif
+
+  if (imuBiasIsPending(&gyroBias))
+  {
+    imuAddBiasValue(&gyroBias, &gyroMpu);
+  }
+  else
+  {
+    imuGyroTempLearnAtRest();
+  }
 #ifdef IMU_TAKE_ACCEL_BIAS
-  if (!accelBias.isBiasValueFound)
+  if (imuBiasIsPending(&accelBias))
   {
     imuAddBiasValue(&accelBias, &accelMpu);
   }
 #endif
-  if (!gyroBias.isBiasValueFound)
+  if (imuBiasIsPending(&gyroBias))
   {
     //decide the quad whether in the static state
-    imuFindBiasValue(&gyroBias);
-    if (gyroBias.isBiasValueFound)
+    if (imuFindBiasValue(&gyroBias))
     {
+      Axis3f found;
+
+      gyroBias.isBiasRestored = false;
+      imuBiasRelease(&gyroBias);
+      found.x = gyroBias.bias.x;
+      found.y = gyroBias.bias.y;
+      found.z = gyroBias.bias.z;
+#ifdef IMU_DUAL
+      imuFusionAtRest(&imuFusion);
+#endif
+#ifdef IMU_ENABLE_MAG_HMC5983
+      magSamplerAtRest();
+#endif
+      imuGyroTempLearn(imuTemperature, &found);
+      imuGyroBiasApply();
       LedseqRun(LEDR, seq_calibrated);
+#ifndef IMU_TAKE_ACCEL_BIAS
+      imuBiasStore();
+#endif
     }
   }
 
 #ifdef IMU_TAKE_ACCEL_BIAS
-  if (gyroBias.isBiasValueFound &&
-      !accelBias.isBiasValueFound)
+  if (!imuBiasIsPending(&gyroBias) &&
+      imuBiasIsPending(&accelBias) &&
+      accelBias.isBufferFilled)
   {
     Axis3i32 mean;
 
@@ -179,6 +368,9 @@ void imu6Read(Axis3f *gyro,Axis3f *acc)
     accelBias.bias.y = mean.y;
     accelBias.bias.z = mean.z - IMU_1G_RAW;
     accelBias.isBiasValueFound = true;
+    accelBias.isBiasRestored = false;
+    imuBiasRelease(&accelBias);
+    imuBiasStore();
   }
 #endif
 
@@ -187,10 +379,22 @@ void imu6Read(Axis3f *gyro,Axis3f *acc)
 
   imuAccAlignToGravity(&accelLPF, &accelLPFAligned);
 
+  if (++modelSampleCount >= IMU_TEMP_MODEL_UPDATE_SAMPLES)
+  {
+    modelSampleCount = 0;
+    imuGyroBiasApply();
+  }
+
   // Re-map outputs
-  gyro->x = -(gyroMpu.x - gyroBias.bias.x) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
-  gyro->y =  (gyroMpu.y - gyroBias.bias.y) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
-  gyro->z =  (gyroMpu.z - gyroBias.bias.z) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
+#ifdef IMU_DUAL
+  gyro->x = -(gyroFused.x - gyroBiasApplied.x) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
+  gyro->y =  (gyroFused.y - gyroBiasApplied.y) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
+  gyro->z =  (gyroFused.z - gyroBiasApplied.z) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
+#else
+  gyro->x = -(gyroMpu.x - gyroBiasApplied.x) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
+  gyro->y =  (gyroMpu.y - gyroBiasApplied.y) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
+  gyro->z =  (gyroMpu.z - gyroBiasApplied.z) * IMU_DEG_PER_LSB_CFG*M_PI/180.0f;
+#endif
 #ifdef IMU_TAKE_ACCEL_BIAS
   acc->x = (accelLPFAligned.x - accelBias.bias.x) * IMU_G_PER_LSB_CFG;
   acc->y = (accelLPFAligned.y - accelBias.bias.y) * IMU_G_PER_LSB_CFG;
@@ -202,6 +406,12 @@ void imu6Read(Axis3f *gyro,Axis3f *acc)
 #endif
 }
 
+/* When the last imu6Read() started its burst, the estimator's dt */
+uint32_t imu6Timestamp(void)
+{
+  return sampleTimestamp;
+}
+
 bool imu6IsCalibrated(void)
 {
   bool status;
@@ -214,19 +424,29 @@ bool imu6IsCalibrated(void)
   return status;
 }
 
-void imu9Read(Axis3f *gyro,Axis3f *acc,Axis3f *mag)
+/* The magnetometer is the last sample of its task, calibrated, in gauss */
+void imu9Read(Axis3f *gyro,Axis3f *acc,Axis3f *mag,uint32_t *magTimestamp)
 {
-  float magDateTemp[3];
   imu6Read(gyro,acc);
   if(isHmc5983lPresent){
-    HMC5983_GetFloatData( magDateTemp );
-    mag->x = magDateTemp[0];
-    mag->y = magDateTemp[1];
-    mag->z = magDateTemp[2];
+    Axis3f chip;
+    float m[3];
+
+    magSamplerRead(&chip, magTimestamp);
+    m[0] = chip.x;
+    m[1] = chip.y;
+    m[2] = chip.z;
+    mag->x = MAG_SIGN_X * m[MAG_AXIS_X];
+    mag->y = MAG_SIGN_Y * m[MAG_AXIS_Y];
+    mag->z = MAG_SIGN_Z * m[MAG_AXIS_Z];
+    if(!magSamplerIsCalibrated()){
+      *magTimestamp = 0;
+    }
   }else{
     mag->x = 0;
     mag->y = 0;
     mag->z = 0;
+    *magTimestamp = 0;
   }
 }
 
@@ -241,60 +461,242 @@ bool imuHasMangnetometer(void)
 }
 
 static void imuBiasInit(BiasObj* bias)
+{
+  if (bias->buffer == NULL)
+  {
+    bias->buffer = mymalloc(SRAMIN, IMU_NBR_OF_BIAS_SAMPLES * sizeof(Axis3i16));
+  }
+  imuBiasReset(bias);
+}
+
+/**
+ * Empties the window, or starts the next one when there is no window memory.
+ */
+static void imuBiasReset(BiasObj* bias)
 {
   bias->isBufferFilled = false;
-  bias->bufHead = bias->buffer;
+  bias->bufHead = 0;
+  bias->count = 0;
+  memset(bias->sum, 0, sizeof(bias->sum));
+  memset(bias->sumSq, 0, sizeof(bias->sumSq));
 }
 
 /**
- * Calculates the variance and mean for the bias buffer.
+ * Gives the window back to the pool, the bias is kept.
  */
-static void imuCalculateVarianceAndMean(BiasObj* bias, Axis3f* varOut, Axis3f* meanOut)
+static void imuBiasRelease(BiasObj* bias)
 {
-  uint32_t i;
-  int64_t sum[GYRO_NBR_OF_AXES] = {0};
-  int64_t sumSq[GYRO_NBR_OF_AXES] = {0};
+  myfree(SRAMIN, bias->buffer);
+  bias->buffer = NULL;
+}
+
+/**
+ * True until a bias is found at rest, the restored one is refined.
+ */
+static bool imuBiasIsPending(BiasObj* bias)
+{
+  return !bias->isBiasValueFound || bias->isBiasRestored;
+}
 
-  for (i = 0; i < IMU_NBR_OF_BIAS_SAMPLES; i++)
+/**
+ * Starts from the stored bias: the copter is ready without waiting for a
+ * stationary window. The gyro one comes from the temperature model when it
+ * knows the current temperature, else it must have been found near it. The
+ * estimator still runs and replaces it at the first one.
+ */
+static void imuBiasRestore(void)
+{
+  float modelBias[3];
+  bool hasModelBias;
+
+  if (!configblockGetGyroTempModel(&gyroTempModel))
   {
-    sum[0] += bias->buffer[i].x;
-    sum[1] += bias->buffer[i].y;
-    sum[2] += bias->buffer[i].z;
-    sumSq[0] += bias->buffer[i].x * bias->buffer[i].x;
-    sumSq[1] += bias->buffer[i].y * bias->buffer[i].y;
-    sumSq[2] += bias->buffer[i].z * bias->buffer[i].z;
+    gyroTempModelReset(&gyroTempModel);
   }
+  modelBins = (uint8_t)gyroTempModelBins(&gyroTempModel);
+  hasModelBias = gyroTempModelGet(&gyroTempModel, imuTemperature, modelBias);
 
-  varOut->x = (sumSq[0] - ((int64_t)sum[0] * sum[0]) / IMU_NBR_OF_BIAS_SAMPLES);
-  varOut->y = (sumSq[1] - ((int64_t)sum[1] * sum[1]) / IMU_NBR_OF_BIAS_SAMPLES);
-  varOut->z = (sumSq[2] - ((int64_t)sum[2] * sum[2]) / IMU_NBR_OF_BIAS_SAMPLES);
+  if (!configblockGetImuCalib(&storedCalib))
+  {
+    return;
+  }
 
-  meanOut->x = (float)sum[0] / IMU_NBR_OF_BIAS_SAMPLES;
-  meanOut->y = (float)sum[1] / IMU_NBR_OF_BIAS_SAMPLES;
-  meanOut->z = (float)sum[2] / IMU_NBR_OF_BIAS_SAMPLES;
+  if (!hasModelBias &&
+      fabsf(imuTemperature - storedCalib.temperature) > IMU_BIAS_TEMP_TOLERANCE)
+  {
+    BPRINTF("IMU bias of %d C not used at %d C\n", (int)storedCalib.temperature,
+            (int)imuTemperature);
+    return;
+  }
 
-  isInit = true;
+  if (hasModelBias)
+  {
+    gyroBias.bias.x = (int16_t)lroundf(modelBias[0]);
+    gyroBias.bias.y = (int16_t)lroundf(modelBias[1]);
+    gyroBias.bias.z = (int16_t)lroundf(modelBias[2]);
+  }
+  else
+  {
+    gyroBias.bias.x = storedCalib.gyroBias[0];
+    gyroBias.bias.y = storedCalib.gyroBias[1];
+    gyroBias.bias.z = storedCalib.gyroBias[2];
+  }
+  gyroBias.isBiasValueFound = true;
+  gyroBias.isBiasRestored = true;
+#ifdef IMU_TAKE_ACCEL_BIAS
+  accelBias.bias.x = storedCalib.accelBias[0];
+  accelBias.bias.y = storedCalib.accelBias[1];
+  accelBias.bias.z = storedCalib.accelBias[2];
+  accelBias.isBiasValueFound = true;
+  accelBias.isBiasRestored = true;
+#endif
+  isCalibStored = true;
+  LedseqRun(LEDR, seq_calibrated);
+}
+
+static bool imuBiasDiffers(const int16_t* stored, const Axis3i16* bias, int16_t minDiff)
+{
+  return abs(stored[0] - bias->x) >= minDiff ||
+         abs(stored[1] - bias->y) >= minDiff ||
+         abs(stored[2] - bias->z) >= minDiff;
 }
 
 /**
- * Calculates the mean for the bias buffer.__attribute__((used))
+ * Writes the bias just found at rest when the stored one is missing, of
+ * another temperature or different. Called at rest: the flash write stalls.
  */
-static void imuCalculateBiasMean(BiasObj* bias, Axis3i32* meanOut)
+static void imuBiasStore(void)
 {
-  uint32_t i;
-  int32_t sum[GYRO_NBR_OF_AXES] = {0};
+  float temperature = ICM20601_GetTemperature();
+
+  if (isCalibStored &&
+      fabsf(temperature - storedCalib.temperature) <= IMU_BIAS_TEMP_TOLERANCE &&
+      !imuBiasDiffers(storedCalib.gyroBias, &gyroBias.bias, IMU_GYRO_BIAS_STORE_MIN_DIFF) &&
+      !imuBiasDiffers(storedCalib.accelBias, &accelBias.bias, IMU_ACCEL_BIAS_STORE_MIN_DIFF))
+  {
+    return;
+  }
+
+  storedCalib.gyroBias[0] = gyroBias.bias.x;
+  storedCalib.gyroBias[1] = gyroBias.bias.y;
+  storedCalib.gyroBias[2] = gyroBias.bias.z;
+  storedCalib.accelBias[0] = accelBias.bias.x;
+  storedCalib.accelBias[1] = accelBias.bias.y;
+  storedCalib.accelBias[2] = accelBias.bias.z;
+  storedCalib.temperature = temperature;
+  isCalibStored = configblockSetImuCalib(&storedCalib);
+}
+
+/**
+ * Adds the mean of a stationary window to the temperature model. Saves it
+ * when it got a new bin, or after IMU_TEMP_MODEL_SAVE_PERIOD_MS of learning:
+ * called at rest, the flash write stalls.
+ */
+static void imuGyroTempLearn(float temperature, const Axis3f* bias)
+{
+  float values[3] = { bias->x, bias->y, bias->z };
+  uint32_t tick = xTaskGetTickCount();
+  bool isNewBin;
+
+  isNewBin = gyroTempModelUpdate(&gyroTempModel, temperature, values);
+  modelBins = (uint8_t)gyroTempModelBins(&gyroTempModel);
+
+  if (isNewBin || tick - modelSaveTick >= M2T(IMU_TEMP_MODEL_SAVE_PERIOD_MS))
+  {
+    configblockSetGyroTempModel(&gyroTempModel);
+    modelSaveTick = tick;
+  }
+}
+
+/**
+ * Once the bias is found, the gyro samples keep going through consecutive
+ * windows, without window memory. A window quiet enough for the bias
+ * estimator, only possible with the motors off, teaches the model the bias
+ * at its mean temperature.
+ */
+static void imuGyroTempLearnAtRest(void)
+{
+  Axis3f variance;
+  Axis3f mean;
+
+  imuAddBiasValue(&gyroBias, &gyroMpu);
+  learnTempSum = (gyroBias.count == 1 ? 0.0f : learnTempSum) + imuTemperature;
+
+  if (!gyroBias.isBufferFilled)
+  {
+    return;
+  }
+
+  imuCalculateVarianceAndMean(&gyroBias, &variance, &mean);
+  if (variance.x < GYRO_VARIANCE_THRESHOLD_X &&
+      variance.y < GYRO_VARIANCE_THRESHOLD_Y &&
+      variance.z < GYRO_VARIANCE_THRESHOLD_Z)
+  {
+#ifdef IMU_DUAL
+    imuFusionAtRest(&imuFusion);
+#endif
+#ifdef IMU_ENABLE_MAG_HMC5983
+    magSamplerAtRest();
+#endif
+    imuGyroTempLearn(learnTempSum / IMU_NBR_OF_BIAS_SAMPLES, &mean);
+  }
+}
+
+/**
+ * The gyro bias of the current temperature, from the model when it knows
+ * it, else the one found or restored.
+ */
+static void imuGyroBiasApply(void)
+{
+  float modelBias[3];
 
-  for (i = 0; i < IMU_NBR_OF_BIAS_SAMPLES; i++)
+  if (gyroBias.isBiasValueFound &&
+      gyroTempModelGet(&gyroTempModel, imuTemperature, modelBias))
   {
-    sum[0] += bias->buffer[i].x;
-    sum[1] += bias->buffer[i].y;
-    sum[2] += bias->buffer[i].z;
+    gyroBiasApplied.x = modelBias[0];
+    gyroBiasApplied.y = modelBias[1];
+    gyroBiasApplied.z = modelBias[2];
   }
+  else
+  {
+    gyroBiasApplied.x = gyroBias.bias.x;
+    gyroBiasApplied.y = gyroBias.bias.y;
+    gyroBiasApplied.z = gyroBias.bias.z;
+  }
+}
+
+/**
+ * Calculates the variance and mean for the bias buffer, from the running sums.
+ */
+static void imuCalculateVarianceAndMean(BiasObj* bias, Axis3f* varOut, Axis3f* meanOut)
+{
+  varOut->x = (bias->sumSq[0] - ((int64_t)bias->sum[0] * bias->sum[0]) / IMU_NBR_OF_BIAS_SAMPLES);
+  varOut->y = (bias->sumSq[1] - ((int64_t)bias->sum[1] * bias->sum[1]) / IMU_NBR_OF_BIAS_SAMPLES);
+  varOut->z = (bias->sumSq[2] - ((int64_t)bias->sum[2] * bias->sum[2]) / IMU_NBR_OF_BIAS_SAMPLES);
+
+  meanOut->x = (float)bias->sum[0] / IMU_NBR_OF_BIAS_SAMPLES;
+  meanOut->y = (float)bias->sum[1] / IMU_NBR_OF_BIAS_SAMPLES;
+  meanOut->z = (float)bias->sum[2] / IMU_NBR_OF_BIAS_SAMPLES;
+}
 
-  meanOut->x = sum[0] / IMU_NBR_OF_BIAS_SAMPLES;
-  meanOut->y = sum[1] / IMU_NBR_OF_BIAS_SAMPLES;
-  meanOut->z = sum[2] / IMU_NBR_OF_BIAS_SAMPLES;
+/**
+ * Calculates the mean for the bias buffer.
+ */
+static void imuCalculateBiasMean(BiasObj* bias, Axis3i32* meanOut)
+{
+  meanOut->x = bias->sum[0] / IMU_NBR_OF_BIAS_SAMPLES;
+  meanOut->y = bias->sum[1] / IMU_NBR_OF_BIAS_SAMPLES;
+  meanOut->z = bias->sum[2] / IMU_NBR_OF_BIAS_SAMPLES;
+}
 
+static void imuBiasSumsUpdate(BiasObj* bias, const Axis3i16* val, int32_t sign)
+{
+  bias->sum[0] += sign * val->x;
+  bias->sum[1] += sign * val->y;
+  bias->sum[2] += sign * val->z;
+  bias->sumSq[0] += sign * ((int32_t)val->x * val->x);
+  bias->sumSq[1] += sign * ((int32_t)val->y * val->y);
+  bias->sumSq[2] += sign * ((int32_t)val->z * val->z);
 }
 
 /**
@@ -303,16 +705,43 @@ static void imuCalculateBiasMean(BiasObj* bias, Axis3i32* meanOut)
  */
 static void imuAddBiasValue(BiasObj* bias, Axis3i16* dVal)
 {
-  bias->bufHead->x = dVal->x;
-  bias->bufHead->y = dVal->y;
-  bias->bufHead->z = dVal->z;
-  bias->bufHead++;
+  // No window: the previous full one was checked, start the next. The window
+  // memory is only tried again here, with the sums empty: a sample summed
+  // without a slot would never be removed from them. Not once the bias is
+  // found, the learning at rest goes on without window memory
+  if (bias->buffer == NULL && bias->isBufferFilled)
+  {
+    imuBiasReset(bias);
+    if (imuBiasIsPending(bias))
+    {
+      bias->buffer = mymalloc(SRAMIN, IMU_NBR_OF_BIAS_SAMPLES * sizeof(Axis3i16));
+    }
+  }
 
-  if (bias->bufHead >= &bias->buffer[IMU_NBR_OF_BIAS_SAMPLES])
+  if (bias->buffer != NULL)
+  {
+    Axis3i16* slot = &bias->buffer[bias->bufHead];
+
+    if (bias->isBufferFilled)
+    {
+      imuBiasSumsUpdate(bias, slot, -1);
+    }
+    *slot = *dVal;
+    if (++bias->bufHead >= IMU_NBR_OF_BIAS_SAMPLES)
+    {
+      bias->bufHead = 0;
+      bias->isBufferFilled = true;
+    }
+  }
+  else
   {
-    bias->bufHead = bias->buffer;
-    bias->isBufferFilled = true;
+    if (++bias->count >= IMU_NBR_OF_BIAS_SAMPLES)
+    {
+      bias->isBufferFilled = true;
+    }
   }
+
+  imuBiasSumsUpdate(bias, dVal, 1);
 }
 
 /**
@@ -348,6 +777,63 @@ static bool imuFindBiasValue(BiasObj* bias)
   return foundBias;
 }
 
+#ifdef IMU_DUAL
+static int16_t imuClampI16(float value)
+{
+  if (value > INT16_MAX)
+    return INT16_MAX;
+  if (value < INT16_MIN)
+    return INT16_MIN;
+  return (int16_t)lroundf(value);
+}
+
+/**
+ * Reads the MPU9250 and fuses it with the ICM20601 sample just read. All
+ * that follows works on the fused sample, in the LSB and with the bias of
+ * the ICM20601: the bias estimation and the temperature model go on with
+ * the unit left when one is excluded. The gyro output keeps the fraction of
+ * LSB, the noise is below one LSB. A unit whose read failed is not fused.
+ */
+static void imuDualRead(bool isIcmRead)
+{
+  static const uint8_t axis[3] = { IMU2_AXIS_X, IMU2_AXIS_Y, IMU2_AXIS_Z };
+  static const float sign[3] = { IMU2_SIGN_X, IMU2_SIGN_Y, IMU2_SIGN_Z };
+  float x[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS];
+  float out[IMU_FUSION_CHANNELS];
+  bool isRead[IMU_FUSION_UNITS];
+  int16_t acc2[3] = {0};
+  int16_t gyro2[3] = {0};
+  uint32_t i;
+
+  isRead[0] = isIcmRead;
+  isRead[1] = isMpu9250Present && MPU9250_GetSixAxisData(acc2, gyro2);
+
+  x[0][IMU_FUSION_GYRO + 0] = gyroMpu.x;
+  x[0][IMU_FUSION_GYRO + 1] = gyroMpu.y;
+  x[0][IMU_FUSION_GYRO + 2] = gyroMpu.z;
+  x[0][IMU_FUSION_ACC + 0] = accelMpu.x;
+  x[0][IMU_FUSION_ACC + 1] = accelMpu.y;
+  x[0][IMU_FUSION_ACC + 2] = accelMpu.z;
+  for (i=0; i<3; i++)
+  {
+    x[1][IMU_FUSION_GYRO + i] = sign[i] * gyro2[axis[i]] * IMU2_GYRO_SCALE;
+    x[1][IMU_FUSION_ACC + i] = sign[i] * acc2[axis[i]] * IMU2_ACCEL_SCALE;
+  }
+
+  imuUnitsInUse = imuFusionUpdate(&imuFusion, (const float (*)[IMU_FUSION_CHANNELS])x, isRead, out);
+
+  gyroFused.x = out[IMU_FUSION_GYRO + 0];
+  gyroFused.y = out[IMU_FUSION_GYRO + 1];
+  gyroFused.z = out[IMU_FUSION_GYRO + 2];
+  gyroMpu.x = imuClampI16(gyroFused.x);
+  gyroMpu.y = imuClampI16(gyroFused.y);
+  gyroMpu.z = imuClampI16(gyroFused.z);
+  accelMpu.x = imuClampI16(out[IMU_FUSION_ACC + 0]);
+  accelMpu.y = imuClampI16(out[IMU_FUSION_ACC + 1]);
+  accelMpu.z = imuClampI16(out[IMU_FUSION_ACC + 2]);
+}
+#endif
+
 static void imuAccIIRLPFilter(Axis3i16* in, Axis3i16* out, Axis3i32* storedValues, int32_t attenuation)
 {
   out->x = iirLPFilterSingle(in->x, attenuation, &storedValues->x);
@@ -378,4 +864,23 @@ static void imuAccAlignToGravity(Axis3i16* in, Axis3i16* out)
   out->x = ry.x;
   out->y = ry.y;
   out->z = ry.z;
-}
\ No newline at end of file
+}
+
+LOG_GROUP_START(gyroBias)
+LOG_ADD(LOG_FLOAT, x, &gyroBiasApplied.x)
+LOG_ADD(LOG_FLOAT, y, &gyroBiasApplied.y)
+LOG_ADD(LOG_FLOAT, z, &gyroBiasApplied.z)
+LOG_ADD(LOG_FLOAT, temp, &imuTemperature)
+LOG_ADD(LOG_UINT8, bins, &modelBins)
+LOG_GROUP_STOP(gyroBias)
+
+#ifdef IMU_DUAL
+LOG_GROUP_START(imuDual)
+LOG_ADD(LOG_UINT8, inUse, &imuUnitsInUse)
+LOG_ADD(LOG_UINT8, fault0, &imuFusion.fault[0])
+LOG_ADD(LOG_UINT8, fault1, &imuFusion.fault[1])
+LOG_ADD(LOG_UINT16, exclusions, &imuFusion.exclusions)
+LOG_ADD(LOG_FLOAT, gyroVar0, &imuFusion.noise0[IMU_FUSION_GYRO])
+LOG_ADD(LOG_FLOAT, gyroDiffVar, &imuFusion.diffVar[IMU_FUSION_GYRO])
+LOG_GROUP_STOP(imuDual)
+#endif
@@ -0,0 +1,86 @@
+/**
+ * gyro_temp_model.c - Gyro bias against the sensor temperature
+ */
+#include <string.h>
+#include <math.h>
+
+#include "gyro_temp_model.h"
+
+void gyroTempModelReset(gyroTempModel_t * model)
+{
+  memset(model, 0, sizeof(*model));
+}
+
+bool gyroTempModelUpdate(gyroTempModel_t * model, float temperature, const float bias[3])
+{
+  float position = (temperature - GYRO_TEMP_MIN) / GYRO_TEMP_BIN_WIDTH;
+  uint32_t bin;
+  float weight;
+  uint32_t i;
+
+  if (!(position >= 0.0f && position < GYRO_TEMP_BINS))
+    return false;
+
+  bin = (uint32_t)position;
+  if (model->count[bin] < GYRO_TEMP_MAX_WEIGHT)
+    model->count[bin]++;
+
+  //Running mean, then a moving average of GYRO_TEMP_MAX_WEIGHT windows
+  weight = 1.0f / model->count[bin];
+  model->temperature[bin] += (temperature - model->temperature[bin]) * weight;
+  for (i=0; i<3; i++)
+    model->bias[bin][i] += (bias[i] - model->bias[bin][i]) * weight;
+
+  return model->count[bin] == 1;
+}
+
+bool gyroTempModelGet(const gyroTempModel_t * model, float temperature, float bias[3])
+{
+  int32_t below = -1;
+  int32_t above = -1;
+  float span;
+  float t;
+  uint32_t i;
+
+  //The learnt bins nearest below and above, their temperatures are ordered
+  for (i=0; i<GYRO_TEMP_BINS; i++)
+  {
+    if (model->count[i] == 0)
+      continue;
+    if (model->temperature[i] <= temperature)
+      below = i;
+    else if (above < 0)
+      above = i;
+  }
+
+  if (below >= 0 && above >= 0)
+  {
+    span = model->temperature[above] - model->temperature[below];
+    t = (temperature - model->temperature[below]) / span;
+    for (i=0; i<3; i++)
+      bias[i] = model->bias[below][i] + (model->bias[above][i] - model->bias[below][i]) * t;
+    return true;
+  }
+
+  if (below < 0)
+    below = above;
+  if (below < 0 ||
+      fabsf(temperature - model->temperature[below]) > GYRO_TEMP_MAX_EXTRAPOLATION)
+    return false;
+
+  for (i=0; i<3; i++)
+    bias[i] = model->bias[below][i];
+  return true;
+}
+
+uint32_t gyroTempModelBins(const gyroTempModel_t * model)
+{
+  uint32_t bins = 0;
+  uint32_t i;
+
+  for (i=0; i<GYRO_TEMP_BINS; i++)
+    if (model->count[i])
+      bins++;
+
+  return bins;
+}
@@ -0,0 +1,265 @@
+/**
+ * imu_fusion.c - Two IMUs fused into one gyro and accel stream
+ */
+#include <string.h>
+#include <math.h>
+
+#include "imu_fusion.h"
+
+void imuFusionReset(imuFusion_t * fusion, float gyroLimit, float accLimit)
+{
+  uint32_t i;
+
+  memset(fusion, 0, sizeof(*fusion));
+  for (i=0; i<3; i++)
+  {
+    fusion->limit[IMU_FUSION_GYRO + i] = gyroLimit;
+    fusion->limit[IMU_FUSION_ACC + i] = accLimit;
+  }
+}
+
+void imuFusionSetNoise(imuFusion_t * fusion, uint32_t first, const float variance[3])
+{
+  uint32_t i;
+
+  for (i=0; i<3 && first + i < IMU_FUSION_CHANNELS; i++)
+    fusion->noise0[first + i] = variance[i];
+}
+
+void imuFusionAtRest(imuFusion_t * fusion)
+{
+  uint32_t i;
+
+  if (fusion->fault[0] != 0 || !fusion->hasLast[0])
+    return;
+
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+    fusion->noise0[i] = fusion->var0[i];
+}
+
+/* n0 / (n0 + n1) */
+static float imuFusionGain(const imuFusion_t * fusion, uint32_t i)
+{
+  float n0 = fusion->noise0[i] > 0.0f ? fusion->noise0[i] : fusion->diffVar[i] * 0.5f;
+  float n1 = fusion->diffVar[i] - n0;
+
+  if (n1 < n0 * IMU_FUSION_MIN_NOISE_RATIO)
+    n1 = n0 * IMU_FUSION_MIN_NOISE_RATIO;
+  if (n0 + n1 <= 0.0f)
+    return 0.5f;
+
+  return n0 / (n0 + n1);
+}
+
+static void imuFusionExclude(imuFusion_t * fusion, uint32_t unit, uint8_t reason)
+{
+  if (fusion->fault[unit] == 0)
+    fusion->exclusions++;
+  fusion->fault[unit] |= reason;
+  fusion->recoverCount[unit] = 0;
+}
+
+/* Read, not stuck. Updates the first difference energy */
+static bool imuFusionCheckUnit(imuFusion_t * fusion, uint32_t unit, const float x[IMU_FUSION_CHANNELS])
+{
+  bool isSame = true;
+  float d;
+  uint32_t i;
+
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+  {
+    d = x[i] - fusion->last[unit][i];
+    if (d != 0.0f)
+      isSame = false;
+    if (fusion->hasLast[unit])
+      fusion->rough[unit][i] += (d * d - fusion->rough[unit][i]) * (1.0f / IMU_FUSION_ROUGH_TC);
+    fusion->last[unit][i] = x[i];
+  }
+
+  if (isSame && fusion->hasLast[unit])
+  {
+    if (fusion->stuckCount[unit] < IMU_FUSION_STUCK_SAMPLES)
+      fusion->stuckCount[unit]++;
+  }
+  else
+  {
+    fusion->stuckCount[unit] = 0;
+  }
+  fusion->hasLast[unit] = 1;
+
+  if (fusion->stuckCount[unit] >= IMU_FUSION_STUCK_SAMPLES)
+  {
+    imuFusionExclude(fusion, unit, IMU_FUSION_FAULT_STUCK);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * The unit to exclude on a disagreement, on the channel of the largest one:
+ * the one whose first difference energy went over its noise much more than
+ * the other. The motion adds the same to both. Unit 1 when neither did.
+ */
+static uint32_t imuFusionCulprit(const imuFusion_t * fusion, uint32_t channel)
+{
+  float n0 = fusion->noise0[channel] > 0.0f ? fusion->noise0[channel] : fusion->diffVar[channel] * 0.5f;
+  float n1 = fusion->diffVar[channel] - n0;
+  float excess0 = fusion->rough[0][channel] - 2.0f * n0;
+  float excess1 = fusion->rough[1][channel] - 2.0f * (n1 > 0.0f ? n1 : 0.0f);
+  float margin = 2.0f * fusion->diffVar[channel];
+
+  if (excess0 > IMU_FUSION_ROUGH_RATIO * (excess1 > 0.0f ? excess1 : 0.0f) + margin)
+    return 0;
+
+  return 1;
+}
+
+uint8_t imuFusionUpdate(imuFusion_t * fusion, const float x[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS],
+                        const bool isRead[IMU_FUSION_UNITS], float out[IMU_FUSION_CHANNELS])
+{
+  bool isValid[IMU_FUSION_UNITS];
+  bool isFirst0 = !fusion->hasLast[0];
+  bool isCompared;
+  bool isOver = false;
+  bool isAgreed = true;
+  float r[IMU_FUSION_CHANNELS];
+  float worst = 0.0f;
+  uint32_t worstChannel = 0;
+  float a;
+  float e;
+  float w;
+  uint8_t inUse = 0;
+  uint32_t u, i;
+
+  for (u=0; u<IMU_FUSION_UNITS; u++)
+  {
+    isValid[u] = isRead[u] && imuFusionCheckUnit(fusion, u, x[u]);
+    if (!isRead[u])
+      imuFusionExclude(fusion, u, IMU_FUSION_FAULT_READ);
+  }
+
+  if (isValid[0])
+  {
+    for (i=0; i<IMU_FUSION_CHANNELS; i++)
+    {
+      if (isFirst0)
+        fusion->mean0[i] = x[0][i];
+      e = x[0][i] - fusion->mean0[i];
+      fusion->mean0[i] += e * (1.0f / IMU_FUSION_QUIET_TC);
+      fusion->var0[i] += (e * e - fusion->var0[i]) * (1.0f / IMU_FUSION_QUIET_TC);
+    }
+  }
+
+  //The residual of unit 1 against unit 0, once there is an offset
+  isCompared = isValid[0] && isValid[1] && fusion->offsetSamples > 0;
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+  {
+    r[i] = x[1][i] - fusion->offset[i] - x[0][i];
+    if (!isCompared)
+      continue;
+    e = fabsf(r[i]) / fusion->limit[i];
+    if (e > 1.0f)
+      isOver = true;
+    if (e > 0.5f)
+      isAgreed = false;
+    if (e > worst)
+    {
+      worst = e;
+      worstChannel = i;
+    }
+  }
+
+  if (isOver)
+  {
+    if (fusion->disagreeCount < IMU_FUSION_DISAGREE_SAMPLES)
+      fusion->disagreeCount++;
+    if (fusion->disagreeCount >= IMU_FUSION_DISAGREE_SAMPLES &&
+        fusion->fault[0] == 0 && fusion->fault[1] == 0)
+      imuFusionExclude(fusion, imuFusionCulprit(fusion, worstChannel), IMU_FUSION_FAULT_DISAGREE);
+  }
+  else
+  {
+    fusion->disagreeCount = 0;
+  }
+
+  //Offset and n0 + n1 from both healthy units only: a failure is not learnt.
+  //Running mean of the first IMU_FUSION_OFFSET_TC samples, moving mean after
+  if (isValid[0] && isValid[1] && !isOver && fusion->fault[0] == 0 && fusion->fault[1] == 0)
+  {
+    if (fusion->offsetSamples == 0)
+    {
+      for (i=0; i<IMU_FUSION_CHANNELS; i++)
+        fusion->offset[i] = x[1][i] - x[0][i];
+      fusion->offsetSamples = 1;
+    }
+    else
+    {
+      if (fusion->offsetSamples < IMU_FUSION_OFFSET_TC)
+        fusion->offsetSamples++;
+      a = 1.0f / fusion->offsetSamples;
+      for (i=0; i<IMU_FUSION_CHANNELS; i++)
+      {
+        fusion->offset[i] += r[i] * a;
+        fusion->diffVar[i] += (r[i] * r[i] - fusion->diffVar[i]) * a;
+      }
+    }
+  }
+
+  //An excluded unit is used again after agreeing long enough, or as soon
+  //as it is valid when the other one is excluded too
+  for (u=0; u<IMU_FUSION_UNITS; u++)
+  {
+    if (fusion->fault[u] == 0)
+      continue;
+    if (isValid[u] && ((isCompared && isAgreed) || fusion->fault[1 - u] != 0))
+    {
+      if (++fusion->recoverCount[u] >= IMU_FUSION_RECOVER_SAMPLES)
+      {
+        fusion->fault[u] = 0;
+        fusion->recoverCount[u] = 0;
+        fusion->disagreeCount = 0;
+      }
+    }
+    else
+    {
+      fusion->recoverCount[u] = 0;
+    }
+  }
+
+  if (fusion->fault[0] == 0)
+    inUse |= 0x01;
+  if (fusion->fault[1] == 0 && fusion->offsetSamples >= IMU_FUSION_OFFSET_SAMPLES)
+    inUse |= 0x02;
+
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+  {
+    if (inUse == 0x03)
+    {
+      w = imuFusionGain(fusion, i);
+      out[i] = x[0][i] + w * r[i];
+    }
+    else if (inUse == 0x02 || (inUse == 0 && fusion->fault[1] == 0 && fusion->offsetSamples > 0))
+    {
+      //Alone, or still learning its offset but better than a failed unit 0
+      out[i] = x[1][i] - fusion->offset[i];
+    }
+    else
+    {
+      out[i] = x[0][i];
+    }
+  }
+
+  return inUse;
+}
+
+float imuFusionWeight(const imuFusion_t * fusion, uint32_t channel)
+{
+  if (channel >= IMU_FUSION_CHANNELS || fusion->fault[1] != 0 || fusion->offsetSamples == 0)
+    return 0.0f;
+  if (fusion->fault[0] != 0)
+    return 1.0f;
+  if (fusion->offsetSamples < IMU_FUSION_OFFSET_SAMPLES)
+    return 0.0f;
+
+  return imuFusionGain(fusion, channel);
+}
@@ -0,0 +1,470 @@
+/**
+ * mag_calib.c - Hard and soft iron calibration of the magnetometer
+ *
+ * The sums are in float, a sample costs MAG_CALIB_NORMAL_SIZE multiply-adds.
+ * They are taken around a center, moved to the mean of the samples at each
+ * solve. The solve, 9 unknowns then a 3x3 eigen decomposition, is in
+ * double: the terms of the quadric span orders of magnitude.
+ */
+#include <string.h>
+#include <math.h>
+
+#include "mag_calib.h"
+
+#define MAG_CALIB_MIN_PIVOT     1e-10   // Of its diagonal term, else the samples are degenerate
+#define MAG_CALIB_EIGEN_SWEEPS  16
+
+void magCalibReset(magCalib_t * calib)
+{
+  memset(calib, 0, sizeof(*calib));
+}
+
+void magCalibRestore(magCalib_t * calib, const magCalibResult_t * result)
+{
+  calib->result = *result;
+}
+
+/* Index of (i, j) in the upper triangle stored by rows */
+static uint32_t magCalibIndex(uint32_t i, uint32_t j)
+{
+  uint32_t k;
+
+  if (i > j)
+  {
+    k = i;
+    i = j;
+    j = k;
+  }
+  return i * MAG_CALIB_TERMS - (i * (i - 1)) / 2 + j - i;
+}
+
+/* Solves the normal equations by Cholesky, the factor packed by rows */
+static bool magCalibSolveNormal(const magCalib_t * calib, double a[MAG_CALIB_TERMS])
+{
+  double l[MAG_CALIB_NORMAL_SIZE];
+  double y[MAG_CALIB_TERMS];
+  double s;
+  uint32_t i, j, k;
+
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+  {
+    for (j=0; j<=i; j++)
+    {
+      s = calib->normal[magCalibIndex(i, j)];
+      for (k=0; k<j; k++)
+        s -= l[i * (i + 1) / 2 + k] * l[j * (j + 1) / 2 + k];
+      if (j < i)
+      {
+        l[i * (i + 1) / 2 + j] = s / l[j * (j + 1) / 2 + j];
+      }
+      else
+      {
+        if (s <= calib->normal[magCalibIndex(i, i)] * MAG_CALIB_MIN_PIVOT)
+          return false;
+        l[i * (i + 1) / 2 + i] = sqrt(s);
+      }
+    }
+  }
+
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+  {
+    s = calib->sum[i];
+    for (k=0; k<i; k++)
+      s -= l[i * (i + 1) / 2 + k] * y[k];
+    y[i] = s / l[i * (i + 1) / 2 + i];
+  }
+  for (i=MAG_CALIB_TERMS; i-- > 0; )
+  {
+    s = y[i];
+    for (k=i+1; k<MAG_CALIB_TERMS; k++)
+      s -= l[k * (k + 1) / 2 + i] * a[k];
+    a[i] = s / l[i * (i + 1) / 2 + i];
+  }
+
+  return true;
+}
+
+/* Eigenvalues d and vectors, the columns of v, of the symmetric m, by Jacobi */
+static void magCalibEigen(double m[3][3], double d[3], double v[3][3])
+{
+  double theta, t, c, s, mp, mq;
+  uint32_t sweep, p, q, k;
+
+  memset(v, 0, sizeof(double[3][3]));
+  v[0][0] = v[1][1] = v[2][2] = 1.0;
+
+  for (sweep=0; sweep<MAG_CALIB_EIGEN_SWEEPS; sweep++)
+  {
+    if (m[0][1] * m[0][1] + m[0][2] * m[0][2] + m[1][2] * m[1][2] <=
+        1e-24 * (m[0][0] * m[0][0] + m[1][1] * m[1][1] + m[2][2] * m[2][2]))
+      break;
+
+    for (p=0; p<2; p++)
+    {
+      for (q=p+1; q<3; q++)
+      {
+        if (m[p][q] == 0.0)
+          continue;
+        theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+        t = 1.0 / (fabs(theta) + sqrt(theta * theta + 1.0));
+        if (theta < 0.0)
+          t = -t;
+        c = 1.0 / sqrt(t * t + 1.0);
+        s = t * c;
+        for (k=0; k<3; k++)
+        {
+          mp = m[k][p];
+          mq = m[k][q];
+          m[k][p] = c * mp - s * mq;
+          m[k][q] = s * mp + c * mq;
+        }
+        for (k=0; k<3; k++)
+        {
+          mp = m[p][k];
+          mq = m[q][k];
+          m[p][k] = c * mp - s * mq;
+          m[q][k] = s * mp + c * mq;
+        }
+        for (k=0; k<3; k++)
+        {
+          mp = v[k][p];
+          mq = v[k][q];
+          v[k][p] = c * mp - s * mq;
+          v[k][q] = s * mp + c * mq;
+        }
+      }
+    }
+  }
+
+  for (k=0; k<3; k++)
+    d[k] = m[k][k];
+}
+
+static double magCalibMin3(const double d[3])
+{
+  double min = d[0] < d[1] ? d[0] : d[1];
+
+  return min < d[2] ? min : d[2];
+}
+
+static double magCalibMax3(const double d[3])
+{
+  double max = d[0] > d[1] ? d[0] : d[1];
+
+  return max > d[2] ? max : d[2];
+}
+
+/* Rms of a t - 1 over the samples */
+static double magCalibResidual(const magCalib_t * calib, const double a[MAG_CALIB_TERMS])
+{
+  double e = calib->weight;
+  uint32_t i, j, k;
+
+  k = 0;
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+  {
+    e -= 2.0 * a[i] * calib->sum[i];
+    e += a[i] * a[i] * calib->normal[k++];
+    for (j=i+1; j<MAG_CALIB_TERMS; j++)
+      e += 2.0 * a[i] * a[j] * calib->normal[k++];
+  }
+
+  return e > 0.0 ? sqrt(e / calib->weight) : 0.0;
+}
+
+/* Deviation of the samples on the narrowest axis once calibrated, over the radius */
+static double magCalibSpread(const magCalib_t * calib, const double w[3][3], double radius)
+{
+  static const uint8_t cross[3][3] = { {0, 3, 4}, {3, 1, 5}, {4, 5, 2} };
+  double mean[3];
+  double cov[3][3];
+  double wc[3][3];
+  double covH[3][3];
+  double d[3];
+  double v[3][3];
+  uint32_t i, j, k;
+
+  for (i=0; i<3; i++)
+    mean[i] = calib->sum[6 + i] / (2.0 * calib->weight);
+  for (i=0; i<3; i++)
+    for (j=0; j<3; j++)
+      cov[i][j] = calib->sum[cross[i][j]] / ((i == j ? 1.0 : 2.0) * calib->weight) -
+                  mean[i] * mean[j];
+
+  for (i=0; i<3; i++)
+    for (j=0; j<3; j++)
+    {
+      wc[i][j] = 0.0;
+      for (k=0; k<3; k++)
+        wc[i][j] += w[i][k] * cov[k][j];
+    }
+  for (i=0; i<3; i++)
+    for (j=0; j<3; j++)
+    {
+      covH[i][j] = 0.0;
+      for (k=0; k<3; k++)
+        covH[i][j] += wc[i][k] * w[j][k];
+    }
+
+  magCalibEigen(covH, d, v);
+  d[0] = magCalibMin3(d);
+
+  return d[0] > 0.0 ? sqrt(d[0]) / radius : 0.0;
+}
+
+/**
+ * Moves the origin of the sums by d: each t of m - d is L t + e, so the
+ * sums become L N L' + L s e' + e (L s)' + w e e' and L s + w e. Kept near
+ * the center, the fit is well conditioned and its origin is inside the
+ * ellipsoid, which the quadric = 1 needs. A row of L has up to 3 terms.
+ */
+static void magCalibShift(magCalib_t * calib, const double d[3])
+{
+  static const uint8_t cross[3][2] = { {0, 1}, {0, 2}, {1, 2} };
+  float normal[MAG_CALIB_NORMAL_SIZE];
+  uint8_t col[MAG_CALIB_TERMS][3];
+  double coef[MAG_CALIB_TERMS][3];
+  uint8_t count[MAG_CALIB_TERMS];
+  double e[MAG_CALIB_TERMS];
+  double ls[MAG_CALIB_TERMS];
+  double v;
+  uint32_t i, j, k, p, q;
+
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+  {
+    col[i][0] = (uint8_t)i;
+    coef[i][0] = 1.0;
+    count[i] = 1;
+  }
+  for (i=0; i<3; i++)
+  {
+    //x^2 - 2 dx x + dx^2, and 2x - 2dx
+    col[i][1] = (uint8_t)(6 + i);
+    coef[i][1] = -d[i];
+    count[i] = 2;
+    e[i] = d[i] * d[i];
+    e[6 + i] = -2.0 * d[i];
+    //2xy - 2 dy x - 2 dx y + 2 dx dy
+    col[3 + i][1] = (uint8_t)(6 + cross[i][0]);
+    coef[3 + i][1] = -d[cross[i][1]];
+    col[3 + i][2] = (uint8_t)(6 + cross[i][1]);
+    coef[3 + i][2] = -d[cross[i][0]];
+    count[3 + i] = 3;
+    e[3 + i] = 2.0 * d[cross[i][0]] * d[cross[i][1]];
+  }
+
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+  {
+    ls[i] = 0.0;
+    for (p=0; p<count[i]; p++)
+      ls[i] += coef[i][p] * calib->sum[col[i][p]];
+  }
+
+  k = 0;
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+  {
+    for (j=i; j<MAG_CALIB_TERMS; j++, k++)
+    {
+      v = ls[i] * e[j] + e[i] * ls[j] + calib->weight * e[i] * e[j];
+      for (p=0; p<count[i]; p++)
+        for (q=0; q<count[j]; q++)
+          v += coef[i][p] * coef[j][q] * calib->normal[magCalibIndex(col[i][p], col[j][q])];
+      normal[k] = (float)v;
+    }
+  }
+
+  memcpy(calib->normal, normal, sizeof(normal));
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+    calib->sum[i] = (float)(ls[i] + calib->weight * e[i]);
+  for (i=0; i<3; i++)
+    calib->center[i] += (float)d[i];
+}
+
+/**
+ * From the mean of the samples, inside the ellipsoid: the offset
+ * c = -A^-1 b and, with k = 1 + c'Ac, the ellipsoid (m - c)' A/k (m - c) = 1.
+ * W is the square root of A/k, scaled to the mean radius.
+ */
+static bool magCalibSolve(magCalib_t * calib)
+{
+  double a[MAG_CALIB_TERMS];
+  double m[3][3];
+  double inv[3][3];
+  double c[3];
+  double w[3][3];
+  double d[3];
+  double v[3][3];
+  double det, k, radius, aspect, spread, residual;
+  magCalibResult_t result;
+  uint32_t i, j;
+
+  for (i=0; i<3; i++)
+    d[i] = calib->sum[6 + i] / (2.0 * calib->weight);
+  magCalibShift(calib, d);
+
+  if (!magCalibSolveNormal(calib, a))
+  {
+    calib->rejections++;
+    return false;
+  }
+
+  m[0][0] = a[0];
+  m[1][1] = a[1];
+  m[2][2] = a[2];
+  m[0][1] = m[1][0] = a[3];
+  m[0][2] = m[2][0] = a[4];
+  m[1][2] = m[2][1] = a[5];
+
+  inv[0][0] = m[1][1] * m[2][2] - m[1][2] * m[1][2];
+  inv[0][1] = m[0][2] * m[1][2] - m[0][1] * m[2][2];
+  inv[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+  inv[1][1] = m[0][0] * m[2][2] - m[0][2] * m[0][2];
+  inv[1][2] = m[0][1] * m[0][2] - m[0][0] * m[1][2];
+  inv[2][2] = m[0][0] * m[1][1] - m[0][1] * m[0][1];
+  det = m[0][0] * inv[0][0] + m[0][1] * inv[0][1] + m[0][2] * inv[0][2];
+  if (det <= 0.0)
+  {
+    calib->rejections++;
+    return false;
+  }
+  inv[1][0] = inv[0][1];
+  inv[2][0] = inv[0][2];
+  inv[2][1] = inv[1][2];
+
+  k = 1.0;
+  for (i=0; i<3; i++)
+  {
+    c[i] = -(inv[i][0] * a[6] + inv[i][1] * a[7] + inv[i][2] * a[8]) / det;
+    k -= a[6 + i] * c[i];
+  }
+  if (k <= 0.0)
+  {
+    calib->rejections++;
+    return false;
+  }
+
+  for (i=0; i<3; i++)
+    for (j=0; j<3; j++)
+      m[i][j] /= k;
+  magCalibEigen(m, d, v);
+  if (magCalibMin3(d) <= 0.0)
+  {
+    calib->rejections++;
+    return false;
+  }
+  radius = pow(d[0] * d[1] * d[2], -1.0 / 6.0);
+  aspect = sqrt(magCalibMax3(d) / magCalibMin3(d));
+
+  for (i=0; i<3; i++)
+    for (j=0; j<3; j++)
+      w[i][j] = radius * (v[i][0] * sqrt(d[0]) * v[j][0] +
+                          v[i][1] * sqrt(d[1]) * v[j][1] +
+                          v[i][2] * sqrt(d[2]) * v[j][2]);
+
+  spread = magCalibSpread(calib, w, radius);
+  residual = magCalibResidual(calib, a);
+  calib->spread = (float)spread;
+  calib->residual = (float)residual;
+
+  if (radius < MAG_CALIB_MIN_FIELD || radius > MAG_CALIB_MAX_FIELD ||
+      aspect > MAG_CALIB_MAX_ASPECT || spread < MAG_CALIB_MIN_SPREAD ||
+      residual > MAG_CALIB_MAX_RESIDUAL ||
+      fabs(c[0]) > MAG_CALIB_MAX_OFFSET || fabs(c[1]) > MAG_CALIB_MAX_OFFSET ||
+      fabs(c[2]) > MAG_CALIB_MAX_OFFSET)
+  {
+    calib->rejections++;
+    return false;
+  }
+
+  for (i=0; i<3; i++)
+  {
+    result.offset[i] = (float)c[i] + calib->center[i];
+    for (j=0; j<3; j++)
+      result.soft[i][j] = (float)w[i][j];
+  }
+  result.radius = (float)radius;
+  calib->result = result;
+  calib->solutions++;
+
+  return true;
+}
+
+bool magCalibUpdate(magCalib_t * calib, const float m[3])
+{
+  const float fade = 1.0f - 1.0f / MAG_CALIB_WINDOW;
+  float t[MAG_CALIB_TERMS];
+  float d[3];
+  uint32_t i, j, k;
+
+  for (i=0; i<3; i++)
+    d[i] = m[i] - calib->last[i];
+  if (calib->hasLast &&
+      d[0] * d[0] + d[1] * d[1] + d[2] * d[2] < MAG_CALIB_MIN_STEP * MAG_CALIB_MIN_STEP)
+    return false;
+  memcpy(calib->last, m, sizeof(calib->last));
+  calib->hasLast = true;
+
+  for (i=0; i<3; i++)
+    d[i] = m[i] - calib->center[i];
+  t[0] = d[0] * d[0];
+  t[1] = d[1] * d[1];
+  t[2] = d[2] * d[2];
+  t[3] = 2.0f * d[0] * d[1];
+  t[4] = 2.0f * d[0] * d[2];
+  t[5] = 2.0f * d[1] * d[2];
+  t[6] = 2.0f * d[0];
+  t[7] = 2.0f * d[1];
+  t[8] = 2.0f * d[2];
+
+  k = 0;
+  for (i=0; i<MAG_CALIB_TERMS; i++)
+  {
+    for (j=i; j<MAG_CALIB_TERMS; j++, k++)
+      calib->normal[k] = calib->normal[k] * fade + t[i] * t[j];
+    calib->sum[i] = calib->sum[i] * fade + t[i];
+  }
+  calib->weight = calib->weight * fade + 1.0f;
+
+  if (++calib->added < MAG_CALIB_SOLVE_SAMPLES || calib->weight < MAG_CALIB_MIN_SAMPLES)
+    return false;
+  calib->added = 0;
+
+  return magCalibSolve(calib);
+}
+
+void magCalibApply(const magCalibResult_t * result, const float m[3], float h[3])
+{
+  float d[3];
+  uint32_t i;
+
+  if (result->radius <= 0.0f)
+  {
+    for (i=0; i<3; i++)
+      h[i] = m[i];
+    return;
+  }
+
+  for (i=0; i<3; i++)
+    d[i] = m[i] - result->offset[i];
+  for (i=0; i<3; i++)
+    h[i] = result->soft[i][0] * d[0] + result->soft[i][1] * d[1] + result->soft[i][2] * d[2];
+}
+
+bool magCalibDiffers(const magCalibResult_t * a, const magCalibResult_t * b, float minDiff)
+{
+  uint32_t i, j;
+
+  if ((a->radius > 0.0f) != (b->radius > 0.0f))
+    return true;
+
+  for (i=0; i<3; i++)
+  {
+    if (fabsf(a->offset[i] - b->offset[i]) > minDiff)
+      return true;
+    for (j=0; j<3; j++)
+      if (fabsf(a->soft[i][j] - b->soft[i][j]) > minDiff)
+        return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,180 @@
+/**
+ * mag_sampler.c - Magnetometer sampled on its data ready line
+ *
+ * The HMC5983 pulls DRDY low at each sample, 220Hz: the ISR takes the tick
+ * and wakes the task, which reads the sample in one burst, without the
+ * status register. Without an edge for MAG_SAMPLER_TIMEOUT_MS, DRDY not
+ * wired, the status register is polled at that period instead.
+ *
+ * An update of the calibration is constant time; every
+ * MAG_CALIB_SOLVE_SAMPLES directions it is solved, in this task and not in
+ * the stabilizer one.
+ */
+#include <string.h>
+
+#include "main.h"
+#include "mag_sampler.h"
+#include "mag_calib.h"
+
+static bool isInit = false;
+
+static xSemaphoreHandle drdyEvent;
+STATIC_MEM_SEMAPHORE_ALLOC(drdyEvent);
+static volatile uint32_t drdyTick;
+
+static magCalib_t magCalib;
+static magCalibResult_t calibInUse;   // Copy of magCalib.result for the other tasks
+static magCalibResult_t storedCalib;
+static bool isCalibStored;
+
+static Axis3f magLast;                // Gauss
+static uint32_t magTick;
+static uint32_t magCount;             // Samples published
+static uint32_t magCountRead;
+
+static uint16_t drdyTimeouts;
+static uint16_t overflows;
+static uint16_t calibSolutions;
+static uint8_t isCalibrated;
+
+static void magSamplerTask(void * param);
+STATIC_MEM_TASK_ALLOC(magSamplerTask, MAG_SAMPLER_TASK_STACKSIZE);
+
+void magSamplerInit(void)
+{
+  if (isInit)
+    return;
+
+  magCalibReset(&magCalib);
+  if (configblockGetMagCalib(&storedCalib))
+  {
+    magCalibRestore(&magCalib, &storedCalib);
+    isCalibStored = true;
+  }
+  calibInUse = magCalib.result;
+  isCalibrated = calibInUse.radius > 0.0f;
+
+  drdyEvent = STATIC_MEM_BINARY_CREATE(drdyEvent);
+  HMC5983_DrdyInit();
+
+  STATIC_MEM_TASK_CREATE(magSamplerTask, magSamplerTask, MAG_SAMPLER_TASK_NAME,
+                         NULL, MAG_SAMPLER_TASK_PRI);
+
+  isInit = true;
+}
+
+bool magSamplerTest(void)
+{
+  return isInit;
+}
+
+bool magSamplerRead(Axis3f * mag, uint32_t * tick)
+{
+  bool isNew;
+
+  taskENTER_CRITICAL();
+  *mag = magLast;
+  if (tick != NULL)
+    *tick = magTick;
+  isNew = magCount != magCountRead;
+  magCountRead = magCount;
+  taskEXIT_CRITICAL();
+
+  return isNew;
+}
+
+bool magSamplerIsCalibrated(void)
+{
+  return isCalibrated != 0;
+}
+
+void magSamplerAtRest(void)
+{
+  magCalibResult_t calib;
+
+  if (!isInit)
+    return;
+
+  taskENTER_CRITICAL();
+  calib = calibInUse;
+  taskEXIT_CRITICAL();
+
+  if (calib.radius <= 0.0f ||
+      (isCalibStored && !magCalibDiffers(&calib, &storedCalib, MAG_SAMPLER_STORE_MIN_DIFF)))
+    return;
+
+  storedCalib = calib;
+  isCalibStored = configblockSetMagCalib(&storedCalib);
+}
+
+void magSamplerIsr(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  drdyTick = xTaskGetTickCountFromISR();
+  xSemaphoreGiveFromISR(drdyEvent, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void magSamplerTask(void * param)
+{
+  int16_t raw[3];
+  float m[3];
+  float h[3];
+  uint32_t tick;
+
+  while (1)
+  {
+    if (xSemaphoreTake(drdyEvent, M2T(MAG_SAMPLER_TIMEOUT_MS)) == pdTRUE)
+    {
+      tick = drdyTick;
+    }
+    else
+    {
+      drdyTimeouts++;
+      if (!HMC5983_IsDataReady())
+        continue;
+      tick = xTaskGetTickCount();
+    }
+
+    if (!HMC5983_ReadRaw(raw))
+    {
+      overflows++;
+      continue;
+    }
+    m[0] = raw[0] * HMC5983_GAUSS_PER_LSB;
+    m[1] = raw[1] * HMC5983_GAUSS_PER_LSB;
+    m[2] = raw[2] * HMC5983_GAUSS_PER_LSB;
+
+    if (magCalibUpdate(&magCalib, m))
+    {
+      taskENTER_CRITICAL();
+      calibInUse = magCalib.result;
+      taskEXIT_CRITICAL();
+      isCalibrated = 1;
+      calibSolutions = magCalib.solutions;
+    }
+    magCalibApply(&magCalib.result, m, h);
+
+    taskENTER_CRITICAL();
+    magLast.x = h[0];
+    magLast.y = h[1];
+    magLast.z = h[2];
+    magTick = tick;
+    magCount++;
+    taskEXIT_CRITICAL();
+  }
+}
+
+LOG_GROUP_START(magCalib)
+LOG_ADD(LOG_FLOAT, offX, &calibInUse.offset[0])
+LOG_ADD(LOG_FLOAT, offY, &calibInUse.offset[1])
+LOG_ADD(LOG_FLOAT, offZ, &calibInUse.offset[2])
+LOG_ADD(LOG_FLOAT, radius, &calibInUse.radius)
+LOG_ADD(LOG_FLOAT, residual, &magCalib.residual)
+LOG_ADD(LOG_FLOAT, spread, &magCalib.spread)
+LOG_ADD(LOG_UINT8, calibrated, &isCalibrated)
+LOG_ADD(LOG_UINT16, solutions, &calibSolutions)
+LOG_ADD(LOG_UINT16, drdyTimeouts, &drdyTimeouts)
+LOG_ADD(LOG_UINT16, overflows, &overflows)
+LOG_GROUP_STOP(magCalib)
@@ -66,6 +66,13 @@ extern "C" {
 #define MP9250_CS_HIGH   GPIO_SetBits(MPU9250_SPI_nCS_PORT,MPU9250_SPI_nCS_PIN)
 #define Byte16(Type, ByteH, ByteL)  ((Type)((((uint16_t)(ByteH))<<8) | ((uint16_t)(ByteL))))
 
+/* nCS of the second IMU, an MPU9250 next to the ICM20601, with IMU_DUAL */
+#define IMU2_SPI_nCS_PIN        GPIO_Pin_3
+#define IMU2_SPI_nCS_PORT       GPIOC
+#define IMU2_SPI_nCS_CLK        RCC_AHB1Periph_GPIOC
+
+#define IMU2_CS_HIGH     GPIO_SetBits(IMU2_SPI_nCS_PORT,IMU2_SPI_nCS_PIN)
+
 
 /**********************HMC5983******************************/
 #define HMC5983_SPI_nCS_PIN     GPIO_Pin_12
@@ -74,6 +81,17 @@ extern "C" {
 
 #define HMC5983_CS_LOW    GPIO_ResetBits(HMC5983_SPI_nCS_PORT,HMC5983_SPI_nCS_PIN)
 #define HMC5983_CS_HIGH   GPIO_SetBits(HMC5983_SPI_nCS_PORT,HMC5983_SPI_nCS_PIN)
+
+/* DRDY, low for 250us when a sample is ready */
+#define HMC5983_DRDY_PIN          GPIO_Pin_4                  /* PE.4 */
+#define HMC5983_DRDY_PORT         GPIOE
+#define HMC5983_DRDY_CLK          RCC_AHB1Periph_GPIOE
+#define HMC5983_DRDY_SRC_PORT     EXTI_PortSourceGPIOE
+#define HMC5983_DRDY_SRC_PIN      EXTI_PinSource4
+#define HMC5983_DRDY_LINE         EXTI_Line4
+#define HMC5983_DRDY_IRQn         EXTI4_IRQn
+#define HMC5983_DRDY_IRQHandler   EXTI4_IRQHandler
+#define HMC5983_DRDY_IRQ_PRIORITY 9    // Gives a semaphore: below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
   
 /**********************MS5611******************************/
 #define MS5611_SPI_nCS_PIN     GPIO_Pin_12
@@ -135,15 +153,93 @@ extern "C" {
 #define PRINTF_COM1_TX_GPIO_PORT           GPIOA
 #define PRINTF_COM1_TX_GPIO_CLK            RCC_AHB1Periph_GPIOA
 #define PRINTF_COM1_TX_SOURCE              GPIO_PinSource2
-#define PRINTF_COM1_TX_AF                  GPIO_AF_USART1
+#define PRINTF_COM1_TX_AF                  GPIO_AF_USART2
 
 #define PRINTF_COM1_RX_PIN                 GPIO_Pin_3
 #define PRINTF_COM1_RX_GPIO_PORT           GPIOA
 #define PRINTF_COM1_RX_GPIO_CLK            RCC_AHB1Periph_GPIOA
 #define PRINTF_COM1_RX_SOURCE              GPIO_PinSource3
-#define PRINTF_COM1_RX_AF                  GPIO_AF_USART1
+#define PRINTF_COM1_RX_AF                  GPIO_AF_USART2
   
-#define PRINTF_COM1_IRQn                   USART1_IRQn
+#define PRINTF_COM1_IRQn                   USART2_IRQn
+
+#define PRINTF_COM1_TX_DMA_CLK             RCC_AHB1Periph_DMA1
+#define PRINTF_COM1_TX_DMA_STREAM          DMA1_Stream6
+#define PRINTF_COM1_TX_DMA_CHANNEL         DMA_Channel_4
+#define PRINTF_COM1_TX_DMA_FLAG_TCIF       DMA_FLAG_TCIF6
+#define PRINTF_COM1_TX_DMA_FLAG_ALL        (DMA_FLAG_FEIF6 | DMA_FLAG_DMEIF6 | DMA_FLAG_TEIF6 | DMA_FLAG_HTIF6 | DMA_FLAG_TCIF6)
+#define PRINTF_COM1_TX_DMA_IRQn            DMA1_Stream6_IRQn
+#define PRINTF_COM1_TX_DMA_IRQHandler      DMA1_Stream6_IRQHandler
+
+/**
+ * @brief Definition for the wired CRTP link, connected to USART6 (PC6/PC7)
+ */
+#define UARTLINK_COM                       USART6
+#define UARTLINK_COM_CLK                   RCC_APB2Periph_USART6
+
+#define UARTLINK_COM_TX_PIN                GPIO_Pin_6
+#define UARTLINK_COM_TX_GPIO_PORT          GPIOC
+#define UARTLINK_COM_TX_GPIO_CLK           RCC_AHB1Periph_GPIOC
+#define UARTLINK_COM_TX_SOURCE             GPIO_PinSource6
+#define UARTLINK_COM_TX_AF                 GPIO_AF_USART6
+
+#define UARTLINK_COM_RX_PIN                GPIO_Pin_7
+#define UARTLINK_COM_RX_GPIO_PORT          GPIOC
+#define UARTLINK_COM_RX_GPIO_CLK           RCC_AHB1Periph_GPIOC
+#define UARTLINK_COM_RX_SOURCE             GPIO_PinSource7
+#define UARTLINK_COM_RX_AF                 GPIO_AF_USART6
+
+#define UARTLINK_COM_IRQn                  USART6_IRQn
+#define UARTLINK_COM_IRQHandler            USART6_IRQHandler
+
+#define UARTLINK_COM_DMA_CLK               RCC_AHB1Periph_DMA2
+//Stream7 for TX, Stream6 is the alternative stream of the SDIO
+#define UARTLINK_COM_TX_DMA_STREAM         DMA2_Stream7
+#define UARTLINK_COM_TX_DMA_CHANNEL        DMA_Channel_5
+#define UARTLINK_COM_TX_DMA_FLAG_TCIF      DMA_FLAG_TCIF7
+#define UARTLINK_COM_TX_DMA_FLAG_ALL       (DMA_FLAG_FEIF7 | DMA_FLAG_DMEIF7 | DMA_FLAG_TEIF7 | DMA_FLAG_HTIF7 | DMA_FLAG_TCIF7)
+#define UARTLINK_COM_TX_DMA_IRQn           DMA2_Stream7_IRQn
+#define UARTLINK_COM_TX_DMA_IRQHandler     DMA2_Stream7_IRQHandler
+
+#define UARTLINK_COM_RX_DMA_STREAM         DMA2_Stream1
+#define UARTLINK_COM_RX_DMA_CHANNEL        DMA_Channel_5
+#define UARTLINK_COM_RX_DMA_FLAG_HTIF      DMA_FLAG_HTIF1
+#define UARTLINK_COM_RX_DMA_FLAG_TCIF      DMA_FLAG_TCIF1
+#define UARTLINK_COM_RX_DMA_FLAG_ALL       (DMA_FLAG_FEIF1 | DMA_FLAG_DMEIF1 | DMA_FLAG_TEIF1 | DMA_FLAG_HTIF1 | DMA_FLAG_TCIF1)
+#define UARTLINK_COM_RX_DMA_IRQn           DMA2_Stream1_IRQn
+#define UARTLINK_COM_RX_DMA_IRQHandler     DMA2_Stream1_IRQHandler
+
+/**
+ * @brief Memory to memory copies (MemDma.c). Only DMA2 can do them, on any
+ *        stream. Stream0 is the first one the SDIO (3 or 6) and the UART
+ *        link (1, 7) leave free, and its requests are not used on the board
+ */
+#define MEMDMA_CLK                         RCC_AHB1Periph_DMA2
+#define MEMDMA_STREAM                      DMA2_Stream0
+#define MEMDMA_CHANNEL                     DMA_Channel_0
+#define MEMDMA_FLAG_TCIF                   DMA_FLAG_TCIF0
+#define MEMDMA_FLAG_TEIF                   DMA_FLAG_TEIF0
+#define MEMDMA_FLAG_ALL                    (DMA_FLAG_FEIF0 | DMA_FLAG_DMEIF0 | DMA_FLAG_TEIF0 | DMA_FLAG_HTIF0 | DMA_FLAG_TCIF0)
+#define MEMDMA_IRQn                        DMA2_Stream0_IRQn
+#define MEMDMA_IRQHandler                  DMA2_Stream0_IRQHandler
+#define MEMDMA_IRQ_PRIORITY                8    // Gives a semaphore: below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+
+/**
+ * @brief SPI1 transfers of the sensors bus (SpiBus.c, SPI_BUS_DMA): DMA2
+ *        channel 3, Stream2 receives and Stream5 sends. Not used by the
+ *        SDIO, the UART link nor MemDma
+ */
+#define SPIBUS_DMA_CLK                     RCC_AHB1Periph_DMA2
+#define SPIBUS_DMA_CHANNEL                 DMA_Channel_3
+#define SPIBUS_DMA_RX_STREAM               DMA2_Stream2
+#define SPIBUS_DMA_TX_STREAM               DMA2_Stream5
+#define SPIBUS_DMA_RX_FLAG_TCIF            DMA_FLAG_TCIF2
+#define SPIBUS_DMA_RX_FLAG_TEIF            DMA_FLAG_TEIF2
+#define SPIBUS_DMA_RX_FLAG_ALL             (DMA_FLAG_FEIF2 | DMA_FLAG_DMEIF2 | DMA_FLAG_TEIF2 | DMA_FLAG_HTIF2 | DMA_FLAG_TCIF2)
+#define SPIBUS_DMA_TX_FLAG_ALL             (DMA_FLAG_FEIF5 | DMA_FLAG_DMEIF5 | DMA_FLAG_TEIF5 | DMA_FLAG_HTIF5 | DMA_FLAG_TCIF5)
+#define SPIBUS_DMA_RX_IRQn                 DMA2_Stream2_IRQn
+#define SPIBUS_DMA_RX_IRQHandler           DMA2_Stream2_IRQHandler
+#define SPIBUS_DMA_IRQ_PRIORITY            8    // Gives a semaphore: below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
 /**************PPM Configure *****************/
 #define PPM_TIM                  TIM4   
 #define PPM_TIM_CLK              RCC_APB1Periph_TIM4
@@ -225,6 +321,13 @@ extern "C" {
   */
 #define SDIO_TRANSFER_CLK_DIV            ((uint8_t)0x03) 
 
+/** 
+  * @brief  SDIO interrupt priorities. The handlers give a semaphore: they
+  *         must stay below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY (5)
+  */
+#define SDIO_IRQ_PRIORITY                7
+#define SD_SDIO_DMA_IRQ_PRIORITY         7
+
 #define SD_SDIO_DMA                   DMA2
 #define SD_SDIO_DMA_CLK               RCC_AHB1Periph_DMA2
  
@@ -261,6 +364,11 @@ void STM_LED_Set(Led_TypeDef led,uint8_t state);
 /* Serial communication Function */
 void SendByte(uint8_t dat);
 
+/* Sensor power */
+void SENSOR_POWER_ENABLE(void);
+void SENSOR_POWER_DISABLE(void);
+uint32_t SENSOR_POWER_ON_TICK(void);
+
 /* SPI function */
 void SPI1_Init(void);
 uint8_t SPI1_RW(uint8_t byte);
@@ -0,0 +1,65 @@
+#ifndef _MEMDMA_H_
+#define _MEMDMA_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+
+#define MEMDMA_MIN_SIZE        256     // Below, the CPU copy is faster than the DMA setup
+#define MEMDMA_TIMEOUT_MS      10
+
+typedef struct {
+  uint32_t transfers;
+  uint32_t bytes;
+  uint32_t cpuCopies;     // memDmaCopy() done by the CPU: small, CCM RAM, no scheduler
+  uint32_t errors;        // Bus errors and timeouts
+} MemDmaStats;
+
+/*************************************************************************
+ *@brief  set up the memory to memory DMA stream (MEMDMA_STREAM)
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void memDmaInit(void);
+bool memDmaTest(void);
+
+/*************************************************************************
+ *@brief  start an asynchronous copy, the CPU is free meanwhile
+ *@param  *dst, *src: the buffers, they must not overlap
+ *@param  len: the number of bytes
+ *@retval false when the DMA cannot do it: CCM RAM (0x10000000) is out of
+ *        its reach, overlapping buffers, not initialised, no scheduler.
+ *        Nothing has been copied then
+ *@note   task context. The channel is held until memDmaWait(): a task
+ *        starts one copy at a time, the others wait for the channel
+ *************************************************************************/
+bool memDmaStart(void * dst, const void * src, uint32_t len);
+
+/*************************************************************************
+ *@brief  wait for the copy started by memDmaStart() and release the channel
+ *@param  None
+ *@retval false on a bus error or after MEMDMA_TIMEOUT_MS
+ *************************************************************************/
+bool memDmaWait(void);
+
+/*************************************************************************
+ *@brief  blocking copy, with the DMA from MEMDMA_MIN_SIZE bytes when it can,
+ *        with mymemcpy() otherwise
+ *************************************************************************/
+void memDmaCopy(void * dst, const void * src, uint32_t len);
+
+void memDmaGetStats(MemDmaStats * stats);
+
+/* To be called from MEMDMA_IRQHandler */
+void memDmaIsr(void);
+
+#ifdef MEMDMA_BENCH
+/* Prints the cycles taken by the copy and fill routines */
+void memDmaBench(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,123 @@
+#ifndef _SPIBUS_H_
+#define _SPIBUS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+******************************************************************************
+* @file    SpiBus.h
+* @brief   The SPI1 bus of the sensors, shared by the ICM20601 or the
+*          MPU9250, the HMC5983 and the MS5611
+******************************************************************************
+* Each device has its clock and mode profile, applied by the bus before its
+* chip select goes down. A transaction is a chip select low, up to
+* SPI_BUS_CMD_MAX command bytes, then len data bytes, chip select high.
+* spiBusRun() takes the bus for a batch of transactions, so a task reading
+* several registers or devices is not interleaved with another one.
+*
+* With SPI_BUS_DMA defined in config.h, the data bytes of the transactions
+* from SPI_BUS_DMA_MIN_SIZE bytes go by DMA and the task sleeps meanwhile.
+*
+* Has no dependency on the RTOS or the hardware: the host mock
+* (Tools/spibus) implements this interface to time the bus use.
+******************************************************************************
+*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPI_BUS_PCLK_HZ       84000000  // SPI1 on APB2
+#define SPI_BUS_CMD_MAX       4
+#define SPI_BUS_DMA_MIN_SIZE  8         // Below, polling is faster than the DMA setup
+#define SPI_BUS_TIMEOUT_MS    5
+
+/* Clock dividers of SPI_BUS_PCLK_HZ, powers of two from 2 to 256. The
+datasheet maximums are 1MHz for all the ICM20601 registers and 10MHz for
+its sensor and interrupt ones, 8MHz for the HMC5983, 20MHz for the MS5611,
+1MHz for all the MPU9250 registers and 20MHz for its sensor, interrupt and
+external sensor ones */
+#define SPI_BUS_ICM20601_DIV       128  // 656kHz
+#define SPI_BUS_ICM20601_FAST_DIV  16   // 5.25MHz
+#define SPI_BUS_HMC5983_DIV        16   // 5.25MHz
+#define SPI_BUS_MS5611_DIV         8    // 10.5MHz
+#define SPI_BUS_MPU9250_DIV        128  // 656kHz
+#define SPI_BUS_MPU9250_FAST_DIV   8    // 10.5MHz
+
+typedef enum
+{
+  SPI_BUS_ICM20601 = 0,
+  SPI_BUS_HMC5983,
+  SPI_BUS_MS5611,
+  SPI_BUS_MPU9250,                // On the chip select of the ICM20601, fitted instead,
+                                  // or on its own with IMU_DUAL
+  SPI_BUS_DEVICES,
+} spiBusDevice_t;
+
+/* Transaction flags */
+#define SPI_BUS_FAST          0x01      // The fast clock of the device, if it has one
+
+typedef struct
+{
+  uint8_t device;                 // spiBusDevice_t
+  uint8_t flags;
+  uint8_t cmdLen;
+  uint8_t cmd[SPI_BUS_CMD_MAX];   // Sent first, what comes in is dropped
+  const uint8_t * tx;             // Then len bytes out, 0x00 when NULL,
+  uint8_t * rx;                   // while len bytes come in, dropped when NULL
+  uint16_t len;
+} spiBusTransaction_t;
+
+typedef struct
+{
+  uint32_t transactions;
+  uint32_t bytes;                 // Command and data
+  uint32_t busyCycles;            // CPU cycles from the chip select down to up
+} spiBusDeviceStats_t;
+
+typedef struct
+{
+  spiBusDeviceStats_t device[SPI_BUS_DEVICES];
+  uint32_t dmaTransfers;
+  uint32_t errors;                // DMA errors and timeouts
+  uint32_t waits;                 // Batches which waited for another task
+} spiBusStats_t;
+
+/*************************************************************************
+ *@brief  set up SPI1, its chip selects, the bus mutex and the DMA
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void spiBusInit(void);
+bool spiBusTest(void);
+
+/*************************************************************************
+ *@brief  run transactions back to back, the bus held for all of them
+ *@param  *t: the transactions, run in order
+ *@param  count: their number
+ *@retval false on a DMA error or timeout, the data read is not valid then
+ *@note   task context, or before the scheduler starts. Waits while another
+ *        task holds the bus
+ *************************************************************************/
+bool spiBusRun(const spiBusTransaction_t * t, uint32_t count);
+
+/*************************************************************************
+ *@brief  one transaction of one command byte, the register accesses
+ *@param  device: spiBusDevice_t
+ *@param  flags: SPI_BUS_FAST or 0
+ *@param  cmd: the command or register address byte
+ *@param  *tx, *rx, len: as in spiBusTransaction_t
+ *@retval as spiBusRun()
+ *************************************************************************/
+bool spiBusTransfer(uint8_t device, uint8_t flags, uint8_t cmd,
+                    const uint8_t * tx, uint8_t * rx, uint16_t len);
+
+void spiBusGetStats(spiBusStats_t * stats);
+
+/* To be called from SPIBUS_DMA_RX_IRQHandler */
+void spiBusDmaIsr(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SPIBUS_H_ */
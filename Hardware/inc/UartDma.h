@@ -0,0 +1,61 @@
+#ifndef _UARTDMA_H_
+#define _UARTDMA_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+
+#define UART_TX_BUFFER_SIZE    1024   // Power of two
+#define UART_TX_IRQ_PRIORITY   12     // Must stay below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+
+/* What to do when a write does not fit in the TX ring */
+typedef enum {
+  UART_TX_DROP_MESSAGE = 0,   // Drop the whole write, keeps packets/records intact
+  UART_TX_DROP_TAIL,          // Queue what fits, drop the rest
+  UART_TX_BLOCK,              // Wait for room. Task context only, falls back to DROP_TAIL elsewhere
+} UartTxOverflow;
+
+typedef struct {
+  uint32_t bytesQueued;
+  uint32_t bytesSent;
+  uint32_t bytesDropped;
+  uint32_t overflows;
+  uint32_t maxUsed;
+} UartTxStats;
+
+/*************************************************************************
+ *@brief  set up the TX DMA stream of PRINTF_COM1, the UART itself must
+ *        already be configured (USART_Config)
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void uartDmaInit(void);
+bool uartDmaTest(void);
+
+/*************************************************************************
+ *@brief  queue bytes for transmission, never busy-waits on the UART
+ *@param  *data: the bytes to send
+ *@param  len: the number of bytes
+ *@retval the number of bytes queued
+ *@note   can be called from tasks and interrupts
+ *************************************************************************/
+uint32_t uartDmaWrite(const uint8_t * data, uint32_t len);
+
+/*************************************************************************
+ *@brief  queue one byte, putc_t compatible
+ *@param  ch: the byte to send
+ *@retval ch, or -1 if it has been dropped
+ *************************************************************************/
+int uartDmaPutchar(int ch);
+
+void uartDmaSetOverflowPolicy(UartTxOverflow policy);
+void uartDmaGetStats(UartTxStats * stats);
+
+/* To be called from PRINTF_COM1_TX_DMA_IRQHandler */
+void uartDmaIsr(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
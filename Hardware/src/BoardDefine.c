@@ -63,9 +63,18 @@ static void SENSOR_POWER_EN_Init(void)
   SENSOR_POWER_EN_GPIO_PORT->BSRRH = SENSOR_POWER_EN_PIN;
 }
 
+static uint32_t sensorPowerOnTick;
+
 void SENSOR_POWER_ENABLE(void)
 {
    SENSOR_POWER_EN_GPIO_PORT->BSRRL = SENSOR_POWER_EN_PIN;
+   sensorPowerOnTick = xTaskGetTickCount();
+}
+
+/* The sensors start-up times count from there */
+uint32_t SENSOR_POWER_ON_TICK(void)
+{
+  return sensorPowerOnTick;
 }
 
 void SENSOR_POWER_DISABLE(void)
@@ -131,6 +140,13 @@ static void SPI1_GPIO_Init(void)
   //HMC5983 nCS Pin
   GPIO_InitStructure.GPIO_Pin   = HMC5983_SPI_nCS_PIN;
   GPIO_Init(HMC5983_SPI_nCS_PORT, &GPIO_InitStructure);
+
+#ifdef IMU_DUAL
+  //Second IMU nCS Pin
+  RCC_AHB1PeriphClockCmd(IMU2_SPI_nCS_CLK, ENABLE);
+  GPIO_InitStructure.GPIO_Pin   = IMU2_SPI_nCS_PIN;
+  GPIO_Init(IMU2_SPI_nCS_PORT, &GPIO_InitStructure);
+#endif
 }
 
 void SPI1_Init(void)
@@ -139,6 +155,9 @@ void SPI1_Init(void)
   SPI1_GPIO_Init();
   MP9250_CS_HIGH;
   HMC5983_CS_HIGH;
+#ifdef IMU_DUAL
+  IMU2_CS_HIGH;
+#endif
   
   SPI_InitStructure.SPI_Direction   = SPI_Direction_2Lines_FullDuplex;
   SPI_InitStructure.SPI_Mode        = SPI_Mode_Master;
@@ -242,22 +261,15 @@ static void USART_Config(void)
   */
 PUTCHAR_PROTOTYPE
 {
-  /* Place your implementation of fputc here */
-  /* e.g. write a character to the USART */
-  USART_SendData(PRINTF_COM1, (uint8_t) ch);
-
-  /* Loop until the end of transmission */
-  while (USART_GetFlagStatus(PRINTF_COM1, USART_FLAG_TC) == RESET)
-  {}
+  /* Queued in the TX ring, sent by DMA */
+  uartDmaPutchar(ch);
 
   return ch;
 }
 
 void SendByte(uint8_t dat)
 {
-  /* Loop until the end of transmission */
-  while (USART_GetFlagStatus(PRINTF_COM1, USART_FLAG_TC) == RESET);
-  USART_SendData(PRINTF_COM1, (uint8_t) dat);
+  uartDmaPutchar(dat);
 }
 
 /********************Time Configure ****************************/
@@ -473,16 +485,15 @@ void SDIO_NVIC_Configuration(void)
 {
   NVIC_InitTypeDef NVIC_InitStructure;
 
-  /* Configure the NVIC Preemption Priority Bits */
-  NVIC_PriorityGroupConfig(NVIC_PriorityGroup_1);
+  /* The priority grouping is set once by main(), as FreeRTOS requires */
 
   NVIC_InitStructure.NVIC_IRQChannel = SDIO_IRQn;
-  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = SDIO_IRQ_PRIORITY;
   NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
   NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
   NVIC_Init(&NVIC_InitStructure);
   NVIC_InitStructure.NVIC_IRQChannel = SD_SDIO_DMA_IRQn;
-  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = SD_SDIO_DMA_IRQ_PRIORITY;
   NVIC_Init(&NVIC_InitStructure);  
 }
 
@@ -573,7 +584,9 @@ void SD_LowLevel_DMA_RxConfig(uint32_t *BufferDST, uint32_t BufferSize)
 void HardwarePeripheralInit(void)
 {
   USART_Config();
+  uartDmaInit();
   printf("UART Init Finish\n");
+  memDmaInit();
   
   SENSOR_POWER_EN_Init();
   SENSOR_POWER_ENABLE();
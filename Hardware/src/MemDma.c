@@ -0,0 +1,265 @@
+/**
+******************************************************************************
+* @file    MemDma.c
+* @brief   Memory to memory copies by DMA2 (MEMDMA_STREAM)
+******************************************************************************
+* Any DMA2 stream can copy memory, Stream0 was taken as the first one not
+* used by either SDIO stream option (3 or 6) nor the UART link (1, 7).
+* Streams 2, 4 and 5 were free too, SPI1 later took 2 and 5 (SpiBus.c).
+*
+* One stream shared by the tasks: memDmaStart() takes channelMutex and
+* starts the transfer, memDmaWait() sleeps on doneEvent given by the
+* transfer complete interrupt, then gives the mutex back.
+*
+* Word aligned buffers move by words, the last 0-3 bytes are copied by the
+* CPU before the start. Other buffers move by bytes, four times slower.
+******************************************************************************
+*/
+#include "MemDma.h"
+
+#define CCM_START      0x10000000
+#define CCM_END        0x10010000
+#define MAX_ITEMS      0xFFFF      // NDTR
+
+static bool isInit = false;
+
+static xSemaphoreHandle channelMutex;
+static xSemaphoreHandle doneEvent;
+STATIC_MEM_SEMAPHORE_ALLOC(channelMutex);
+STATIC_MEM_SEMAPHORE_ALLOC(doneEvent);
+static volatile bool transferError;
+static uint32_t transferBytes;
+
+static MemDmaStats stats;
+
+static bool inCcm(const void * p, uint32_t len)
+{
+  uint32_t a = (uint32_t)p;
+
+  return a < CCM_END && a + len > CCM_START;
+}
+
+void memDmaInit(void)
+{
+  DMA_InitTypeDef  DMA_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  if(isInit)
+    return;
+
+  channelMutex = STATIC_MEM_MUTEX_CREATE(channelMutex);
+  doneEvent = STATIC_MEM_BINARY_CREATE(doneEvent);
+
+  RCC_AHB1PeriphClockCmd(MEMDMA_CLK, ENABLE);
+
+  DMA_Cmd(MEMDMA_STREAM, DISABLE);
+  DMA_DeInit(MEMDMA_STREAM);
+
+  //The "peripheral" port reads the source. Addresses and sizes set per copy
+  DMA_InitStructure.DMA_Channel = MEMDMA_CHANNEL;
+  DMA_InitStructure.DMA_PeripheralBaseAddr = 0;
+  DMA_InitStructure.DMA_Memory0BaseAddr = 0;
+  DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToMemory;
+  DMA_InitStructure.DMA_BufferSize = 1;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Enable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+  //Memory to memory needs the FIFO
+  DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Enable;
+  DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+  DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+  DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+  DMA_Init(MEMDMA_STREAM, &DMA_InitStructure);
+  DMA_ITConfig(MEMDMA_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+
+  NVIC_InitStructure.NVIC_IRQChannel = MEMDMA_IRQn;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = MEMDMA_IRQ_PRIORITY;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+
+  //Cycle counter for memDmaBench and the callers timing their copies
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  isInit = true;
+}
+
+bool memDmaTest(void)
+{
+  return isInit;
+}
+
+bool memDmaStart(void * dst, const void * src, uint32_t len)
+{
+  uint32_t d = (uint32_t)dst;
+  uint32_t s = (uint32_t)src;
+  uint32_t items;
+  uint32_t tail = 0;
+  bool words;
+
+  if (!isInit || len == 0 || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING ||
+      (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk))
+    return false;
+  if (inCcm(dst, len) || inCcm(src, len) || (d < s + len && s < d + len))
+    return false;
+
+  words = ((d | s) & 3) == 0;
+  if (words)
+  {
+    items = len / 4;
+    tail = len & 3;
+  }
+  else
+    items = len;
+  if (items == 0 || items > MAX_ITEMS)
+    return false;
+
+  xSemaphoreTake(channelMutex, portMAX_DELAY);
+
+  if (tail)
+    mymemcpy((uint8_t *)dst + len - tail, (const uint8_t *)src + len - tail, tail);
+
+  transferError = false;
+  transferBytes = len;
+  xSemaphoreTake(doneEvent, 0);
+
+  //PSIZE, MSIZE and the addresses can only be changed with the stream off
+  MEMDMA_STREAM->CR &= ~(DMA_SxCR_PSIZE | DMA_SxCR_MSIZE);
+  if (words)
+    MEMDMA_STREAM->CR |= DMA_PeripheralDataSize_Word | DMA_MemoryDataSize_Word;
+  MEMDMA_STREAM->PAR = s;
+  MEMDMA_STREAM->M0AR = d;
+  MEMDMA_STREAM->NDTR = items;
+  DMA_ClearFlag(MEMDMA_STREAM, MEMDMA_FLAG_ALL);
+  DMA_Cmd(MEMDMA_STREAM, ENABLE);
+
+  return true;
+}
+
+bool memDmaWait(void)
+{
+  bool ok;
+
+  ok = xSemaphoreTake(doneEvent, M2T(MEMDMA_TIMEOUT_MS)) == pdTRUE && !transferError;
+  if (!ok)
+  {
+    DMA_Cmd(MEMDMA_STREAM, DISABLE);
+    while (DMA_GetCmdStatus(MEMDMA_STREAM) != DISABLE);
+    stats.errors++;
+  }
+  else
+  {
+    stats.transfers++;
+    stats.bytes += transferBytes;
+  }
+
+  xSemaphoreGive(channelMutex);
+
+  return ok;
+}
+
+void memDmaCopy(void * dst, const void * src, uint32_t len)
+{
+  if (len >= MEMDMA_MIN_SIZE && memDmaStart(dst, src, len))
+  {
+    if (memDmaWait())
+      return;
+    //Failed: the CPU copies it all again
+  }
+
+  stats.cpuCopies++;
+  mymemcpy(dst, src, len);
+}
+
+void memDmaGetStats(MemDmaStats * s)
+{
+  *s = stats;
+}
+
+/*************************************************************************
+ *@brief  transfer complete or error: wake up the task in memDmaWait()
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void memDmaIsr(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  if (DMA_GetFlagStatus(MEMDMA_STREAM, MEMDMA_FLAG_TEIF) != RESET)
+    transferError = true;
+  else if (DMA_GetFlagStatus(MEMDMA_STREAM, MEMDMA_FLAG_TCIF) == RESET)
+    return;
+
+  DMA_ClearFlag(MEMDMA_STREAM, MEMDMA_FLAG_ALL);
+  xSemaphoreGiveFromISR(doneEvent, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+#ifdef MEMDMA_BENCH
+#define BENCH_SIZE   4096
+
+static void byteCopy(uint8_t * d, const uint8_t * s, uint32_t n)
+{
+  while (n--) *d++ = *s++;
+}
+
+static void byteFill(uint8_t * d, uint8_t c, uint32_t n)
+{
+  while (n--) *d++ = c;
+}
+
+void memDmaBench(void)
+{
+  uint8_t * a = mymalloc(SRAMIN, BENCH_SIZE + 4);
+  uint8_t * b = mymalloc(SRAMIN, BENCH_SIZE + 4);
+  uint32_t t, busy;
+
+  if (!a || !b)
+  {
+    printf("memDmaBench: no memory\n");
+    myfree(SRAMIN, a);
+    myfree(SRAMIN, b);
+    return;
+  }
+
+  printf("Copy/fill of %d bytes, cycles:\n", BENCH_SIZE);
+
+  t = DWT->CYCCNT; byteCopy(a, b, BENCH_SIZE); t = DWT->CYCCNT - t;
+  printf("  byte copy           %6lu\n", (unsigned long)t);
+  t = DWT->CYCCNT; mymemcpy(a, b, BENCH_SIZE); t = DWT->CYCCNT - t;
+  printf("  mymemcpy aligned    %6lu\n", (unsigned long)t);
+  t = DWT->CYCCNT; mymemcpy(a, b + 1, BENCH_SIZE); t = DWT->CYCCNT - t;
+  printf("  mymemcpy unaligned  %6lu\n", (unsigned long)t);
+  t = DWT->CYCCNT; memcpy(a, b, BENCH_SIZE); t = DWT->CYCCNT - t;
+  printf("  libc memcpy         %6lu\n", (unsigned long)t);
+  t = DWT->CYCCNT; byteFill(a, 0x55, BENCH_SIZE); t = DWT->CYCCNT - t;
+  printf("  byte fill           %6lu\n", (unsigned long)t);
+  t = DWT->CYCCNT; mymemset(a, 0x55, BENCH_SIZE); t = DWT->CYCCNT - t;
+  printf("  mymemset            %6lu\n", (unsigned long)t);
+
+  //CPU time to start, then the whole transfer
+  t = DWT->CYCCNT;
+  if (memDmaStart(a, b, BENCH_SIZE))
+  {
+    busy = DWT->CYCCNT - t;
+    memDmaWait();
+    t = DWT->CYCCNT - t;
+    printf("  DMA words: start    %6lu, done %6lu\n", (unsigned long)busy, (unsigned long)t);
+  }
+  t = DWT->CYCCNT;
+  if (memDmaStart(a, b + 1, BENCH_SIZE))
+  {
+    busy = DWT->CYCCNT - t;
+    memDmaWait();
+    t = DWT->CYCCNT - t;
+    printf("  DMA bytes: start    %6lu, done %6lu\n", (unsigned long)busy, (unsigned long)t);
+  }
+
+  myfree(SRAMIN, a);
+  myfree(SRAMIN, b);
+}
+#endif
@@ -0,0 +1,340 @@
+/**
+******************************************************************************
+* @file    SpiBus.c
+* @brief   The SPI1 bus of the sensors
+******************************************************************************
+* spiBusRun() takes busMutex for the batch. For each transaction it sets the
+* clock and the mode of the device, only when they change (SPE off), drives
+* the chip select and moves the bytes: by polling, or with SPI_BUS_DMA by
+* the two SPIBUS_DMA streams, the task sleeping on doneEvent given by the
+* receive complete interrupt.
+******************************************************************************
+*/
+#include "main.h"
+#include "SpiBus.h"
+
+#define CCM_START      0x10000000
+#define CCM_END        0x10010000
+#define CR1_PROFILE    (SPI_CR1_BR | SPI_CR1_CPOL | SPI_CR1_CPHA)
+
+typedef struct
+{
+  GPIO_TypeDef * csPort;
+  uint16_t csPin;
+  uint16_t div;
+  uint16_t fastDiv;               // With SPI_BUS_FAST
+  uint16_t mode;                  // SPI_CPOL_x | SPI_CPHA_x
+} spiBusProfile_t;
+
+static const spiBusProfile_t profiles[SPI_BUS_DEVICES] =
+{
+  { MPU9250_SPI_nCS_PORT, MPU9250_SPI_nCS_PIN, SPI_BUS_ICM20601_DIV,
+    SPI_BUS_ICM20601_FAST_DIV, SPI_CPOL_High | SPI_CPHA_2Edge },
+  { HMC5983_SPI_nCS_PORT, HMC5983_SPI_nCS_PIN, SPI_BUS_HMC5983_DIV,
+    SPI_BUS_HMC5983_DIV, SPI_CPOL_High | SPI_CPHA_2Edge },
+  { MS5611_SPI_nCS_PORT, MS5611_SPI_nCS_PIN, SPI_BUS_MS5611_DIV,
+    SPI_BUS_MS5611_DIV, SPI_CPOL_High | SPI_CPHA_2Edge },
+#ifdef IMU_DUAL
+  { IMU2_SPI_nCS_PORT, IMU2_SPI_nCS_PIN, SPI_BUS_MPU9250_DIV,
+    SPI_BUS_MPU9250_FAST_DIV, SPI_CPOL_High | SPI_CPHA_2Edge },
+#else
+  { MPU9250_SPI_nCS_PORT, MPU9250_SPI_nCS_PIN, SPI_BUS_MPU9250_DIV,
+    SPI_BUS_MPU9250_FAST_DIV, SPI_CPOL_High | SPI_CPHA_2Edge },
+#endif
+};
+
+static bool isInit = false;
+
+static xSemaphoreHandle busMutex;
+STATIC_MEM_SEMAPHORE_ALLOC(busMutex);
+
+static spiBusStats_t stats;
+
+#ifdef SPI_BUS_DMA
+static xSemaphoreHandle doneEvent;
+STATIC_MEM_SEMAPHORE_ALLOC(doneEvent);
+static volatile bool transferError;
+static uint8_t txZero;            // Sent when there is no tx buffer
+static uint8_t rxDrop;            // Received when there is no rx buffer
+#endif
+
+/* SPI_CR1 BR bits of a clock divider */
+static uint16_t spiBusPrescaler(uint16_t div)
+{
+  uint16_t br = 0;
+
+  while ((2u << br) < div && br < 7)
+    br++;
+
+  return br << 3;
+}
+
+#ifdef SPI_BUS_DMA
+static bool inCcm(const void * p, uint32_t len)
+{
+  uint32_t a = (uint32_t)p;
+
+  return a < CCM_END && a + len > CCM_START;
+}
+
+static void spiBusDmaInit(void)
+{
+  DMA_InitTypeDef  DMA_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  doneEvent = STATIC_MEM_BINARY_CREATE(doneEvent);
+
+  RCC_AHB1PeriphClockCmd(SPIBUS_DMA_CLK, ENABLE);
+
+  //Memory addresses, increments and sizes set per transfer
+  DMA_InitStructure.DMA_Channel = SPIBUS_DMA_CHANNEL;
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&MPU9250_SPI->DR;
+  DMA_InitStructure.DMA_Memory0BaseAddr = 0;
+  DMA_InitStructure.DMA_BufferSize = 1;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+  DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+  DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+  DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+  DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+
+  DMA_Cmd(SPIBUS_DMA_RX_STREAM, DISABLE);
+  DMA_DeInit(SPIBUS_DMA_RX_STREAM);
+  DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralToMemory;
+  DMA_Init(SPIBUS_DMA_RX_STREAM, &DMA_InitStructure);
+  DMA_ITConfig(SPIBUS_DMA_RX_STREAM, DMA_IT_TC | DMA_IT_TE, ENABLE);
+
+  DMA_Cmd(SPIBUS_DMA_TX_STREAM, DISABLE);
+  DMA_DeInit(SPIBUS_DMA_TX_STREAM);
+  DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+  DMA_Init(SPIBUS_DMA_TX_STREAM, &DMA_InitStructure);
+
+  //The receive stream completes last: its interrupt ends the transfer
+  NVIC_InitStructure.NVIC_IRQChannel = SPIBUS_DMA_RX_IRQn;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = SPIBUS_DMA_IRQ_PRIORITY;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+}
+#endif
+
+void spiBusInit(void)
+{
+  if(isInit)
+    return;
+
+  SPI1_Init();
+  busMutex = STATIC_MEM_MUTEX_CREATE(busMutex);
+#ifdef SPI_BUS_DMA
+  spiBusDmaInit();
+#endif
+
+  //Cycle counter of the busy time
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  isInit = true;
+}
+
+bool spiBusTest(void)
+{
+  return isInit;
+}
+
+/* Clock and mode of the device, the bus is idle */
+static void spiBusConfigure(const spiBusProfile_t * profile, uint8_t flags)
+{
+  uint16_t div = (flags & SPI_BUS_FAST) ? profile->fastDiv : profile->div;
+  uint16_t cr1 = spiBusPrescaler(div) | profile->mode;
+
+  if ((MPU9250_SPI->CR1 & CR1_PROFILE) == cr1)
+    return;
+
+  //BR, CPOL and CPHA can only be changed with SPE off, the bus idle
+  while (SPI_I2S_GetFlagStatus(MPU9250_SPI, SPI_I2S_FLAG_BSY) == SET);
+  MPU9250_SPI->CR1 &= ~SPI_CR1_SPE;
+  MPU9250_SPI->CR1 = (MPU9250_SPI->CR1 & ~CR1_PROFILE) | cr1;
+  MPU9250_SPI->CR1 |= SPI_CR1_SPE;
+}
+
+static void spiBusPoll(const uint8_t * tx, uint8_t * rx, uint32_t len)
+{
+  uint32_t i;
+
+  for (i=0; i<len; i++)
+  {
+    uint8_t in = SPI1_RW(tx ? tx[i] : 0x00);
+
+    if (rx)
+      rx[i] = in;
+  }
+}
+
+#ifdef SPI_BUS_DMA
+static bool spiBusDmaUsable(const spiBusTransaction_t * t)
+{
+  return t->len >= SPI_BUS_DMA_MIN_SIZE &&
+         xTaskGetSchedulerState() == taskSCHEDULER_RUNNING &&
+         !(t->tx && inCcm(t->tx, t->len)) && !(t->rx && inCcm(t->rx, t->len));
+}
+
+static bool spiBusDma(const uint8_t * tx, uint8_t * rx, uint32_t len)
+{
+  bool ok;
+
+  transferError = false;
+  xSemaphoreTake(doneEvent, 0);
+
+  //Addresses and increments can only be changed with the streams off
+  SPIBUS_DMA_RX_STREAM->M0AR = rx ? (uint32_t)rx : (uint32_t)&rxDrop;
+  SPIBUS_DMA_RX_STREAM->NDTR = len;
+  if (rx)
+    SPIBUS_DMA_RX_STREAM->CR |= DMA_SxCR_MINC;
+  else
+    SPIBUS_DMA_RX_STREAM->CR &= ~DMA_SxCR_MINC;
+
+  SPIBUS_DMA_TX_STREAM->M0AR = tx ? (uint32_t)tx : (uint32_t)&txZero;
+  SPIBUS_DMA_TX_STREAM->NDTR = len;
+  if (tx)
+    SPIBUS_DMA_TX_STREAM->CR |= DMA_SxCR_MINC;
+  else
+    SPIBUS_DMA_TX_STREAM->CR &= ~DMA_SxCR_MINC;
+
+  DMA_ClearFlag(SPIBUS_DMA_RX_STREAM, SPIBUS_DMA_RX_FLAG_ALL);
+  DMA_ClearFlag(SPIBUS_DMA_TX_STREAM, SPIBUS_DMA_TX_FLAG_ALL);
+
+  //Receive side first, so that no byte is missed
+  SPI_I2S_DMACmd(MPU9250_SPI, SPI_I2S_DMAReq_Rx, ENABLE);
+  DMA_Cmd(SPIBUS_DMA_RX_STREAM, ENABLE);
+  DMA_Cmd(SPIBUS_DMA_TX_STREAM, ENABLE);
+  SPI_I2S_DMACmd(MPU9250_SPI, SPI_I2S_DMAReq_Tx, ENABLE);
+
+  ok = xSemaphoreTake(doneEvent, M2T(SPI_BUS_TIMEOUT_MS)) == pdTRUE && !transferError;
+
+  SPI_I2S_DMACmd(MPU9250_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, DISABLE);
+  if (!ok)
+  {
+    DMA_Cmd(SPIBUS_DMA_TX_STREAM, DISABLE);
+    DMA_Cmd(SPIBUS_DMA_RX_STREAM, DISABLE);
+    while (DMA_GetCmdStatus(SPIBUS_DMA_TX_STREAM) != DISABLE ||
+           DMA_GetCmdStatus(SPIBUS_DMA_RX_STREAM) != DISABLE);
+    stats.errors++;
+  }
+  else
+    stats.dmaTransfers++;
+
+  //The last byte received, the bus goes idle
+  while (SPI_I2S_GetFlagStatus(MPU9250_SPI, SPI_I2S_FLAG_BSY) == SET);
+
+  return ok;
+}
+#endif
+
+static bool spiBusRunOne(const spiBusTransaction_t * t)
+{
+  const spiBusProfile_t * profile = &profiles[t->device];
+  spiBusDeviceStats_t * s = &stats.device[t->device];
+  uint32_t start;
+  bool ok = true;
+
+  spiBusConfigure(profile, t->flags);
+
+  start = DWT->CYCCNT;
+  GPIO_ResetBits(profile->csPort, profile->csPin);
+
+  spiBusPoll(t->cmd, NULL, t->cmdLen);
+#ifdef SPI_BUS_DMA
+  if (spiBusDmaUsable(t))
+    ok = spiBusDma(t->tx, t->rx, t->len);
+  else
+#endif
+    spiBusPoll(t->tx, t->rx, t->len);
+
+  GPIO_SetBits(profile->csPort, profile->csPin);
+
+  s->busyCycles += DWT->CYCCNT - start;
+  s->transactions++;
+  s->bytes += t->cmdLen + t->len;
+
+  return ok;
+}
+
+bool spiBusRun(const spiBusTransaction_t * t, uint32_t count)
+{
+  bool locked = xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+  bool ok = true;
+  uint32_t i;
+
+  if (locked && xSemaphoreTake(busMutex, 0) != pdTRUE)
+  {
+    stats.waits++;
+    xSemaphoreTake(busMutex, portMAX_DELAY);
+  }
+
+  for (i=0; i<count; i++)
+  {
+    if (t[i].device < SPI_BUS_DEVICES && t[i].cmdLen <= SPI_BUS_CMD_MAX)
+      ok &= spiBusRunOne(&t[i]);
+  }
+
+  if (locked)
+    xSemaphoreGive(busMutex);
+
+  return ok;
+}
+
+bool spiBusTransfer(uint8_t device, uint8_t flags, uint8_t cmd,
+                    const uint8_t * tx, uint8_t * rx, uint16_t len)
+{
+  spiBusTransaction_t t;
+
+  t.device = device;
+  t.flags = flags;
+  t.cmdLen = 1;
+  t.cmd[0] = cmd;
+  t.tx = tx;
+  t.rx = rx;
+  t.len = len;
+
+  return spiBusRun(&t, 1);
+}
+
+void spiBusGetStats(spiBusStats_t * s)
+{
+  *s = stats;
+}
+
+/*************************************************************************
+ *@brief  receive complete or error: wake up the task in spiBusDma()
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void spiBusDmaIsr(void)
+{
+#ifdef SPI_BUS_DMA
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  if (DMA_GetFlagStatus(SPIBUS_DMA_RX_STREAM, SPIBUS_DMA_RX_FLAG_TEIF) != RESET)
+    transferError = true;
+  else if (DMA_GetFlagStatus(SPIBUS_DMA_RX_STREAM, SPIBUS_DMA_RX_FLAG_TCIF) == RESET)
+    return;
+
+  DMA_ClearFlag(SPIBUS_DMA_RX_STREAM, SPIBUS_DMA_RX_FLAG_ALL);
+  xSemaphoreGiveFromISR(doneEvent, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+#endif
+}
+
+LOG_GROUP_START(spiBus)
+LOG_ADD(LOG_UINT32, icmCycles, &stats.device[SPI_BUS_ICM20601].busyCycles)
+LOG_ADD(LOG_UINT32, magCycles, &stats.device[SPI_BUS_HMC5983].busyCycles)
+LOG_ADD(LOG_UINT32, baroCycles, &stats.device[SPI_BUS_MS5611].busyCycles)
+LOG_ADD(LOG_UINT32, mpuCycles, &stats.device[SPI_BUS_MPU9250].busyCycles)
+LOG_ADD(LOG_UINT32, dma, &stats.dmaTransfers)
+LOG_ADD(LOG_UINT32, errors, &stats.errors)
+LOG_ADD(LOG_UINT32, waits, &stats.waits)
+LOG_GROUP_STOP(spiBus)
@@ -0,0 +1,193 @@
+/**
+******************************************************************************
+* @file    UartDma.c
+* @brief   DMA driven transmit ring buffer of the console UART (PRINTF_COM1)
+******************************************************************************
+* The producers copy their bytes in the ring with the interrupts masked for
+* the duration of the copy only, then start the DMA if it is idle. The DMA
+* transfer complete interrupt releases the sent bytes and restarts the DMA
+* on the next contiguous chunk. No producer ever waits for the UART, unless
+* the UART_TX_BLOCK policy is selected.
+******************************************************************************
+*/
+#include "UartDma.h"
+
+static bool isInit = false;
+
+static uint8_t txBuffer[UART_TX_BUFFER_SIZE];
+static volatile uint32_t txHead;      // next byte to write
+static volatile uint32_t txTail;      // next byte to send
+static volatile uint32_t dmaLength;   // bytes of the running transfer, 0 when idle
+
+static UartTxOverflow overflowPolicy = UART_TX_DROP_TAIL;
+static UartTxStats stats;
+
+/* Start a transfer on the contiguous part of the ring. Interrupts masked. */
+static void uartDmaStart(void)
+{
+  uint32_t tail = txTail & (UART_TX_BUFFER_SIZE-1);
+  uint32_t len = txHead - txTail;
+
+  if (len > UART_TX_BUFFER_SIZE - tail)
+    len = UART_TX_BUFFER_SIZE - tail;
+
+  dmaLength = len;
+  if (len == 0)
+    return;
+
+  DMA_ClearFlag(PRINTF_COM1_TX_DMA_STREAM, PRINTF_COM1_TX_DMA_FLAG_ALL);
+  PRINTF_COM1_TX_DMA_STREAM->M0AR = (uint32_t)&txBuffer[tail];
+  PRINTF_COM1_TX_DMA_STREAM->NDTR = len;
+  DMA_Cmd(PRINTF_COM1_TX_DMA_STREAM, ENABLE);
+}
+
+void uartDmaInit(void)
+{
+  DMA_InitTypeDef  DMA_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  if(isInit)
+    return;
+
+  RCC_AHB1PeriphClockCmd(PRINTF_COM1_TX_DMA_CLK, ENABLE);
+
+  DMA_Cmd(PRINTF_COM1_TX_DMA_STREAM, DISABLE);
+  DMA_DeInit(PRINTF_COM1_TX_DMA_STREAM);
+
+  DMA_InitStructure.DMA_Channel = PRINTF_COM1_TX_DMA_CHANNEL;
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&PRINTF_COM1->DR;
+  DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)txBuffer;
+  DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+  DMA_InitStructure.DMA_BufferSize = 1;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+  DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+  DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_Full;
+  DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+  DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+  DMA_Init(PRINTF_COM1_TX_DMA_STREAM, &DMA_InitStructure);
+  DMA_ITConfig(PRINTF_COM1_TX_DMA_STREAM, DMA_IT_TC, ENABLE);
+
+  NVIC_InitStructure.NVIC_IRQChannel = PRINTF_COM1_TX_DMA_IRQn;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = UART_TX_IRQ_PRIORITY;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+
+  //Wait for a byte sent by polling before to hand the UART to the DMA
+  while (USART_GetFlagStatus(PRINTF_COM1, USART_FLAG_TC) == RESET);
+  USART_DMACmd(PRINTF_COM1, USART_DMAReq_Tx, ENABLE);
+
+  isInit = true;
+}
+
+bool uartDmaTest(void)
+{
+  return isInit;
+}
+
+uint32_t uartDmaWrite(const uint8_t * data, uint32_t len)
+{
+  uint32_t mask;
+  uint32_t head;
+  uint32_t room;
+  uint32_t n = 0;
+  uint32_t i;
+
+  if (!isInit)
+  {
+    //Before uartDmaInit: polled output as the original retarget did
+    for (i=0; i<len; i++)
+    {
+      USART_SendData(PRINTF_COM1, data[i]);
+      while (USART_GetFlagStatus(PRINTF_COM1, USART_FLAG_TC) == RESET);
+    }
+    return len;
+  }
+
+  while (1)
+  {
+    mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    head = txHead;
+    room = UART_TX_BUFFER_SIZE - (head - txTail);
+
+    if (room >= len - n || overflowPolicy == UART_TX_DROP_TAIL ||
+        (overflowPolicy == UART_TX_BLOCK && room > 0))
+    {
+      uint32_t chunk = (len - n < room) ? len - n : room;
+
+      for (i=0; i<chunk; i++)
+        txBuffer[(head + i) & (UART_TX_BUFFER_SIZE-1)] = data[n + i];
+      txHead = head + chunk;
+      n += chunk;
+      stats.bytesQueued += chunk;
+
+      if (txHead - txTail > stats.maxUsed)
+        stats.maxUsed = txHead - txTail;
+      if (dmaLength == 0)
+        uartDmaStart();
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    if (n == len)
+      break;
+
+    //Not enough room left
+    if (overflowPolicy == UART_TX_BLOCK && !(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) &&
+        xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    {
+      vTaskDelay(1);
+      continue;
+    }
+
+    mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    stats.overflows++;
+    stats.bytesDropped += len - n;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+    break;
+  }
+
+  return n;
+}
+
+int uartDmaPutchar(int ch)
+{
+  uint8_t c = (uint8_t)ch;
+
+  return uartDmaWrite(&c, 1) ? ch : -1;
+}
+
+void uartDmaSetOverflowPolicy(UartTxOverflow policy)
+{
+  overflowPolicy = policy;
+}
+
+void uartDmaGetStats(UartTxStats * s)
+{
+  *s = stats;
+}
+
+/*************************************************************************
+ *@brief  transfer complete: release the sent bytes and send the next chunk
+ *@param  None
+ *@retval None
+ *************************************************************************/
+void uartDmaIsr(void)
+{
+  uint32_t mask;
+
+  if (DMA_GetFlagStatus(PRINTF_COM1_TX_DMA_STREAM, PRINTF_COM1_TX_DMA_FLAG_TCIF) == RESET)
+    return;
+
+  DMA_ClearFlag(PRINTF_COM1_TX_DMA_STREAM, PRINTF_COM1_TX_DMA_FLAG_TCIF);
+
+  mask = portSET_INTERRUPT_MASK_FROM_ISR();
+  stats.bytesSent += dmaLength;
+  txTail += dmaLength;
+  uartDmaStart();
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
@@ -1,74 +1,45 @@
+/**
+ * malloc.h - Memory pools
+ *
+ * mymalloc()/myfree()/myrealloc() allocate from a static pool with the TLSF
+ * allocator (tlsf.h): constant time whatever the pool state, where the
+ * previous allocator scanned a block table linearly.
+ *
+ * Task safe: the scheduler is suspended around the pool operations, as the
+ * FreeRTOS heap_4 does. Not callable from an interrupt.
+ */
 #ifndef __MALLOC_H
 #define __MALLOC_H
-//////////////////////////////////////////////////////////////////////////////////	 
-//ֻѧϰʹãδɣκ;
-//ALIENTEKսSTM32
-//ڴ 	   
-//ԭ@ALIENTEK
-//̳:www.openedv.com
-//޸:2012/9/16
-//汾V1.0
-//ȨУؾ
-//Copyright(C) ӿƼ޹˾ 2009-2019
-//All rights reserved									  
-//////////////////////////////////////////////////////////////////////////////////
-#include "main.h"
 
-//typedef unsigned long  u32;
-//typedef unsigned short u16;
-//typedef unsigned char  u8;	  
+#include <stdint.h>
+
+#include "tlsf.h"
+#include "memops.h"
+
 #ifndef NULL
 #define NULL 0
 #endif
 
-#define SRAMIN	0	//ڲڴ
-#define SRAMEX  1	//ⲿڴ
+#define SRAMIN	0	// Internal SRAM pool
+#define SRAMEX  1	// External SRAM pool, not fitted
+#define MEM_POOLS   1
 
+#define MEM1_MAX_SIZE   (40*1024)   // Internal pool size
 
-//mem1ڴ趨.mem1ȫڲSRAM
-#define MEM1_BLOCK_SIZE			32  	  						//ڴСΪ32ֽ
-#define MEM1_MAX_SIZE			40*1024  						//ڴ 40K
-#define MEM1_ALLOC_TABLE_SIZE	MEM1_MAX_SIZE/MEM1_BLOCK_SIZE 	//ڴС
+/* Pools are initialised on first use, mem_init() empties a pool */
+void mem_init(uint8_t memx);
+/* Offset of the block in the pool, 0XFFFFFFFF on failure */
+uint32_t mem_malloc(uint8_t memx,uint32_t size);
+/* 0: freed, 2: offset out of the pool */
+uint8_t mem_free(uint8_t memx,uint32_t offset);
+/* Pool usage in percent, headers included */
+uint8_t mem_perused(uint8_t memx);
+/* Usage, peak, largest free block and fragmentation of a pool */
+void mem_stats(uint8_t memx,tlsfStats_t *stats);
 
-//mem2ڴ趨.mem2ڴشⲿSRAM,ĴڲSRAM
-#define MEM2_BLOCK_SIZE			32  	  						//ڴСΪ32ֽ
-#define MEM2_MAX_SIZE			10*1024  						//ڴ200K
-#define MEM2_ALLOC_TABLE_SIZE	MEM2_MAX_SIZE/MEM2_BLOCK_SIZE 	//ڴС
-		 
-		 
-//ڴ
-struct _m_mallco_dev
-{
-	void (*init)(uint8_t);					//ʼ
-	uint8_t (*perused)(uint8_t);		  	    	//ڴʹ
-	uint8_t 	*membase[1];					//ڴ 2ڴ
-	uint16_t *memmap[1]; 					//ڴ״̬
-	uint8_t  memrdy[1]; 						//ڴǷ
-};
-extern struct _m_mallco_dev mallco_dev;	 //mallco.c涨
+void myfree(uint8_t memx,void *ptr);
+void *mymalloc(uint8_t memx,uint32_t size);
+/* Grows in place when the memory after the block is free, else moves it */
+void *myrealloc(uint8_t memx,void *ptr,uint32_t size);
 
-void mymemset(void *s,uint8_t c,uint32_t count);	 //ڴ
-void mymemcpy(void *des,void *src,uint32_t n);//ڴ     
-void mem_init(uint8_t memx);					 //ڴʼ(/ڲ)
-uint32_t mem_malloc(uint8_t memx,uint32_t size);		 //ڴ(ڲ)
-uint8_t mem_free(uint8_t memx,uint32_t offset);		 //ڴͷ(ڲ)
-uint8_t mem_perused(uint8_t memx);				 //ڴʹ(/ڲ) 
-////////////////////////////////////////////////////////////////////////////////
-//ûú
-void myfree(uint8_t memx,void *ptr);  			//ڴͷ(ⲿ)
-void *mymalloc(uint8_t memx,uint32_t size);			//ڴ(ⲿ)
-void *myrealloc(uint8_t memx,void *ptr,uint32_t size);//·ڴ(ⲿ)
 #endif
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -0,0 +1,20 @@
+/**
+ * memops.h - Word wide memory copy and fill
+ *
+ * mymemcpy()/mymemset() move four words per loop once the destination is
+ * word aligned. A source with another alignment is read with unaligned word
+ * loads, which the Cortex-M4 does in one access.
+ *
+ * No dependency on the RTOS or the hardware: also built in the host
+ * benchmark (Tools/memops_bench). Large copies can go to the DMA instead,
+ * see MemDma.h.
+ */
+#ifndef __MEMOPS_H
+#define __MEMOPS_H
+
+#include <stdint.h>
+
+void mymemcpy(void *des,const void *src,uint32_t n);
+void mymemset(void *s,uint8_t c,uint32_t count);
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * tlsf.h - Two-Level Segregated Fit allocator
+ *
+ * Free blocks are kept in lists indexed by size: the first level is the
+ * power of two of the size, the second level splits each power of two in
+ * TLSF_SL_COUNT ranges. Two bitmaps tell which lists are not empty, so a
+ * fitting block is found with two count-leading-zeros instructions:
+ * allocation and free run in constant time, whatever the pool state.
+ *
+ * Each block has a two word header (previous physical block, size), free
+ * blocks also hold their list links. Adjacent free blocks are merged on
+ * free.
+ *
+ * No locking and no dependency on the RTOS or the hardware: malloc.c adds
+ * the locking, the host benchmark (Tools/malloc_bench) uses it as is.
+ */
+#ifndef __TLSF_H__
+#define __TLSF_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TLSF_ALIGN_LOG2   3                            // 8 bytes aligned blocks
+#define TLSF_ALIGN        (1 << TLSF_ALIGN_LOG2)
+#define TLSF_SL_LOG2      3
+#define TLSF_SL_COUNT     (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT     (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_FL_MAX_LOG2  17                           // Pools up to 128KB
+#define TLSF_FL_COUNT     (TLSF_FL_MAX_LOG2 - TLSF_FL_SHIFT + 1)
+
+typedef struct tlsfBlock_s
+{
+  struct tlsfBlock_s * prevPhys;   // Previous block in memory
+  size_t size;                     // Payload bytes, bit 0 set when free
+  struct tlsfBlock_s * nextFree;   // Free blocks only, in the payload
+  struct tlsfBlock_s * prevFree;
+} tlsfBlock_t;
+
+typedef struct
+{
+  uint32_t flBitmap;
+  uint32_t slBitmap[TLSF_FL_COUNT];
+  tlsfBlock_t * blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+  size_t poolSize;                 // Payload bytes of the pool when empty
+  size_t used;                     // Bytes of the used blocks, headers included
+  size_t peak;
+  uint32_t freeBlocks;
+  uint32_t allocations;
+  uint32_t failures;
+} tlsf_t;
+
+typedef struct
+{
+  size_t size;                     // Pool size, headers included
+  size_t used;
+  size_t peak;
+  size_t free;
+  size_t largestFree;              // Largest free block
+  uint32_t freeBlocks;
+  uint32_t allocations;            // Blocks allocated now
+  uint32_t failures;
+  uint8_t fragmentation;           // 100 * (1 - largestFree / free)
+} tlsfStats_t;
+
+/* Set up a pool, returns 0 if the memory is too small or too large */
+int tlsfInit(tlsf_t * tlsf, void * mem, size_t bytes);
+
+void * tlsfMalloc(tlsf_t * tlsf, size_t size);
+void tlsfFree(tlsf_t * tlsf, void * ptr);
+
+/* Grows in place into a following free block when possible */
+void * tlsfRealloc(tlsf_t * tlsf, void * ptr, size_t size);
+
+/* Usable size of an allocated block */
+size_t tlsfBlockSize(const void * ptr);
+
+/* Not constant time: walks the largest non empty list only */
+void tlsfGetStats(tlsf_t * tlsf, tlsfStats_t * stats);
+
+#endif //__TLSF_H__
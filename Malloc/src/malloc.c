@@ -1,183 +1,159 @@
-#include "malloc.h"	
+/**
+ * malloc.c - Memory pools on the TLSF allocator
+ *
+ * Keeps the ALIENTEK memory management API (mymalloc(SRAMIN, size)...) used
+ * by FatFs for its long file name buffers.
+ */
 #include <stdbool.h>
 #include <stdint.h>
-//////////////////////////////////////////////////////////////////////////////////	 
-//ֻѧϰʹãδɣκ;
-//ALIENTEKսSTM32
-//ڴ 	   
-//ԭ@ALIENTEK
-//̳:www.openedv.com
-//޸:2012/9/16
-//汾V1.0
-//ȨУؾ
-//Copyright(C) ӿƼ޹˾ 2009-2019
-//All rights reserved									  
-//////////////////////////////////////////////////////////////////////////////////
-
-//ڴ(4ֽڶ)__align(4) __align(4)__no_init__no_init  
-#pragma pack(push) //״̬ 
-#pragma pack(4)//趨Ϊ4ֽڶ  
-uint8_t mem1base[MEM1_MAX_SIZE];									//ڲSRAMڴ
-//uint8_t mem2base[MEM2_MAX_SIZE] @(0X68000000+MEM2_MAX_SIZE);		//ⲿSRAMڴ
-#pragma pack(pop)//ָ״̬
-//ڴ
-uint16_t mem1mapbase[MEM1_ALLOC_TABLE_SIZE];													//ڲSRAMڴMAP
-//uint16_t mem2mapbase[MEM2_ALLOC_TABLE_SIZE] @(0X68000000+MEM2_MAX_SIZE);	//ⲿSRAMڴMAP
-//ڴ	   
-const uint32_t memtblsize[2]={MEM1_ALLOC_TABLE_SIZE,MEM2_ALLOC_TABLE_SIZE};		//ڴС
-const uint32_t memblksize[2]={MEM1_BLOCK_SIZE,MEM2_BLOCK_SIZE};					//ڴֿС
-const uint32_t memsize[2]={MEM1_MAX_SIZE,MEM2_MAX_SIZE};							//ڴܴС
-
-
-//ڴmem2base mem2mapbase
-struct _m_mallco_dev mallco_dev=
+
+#include "malloc.h"
+#include "main.h"
+
+typedef struct
+{
+  uint8_t *base;
+  uint32_t size;
+  tlsf_t tlsf;
+  bool isInit;
+} memPool_t;
+
+// Blocks are 8 bytes aligned: so is the pool
+static uint64_t mem1base[MEM1_MAX_SIZE / sizeof(uint64_t)];
+
+static memPool_t pools[MEM_POOLS] =
 {
-	mem_init,				//ڴʼ
-	mem_perused,			//ڴʹ
-	mem1base,		//ڴ
-	mem1mapbase,//ڴ״̬
-	0,  					//ڴδ
+  { (uint8_t *)mem1base, MEM1_MAX_SIZE },
 };
 
-//ڴ
-//*des:Ŀĵַ
-//*src:Դַ
-//n:ҪƵڴ泤(ֽΪλ)
-void mymemcpy(void *des,void *src,uint32_t n)  
-{  
-    uint8_t *xdes=des;
-	uint8_t *xsrc=src; 
-    while(n--)*xdes++=*xsrc++;  
-}  
-//ڴ
-//*s:ڴ׵ַ
-//c :Ҫõֵ
-//count:ҪõڴС(ֽΪλ)
-void mymemset(void *s,uint8_t c,uint32_t count)  
-{  
-    uint8_t *xs = s;  
-    while(count--)*xs++=c;  
-}	   
-//ڴʼ  
-//memx:ڴ
-void mem_init(uint8_t memx)  
-{  
-    mymemset(mallco_dev.memmap[memx], 0,memtblsize[memx]*2);//ڴ״̬  
-	mymemset(mallco_dev.membase[memx], 0,memsize[memx]);	//ڴ  
-	mallco_dev.memrdy[memx]=1;								//ڴʼOK  
-}  
-//ȡڴʹ
-//memx:ڴ
-//ֵ:ʹ(0~100)
-uint8_t mem_perused(uint8_t memx)  
-{  
-    uint32_t used=0;  
-    uint32_t i;  
-    for(i=0;i<memtblsize[memx];i++)  
-    {  
-        if(mallco_dev.memmap[memx][i])used++; 
-    } 
-    return (used*100)/(memtblsize[memx]);  
-}  
-//ڴ(ڲ)
-//memx:ڴ
-//size:ҪڴС(ֽ)
-//ֵ:0XFFFFFFFF,;,ڴƫƵַ 
-uint32_t mem_malloc(uint8_t memx,uint32_t size)  
-{  
-    signed long offset=0;  
-    uint16_t nmemb;	//Ҫڴ  
-	uint16_t cmemb=0;//ڴ
-    uint32_t i;  
-    if(!mallco_dev.memrdy[memx])mallco_dev.init(memx);//δʼ,ִгʼ 
-    if(size==0)return 0XFFFFFFFF;//Ҫ
-    nmemb=size/memblksize[memx];  	//ȡҪڴ
-    if(size%memblksize[memx])nmemb++;  
-    for(offset=memtblsize[memx]-1;offset>=0;offset--)//ڴ  
-    {     
-		if(!mallco_dev.memmap[memx][offset])cmemb++;//ڴ
-		else cmemb=0;								//ڴ
-		if(cmemb==nmemb)							//ҵnmembڴ
-		{
-            for(i=0;i<nmemb;i++)  					//עڴǿ 
-            {  
-                mallco_dev.memmap[memx][offset+i]=nmemb;  
-            }  
-            return (offset*memblksize[memx]);//ƫƵַ  
-		}
-    }  
-    return 0XFFFFFFFF;//δҵϷڴ  
-}  
-//ͷڴ(ڲ) 
-//memx:ڴ
-//offset:ڴַƫ
-//ֵ:0,ͷųɹ;1,ͷʧ;  
-uint8_t mem_free(uint8_t memx,uint32_t offset)  
-{  
-    int i;  
-    if(!mallco_dev.memrdy[memx])//δʼ,ִгʼ
-	{
-		mallco_dev.init(memx);    
-        return 1;//δʼ  
-    }  
-    if(offset<memsize[memx])//ƫڴ. 
-    {  
-        int index=offset/memblksize[memx];			//ƫڴ  
-        int nmemb=mallco_dev.memmap[memx][index];	//ڴ
-        for(i=0;i<nmemb;i++)  						//ڴ
-        {  
-            mallco_dev.memmap[memx][index+i]=0;  
-        }  
-        return 0;  
-    }else return 2;//ƫƳ.  
-}  
-//ͷڴ(ⲿ) 
-//memx:ڴ
-//ptr:ڴ׵ַ 
-void myfree(uint8_t memx,void *ptr)  
-{  
-	u32 offset;  
-    if(ptr==NULL)return;//ַΪ0.  
- 	offset=(u32)ptr-(u32)mallco_dev.membase[memx];  
-    mem_free(memx,offset);//ͷڴ     
-}  
-//ڴ(ⲿ)
-//memx:ڴ
-//size:ڴС(ֽ)
-//ֵ:䵽ڴ׵ַ.
-void *mymalloc(uint8_t memx,uint32_t size)  
-{  
-    uint32_t offset;  									      
-	offset=mem_malloc(memx,size);  	   				   
-    if(offset==0XFFFFFFFF)return NULL;  
-    else return (void*)((u32)mallco_dev.membase[memx]+offset);  
-}  
-//·ڴ(ⲿ)
-//memx:ڴ
-//*ptr:ڴ׵ַ
-//size:ҪڴС(ֽ)
-//ֵ:·䵽ڴ׵ַ.
-void *myrealloc(uint8_t memx,void *ptr,uint32_t size)  
-{  
-    uint32_t offset;  
-    offset=mem_malloc(memx,size);  
-    if(offset==0XFFFFFFFF)return NULL;     
-    else  
-    {  									   
-	    mymemcpy((void*)((uint32_t)mallco_dev.membase[memx]+offset),ptr,size);	//ڴݵڴ   
-        myfree(memx,ptr);  											  		//ͷžڴ
-        return (void*)((uint32_t)mallco_dev.membase[memx]+offset);  				//ڴ׵ַ
-    }  
+static void memLock(void)
+{
+  vTaskSuspendAll();
+}
+
+static void memUnlock(void)
+{
+  xTaskResumeAll();
+}
+
+// Called locked
+static memPool_t *memPool(uint8_t memx)
+{
+  memPool_t *pool;
+
+  if (memx >= MEM_POOLS)
+    return NULL;
+
+  pool = &pools[memx];
+  if (!pool->isInit)
+    pool->isInit = tlsfInit(&pool->tlsf, pool->base, pool->size) != 0;
+
+  return pool->isInit ? pool : NULL;
+}
+
+void mem_init(uint8_t memx)
+{
+  if (memx >= MEM_POOLS)
+    return;
+
+  memLock();
+  pools[memx].isInit = false;
+  memPool(memx);
+  memUnlock();
+}
+
+uint8_t mem_perused(uint8_t memx)
+{
+  memPool_t *pool;
+  uint8_t perused = 0;
+
+  memLock();
+  pool = memPool(memx);
+  if (pool)
+    perused = (uint8_t)(pool->tlsf.used * 100 / pool->size);
+  memUnlock();
+
+  return perused;
+}
+
+void mem_stats(uint8_t memx,tlsfStats_t *stats)
+{
+  memPool_t *pool;
+
+  memLock();
+  pool = memPool(memx);
+  if (pool)
+    tlsfGetStats(&pool->tlsf, stats);
+  else
+    mymemset(stats, 0, sizeof(*stats));
+  memUnlock();
+}
+
+void *mymalloc(uint8_t memx,uint32_t size)
+{
+  memPool_t *pool;
+  void *ptr = NULL;
+
+  memLock();
+  pool = memPool(memx);
+  if (pool)
+    ptr = tlsfMalloc(&pool->tlsf, size);
+  memUnlock();
+
+  return ptr;
 }
 
+void myfree(uint8_t memx,void *ptr)
+{
+  memPool_t *pool;
 
+  if (ptr == NULL)
+    return;
 
+  memLock();
+  pool = memPool(memx);
+  if (pool && (uint8_t *)ptr >= pool->base && (uint8_t *)ptr < pool->base + pool->size)
+    tlsfFree(&pool->tlsf, ptr);
+  memUnlock();
+}
 
+void *myrealloc(uint8_t memx,void *ptr,uint32_t size)
+{
+  memPool_t *pool;
+  void *p = NULL;
 
+  memLock();
+  pool = memPool(memx);
+  if (pool)
+    p = tlsfRealloc(&pool->tlsf, ptr, size);
+  memUnlock();
 
+  return p;
+}
 
+uint32_t mem_malloc(uint8_t memx,uint32_t size)
+{
+  uint8_t *ptr = mymalloc(memx, size);
 
+  if (ptr == NULL)
+    return 0XFFFFFFFF;
 
+  return (uint32_t)(ptr - pools[memx].base);
+}
 
+uint8_t mem_free(uint8_t memx,uint32_t offset)
+{
+  if (memx >= MEM_POOLS || offset >= pools[memx].size)
+    return 2;
 
+  myfree(memx, pools[memx].base + offset);
+  return 0;
+}
 
+LOG_GROUP_START(malloc)
+LOG_ADD(LOG_UINT32, used, &pools[SRAMIN].tlsf.used)
+LOG_ADD(LOG_UINT32, peak, &pools[SRAMIN].tlsf.peak)
+LOG_ADD(LOG_UINT32, blocks, &pools[SRAMIN].tlsf.allocations)
+LOG_ADD(LOG_UINT32, freeBlks, &pools[SRAMIN].tlsf.freeBlocks)
+LOG_ADD(LOG_UINT32, fails, &pools[SRAMIN].tlsf.failures)
+LOG_GROUP_STOP(malloc)
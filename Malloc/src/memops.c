@@ -0,0 +1,104 @@
+/**
+ * memops.c - Word wide memory copy and fill
+ */
+#include <string.h>
+
+#include "memops.h"
+
+#if defined(__ICCARM__)
+  #define LOAD_UNALIGNED(P)  (*(__packed const uint32_t *)(P))
+#else
+  static inline uint32_t loadUnaligned(const uint8_t *p)
+  {
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+  }
+  #define LOAD_UNALIGNED(P)  loadUnaligned(P)
+#endif
+
+// Below this the alignment work costs more than it saves
+#define WORD_THRESHOLD  16
+
+void mymemcpy(void *des,const void *src,uint32_t n)
+{
+  uint8_t *d = des;
+  const uint8_t *s = src;
+  uint32_t *dw;
+
+  if (n >= WORD_THRESHOLD)
+  {
+    while ((uint32_t)(uintptr_t)d & 3)
+    {
+      *d++ = *s++;
+      n--;
+    }
+
+    dw = (uint32_t *)d;
+    if (((uint32_t)(uintptr_t)s & 3) == 0)
+    {
+      const uint32_t *sw = (const uint32_t *)s;
+
+      for (; n >= 16; n -= 16)
+      {
+        uint32_t a = sw[0], b = sw[1], c = sw[2], e = sw[3];
+        dw[0] = a; dw[1] = b; dw[2] = c; dw[3] = e;
+        dw += 4;
+        sw += 4;
+      }
+      for (; n >= 4; n -= 4)
+        *dw++ = *sw++;
+      s = (const uint8_t *)sw;
+    }
+    else
+    {
+      for (; n >= 16; n -= 16)
+      {
+        uint32_t a = LOAD_UNALIGNED(s), b = LOAD_UNALIGNED(s + 4);
+        uint32_t c = LOAD_UNALIGNED(s + 8), e = LOAD_UNALIGNED(s + 12);
+        dw[0] = a; dw[1] = b; dw[2] = c; dw[3] = e;
+        dw += 4;
+        s += 16;
+      }
+      for (; n >= 4; n -= 4)
+      {
+        *dw++ = LOAD_UNALIGNED(s);
+        s += 4;
+      }
+    }
+    d = (uint8_t *)dw;
+  }
+
+  while (n--)
+    *d++ = *s++;
+}
+
+void mymemset(void *s,uint8_t c,uint32_t count)
+{
+  uint8_t *d = s;
+  uint32_t *dw;
+  uint32_t w;
+
+  if (count >= WORD_THRESHOLD)
+  {
+    while ((uint32_t)(uintptr_t)d & 3)
+    {
+      *d++ = c;
+      count--;
+    }
+
+    w = c * 0x01010101u;
+    dw = (uint32_t *)d;
+    for (; count >= 16; count -= 16)
+    {
+      dw[0] = w; dw[1] = w; dw[2] = w; dw[3] = w;
+      dw += 4;
+    }
+    for (; count >= 4; count -= 4)
+      *dw++ = w;
+    d = (uint8_t *)dw;
+  }
+
+  while (count--)
+    *d++ = c;
+}
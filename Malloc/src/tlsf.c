@@ -0,0 +1,350 @@
+/**
+ * tlsf.c - Two-Level Segregated Fit allocator
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host benchmark (Tools/malloc_bench).
+ */
+#include <string.h>
+
+#include "tlsf.h"
+
+#if defined(__ICCARM__)
+  #include <intrinsics.h>
+  #define CLZ(X) __CLZ(X)
+#else
+  #define CLZ(X) __builtin_clz(X)
+#endif
+
+#define HEADER_SIZE     offsetof(tlsfBlock_t, nextFree)
+#define MIN_PAYLOAD     (sizeof(tlsfBlock_t) - HEADER_SIZE)
+#define SMALL_SIZE      (1u << TLSF_FL_SHIFT)
+#define FREE_BIT        ((size_t)1)
+
+#define BLOCK_SIZE(B)   ((B)->size & ~FREE_BIT)
+#define IS_FREE(B)      ((B)->size & FREE_BIT)
+#define PAYLOAD(B)      ((void *)((uint8_t *)(B) + HEADER_SIZE))
+#define FROM_PAYLOAD(P) ((tlsfBlock_t *)((uint8_t *)(P) - HEADER_SIZE))
+#define NEXT_PHYS(B)    ((tlsfBlock_t *)((uint8_t *)PAYLOAD(B) + BLOCK_SIZE(B)))
+
+/* Index of the most significant bit set, x != 0 */
+static inline int highBit(uint32_t x)
+{
+  return 31 - CLZ(x);
+}
+
+/* Index of the least significant bit set, x != 0 */
+static inline int lowBit(uint32_t x)
+{
+  return highBit(x & (0u - x));
+}
+
+static inline size_t alignUp(size_t x)
+{
+  return (x + TLSF_ALIGN - 1) & ~(size_t)(TLSF_ALIGN - 1);
+}
+
+/* List holding the blocks of that size */
+static void mappingInsert(size_t size, int * fl, int * sl)
+{
+  if (size < SMALL_SIZE)
+  {
+    *fl = 0;
+    *sl = (int)(size / (SMALL_SIZE / TLSF_SL_COUNT));
+  }
+  else
+  {
+    int f = highBit((uint32_t)size);
+    *sl = (int)(size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+    *fl = f - TLSF_FL_SHIFT + 1;
+  }
+}
+
+/* First list whose blocks are all large enough */
+static void mappingSearch(size_t size, int * fl, int * sl)
+{
+  if (size >= SMALL_SIZE)
+    size += ((size_t)1 << (highBit((uint32_t)size) - TLSF_SL_LOG2)) - 1;
+  mappingInsert(size, fl, sl);
+}
+
+static tlsfBlock_t * findSuitable(tlsf_t * tlsf, int * fl, int * sl)
+{
+  uint32_t slMap;
+  uint32_t flMap;
+
+  if (*fl >= TLSF_FL_COUNT)
+    return NULL;
+
+  slMap = tlsf->slBitmap[*fl] & (~0u << *sl);
+  if (!slMap)
+  {
+    flMap = *fl + 1 < 32 ? tlsf->flBitmap & (~0u << (*fl + 1)) : 0;
+    if (!flMap)
+      return NULL;
+    *fl = lowBit(flMap);
+    slMap = tlsf->slBitmap[*fl];
+  }
+  *sl = lowBit(slMap);
+
+  return tlsf->blocks[*fl][*sl];
+}
+
+static void removeFree(tlsf_t * tlsf, tlsfBlock_t * block)
+{
+  int fl, sl;
+
+  mappingInsert(BLOCK_SIZE(block), &fl, &sl);
+
+  if (block->nextFree)
+    block->nextFree->prevFree = block->prevFree;
+  if (block->prevFree)
+    block->prevFree->nextFree = block->nextFree;
+  else
+  {
+    tlsf->blocks[fl][sl] = block->nextFree;
+    if (!block->nextFree)
+    {
+      tlsf->slBitmap[fl] &= ~(1u << sl);
+      if (!tlsf->slBitmap[fl])
+        tlsf->flBitmap &= ~(1u << fl);
+    }
+  }
+  block->size &= ~FREE_BIT;
+  tlsf->freeBlocks--;
+}
+
+static void insertFree(tlsf_t * tlsf, tlsfBlock_t * block)
+{
+  int fl, sl;
+
+  mappingInsert(BLOCK_SIZE(block), &fl, &sl);
+
+  block->size |= FREE_BIT;
+  block->prevFree = NULL;
+  block->nextFree = tlsf->blocks[fl][sl];
+  if (block->nextFree)
+    block->nextFree->prevFree = block;
+  tlsf->blocks[fl][sl] = block;
+  tlsf->slBitmap[fl] |= 1u << sl;
+  tlsf->flBitmap |= 1u << fl;
+  tlsf->freeBlocks++;
+}
+
+/* Cut a used block to size, the end goes back to the free lists */
+static void trim(tlsf_t * tlsf, tlsfBlock_t * block, size_t size)
+{
+  tlsfBlock_t * rest;
+  tlsfBlock_t * next;
+
+  if (BLOCK_SIZE(block) < size + sizeof(tlsfBlock_t))
+    return;
+
+  rest = (tlsfBlock_t *)((uint8_t *)PAYLOAD(block) + size);
+  rest->size = BLOCK_SIZE(block) - size - HEADER_SIZE;
+  rest->prevPhys = block;
+  block->size = size;
+
+  //The block after may be free: merge
+  next = NEXT_PHYS(rest);
+  if (IS_FREE(next))
+  {
+    removeFree(tlsf, next);
+    rest->size += HEADER_SIZE + BLOCK_SIZE(next);
+    next = NEXT_PHYS(rest);
+  }
+  next->prevPhys = rest;
+  insertFree(tlsf, rest);
+}
+
+int tlsfInit(tlsf_t * tlsf, void * mem, size_t bytes)
+{
+  uint8_t * start = (uint8_t *)alignUp((size_t)mem);
+  tlsfBlock_t * block;
+  tlsfBlock_t * sentinel;
+  size_t size;
+
+  memset(tlsf, 0, sizeof(*tlsf));
+
+  bytes -= start - (uint8_t *)mem;
+  bytes &= ~(size_t)(TLSF_ALIGN - 1);
+  //First block header, sentinel header
+  if (bytes < 2 * HEADER_SIZE + MIN_PAYLOAD)
+    return 0;
+  size = bytes - 2 * HEADER_SIZE;
+  if (size >= ((size_t)1 << TLSF_FL_MAX_LOG2))
+    return 0;
+
+  block = (tlsfBlock_t *)start;
+  block->prevPhys = NULL;
+  block->size = size;
+
+  //Zero sized used block: the last block never has a free next
+  sentinel = NEXT_PHYS(block);
+  sentinel->prevPhys = block;
+  sentinel->size = 0;
+
+  insertFree(tlsf, block);
+  tlsf->poolSize = size;
+
+  return 1;
+}
+
+void * tlsfMalloc(tlsf_t * tlsf, size_t size)
+{
+  tlsfBlock_t * block;
+  int fl, sl;
+
+  if (size == 0)
+    return NULL;
+  if (size >= ((size_t)1 << TLSF_FL_MAX_LOG2))
+  {
+    tlsf->failures++;
+    return NULL;
+  }
+
+  size = alignUp(size);
+  if (size < MIN_PAYLOAD)
+    size = MIN_PAYLOAD;
+
+  mappingSearch(size, &fl, &sl);
+  block = findSuitable(tlsf, &fl, &sl);
+  if (!block)
+  {
+    tlsf->failures++;
+    return NULL;
+  }
+
+  removeFree(tlsf, block);
+  trim(tlsf, block, size);
+
+  tlsf->used += HEADER_SIZE + BLOCK_SIZE(block);
+  if (tlsf->used > tlsf->peak)
+    tlsf->peak = tlsf->used;
+  tlsf->allocations++;
+
+  return PAYLOAD(block);
+}
+
+void tlsfFree(tlsf_t * tlsf, void * ptr)
+{
+  tlsfBlock_t * block;
+  tlsfBlock_t * next;
+  tlsfBlock_t * prev;
+
+  if (!ptr)
+    return;
+
+  block = FROM_PAYLOAD(ptr);
+  tlsf->used -= HEADER_SIZE + BLOCK_SIZE(block);
+  tlsf->allocations--;
+
+  next = NEXT_PHYS(block);
+  if (IS_FREE(next))
+  {
+    removeFree(tlsf, next);
+    block->size += HEADER_SIZE + BLOCK_SIZE(next);
+    next = NEXT_PHYS(block);
+    next->prevPhys = block;
+  }
+
+  prev = block->prevPhys;
+  if (prev && IS_FREE(prev))
+  {
+    removeFree(tlsf, prev);
+    prev->size += HEADER_SIZE + BLOCK_SIZE(block);
+    next->prevPhys = prev;
+    block = prev;
+  }
+
+  insertFree(tlsf, block);
+}
+
+void * tlsfRealloc(tlsf_t * tlsf, void * ptr, size_t size)
+{
+  tlsfBlock_t * block;
+  tlsfBlock_t * next;
+  size_t current;
+  void * p;
+
+  if (!ptr)
+    return tlsfMalloc(tlsf, size);
+  if (size == 0)
+  {
+    tlsfFree(tlsf, ptr);
+    return NULL;
+  }
+
+  if (size >= ((size_t)1 << TLSF_FL_MAX_LOG2))
+  {
+    tlsf->failures++;
+    return NULL;
+  }
+
+  block = FROM_PAYLOAD(ptr);
+  current = BLOCK_SIZE(block);
+  size = alignUp(size);
+  if (size < MIN_PAYLOAD)
+    size = MIN_PAYLOAD;
+
+  //Grow in place into the next block when it is free and large enough
+  next = NEXT_PHYS(block);
+  if (size > current && IS_FREE(next) && current + HEADER_SIZE + BLOCK_SIZE(next) >= size)
+  {
+    removeFree(tlsf, next);
+    block->size += HEADER_SIZE + BLOCK_SIZE(next);
+    NEXT_PHYS(block)->prevPhys = block;
+  }
+
+  if (BLOCK_SIZE(block) >= size)
+  {
+    tlsf->used -= HEADER_SIZE + current;
+    trim(tlsf, block, size);
+    tlsf->used += HEADER_SIZE + BLOCK_SIZE(block);
+    if (tlsf->used > tlsf->peak)
+      tlsf->peak = tlsf->used;
+    return ptr;
+  }
+
+  //Moved: only the old content is copied
+  p = tlsfMalloc(tlsf, size);
+  if (p)
+  {
+    memcpy(p, ptr, current);
+    tlsfFree(tlsf, ptr);
+  }
+
+  return p;
+}
+
+size_t tlsfBlockSize(const void * ptr)
+{
+  return ptr ? BLOCK_SIZE(FROM_PAYLOAD(ptr)) : 0;
+}
+
+void tlsfGetStats(tlsf_t * tlsf, tlsfStats_t * stats)
+{
+  tlsfBlock_t * block;
+  int fl, sl;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->size = tlsf->poolSize + HEADER_SIZE;
+  stats->used = tlsf->used;
+  stats->peak = tlsf->peak;
+  stats->free = stats->size - tlsf->used;
+  stats->freeBlocks = tlsf->freeBlocks;
+  stats->allocations = tlsf->allocations;
+  stats->failures = tlsf->failures;
+
+  if (tlsf->flBitmap)
+  {
+    fl = highBit(tlsf->flBitmap);
+    sl = highBit(tlsf->slBitmap[fl]);
+    for (block = tlsf->blocks[fl][sl]; block; block = block->nextFree)
+      if (BLOCK_SIZE(block) > stats->largestFree)
+        stats->largestFree = BLOCK_SIZE(block);
+  }
+
+  //Free space counted with the headers of the free blocks
+  if (stats->free)
+    stats->fragmentation = (uint8_t)(100 - (stats->largestFree + HEADER_SIZE) * 100 / stats->free);
+}
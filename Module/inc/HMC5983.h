@@ -79,14 +79,18 @@ typedef struct {
   Operating_Mode_TypeDef    MAG_Operate_Mode;
 } MAG_InitTypeDef;
 
+#define HMC5983_FIRST_SAMPLE_MS   5     // One period at DOR_220HZ
+#define HMC5983_GAUSS_PER_LSB     0.00152f  // Mag_Gain_2_5G
+#define HMC5983_OVERFLOW          (-4096)   // Value of an axis out of the gain range
+
 bool HMC5983_TestConnection( void );
 
 void HMC5983_Configure(void);
-void HMC5983_GetData( int16_t *dataIMU );
+int32_t HMC5983_InitStep(uint32_t step);
+void HMC5983_DrdyInit(void);
+bool HMC5983_IsDataReady(void);
+bool HMC5983_ReadRaw(int16_t *dataIMU);
 void HMC5983_GetFloatData( float *dataIMU );
-void HMC5983GetTreeAxisData( int16_t *mx,int16_t *my,int16_t *mz );
-void MagCorrect( float *dataIMU , float *CorrectDataIMU );
-void MagCorrectOffset( float *dataIMU , float *CorrectDataIMU );
 void HMC5983_SendData(float *dat);
 #ifdef __cplusplus
 }
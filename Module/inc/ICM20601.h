@@ -60,6 +60,14 @@ extern "C" {
 #define ICM20601_ZA_OFFSET_H            ((uint8_t)0x7D)  
 #define ICM20601_ZA_OFFSET_L            ((uint8_t)0x7E)
   
+/* Datasheet minimum times */
+#define ICM20601_STARTUP_MS       100   // Power up to register access
+#define ICM20601_RESET_MS         100   // Device reset to register access
+#define ICM20601_GYRO_STARTUP_MS  35    // Gyro on to valid samples
+
+/* Raw temperature to Celsius */
+#define ICM20601_TEMP_DEGC(raw)   (25.0f + (raw) / 326.8f)
+
 #define ICM20602_DEG_PER_LSB_250  (float)((2 * 250.0)  / 65536.0f)
 #define ICM20602_DEG_PER_LSB_500  (float)((2 * 500.0)  / 65536.0f)
 #define ICM20602_DEG_PER_LSB_1000 (float)((2 * 1000.0) / 65536.0f)
@@ -73,12 +81,15 @@ extern "C" {
 void ICM20601_WriteReg( uint8_t writeAddr, uint8_t writeData );
 uint8_t ICM20601_ReadReg( uint8_t readAddr );
 void ICM20601_WriteRegs( uint8_t writeAddr, uint8_t *writeData, uint8_t lens );
-void ICM20601_ReadRegs( uint8_t readAddr, uint8_t *readData, uint8_t lens );
+bool ICM20601_ReadRegs( uint8_t readAddr, uint8_t *readData, uint8_t lens );
 
 void ICM20601_Init( void );
+int32_t ICM20601_InitStep( uint32_t step );
 bool ICM20601_TestConnection( void );
 void ICM20601_GetFloatData( float *dataIMU );
-void ICM20601GetSixAxisData( int16_t *ax,int16_t *ay,int16_t *az,int16_t *gx,int16_t *gy,int16_t *gz );
+float ICM20601_GetTemperature( void );
+bool ICM20601GetSixAxisData( int16_t *ax,int16_t *ay,int16_t *az,int16_t *gx,int16_t *gy,int16_t *gz,
+                             int16_t *temp );
 #ifdef __cplusplus
 }
 #endif
@@ -97,6 +97,7 @@ typedef struct {
 #define MPU9250G_2000dps  ((float)0.060975609756f)  // 0.060975609756 dps/LSB
 
 #define MPU9250M_4800uT   ((float)0.6f)             // 0.6 uT/LSB
+#define MPU9250M_16BIT    ((float)0.15f)            // 0.15 uT/LSB, CNTL1 BIT set
 
 #define MPU9250T_85degC   ((float)0.002995177763f)  // 0.002995177763 degC/LSB
 
@@ -249,6 +250,17 @@ uint8_t MPU9250_Check( void );
 
 void MPU9250_Config( void );
 void MPU9250_getData( int16_t *dataIMU );
+
+/* ACCEL_XOUT_H to EXT_SENS_DATA_07: the 14 bytes of the MPU6500, then ST1
+ * to ST2 of the AK8963 */
+#define MPU9250_BURST_SIZE          22
+bool MPU9250_GetNineAxisData( int16_t *acc, int16_t *gyro, int16_t *mag, int16_t *temp );
+
+#define MPU9250_RESET_MS            100   // Device reset to register access
+#define MPU9250_GYRO_STARTUP_MS     35    // Gyro on to valid samples
+bool MPU9250_TestConnection( void );
+int32_t MPU9250_InitStep( uint32_t step );
+bool MPU9250_GetSixAxisData( int16_t *acc, int16_t *gyro );
 #ifdef __cplusplus
 }
 #endif
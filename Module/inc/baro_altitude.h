@@ -0,0 +1,34 @@
+/**
+ * baro_altitude.h - Pressure to altitude in single precision
+ *
+ * The altitude of the standard atmosphere at a fixed temperature, as the
+ * MS5611 driver computed it with the double pow():
+ *
+ *   h = ((p0 / p)^(1 / 5.25588) - 1) * T / 0.0065
+ *
+ * x^a is evaluated as 2^(a log2 p0 - a log2 p) with short series on the
+ * mantissa of p. 2^y - 1 is computed without the cancellation around y = 0:
+ * near the ground the altitude does not move by the 5 mm float steps of
+ * x^a - 1. One division, no double, no libm call.
+ *
+ * Error against the formula in long double (Tools/baro_bench): below 4 mm
+ * from 300 to 1100 mbar, below 1 cm from 10 to 1200 mbar, the range of the
+ * sensor. That is 2 to 3 float steps of the result, under the 0.012 mbar
+ * (10 cm) resolution of the MS5611 at OSR 4096. Has no dependency on the
+ * RTOS or the hardware.
+ */
+#ifndef __BARO_ALTITUDE_H__
+#define __BARO_ALTITUDE_H__
+
+#define BARO_SEA_PRESSURE     1015.7f       // mbar, p0
+#define BARO_TEMPERATURE      25.0f         // Celsius, fixed: see ms5611.c
+#define BARO_LAPSE_RATE       0.0065f       // K/m
+#define BARO_PRESSURE_FACTOR  0.1902630958f // 1 / 5.25588
+
+/**
+ * Altitude above BARO_SEA_PRESSURE in meters.
+ * @param pressure in mbar, 0 or below gives 0
+ */
+float baroPressureToAltitude(float pressure);
+
+#endif //__BARO_ALTITUDE_H__
@@ -70,6 +70,7 @@
 
 bool MS5611_Init();
 bool MS5611_SelfTest(void);
+void MS5611_Start(void);
 void MS5611_GetData(float* pressure, float* temperature, float* asl);
 
 #endif // MS5611_H
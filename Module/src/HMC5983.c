@@ -1,17 +1,6 @@
 #include "HMC5983.h"
 
 
-//float B[6] = {1.0119836225537   ,  0.00804477285115623 ,0.00718567847934233,
-//              0.980743846974053 , -0.043053987729707   ,1.00957192431739   };
-
-//תƽ̨
-#define MagOffsetX   -0.047030661217639
-#define MagOffsetY   -0.098843728296896
-#define MagOffsetZ   0
-
-float B[6] = {0.122158190704876   , 0.0328369577517874 ,0.237010139644319,
-              0.00882679899048001 , 0.0637099477107354 ,0.459844779708063};
-
 int16_t Xoffset,Yoffset,Zoffset;
 uint16_t Tag_Cnt=0;
 
@@ -23,43 +12,26 @@ union b2f
 
 void HMC5983_WriteReg( uint8_t writeAddr, uint8_t writeData )
 {
-  HMC5983_CS_LOW;
-  
-  SPI1_RW(writeAddr);
-  SPI1_RW(writeData);
-  
-  HMC5983_CS_HIGH;
+  spiBusTransfer(SPI_BUS_HMC5983, 0, writeAddr, &writeData, NULL, 1);
 }
 
 void HMC5983_WriteRegs( uint8_t writeAddr, uint8_t *writeData, uint8_t lens )
 {
-  HMC5983_CS_LOW;
-  
-  SPI1_RW(writeAddr|0x40);
-  for(uint8_t i = 0; i < lens; i++)
-    SPI1_RW(writeData[i]);
-  
-  HMC5983_CS_HIGH;
+  spiBusTransfer(SPI_BUS_HMC5983, 0, writeAddr|0x40, writeData, NULL, lens);
 }
 
 uint8_t HMC5983_ReadReg( uint8_t readAddr )
 {
   uint8_t readData = 0;
-  HMC5983_CS_LOW;
-  SPI1_RW(0x80 | readAddr);
-  readData = SPI1_RW(0x00);  
-  HMC5983_CS_HIGH;
+
+  spiBusTransfer(SPI_BUS_HMC5983, 0, 0x80 | readAddr, NULL, &readData, 1);
 
   return readData;
 }
 
 void HMC5983_ReadRegs(uint8_t readAddr, uint8_t *readData, uint8_t lens)
 {
-  HMC5983_CS_LOW;
-  SPI1_RW(0xC0 | readAddr);
-  for(uint8_t i = 0; i < lens; i++)
-    readData[i] = SPI1_RW(0x00);
-  HMC5983_CS_HIGH;
+  spiBusTransfer(SPI_BUS_HMC5983, 0, 0xC0 | readAddr, NULL, readData, lens);
 }
 
 bool HMC5983_TestConnection( void )
@@ -69,7 +41,7 @@ bool HMC5983_TestConnection( void )
   HMC5983_ReadRegs(IRA,deviceID,3);
   if(deviceID[0] != 'H' || deviceID[1] != '4' || deviceID[2] != '3')
   {
-    printf("HMC5983 ID=%d %d %d\n",deviceID[0],deviceID[1],deviceID[2]);
+    BPRINTF("HMC5983 ID=%d %d %d\n",deviceID[0],deviceID[1],deviceID[2]);
     return ERROR;
   }
   return SUCCESS;
@@ -105,67 +77,90 @@ void HMC5983_Configure(void)
   MAG_Init_Struct.MAG_Gain          = Mag_Gain_2_5G;
   MAG_Init_Struct.MAG_Operate_Mode  = ContinuousMeasurementMode;
   HMC5983_Init(&MAG_Init_Struct);
-  printf("HMC5983 Init ...");
+  BPRINTF("HMC5983 Init ...");
 }
 
-void HMC5983_GetInt16Data( int16_t *dataIMU )
+/**
+ * One step of the bring-up, for initseq.h: the configuration, then the
+ * first measurement, one period of the 220Hz output rate.
+ */
+int32_t HMC5983_InitStep(uint32_t step)
 {
-  uint8_t temp_data[6];
-  if(HMC5983_ReadReg(SR)&0x01)
+  if (step == 0)
   {
-    HMC5983_ReadRegs(DOMR_X,temp_data,6);
-    dataIMU[0] = Byte16(int16_t, temp_data[0],  temp_data[1]); // MAG.X
-    dataIMU[1] = Byte16(int16_t, temp_data[4],  temp_data[5]); // MAG.Y
-    dataIMU[2] = Byte16(int16_t, temp_data[2],  temp_data[3]); // MAG.Z
+    HMC5983_Configure();
+    return HMC5983_FIRST_SAMPLE_MS;
   }
+
+  return INIT_SEQ_DONE;
 }
 
-void HMC5983_GetFloatData( float *dataIMU )
+/**
+ * Enables the EXTI of DRDY, which goes low when a sample is ready: the data
+ * is read in one burst, without polling the status register.
+ */
+void HMC5983_DrdyInit(void)
 {
-  uint8_t temp_data[6];
-  uint8_t status;
-  status = HMC5983_ReadReg(SR);
-  if(status & 0x01)
-  {
-    HMC5983_ReadRegs(DOMR_X,temp_data,6);
-    dataIMU[0] = Byte16(int16_t, temp_data[0],  temp_data[1])*0.00152 ;  //MAG.X
-    dataIMU[1] = Byte16(int16_t, temp_data[4],  temp_data[5])*0.00152 ;  //MAG.Y
-    dataIMU[2] = Byte16(int16_t, temp_data[2],  temp_data[3])*0.00152 ;  //MAG.Z
-  }
+  GPIO_InitTypeDef GPIO_InitStructure;
+  EXTI_InitTypeDef EXTI_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+
+  RCC_AHB1PeriphClockCmd(HMC5983_DRDY_CLK, ENABLE);
+  RCC_APB2PeriphClockCmd(RCC_APB2Periph_SYSCFG, ENABLE);
+
+  GPIO_InitStructure.GPIO_Pin   = HMC5983_DRDY_PIN;
+  GPIO_InitStructure.GPIO_Mode  = GPIO_Mode_IN;
+  GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+  GPIO_InitStructure.GPIO_PuPd  = GPIO_PuPd_UP;
+  GPIO_Init(HMC5983_DRDY_PORT, &GPIO_InitStructure);
+
+  SYSCFG_EXTILineConfig(HMC5983_DRDY_SRC_PORT, HMC5983_DRDY_SRC_PIN);
+
+  EXTI_InitStructure.EXTI_Line    = HMC5983_DRDY_LINE;
+  EXTI_InitStructure.EXTI_Mode    = EXTI_Mode_Interrupt;
+  EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Falling;
+  EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+  EXTI_Init(&EXTI_InitStructure);
+
+  NVIC_InitStructure.NVIC_IRQChannel = HMC5983_DRDY_IRQn;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = HMC5983_DRDY_IRQ_PRIORITY;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
 }
 
-void HMC5983GetTreeAxisData( int16_t *mx,int16_t *my,int16_t *mz )
+/* For the boards without DRDY: one register read */
+bool HMC5983_IsDataReady(void)
 {
-  uint8_t temp_data[6];
-  uint8_t status;
-  status = HMC5983_ReadReg(SR);
-  if(status & 0x01)
-  {
-    HMC5983_ReadRegs(DOMR_X,temp_data,6);
-    *mx = Byte16(int16_t, temp_data[0],  temp_data[1]);  //MAG.X*0.00152 
-    *my = Byte16(int16_t, temp_data[4],  temp_data[5]);  //MAG.Y*0.00152 
-    *mz = Byte16(int16_t, temp_data[2],  temp_data[3]);  //MAG.Z*0.00152 
-  }
+  return (HMC5983_ReadReg(SR) & 0x01) != 0;
 }
 
-void MagCorrect( float *dataIMU , float *CorrectDataIMU )
+/**
+ * The sample in one burst of the data registers, X Z Y in the device.
+ * @return false when an axis overflowed the gain
+ */
+bool HMC5983_ReadRaw(int16_t *dataIMU)
 {
-  float temp[3];
-  
-  temp[0] = dataIMU[0]- MagOffsetX;
-  temp[1] = dataIMU[1]- MagOffsetY;
-  temp[2] = dataIMU[2]- MagOffsetZ;
-  
-  CorrectDataIMU[0] = B[0]*temp[0] + B[1]*temp[1] + B[2]*temp[2];
-  CorrectDataIMU[1] = B[1]*temp[0] + B[3]*temp[1] + B[4]*temp[2];
-  CorrectDataIMU[2] = B[2]*temp[0] + B[4]*temp[1] + B[5]*temp[2];
+  uint8_t temp_data[6];
+
+  HMC5983_ReadRegs(DOMR_X,temp_data,6);
+  dataIMU[0] = Byte16(int16_t, temp_data[0],  temp_data[1]); // MAG.X
+  dataIMU[1] = Byte16(int16_t, temp_data[4],  temp_data[5]); // MAG.Y
+  dataIMU[2] = Byte16(int16_t, temp_data[2],  temp_data[3]); // MAG.Z
+
+  return dataIMU[0] != HMC5983_OVERFLOW && dataIMU[1] != HMC5983_OVERFLOW &&
+         dataIMU[2] != HMC5983_OVERFLOW;
 }
 
-void MagCorrectOffset( float *dataIMU , float *CorrectDataIMU )
-{ 
-  CorrectDataIMU[0] = dataIMU[0] - MagOffsetX;
-  CorrectDataIMU[1] = dataIMU[1] - MagOffsetY;
-  CorrectDataIMU[2] = dataIMU[2] - MagOffsetZ;
+/* Gauss, uncalibrated. The hard and soft iron are learnt by mag_calib.c */
+void HMC5983_GetFloatData( float *dataIMU )
+{
+  int16_t raw[3];
+
+  HMC5983_ReadRaw(raw);
+  dataIMU[0] = raw[0] * HMC5983_GAUSS_PER_LSB;
+  dataIMU[1] = raw[1] * HMC5983_GAUSS_PER_LSB;
+  dataIMU[2] = raw[2] * HMC5983_GAUSS_PER_LSB;
 }
 
 void HMC5983_SendData(float *dat)
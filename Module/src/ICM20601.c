@@ -1,40 +1,40 @@
 #include "ICM20601.h"
 
+/* The sensor and interrupt registers can be read at 10MHz, the others at 1MHz */
+static uint8_t ICM20601_BusFlags( uint8_t readAddr, uint8_t lens )
+{
+  if (readAddr >= ICM20601_INT_STATUS && readAddr + lens - 1 <= ICM20601_GYRO_ZOUT_L)
+  {
+    return SPI_BUS_FAST;
+  }
+  return 0;
+}
+
 void ICM20601_WriteReg( uint8_t writeAddr, uint8_t writeData )
 {
-  MP9250_CS_LOW;
-  SPI1_RW(writeAddr);
-  SPI1_RW(writeData);
-  MP9250_CS_HIGH;
+  spiBusTransfer(SPI_BUS_ICM20601, 0, writeAddr, &writeData, NULL, 1);
 }
 
 uint8_t ICM20601_ReadReg( uint8_t readAddr )
 {
   uint8_t readData = 0;
-  MP9250_CS_LOW;
-  SPI1_RW(0x80 | readAddr);
-  readData = SPI1_RW(0x00);  
-  MP9250_CS_HIGH;
+
+  spiBusTransfer(SPI_BUS_ICM20601, ICM20601_BusFlags(readAddr, 1), 0x80 | readAddr,
+                 NULL, &readData, 1);
 
   return readData;
 }
 
 void ICM20601_WriteRegs(uint8_t writeAddr, uint8_t *writeData, uint8_t lens)
 {
-  MP9250_CS_LOW;
-  SPI1_RW(writeAddr);
-  for(uint8_t i = 0; i < lens; i++)
-    SPI1_RW(writeData[i]);
-  MP9250_CS_HIGH;
+  spiBusTransfer(SPI_BUS_ICM20601, 0, writeAddr, writeData, NULL, lens);
 }
 
-void ICM20601_ReadRegs(uint8_t readAddr, uint8_t *readData, uint8_t lens)
+/* false when the bus failed, readData is not valid then */
+bool ICM20601_ReadRegs(uint8_t readAddr, uint8_t *readData, uint8_t lens)
 {
-  MP9250_CS_LOW;
-  SPI1_RW(0x80 | readAddr);
-  for(uint8_t i = 0; i < lens; i++)
-    readData[i] = SPI1_RW(0x00);
-  MP9250_CS_HIGH;
+  return spiBusTransfer(SPI_BUS_ICM20601, ICM20601_BusFlags(readAddr, lens), 0x80 | readAddr,
+                        NULL, readData, lens);
 }
 
 bool ICM20601_TestConnection(void)
@@ -43,7 +43,7 @@ bool ICM20601_TestConnection(void)
   ID = ICM20601_ReadReg(ICM20601_WHO_AM_I);
   if(ID != 0x12)
   {
-    printf("ICM20601 ID=%d\n",ID);
+    BPRINTF("ICM20601 ID=%d\n",ID);
     return ERROR;
   }
   else
@@ -58,7 +58,7 @@ void ICM20601_GetFloatData( float *dataIMU )
 
   ICM20601_ReadRegs(ICM20601_ACCEL_XOUT_H, tmpRead, 14);
 
-  dataIMU[0] = 25.0f + (Byte16(int16_t, tmpRead[6],  tmpRead[7]))/326.8f;    // Temp
+  dataIMU[0] = ICM20601_TEMP_DEGC(Byte16(int16_t, tmpRead[6],  tmpRead[7]));    // Temp
   dataIMU[1] = (float)((Byte16(int16_t, tmpRead[0],  tmpRead[1])) /2048.0f);// Acc.X
   dataIMU[2] = (float)((Byte16(int16_t, tmpRead[2],  tmpRead[3])) /2048.0f);// Acc.Y
   dataIMU[3] = (float)((Byte16(int16_t, tmpRead[4],  tmpRead[5])) /2048.0f);// Acc.Z
@@ -67,11 +67,24 @@ void ICM20601_GetFloatData( float *dataIMU )
   dataIMU[6] = (float)((Byte16(int16_t, tmpRead[12], tmpRead[13]))/16.4f);//Gyr.Z 
 }
 
-void ICM20601GetSixAxisData(int16_t *ax,int16_t *ay,int16_t *az,int16_t *gx,int16_t *gy,int16_t *gz)
+float ICM20601_GetTemperature(void)
+{
+  uint8_t tmpRead[2];
+
+  ICM20601_ReadRegs(ICM20601_TEMP_OUT_H, tmpRead, 2);
+
+  return ICM20601_TEMP_DEGC(Byte16(int16_t, tmpRead[0], tmpRead[1]));
+}
+
+/* temp: the raw temperature of the same burst, ICM20601_TEMP_DEGC(), or NULL.
+ * false when the read failed, the outputs are left as they were */
+bool ICM20601GetSixAxisData(int16_t *ax,int16_t *ay,int16_t *az,int16_t *gx,int16_t *gy,int16_t *gz,
+                            int16_t *temp)
 {
   uint8_t tmpRead[14];
 
-  ICM20601_ReadRegs(ICM20601_ACCEL_XOUT_H, tmpRead, 14);
+  if (!ICM20601_ReadRegs(ICM20601_ACCEL_XOUT_H, tmpRead, 14))
+    return false;
 
   *ax  = Byte16(int16_t, tmpRead[0],  tmpRead[1]) ;// Acc.X /2048.0f
   *ay  = Byte16(int16_t, tmpRead[2],  tmpRead[3]) ;// Acc.Y /2048.0f
@@ -79,6 +92,11 @@ void ICM20601GetSixAxisData(int16_t *ax,int16_t *ay,int16_t *az,int16_t *gx,int1
   *gx  = Byte16(int16_t, tmpRead[8],  tmpRead[9]) ;// Gyr.X /16.4f
   *gy  = Byte16(int16_t, tmpRead[10], tmpRead[11]);// Gyr.Y /16.4f 
   *gz  = Byte16(int16_t, tmpRead[12], tmpRead[13]);// Gyr.Z /16.4f 
+  if (temp != NULL)
+  {
+    *temp = Byte16(int16_t, tmpRead[6], tmpRead[7]);
+  }
+  return true;
 }
 
 static void ICM20601_Offset_Correct(void)
@@ -111,33 +129,56 @@ static void ICM20601_Offset_Correct(void)
     reg_offset[0] = (uint8_t)((OffsetValue[i] >> 8)&0xff);
     reg_offset[1] = (uint8_t)(OffsetValue[i] & 0xff);
     ICM20601_WriteRegs(icm20601_offset_reg[i],reg_offset,2);
-    vTaskDelay( pdMS_TO_TICKS( 1 ) );
   }
 }
 
+static const uint8_t ICM20601_ConfigParameter[][2]={
+  {ICM20601_PWR_MGMT_1   ,0x80},//Reset Device
+  {ICM20601_PWR_MGMT_1   ,0x04},//Clock Source
+  {ICM20601_INT_PIN_CFG  ,0x10},//Set INT_ANYRD_2CLEAR
+  {ICM20601_INT_ENABLE   ,0x01},//Set RAW_RDY_EN
+  {ICM20601_PWR_MGMT_2   ,0x00},//Enable Acc & Gyro
+  {ICM20601_SMPLRT_DIV   ,0x00},//Sample Rate Divider 1kHz
+  {ICM20601_GYRO_CONFIG  ,0x18},//set : 2000dps  250hz
+  {ICM20601_ACCEL_CONFIG ,0x18},//set : 16g 218.1hz
+  {ICM20601_CONFIG       ,0x00},//set : 250hz for gyro
+  {ICM20601_ACCEL_CONFIG2,0x00},//set : 7.8HZ rate: 1Khz
+  {ICM20601_USER_CTRL    ,0x10} //Disable I2C Slave module and put the serial interface in SPI mode only.
+};
+#define ICM20601_CONFIG_COUNT (sizeof(ICM20601_ConfigParameter) / sizeof(ICM20601_ConfigParameter[0]))
+
+/**
+ * One step of the bring-up, for initseq.h: the configuration writes, the
+ * offsets, then the gyro start-up. Only the reset needs a wait before the
+ * next write.
+ * @return The ms to wait before the next step, INIT_SEQ_DONE at the end
+ */
+int32_t ICM20601_InitStep(uint32_t step)
+{
+  if (step < ICM20601_CONFIG_COUNT)
+  {
+    ICM20601_WriteReg(ICM20601_ConfigParameter[step][0],ICM20601_ConfigParameter[step][1]);
+    return step == 0 ? ICM20601_RESET_MS : 0;
+  }
+  if (step == ICM20601_CONFIG_COUNT)
+  {
+    ICM20601_Offset_Correct();
+    return ICM20601_GYRO_STARTUP_MS;
+  }
+
+  return INIT_SEQ_DONE;
+}
+
 void ICM20601_Init(void)
 {
-  uint8_t i;
-  uint8_t ConfigParameter[11][2]={
-    {ICM20601_PWR_MGMT_1   ,0x80},//Reset Device
-    {ICM20601_PWR_MGMT_1   ,0x04},//Clock Source
-    {ICM20601_INT_PIN_CFG  ,0x10},//Set INT_ANYRD_2CLEAR
-    {ICM20601_INT_ENABLE   ,0x01},//Set RAW_RDY_EN
-    {ICM20601_PWR_MGMT_2   ,0x00},//Enable Acc & Gyro
-    {ICM20601_SMPLRT_DIV   ,0x00},//Sample Rate Divider 1kHz
-    {ICM20601_GYRO_CONFIG  ,0x18},//set : 2000dps  250hz
-    {ICM20601_ACCEL_CONFIG ,0x18},//set : 16g 218.1hz
-    {ICM20601_CONFIG       ,0x00},//set : 250hz for gyro
-    {ICM20601_ACCEL_CONFIG2,0x00},//set : 7.8HZ rate: 1Khz
-    {ICM20601_USER_CTRL    ,0x10} //Disable I2C Slave module and put the serial interface in SPI mode only.
-  };
+  uint32_t step = 0;
+  int32_t wait;
 
-  for(i=0;i<11;i++)
+  while ((wait = ICM20601_InitStep(step++)) != INIT_SEQ_DONE)
   {
-    ICM20601_WriteReg(ConfigParameter[i][0],ConfigParameter[i][1]);
-    vTaskDelay( pdMS_TO_TICKS( 10 ) );
+    if (wait)
+      vTaskDelay(M2T(wait) + 1);
   }
-  ICM20601_Offset_Correct();
 }
 //  int16_t Acc_X_Offset,Acc_Y_Offset,Acc_Z_Offset;
 //  int16_t GYRO_X_Offset,GYRO_Y_Offset,GYRO_Z_Offset;
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "MPU9250.h"
 
 #define _USE_MAG_AK8963
@@ -90,23 +92,26 @@ int16_t AK8963_ASA[3] = {0};
 //  return SPI_I2S_ReceiveData(MPU9250_SPI);
 //}
 
+// Sensor, interrupt and external sensor registers: read at the fast clock
+static uint8_t MPU9250_BusFlags( uint8_t readAddr, uint8_t lens )
+{
+  if (readAddr >= MPU6500_INT_STATUS && readAddr + lens - 1 <= MPU6500_EXT_SENS_DATA_23)
+  {
+    return SPI_BUS_FAST;
+  }
+  return 0;
+}
+
 //write the mpu9250 reg
 void MPU9250_WriteReg( uint8_t writeAddr, uint8_t writeData )
 {
-  MP9250_CS_LOW;
-  SPI1_RW(writeAddr);
-  SPI1_RW(writeData);
-  MP9250_CS_HIGH;
+  spiBusTransfer(SPI_BUS_MPU9250, 0, writeAddr, &writeData, NULL, 1);
 }
 
 //write serials data into the reg
 void MPU9250_WriteRegs( uint8_t writeAddr, uint8_t *writeData, uint8_t lens )
 {
-  MP9250_CS_LOW;
-  SPI1_RW(writeAddr);
-  for(uint8_t i = 0; i < lens; i++)
-    SPI1_RW(writeData[i]);
-  MP9250_CS_HIGH;
+  spiBusTransfer(SPI_BUS_MPU9250, 0, writeAddr, writeData, NULL, lens);
 }
 
 //read one the reg value
@@ -114,65 +119,56 @@ uint8_t MPU9250_ReadReg( uint8_t readAddr )
 {
   uint8_t readData = 0;
 
-  MP9250_CS_LOW;
-  SPI1_RW(0x80 | readAddr);
-  readData = SPI1_RW(0x00);
-  MP9250_CS_HIGH;
+  spiBusTransfer(SPI_BUS_MPU9250, MPU9250_BusFlags(readAddr, 1), 0x80 | readAddr,
+                 NULL, &readData, 1);
 
   return readData;
 }
 
-void MPU9250_ReadRegs(uint8_t readAddr, uint8_t *readData, uint8_t lens)
+/* false when the bus failed, readData is not valid then */
+bool MPU9250_ReadRegs(uint8_t readAddr, uint8_t *readData, uint8_t lens)
 {
-  MP9250_CS_LOW;
-  SPI1_RW(0x80 | readAddr);
-  for(uint8_t i = 0; i < lens; i++)
-    readData[i] = SPI1_RW(0x00);
-  MP9250_CS_HIGH;
+  return spiBusTransfer(SPI_BUS_MPU9250, MPU9250_BusFlags(readAddr, lens), 0x80 | readAddr,
+                        NULL, readData, lens);
 }
 
-
+/* The AK8963 registers through I2C_SLV4, one byte per I2C transaction. The
+ * SPI writes take effect at once: only the end of the transaction is polled,
+ * about 25us per poll at the slow clock, MAG_READ_DELAY polls at most. For
+ * the set up only, the data come from MPU9250_GetNineAxisData() */
 #ifdef _USE_MAG_AK8963
+static void MPU9250_Mag_WaitDone( uint32_t *timeout )
+{
+  uint8_t status = 0;
+
+  do {
+    status = MPU9250_ReadReg(MPU6500_I2C_MST_STATUS);
+  } while(((status & MPU6500_I2C_SLV4_DONE) == 0) && (*timeout)--);
+}
+
 void MPU9250_Mag_WriteReg( uint8_t writeAddr, uint8_t writeData )
 {
-  uint8_t  status = 0;
   uint32_t timeout = MAG_READ_DELAY;
 
   MPU9250_WriteReg(MPU6500_I2C_SLV4_ADDR, AK8963_I2C_ADDR);
-  Delay(1);
   MPU9250_WriteReg(MPU6500_I2C_SLV4_REG, writeAddr);
-  Delay(1);
   MPU9250_WriteReg(MPU6500_I2C_SLV4_DO, writeData);
-  Delay(1);
   MPU9250_WriteReg(MPU6500_I2C_SLV4_CTRL, MPU6500_I2C_SLVx_EN);
-  Delay(1);
-
-  do {
-    status = MPU9250_ReadReg(MPU6500_I2C_MST_STATUS);
-    Delay(1);
-  } while(((status & MPU6500_I2C_SLV4_DONE) == 0) && (timeout--));
+  MPU9250_Mag_WaitDone(&timeout);
 }
 #endif
 
 #ifdef _USE_MAG_AK8963
 void MPU9250_Mag_WriteRegs( uint8_t writeAddr, uint8_t *writeData, uint8_t lens )
 {
-  uint8_t  status = 0;
   uint32_t timeout = MAG_READ_DELAY;
 
   MPU9250_WriteReg(MPU6500_I2C_SLV4_ADDR, AK8963_I2C_ADDR);
-  Delay(1);
   for(uint8_t i = 0; i < lens; i++) {
     MPU9250_WriteReg(MPU6500_I2C_SLV4_REG, writeAddr + i);
-    Delay(1);
     MPU9250_WriteReg(MPU6500_I2C_SLV4_DO, writeData[i]);
-    Delay(1);
     MPU9250_WriteReg(MPU6500_I2C_SLV4_CTRL, MPU6500_I2C_SLVx_EN);
-    Delay(1);
-
-    do {
-      status = MPU9250_ReadReg(MPU6500_I2C_MST_STATUS);
-    } while(((status & MPU6500_I2C_SLV4_DONE) == 0) && (timeout--));
+    MPU9250_Mag_WaitDone(&timeout);
   }
 }
 #endif
@@ -180,48 +176,28 @@ void MPU9250_Mag_WriteRegs( uint8_t writeAddr, uint8_t *writeData, uint8_t lens
 #ifdef _USE_MAG_AK8963
 uint8_t MPU9250_Mag_ReadReg( uint8_t readAddr )
 {
-  uint8_t status = 0;
-  uint8_t readData = 0;
   uint32_t timeout = MAG_READ_DELAY;
 
   MPU9250_WriteReg(MPU6500_I2C_SLV4_ADDR, AK8963_I2C_ADDR | 0x80);
-  Delay(1);
   MPU9250_WriteReg(MPU6500_I2C_SLV4_REG, readAddr);
-  Delay(1);
   MPU9250_WriteReg(MPU6500_I2C_SLV4_CTRL, MPU6500_I2C_SLVx_EN);
-  Delay(1);
+  MPU9250_Mag_WaitDone(&timeout);
 
-  do {
-    status = MPU9250_ReadReg(MPU6500_I2C_MST_STATUS);
-    Delay(1);
-  } while(((status & MPU6500_I2C_SLV4_DONE) == 0) && (timeout--));
-
-  readData = MPU9250_ReadReg(MPU6500_I2C_SLV4_DI);
-
-  return readData;
+  return MPU9250_ReadReg(MPU6500_I2C_SLV4_DI);
 }
 #endif
 
 #ifdef _USE_MAG_AK8963
 void MPU9250_Mag_ReadRegs( uint8_t readAddr, uint8_t *readData, uint8_t lens )
 {
-  uint8_t status = 0;
   uint32_t timeout = MAG_READ_DELAY;
 
   MPU9250_WriteReg(MPU6500_I2C_SLV4_ADDR, AK8963_I2C_ADDR | 0x80);
-  Delay(1);
   for(uint8_t i = 0; i< lens; i++) {
     MPU9250_WriteReg(MPU6500_I2C_SLV4_REG, readAddr + i);
-    Delay(1);
     MPU9250_WriteReg(MPU6500_I2C_SLV4_CTRL, MPU6500_I2C_SLVx_EN);
-    Delay(1);
-
-    do {
-      status = MPU9250_ReadReg(MPU6500_I2C_MST_STATUS);
-    } while(((status & MPU6500_I2C_SLV4_DONE) == 0) && (timeout--));
-
+    MPU9250_Mag_WaitDone(&timeout);
     readData[i] = MPU9250_ReadReg(MPU6500_I2C_SLV4_DI);
-    Delay(1);
   }
 }
 #endif
@@ -308,14 +284,14 @@ uint8_t MPU9250_Check( void )
   deviceID = MPU9250_ReadReg(MPU6500_WHO_AM_I);
   if(deviceID != MPU6500_Device_ID)
   {
-    printf("MPU9250 ERR,ID=%d\n",deviceID);
+    BPRINTF("MPU9250 ERR,ID=%d\n",deviceID);
     return ERROR;
   }
 #ifdef _USE_MAG_AK8963
   deviceID = MPU9250_Mag_ReadReg(AK8963_WIA);
   if(deviceID != AK8963_Device_ID)
   {
-    printf("AK8963 ERR,ID=%d\n",deviceID);
+    BPRINTF("AK8963 ERR,ID=%d\n",deviceID);
     return ERROR;
   }
 #endif
@@ -332,21 +308,21 @@ void MPU9250_Config( void )
 //  SPI1_Init();
 //  Delay(10);
   
-  printf("MPU9250 Init ... ");
+  BPRINTF("MPU9250 Init ... ");
 
   MPU_InitStruct.MPU_Gyr_FullScale     = MPU_GyrFS_2000dps;
   MPU_InitStruct.MPU_Gyr_LowPassFilter = MPU_GyrLPS_41Hz;
   MPU_InitStruct.MPU_Acc_FullScale     = MPU_AccFS_4g;
   MPU_InitStruct.MPU_Acc_LowPassFilter = MPU_AccLPS_41Hz;
   if(MPU9250_Init(&MPU_InitStruct) != SUCCESS) {
-    printf("ERROR\r\n");
+    BPRINTF("ERROR\r\n");
     while(1) {
       STM_LED_Toggle(LEDR);
       Delay(100);
     }
   }
   else {
-    printf("SUCCESS\r\n");
+    BPRINTF("SUCCESS\r\n");
   }
   Delay(100);
 }
@@ -380,4 +356,128 @@ void MPU9250_getData( int16_t *dataIMU )
 //  dataIMU[8] = ((long)dataIMU[8] * AK8963_ASA[1]) >> 8;
 //  dataIMU[9] = ((long)dataIMU[9] * AK8963_ASA[2]) >> 8;
 #endif  
-}
\ No newline at end of file
+}
+
+/**
+ * One SPI burst from ACCEL_XOUT_H: accel, temperature, gyro, then the
+ * EXT_SENS_DATA bytes which I2C_SLV0 copies from the AK8963 (ST1 to ST2) at
+ * the I2C master rate. The magnetometer is scaled by its sensitivity
+ * adjustment and turned to the axes of the accel and gyro: X and Y swapped,
+ * Z reversed. The copy is kept for several samples: a magnetometer sample is
+ * new when its data bytes change, DRDY set and no overflow.
+ */
+bool MPU9250_GetNineAxisData( int16_t *acc, int16_t *gyro, int16_t *mag, int16_t *temp )
+{
+  static uint8_t lastMag[6];
+  uint8_t tmpRead[MPU9250_BURST_SIZE];
+  int16_t magRaw[3];
+
+  if (!MPU9250_ReadRegs(MPU6500_ACCEL_XOUT_H, tmpRead, MPU9250_BURST_SIZE))
+    return false;
+
+  if (acc) {
+    acc[0] = Byte16(int16_t, tmpRead[0],  tmpRead[1]);
+    acc[1] = Byte16(int16_t, tmpRead[2],  tmpRead[3]);
+    acc[2] = Byte16(int16_t, tmpRead[4],  tmpRead[5]);
+  }
+  if (temp) {
+    *temp = Byte16(int16_t, tmpRead[6],  tmpRead[7]);
+  }
+  if (gyro) {
+    gyro[0] = Byte16(int16_t, tmpRead[8],  tmpRead[9]);
+    gyro[1] = Byte16(int16_t, tmpRead[10], tmpRead[11]);
+    gyro[2] = Byte16(int16_t, tmpRead[12], tmpRead[13]);
+  }
+
+#ifdef _USE_MAG_AK8963
+  if (!(tmpRead[14] & AK8963_STATUS_DRDY) || (tmpRead[21] & AK8963_STATUS_HOFL) ||
+      memcmp(lastMag, &tmpRead[15], sizeof(lastMag)) == 0)
+    return false;
+  memcpy(lastMag, &tmpRead[15], sizeof(lastMag));
+
+  if (mag) {
+    magRaw[0] = Byte16(int16_t, tmpRead[16], tmpRead[15]);
+    magRaw[1] = Byte16(int16_t, tmpRead[18], tmpRead[17]);
+    magRaw[2] = Byte16(int16_t, tmpRead[20], tmpRead[19]);
+    mag[0] =  (int16_t)(((int32_t)magRaw[1] * AK8963_ASA[1]) >> 8);
+    mag[1] =  (int16_t)(((int32_t)magRaw[0] * AK8963_ASA[0]) >> 8);
+    mag[2] = -(int16_t)(((int32_t)magRaw[2] * AK8963_ASA[2]) >> 8);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+/* Accel and gyro alone, SPI only, at the full scales and close to the
+ * bandwidths of the ICM20601: as a second IMU next to it */
+static const uint8_t MPU9250_SixAxisConfig[][2] = {
+  {MPU6500_PWR_MGMT_1,     0x80},               // Reset Device
+  {MPU6500_PWR_MGMT_1,     0x04},               // Clock Source
+  {MPU6500_INT_PIN_CFG,    0x10},               // Set INT_ANYRD_2CLEAR
+  {MPU6500_INT_ENABLE,     0x01},               // Set RAW_RDY_EN
+  {MPU6500_PWR_MGMT_2,     0x00},               // Enable Acc & Gyro
+  {MPU6500_SMPLRT_DIV,     0x00},               // Sample Rate Divider
+  {MPU6500_GYRO_CONFIG,    MPU_GyrFS_2000dps},
+  {MPU6500_ACCEL_CONFIG,   MPU_AccFS_16g},
+  {MPU6500_CONFIG,         MPU_GyrLPS_250Hz},
+  {MPU6500_ACCEL_CONFIG_2, MPU_AccLPS_184Hz},
+  {MPU6500_USER_CTRL,      0x10},               // Set I2C_IF_DIS
+};
+#define MPU9250_SIX_AXIS_CONFIG_COUNT (sizeof(MPU9250_SixAxisConfig) / sizeof(MPU9250_SixAxisConfig[0]))
+
+/**
+ * The MPU6500 part answers, without the AK8963 of MPU9250_Check().
+ */
+bool MPU9250_TestConnection( void )
+{
+  uint8_t deviceID;
+
+  deviceID = MPU9250_ReadReg(MPU6500_WHO_AM_I);
+  if(deviceID != MPU6500_Device_ID)
+  {
+    BPRINTF("MPU9250 ID=%d\n",deviceID);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * One step of the accel and gyro bring-up, for initseq.h. The AK8963 is not
+ * started. Only the reset needs a wait before the next write.
+ * @return The ms to wait before the next step, INIT_SEQ_DONE at the end
+ */
+int32_t MPU9250_InitStep( uint32_t step )
+{
+  if (step < MPU9250_SIX_AXIS_CONFIG_COUNT)
+  {
+    MPU9250_WriteReg(MPU9250_SixAxisConfig[step][0], MPU9250_SixAxisConfig[step][1]);
+    return step == 0 ? MPU9250_RESET_MS : 0;
+  }
+  if (step == MPU9250_SIX_AXIS_CONFIG_COUNT)
+  {
+    return MPU9250_GYRO_STARTUP_MS;
+  }
+
+  return INIT_SEQ_DONE;
+}
+
+/**
+ * Accel and gyro, from one 14 bytes burst at the fast clock.
+ * @return false when the read failed, acc and gyro are left as they were
+ */
+bool MPU9250_GetSixAxisData( int16_t *acc, int16_t *gyro )
+{
+  uint8_t tmpRead[14];
+
+  if (!MPU9250_ReadRegs(MPU6500_ACCEL_XOUT_H, tmpRead, sizeof(tmpRead)))
+    return false;
+
+  acc[0]  = Byte16(int16_t, tmpRead[0],  tmpRead[1]);
+  acc[1]  = Byte16(int16_t, tmpRead[2],  tmpRead[3]);
+  acc[2]  = Byte16(int16_t, tmpRead[4],  tmpRead[5]);
+  gyro[0] = Byte16(int16_t, tmpRead[8],  tmpRead[9]);
+  gyro[1] = Byte16(int16_t, tmpRead[10], tmpRead[11]);
+  gyro[2] = Byte16(int16_t, tmpRead[12], tmpRead[13]);
+  return true;
+}
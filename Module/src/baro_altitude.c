@@ -0,0 +1,85 @@
+/**
+ * baro_altitude.c - Pressure to altitude in single precision
+ */
+#include <stdint.h>
+
+#include "baro_altitude.h"
+
+#define LN2         0.693147181f
+#define SQRT2       1.414213562f
+
+/* The altitude of 2^y - 1 */
+#define BARO_SCALE  ((BARO_TEMPERATURE + 273.15f) / BARO_LAPSE_RATE)
+
+/* y = a log2(p0) - a log2(p), a = BARO_PRESSURE_FACTOR. With log2(p) =
+ * e + log2(m), a e is taken as A_HI e + A_LO e where A_HI has 12 bits: the
+ * product is exact and y keeps the bits of the small log2(m) term. Same
+ * split for a log2(p0) */
+#define A_HI        (779.0f / 4096)
+#define A_LO        (BARO_PRESSURE_FACTOR - A_HI)
+#define A_LOG2P0    1.90039706f      // a log2(1015.7)
+#define A_LOG2P0_LO (-5.347e-8f)     // What the float above misses
+
+typedef union
+{
+  float f;
+  uint32_t u;
+} floatBits_t;
+
+/* log2(x) = e + log2(m), x normal and positive, m in [1/sqrt2, sqrt2).
+ * ln(m) = 2 atanh(s), s = (m - 1) / (m + 1), |s| < 0.172: the series to s^7
+ * leaves 3e-8 */
+static float log2Mantissa(float x, int32_t * e)
+{
+  floatBits_t v;
+  float m, s, s2;
+
+  v.f = x;
+  *e = (int32_t)((v.u >> 23) & 0xFF) - 127;
+  v.u = (v.u & 0x007FFFFF) | 0x3F800000;
+  m = v.f;
+  if (m > SQRT2)
+  {
+    m *= 0.5f;
+    (*e)++;
+  }
+
+  s = (m - 1.0f) / (m + 1.0f);
+  s2 = s * s;
+  return s * (2.0f / LN2) * (1.0f + s2 * (1.0f / 3 + s2 * (1.0f / 5 + s2 * (1.0f / 7))));
+}
+
+/* 2^(n + f) - 1, |f| <= 1/2: 2^f - 1 = expm1(t), t = f ln2, by its series to
+ * t^7 which leaves 1e-8. No cancellation for n = 0, near the ground */
+static float exp2m1(int32_t n, float f)
+{
+  floatBits_t scale;
+  float t = f * LN2;
+  float em1;
+
+  em1 = t + t * t * (1.0f / 2 + t * (1.0f / 6 + t * (1.0f / 24 +
+        t * (1.0f / 120 + t * (1.0f / 720 + t * (1.0f / 5040))))));
+  if (n == 0)
+    return em1;
+
+  scale.u = (uint32_t)(n + 127) << 23;
+  return (em1 + 1.0f) * scale.f - 1.0f;
+}
+
+float baroPressureToAltitude(float pressure)
+{
+  int32_t e;
+  int32_t n;
+  float lm;
+  float y;
+
+  //Also false for NaN. Denormals are far below the range of the sensor
+  if (!(pressure >= 1e-30f))
+    return 0;
+
+  lm = log2Mantissa(pressure, &e);
+  y = A_LOG2P0 - A_HI * e;
+  n = (int32_t)(y + 64.5f) - 64;
+
+  return exp2m1(n, (y - n) + (A_LOG2P0_LO - A_LO * e - BARO_PRESSURE_FACTOR * lm)) * BARO_SCALE;
+}
@@ -30,10 +30,9 @@
 #include "ms5611.h"
 
 #define EXTRA_PRECISION      5 // trick to add more precision to the pressure and temp readings
-#define CONVERSION_TIME_MS   10 // conversion time in milliseconds. 10 is minimum
 #define PRESSURE_PER_TEMP 5 // Length of reading cycle: 1x temp, rest pressure. Good values: 1-10
-#define FIX_TEMP 25         // Fixed Temperature. ASL is a function of pressure and temperature, but as the temperature changes so much (blow a little towards the flie and watch it drop 5 degrees) it corrupts the ASL estimates.
-                            // TLDR: Adjusting for temp changes does more harm than good.
+// The altitude uses a fixed temperature (BARO_TEMPERATURE). ASL is a function of pressure and temperature, but as the temperature changes so much (blow a little towards the flie and watch it drop 5 degrees) it corrupts the ASL estimates.
+// TLDR: Adjusting for temp changes does more harm than good.
 
 typedef struct
 {
@@ -48,14 +47,28 @@ typedef struct
 static bool isInit;
 
 static CalReg   calReg;
-static uint32_t lastPresConv;
-static uint32_t lastTempConv;
-static int32_t  tempCache;
 
-static uint8_t readState=0;
-static uint32_t lastConv=0;
+// Maximum conversion times in us, OSR 256 to 4096, from the datasheet
+static const uint16_t conversionTimeUs[] = {600, 1170, 2280, 4540, 9040};
+
+// Conversion scheduler: the timer wakes the baro task, which does the bus
+// accesses. The timer task must not wait for the bus mutex or the DMA
+STATIC_MEM_TIMER_ALLOC(conversionTimer);
+static TimerHandle_t conversionTimer;
+static void baroTask(void *param);
+STATIC_MEM_TASK_ALLOC(baroTask, BARO_TASK_STACKSIZE);
+static TaskHandle_t baroTaskHandle;
+static uint8_t converting;      // MS5611_D1 or MS5611_D2, 0 before the first one
+static uint8_t readState;       // Pressures since the temperature
 static int32_t tempDeltaT;
 
+// Last results, for MS5611_GetData()
+static float lastPressure;
+static float lastTemperature;
+static float lastAsl;
+static uint32_t conversions;
+static uint32_t misses;         // Conversions read 0: not done, or read twice
+
 //LOW level Driver
 /**************************************************************/
 /**
@@ -64,110 +77,59 @@ static int32_t tempDeltaT;
  */
 void MS5611_Reset(void)
 {
-  MS5611_CS_LOW;
-  
-  SPI1_RW(MS5611_RESET);
-  
-  MS5611_CS_HIGH;
+  spiBusTransfer(SPI_BUS_MS5611, 0, MS5611_RESET, NULL, NULL, 0);
 }
 
 // see page 11 of the datasheet
 void MS5611_StartConversion(uint8_t command)
 {
-  MS5611_CS_LOW;
-  
-  SPI1_RW(command);
-  
-  MS5611_CS_HIGH;
+  spiBusTransfer(SPI_BUS_MS5611, 0, command, NULL, NULL, 0);
 }
 
 int32_t MS5611_GetConversion(void)
 {
-	uint8_t i;
 	int32_t conversion = 0;
 	uint8_t buffer[MS5611_D1D2_SIZE];
-	// start the read sequence
-	MS5611_CS_LOW;
-	// start read sequence
-	SPI1_RW(0);
-	// Read conversion
-	for(i=0;i<MS5611_D1D2_SIZE;i++)
-	{
-	  buffer[i] = SPI1_RW(0);
-	}
-	//end of the read sequence
-	MS5611_CS_HIGH;
+	// ADC read command, then the conversion
+	spiBusTransfer(SPI_BUS_MS5611, 0, 0, NULL, buffer, MS5611_D1D2_SIZE);
 	
 	conversion = ((int32_t)buffer[0] << 16) |((int32_t)buffer[1] << 8) | buffer[2];
 
 	return conversion;
 }
 
-int32_t MS5611_RawPressure(uint8_t osr)
+// Ticks from a conversion start to its result, rounded up
+static uint32_t MS5611_ConversionTicks(uint8_t osr)
 {
-  uint32_t now = xTaskGetTickCount();
-  if (lastPresConv != 0 && (now - lastPresConv) >= CONVERSION_TIME_MS)
-  {
-    lastPresConv = 0;
-    return MS5611_GetConversion();
-  }
-  else
-  {
-    if (lastPresConv == 0 && lastTempConv == 0)
-    {
-      MS5611_StartConversion(MS5611_D1 + osr);
-      lastPresConv = now;
-    }
-    return 0;
-  }
-}
-
-int32_t MS5611_RawTemperature(uint8_t osr)
-{
-  uint32_t now = xTaskGetTickCount();
-  if (lastTempConv != 0 && (now - lastTempConv) >= CONVERSION_TIME_MS)
-  {
-    lastTempConv = 0;
-    tempCache = MS5611_GetConversion();
-    return tempCache;
-  }
-  else
-  {
-    if (lastTempConv == 0 && lastPresConv == 0)
-    {
-      MS5611_StartConversion(MS5611_D2 + osr);
-      lastTempConv = now;
-    }
-    return tempCache;
-  }
+  return (conversionTimeUs[osr >> 1] * (configTICK_RATE_HZ / 1000) + 999) / 1000;
 }
 /**
  * Reads factory calibration and store it into object variables.
  */
 void MS5611_ReadPROM(void)
 {
-	uint8_t buffer[MS5611_PROM_REG_SIZE];
+	uint8_t buffer[MS5611_PROM_REG_COUNT][MS5611_PROM_REG_SIZE];
+	spiBusTransaction_t reads[MS5611_PROM_REG_COUNT];
 	uint16_t* pCalRegU16 = (uint16_t*)&calReg;
-	int32_t i = 0,j = 0;
+	int32_t i = 0;
 	
-	// start the read sequence
-	MS5611_CS_LOW;
-
+	// one command per register, each with its own chip select
 	for (i = 0; i < MS5611_PROM_REG_COUNT; i++)
 	{
-		// start read sequence
-		SPI1_RW(MS5611_PROM_BASE_ADDR + (i * MS5611_PROM_REG_SIZE));
-		// Read conversion
-
-		for(j=0;j < MS5611_PROM_REG_SIZE;j++)
-		{
-			buffer[j] = SPI1_RW(0);
-		}		  
-		pCalRegU16[i] = ((uint16_t)buffer[0] << 8) | buffer[1];
+		reads[i].device = SPI_BUS_MS5611;
+		reads[i].flags = 0;
+		reads[i].cmdLen = 1;
+		reads[i].cmd[0] = MS5611_PROM_BASE_ADDR + (i * MS5611_PROM_REG_SIZE);
+		reads[i].tx = NULL;
+		reads[i].rx = buffer[i];
+		reads[i].len = MS5611_PROM_REG_SIZE;
 	}
+	spiBusRun(reads, MS5611_PROM_REG_COUNT);
 	
-	//end of the read sequence
-	MS5611_CS_HIGH;
+	for (i = 0; i < MS5611_PROM_REG_COUNT; i++)
+	{
+		pCalRegU16[i] = ((uint16_t)buffer[i][0] << 8) | buffer[i][1];
+	}
 }
 
 //at the datasheet page 7 ,describe the in detial
@@ -194,7 +156,7 @@ float MS5611_CalcTemp(int32_t deltaT)
 		else
 	{
 		return (float)(((1 << EXTRA_PRECISION) * 2000)+ (((int64_t)deltaT * calReg.tsens) >> (23 - EXTRA_PRECISION)))/
-					  ((1 << EXTRA_PRECISION) * 100.0);
+					  ((1 << EXTRA_PRECISION) * 100.0f);
 	}
 }
 
@@ -219,15 +181,15 @@ float MS5611_CalcPressure(int32_t rawPress, int32_t dT)
 	
 	// Temperature compensated pressure (10…1200mbar with0.01mbar resolution)
 	// P = D1 * SENS - OFF = (D1 * SENS / 2^21 - OFF) / 2^15
-	return ((((rawPress * sens) >> 21) - off) >> (15 - EXTRA_PRECISION))/
-			((1 << EXTRA_PRECISION) * 100.0);
+	return (float)((((rawPress * sens) >> 21) - off) >> (15 - EXTRA_PRECISION))/
+			((1 << EXTRA_PRECISION) * 100.0f);
 }
 
 bool ms5611EvaluateSelfTest(float min, float max, float value, char* string)
 {
   if (value < min || value > max)
   {
-    printf("Self test %s [FAIL]. low: %0.2f, high: %0.2f, measured: %0.2f\n",
+    BPRINTF("Self test %s [FAIL]. low: %0.2f, high: %0.2f, measured: %0.2f\n",
                 string, min, max, value);
     return false;
   }
@@ -236,56 +198,100 @@ bool ms5611EvaluateSelfTest(float min, float max, float value, char* string)
 
 
 
-int32_t MS5611_GetDeltaTemp(uint8_t osr)
+/**
+ * Runs in the baro task every conversion time of MS5611_OSR_DEFAULT: reads
+ * the conversion done and starts the next one in the same bus access, so the
+ * sensor converts back to back. For every PRESSURE_PER_TEMP-1 pressure
+ * conversions the temperature is converted once.
+ */
+static void MS5611_Convert(void)
 {
-  int32_t rawTemp = MS5611_RawTemperature(osr);
-  if (rawTemp != 0)
+  spiBusTransaction_t t[2];
+  uint8_t buffer[MS5611_D1D2_SIZE];
+  uint8_t next;
+  int32_t raw;
+  float pressure;
+  float asl;
+
+  // The temperature first, then once in PRESSURE_PER_TEMP conversions
+  if (converting == 0 || ++readState >= PRESSURE_PER_TEMP)
   {
-    return MS5611_CalcDeltaTemp(rawTemp);
+    next = MS5611_D2;
+    readState = 0;
   }
   else
   {
-    return 0;
+    next = MS5611_D1;
   }
-}
 
-float MS5611_GetTemperature(uint8_t osr)
-{
-  // see datasheet page 7 for formulas
-  int32_t dT;
-
-  dT = MS5611_GetDeltaTemp(osr);
-  if (dT != 0)
+  // ADC read of the conversion done, then the next conversion
+  t[0].device = SPI_BUS_MS5611;
+  t[0].flags = 0;
+  t[0].cmdLen = 1;
+  t[0].cmd[0] = 0;
+  t[0].tx = NULL;
+  t[0].rx = buffer;
+  t[0].len = MS5611_D1D2_SIZE;
+  t[1] = t[0];
+  t[1].cmd[0] = next + MS5611_OSR_DEFAULT;
+  t[1].rx = NULL;
+  t[1].len = 0;
+
+  if (converting == 0)
   {
-    return MS5611_CalcTemp(dT);
+    spiBusRun(&t[1], 1);
+    converting = next;
+    return;
   }
-  else
+
+  if (!spiBusRun(t, 2))
+    buffer[0] = buffer[1] = buffer[2] = 0;
+  raw = ((int32_t)buffer[0] << 16) | ((int32_t)buffer[1] << 8) | buffer[2];
+
+  // 0 when read before the end of the conversion: the sample is dropped
+  if (raw == 0)
   {
-    return 0;
+    misses++;
   }
-}
-
-float MS5611_GetPressure(uint8_t osr)
-{
-  // see datasheet page 7 for formulas
-  int32_t rawPress = MS5611_RawPressure(osr);
-  int64_t dT = (int64_t)MS5611_GetDeltaTemp(osr);
-  if (dT == 0)
+  else if (converting == MS5611_D2)
   {
-    return 0;
+    tempDeltaT = MS5611_CalcDeltaTemp(raw);
+    lastTemperature = MS5611_CalcTemp(tempDeltaT);
+    conversions++;
   }
-  int64_t off = (((int64_t)calReg.off) << 16) + ((calReg.tco * dT) >> 7);
-  int64_t sens = (((int64_t)calReg.psens) << 15) + ((calReg.tcs * dT) >> 8);
-  if (rawPress != 0)
+  else if (tempDeltaT != 0)
   {
-    return ((((rawPress * sens) >> 21) - off) >> (15 - EXTRA_PRECISION))/
-		   ((1 << EXTRA_PRECISION) * 100.0);
+    pressure = MS5611_CalcPressure(raw, tempDeltaT);
+    asl = baroPressureToAltitude(pressure);
+
+    taskENTER_CRITICAL();
+    lastPressure = pressure;
+    lastAsl = asl;
+    taskEXIT_CRITICAL();
+    conversions++;
   }
-  else
+
+  converting = next;
+}
+
+/**
+ * Wakes the baro task. Expiries while it waits for the bus are merged: the
+ * conversion is read late, the sensor stays idle meanwhile.
+ */
+static void MS5611_ConversionTimer(TimerHandle_t timer)
+{
+  xTaskNotifyGive(baroTaskHandle);
+}
+
+static void baroTask(void *param)
+{
+  while (1)
   {
-    return 0;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    MS5611_Convert();
   }
 }
+
 /***************************Public Function***********************************/
 bool MS5611_Init(void)
 {
@@ -296,6 +302,12 @@ bool MS5611_Init(void)
   vTaskDelay(M2T(5)); //the datasheet describe the min time is 2.8ms
   MS5611_ReadPROM(); // reads the PROM into object variables for later use
 
+  conversionTimer = STATIC_MEM_TIMER_CREATE(conversionTimer, "ms5611",
+                                            MS5611_ConversionTicks(MS5611_OSR_DEFAULT),
+                                            pdTRUE, NULL, MS5611_ConversionTimer);
+  baroTaskHandle = STATIC_MEM_TASK_CREATE(baroTask, baroTask, BARO_TASK_NAME,
+                                          NULL, BARO_TASK_PRI);
+
   isInit = true;
   return true;
 }
@@ -312,12 +324,13 @@ bool MS5611_SelfTest(void)
   if (!isInit)
     return false;
 
+  // vTaskDelay() waits from 1 tick less than asked
   MS5611_StartConversion(MS5611_D1 + MS5611_OSR_4096);
-  vTaskDelay(M2T(CONVERSION_TIME_MS));
+  vTaskDelay(MS5611_ConversionTicks(MS5611_OSR_4096) + 1);
   rawPress = MS5611_GetConversion();
 
   MS5611_StartConversion(MS5611_D2 + MS5611_OSR_4096);
-  vTaskDelay(M2T(CONVERSION_TIME_MS));
+  vTaskDelay(MS5611_ConversionTicks(MS5611_OSR_4096) + 1);
   rawTemp = MS5611_GetConversion();
 
   deltaT      = MS5611_CalcDeltaTemp(rawTemp);
@@ -327,7 +340,7 @@ bool MS5611_SelfTest(void)
   if (ms5611EvaluateSelfTest(MS5611_ST_PRESS_MIN, MS5611_ST_PRESS_MAX, pressure, "pressure") &&
       ms5611EvaluateSelfTest(MS5611_ST_TEMP_MIN, MS5611_ST_TEMP_MAX, temperature, "temperature"))
   {
-    printf("Self test [OK].\n");
+    BPRINTF("Self test [OK].\n");
   }
   else
   {
@@ -337,77 +350,34 @@ bool MS5611_SelfTest(void)
   return testStatus;
 }
 
-//TODO: pretty expensive function. Rather smooth the pressure estimates and only call this when needed
-
 /**
- * Converts pressure to altitude above sea level (ASL) in meters
+ * Starts the conversions, back to back from now on. After MS5611_SelfTest().
  */
-float MS5611_PressureToAltitude(float* pressure/*, float* ground_pressure, float* ground_temp*/)
+void MS5611_Start(void)
 {
-    if (*pressure > 0)
-    {
-        //return (1.f - pow(*pressure / CONST_SEA_PRESSURE, CONST_PF)) * CONST_PF2;
-        //return ((pow((1015.7 / *pressure), CONST_PF) - 1.0) * (25. + 273.15)) / 0.0065;
-        return ((pow((1015.7 / *pressure), CONST_PF) - 1.0) * (FIX_TEMP + 273.15)) / 0.0065;
-    }
-    else
-    {
-        return 0;
-    }
-}
+  if (!isInit)
+    return;
 
+  converting = 0;
+  readState = 0;
+  xTimerStart(conversionTimer, M2T(100));
+}
 
 /**
- * Gets pressure, temperature and above sea level altitude estimate (asl).
- * Best called at 100hz. For every PRESSURE_PER_TEMP-1 pressure readings temp is read once.
- * Effective 50-90hz baro update and 50-10hz temperature update if called at 100hz.
+ * Gets the last pressure, temperature and above sea level altitude estimate
+ * (asl). Does not touch the bus: the conversions run on their own since
+ * MS5611_Start(), at the rate of MS5611_OSR_DEFAULT.
  */
 void MS5611_GetData(float* pressure, float* temperature, float* asl)
 {
-    int32_t tempPressureRaw, tempTemperatureRaw;
-    static float savedPress, savedTemp;
-
-    // Dont reader faster than we can
-    uint32_t now = xTaskGetTickCount();
-    if ((now - lastConv) < CONVERSION_TIME_MS)
-    {
-      *pressure = savedPress;
-      *temperature = savedTemp;
-      return;
-    }
-    lastConv = now;
-
-    if (readState == 0)
-    {
-        // read temp
-        ++readState;
-        tempTemperatureRaw = MS5611_GetConversion();
-        tempDeltaT   = MS5611_CalcDeltaTemp(tempTemperatureRaw);
-        *temperature = MS5611_CalcTemp(tempDeltaT);
-        savedTemp = *temperature;
-        *pressure = savedPress;
-        // cmd to read pressure
-        MS5611_StartConversion(MS5611_D1 + MS5611_OSR_DEFAULT);
-    }
-    else
-    {
-        // read pressure
-        ++readState;
-        tempPressureRaw = MS5611_GetConversion();
-        *pressure = MS5611_CalcPressure(tempPressureRaw, tempDeltaT);
-        savedPress = *pressure;
-        *asl = MS5611_PressureToAltitude(pressure);
-        *temperature = savedTemp;
-        if (readState == PRESSURE_PER_TEMP){
-            // cmd to read temp
-            MS5611_StartConversion(MS5611_D2 + MS5611_OSR_DEFAULT);
-            readState = 0;
-        }
-        else
-        {
-            // cmd to read pressure
-            MS5611_StartConversion(MS5611_D1 + MS5611_OSR_DEFAULT);
-        }
-    }
+    taskENTER_CRITICAL();
+    *pressure = lastPressure;
+    *asl = lastAsl;
+    taskEXIT_CRITICAL();
+    *temperature = lastTemperature;
 }
 
+LOG_GROUP_START(ms5611)
+LOG_ADD(LOG_UINT32, conversions, &conversions)
+LOG_ADD(LOG_UINT32, misses, &misses)
+LOG_GROUP_STOP(ms5611)
@@ -305,6 +305,7 @@
 #define SD_CARD_LOCKED                  ((uint32_t)0x02000000)
 
 #define SD_DATATIMEOUT                  ((uint32_t)0xFFFFFFFF)
+#define SD_TRANSFER_TIMEOUT_MS          ((uint32_t)1000)
 #define SD_0TO7BITS                     ((uint32_t)0x000000FF)
 #define SD_8TO15BITS                    ((uint32_t)0x0000FF00)
 #define SD_16TO23BITS                   ((uint32_t)0x00FF0000)
@@ -350,6 +351,11 @@ __IO SD_Error TransferError = SD_OK;
 __IO uint32_t TransferEnd = 0, DMAEndOfTransfer = 0;
 SD_CardInfo SDCardInfo;
 
+/* Given by the transfer interrupts to wake up the task waiting in
+   SD_WaitReadOperation/SD_WaitWriteOperation */
+static xSemaphoreHandle SDTransferEvent = NULL;
+STATIC_MEM_SEMAPHORE_ALLOC(SDTransferEvent);
+
 SDIO_InitTypeDef SDIO_InitStructure;
 SDIO_CmdInitTypeDef SDIO_CmdInitStructure;
 SDIO_DataInitTypeDef SDIO_DataInitStructure;
@@ -371,6 +377,9 @@ static SD_Error SDEnWideBus(FunctionalState NewState);
 static SD_Error IsCardProgramming(uint8_t *pstatus);
 static SD_Error FindSCR(uint16_t rca, uint32_t *pscr);
 uint8_t convert_from_bytes_to_power_of_two(uint16_t NumberOfBytes);
+static void SD_StartTransferEvent(void);
+static uint32_t SD_WaitTransferEvent(void);
+static void SD_SignalTransferEvent(void);
   
 #pragma pack(push) //״̬ 
 #pragma pack(4)//趨Ϊ4ֽڶ 
@@ -405,6 +414,11 @@ SD_Error SD_Init(void)
 {
   __IO SD_Error errorstatus = SD_OK;
   
+  if (SDTransferEvent == NULL)
+  {
+    SDTransferEvent = STATIC_MEM_BINARY_CREATE(SDTransferEvent);
+  }
+
   /* SDIO Peripheral Low Level Init */
   SD_LowLevel_Init();
   
@@ -1179,6 +1193,7 @@ SD_Error SD_ReadBlock(uint8_t *readbuff, uint64_t ReadAddr, uint16_t BlockSize)
   TransferError = SD_OK;
   TransferEnd = 0;
   StopCondition = 0;
+  SD_StartTransferEvent();
 
   SDIO->DCTRL = 0x0;
 
@@ -1308,6 +1323,7 @@ SD_Error SD_ReadMultiBlocks(uint8_t *readbuff, uint64_t ReadAddr, uint16_t Block
   TransferError = SD_OK;
   TransferEnd = 0;
   StopCondition = 1;
+  SD_StartTransferEvent();
 	
   SDIO->DCTRL = 0x0;
 
@@ -1375,16 +1391,14 @@ SD_Error SD_WaitReadOperation(void)
   SD_Error errorstatus = SD_OK;
   uint32_t timeout;
 
-  timeout = SD_DATATIMEOUT;
-  
-  while ((DMAEndOfTransfer == 0x00) && (TransferEnd == 0) && (TransferError == SD_OK) && (timeout > 0))
-  {
-    timeout--;
-  }
+  timeout = SD_WaitTransferEvent();
   
   DMAEndOfTransfer = 0x00;
 
-  timeout = SD_DATATIMEOUT;
+  if (timeout > 0)
+  {
+    timeout = SD_DATATIMEOUT;
+  }
   
   while(((SDIO->STA & SDIO_FLAG_RXACT)) && (timeout > 0))
   {
@@ -1441,6 +1455,7 @@ SD_Error SD_WriteBlock(uint8_t *writebuff, uint64_t WriteAddr, uint16_t BlockSiz
   TransferError = SD_OK;
   TransferEnd = 0;
   StopCondition = 0;
+  SD_StartTransferEvent();
 
   SDIO->DCTRL = 0x0;
 
@@ -1571,6 +1586,7 @@ SD_Error SD_WriteMultiBlocks(uint8_t *writebuff, uint64_t WriteAddr, uint16_t Bl
   TransferError = SD_OK;
   TransferEnd = 0;
   StopCondition = 1;
+  SD_StartTransferEvent();
   SDIO->DCTRL = 0x0;
 
   SDIO_ITConfig(SDIO_IT_DCRCFAIL | SDIO_IT_DTIMEOUT | SDIO_IT_DATAEND | SDIO_IT_TXUNDERR | SDIO_IT_STBITERR, ENABLE);
@@ -1668,16 +1684,14 @@ SD_Error SD_WaitWriteOperation(void)
   SD_Error errorstatus = SD_OK;
   uint32_t timeout;
 
-  timeout = SD_DATATIMEOUT;
-  
-  while ((DMAEndOfTransfer == 0x00) && (TransferEnd == 0) && (TransferError == SD_OK) && (timeout > 0))
-  {
-    timeout--;
-  }
+  timeout = SD_WaitTransferEvent();
   
   DMAEndOfTransfer = 0x00;
 
-  timeout = SD_DATATIMEOUT;
+  if (timeout > 0)
+  {
+    timeout = SD_DATATIMEOUT;
+  }
   
   while(((SDIO->STA & SDIO_FLAG_TXACT)) && (timeout > 0))
   {
@@ -2041,6 +2055,8 @@ SD_Error SD_ProcessIRQSrc(void)
   SDIO_ITConfig(SDIO_IT_DCRCFAIL | SDIO_IT_DTIMEOUT | SDIO_IT_DATAEND |
                 SDIO_IT_TXFIFOHE | SDIO_IT_RXFIFOHF | SDIO_IT_TXUNDERR |
                 SDIO_IT_RXOVERR | SDIO_IT_STBITERR, DISABLE);
+
+  SD_SignalTransferEvent();
   return(TransferError);
 }
 
@@ -2055,6 +2071,73 @@ void SD_ProcessDMAIRQ(void)
   {
     DMAEndOfTransfer = 0x01;
     DMA_ClearFlag(SD_SDIO_DMA_STREAM, SD_SDIO_DMA_FLAG_TCIF|SD_SDIO_DMA_FLAG_FEIF);
+    SD_SignalTransferEvent();
+  }
+}
+
+/**
+  * @brief  Clears the events of the previous transfer. Called before a new
+  *         data transfer is started.
+  * @param  None
+  * @retval None
+  */
+static void SD_StartTransferEvent(void)
+{
+  DMAEndOfTransfer = 0x00;
+
+  if (SDTransferEvent != NULL)
+  {
+    xSemaphoreTake(SDTransferEvent, 0);
+  }
+}
+
+/**
+  * @brief  Waits for the end of the data transfer: the SDIO DATAEND and the
+  *         DMA transfer complete interrupts, or an error. The calling task
+  *         sleeps on SDTransferEvent. Before the scheduler is started the
+  *         flags are polled.
+  * @param  None
+  * @retval 0 on timeout, not 0 otherwise.
+  */
+static uint32_t SD_WaitTransferEvent(void)
+{
+  uint32_t timeout = SD_DATATIMEOUT;
+
+  if ((SDTransferEvent != NULL) &&
+      (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) &&
+      !(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk))
+  {
+    while (((DMAEndOfTransfer == 0x00) || (TransferEnd == 0)) && (TransferError == SD_OK))
+    {
+      if (xSemaphoreTake(SDTransferEvent, M2T(SD_TRANSFER_TIMEOUT_MS)) != pdTRUE)
+      {
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  while ((DMAEndOfTransfer == 0x00) && (TransferEnd == 0) && (TransferError == SD_OK) && (timeout > 0))
+  {
+    timeout--;
+  }
+
+  return timeout;
+}
+
+/**
+  * @brief  Wakes up the task waiting for the transfer. Interrupt context.
+  * @param  None
+  * @retval None
+  */
+static void SD_SignalTransferEvent(void)
+{
+  portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+  if (SDTransferEvent != NULL)
+  {
+    xSemaphoreGiveFromISR(SDTransferEvent, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
   }
 }
 
@@ -2822,6 +2905,7 @@ SD_Error SD_HighSpeed (void)
   TransferError = SD_OK;
   TransferEnd = 0;
   StopCondition = 0;
+  SD_StartTransferEvent();
 
   SDIO->DCTRL = 0x0;
 
@@ -0,0 +1,223 @@
+/**
+ * baro_bench.c - Float pressure to altitude against the double pow() path
+ *
+ * Sweeps Module/src/baro_altitude.c over the MS5611 range against the
+ * formula in long double, times it against the double pow() which
+ * MS5611_PressureToAltitude() used and against powf(), and gives the
+ * baro sample rates of the old 10ms polling and of the conversion timer:
+ *
+ *   gcc -O2 -I../../Module/inc -o baro_bench baro_bench.c \
+ *       ../../Module/src/baro_altitude.c -lm
+ *   ./baro_bench
+ *   ./baro_bench -t                 self test
+ *
+ * The host has a double FPU: on the Cortex-M4F, single precision only, the
+ * double pow() is software emulated and the gap is far wider than here.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "baro_altitude.h"
+
+#define FIX_TEMP      25
+#define CONST_PF      0.1902630958
+
+#define SWEEP_MIN     10.0
+#define SWEEP_MAX     1200.0
+#define SWEEP_STEP    0.0005
+#define FLIGHT_MIN    300.0
+#define FLIGHT_MAX    1100.0
+
+#define CALLS         2000000
+#define RUNS          5
+
+/* Datasheet maximum conversion times, OSR 256 to 4096 */
+static const uint32_t convTimeUs[] = {600, 1170, 2280, 4540, 9040};
+#define OLD_PERIOD_MS 10        // CONVERSION_TIME_MS, whatever the OSR
+#define PRESSURE_PER_TEMP 5
+
+static double reference(double pressure)
+{
+  return (double)((powl(1015.7L / pressure, (long double)CONST_PF) - 1.0L) * (FIX_TEMP + 273.15L) / 0.0065L);
+}
+
+/* MS5611_PressureToAltitude() as it was */
+static float oldAltitude(float* pressure)
+{
+  if (*pressure > 0)
+    return ((pow((1015.7 / *pressure), CONST_PF) - 1.0) * (FIX_TEMP + 273.15)) / 0.0065;
+  else
+    return 0;
+}
+
+static float powfAltitude(float pressure)
+{
+  if (pressure > 0)
+    return (powf(BARO_SEA_PRESSURE / pressure, BARO_PRESSURE_FACTOR) - 1.0f) *
+           (BARO_TEMPERATURE + 273.15f) / BARO_LAPSE_RATE;
+  else
+    return 0;
+}
+
+typedef struct
+{
+  double flight;      // Max error from FLIGHT_MIN to FLIGHT_MAX, m
+  double all;         // Max error over the sweep, m
+  double at;          // Pressure of the max
+} sweepError_t;
+
+static void sweep(int which, sweepError_t * e)
+{
+  double p;
+  float pf;
+  double err;
+
+  memset(e, 0, sizeof(*e));
+  for (p=SWEEP_MIN; p<=SWEEP_MAX; p+=SWEEP_STEP)
+  {
+    pf = (float)p;
+    if (which == 0)
+      err = fabs(baroPressureToAltitude(pf) - reference(pf));
+    else if (which == 1)
+      err = fabs(oldAltitude(&pf) - reference(pf));
+    else
+      err = fabs(powfAltitude(pf) - reference(pf));
+
+    if (err > e->all)
+    {
+      e->all = err;
+      e->at = pf;
+    }
+    if (pf >= FLIGHT_MIN && pf <= FLIGHT_MAX && err > e->flight)
+      e->flight = err;
+  }
+}
+
+static double nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile float sink;
+
+/* Best ns per call, the pressure ramping over the flight range */
+static double timeIt(int which)
+{
+  double best = 1e30;
+  double start, ns;
+  float p;
+  float sum;
+  int run, i;
+
+  for (run=0; run<RUNS; run++)
+  {
+    sum = 0;
+    p = FLIGHT_MIN;
+    start = nowNs();
+    for (i=0; i<CALLS; i++)
+    {
+      if (which == 0)
+        sum += baroPressureToAltitude(p);
+      else if (which == 1)
+        sum += oldAltitude(&p);
+      else
+        sum += powfAltitude(p);
+      p += 0.0004f;
+    }
+    ns = (nowNs() - start) / CALLS;
+    sink = sum;
+    if (ns < best)
+      best = ns;
+  }
+
+  return best;
+}
+
+static uint32_t timerTicks(uint32_t osr)
+{
+  return (convTimeUs[osr] + 999) / 1000;
+}
+
+static int selfTest(void)
+{
+  sweepError_t e;
+  float previous = 1e9f;
+  float a;
+  double p;
+  int errors = 0;
+  uint32_t i;
+
+  sweep(0, &e);
+  if (!(e.flight < 0.004) || !(e.all < 0.01))
+    errors++;
+
+  //No output at no pressure, 0 at p0, the altitude falls with the pressure
+  if (baroPressureToAltitude(0.0f) != 0.0f || baroPressureToAltitude(-1.0f) != 0.0f ||
+      baroPressureToAltitude(NAN) != 0.0f || fabsf(baroPressureToAltitude(BARO_SEA_PRESSURE)) > 2e-3f)
+    errors++;
+  for (p=SWEEP_MIN; p<=SWEEP_MAX; p+=0.01)
+  {
+    a = baroPressureToAltitude((float)p);
+    if (a > previous)
+    {
+      errors++;
+      break;
+    }
+    previous = a;
+  }
+
+  //The timer is never faster than the datasheet, never slower than the
+  //tick above it, and the old fixed period was too short for no OSR
+  for (i=0; i<sizeof(convTimeUs) / sizeof(convTimeUs[0]); i++)
+    if (timerTicks(i) * 1000 < convTimeUs[i] || timerTicks(i) * 1000 >= convTimeUs[i] + 1000 ||
+        OLD_PERIOD_MS * 1000 < convTimeUs[i])
+      errors++;
+
+  printf("%s, %d errors\n", errors ? "FAIL" : "pass", errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  static const char * names[] = {"float series", "double pow()", "powf()"};
+  sweepError_t e;
+  double ns;
+  uint32_t i;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': return selfTest();
+      default:
+        fprintf(stderr, "usage: %s [-t]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  printf("Altitude from pressure, error against long double:\n");
+  printf("  %-14s %16s %16s %10s\n", "", "300-1100 mbar", "10-1200 mbar", "ns/call");
+  for (i=0; i<3; i++)
+  {
+    sweep(i, &e);
+    ns = timeIt(i);
+    printf("  %-14s %13.3f mm %13.3f mm %10.2f\n", names[i], e.flight * 1e3, e.all * 1e3, ns);
+  }
+
+  printf("\nConversions per second (1 temperature in %d):\n", PRESSURE_PER_TEMP);
+  printf("  %-5s %10s %14s %14s\n", "OSR", "max us", "10ms polling", "timer");
+  for (i=0; i<sizeof(convTimeUs) / sizeof(convTimeUs[0]); i++)
+    printf("  %-5u %10u %14.0f %14.0f\n", 256u << i, convTimeUs[i],
+           1000.0 / OLD_PERIOD_MS, 1000.0 / timerTicks(i));
+
+  return 0;
+}
@@ -0,0 +1,335 @@
+/**
+ * blackbox_bench.c - Compression and speed of the blackbox frame encoding
+ *
+ *   gcc -O2 -I../../utils/inc -o blackbox_bench blackbox_bench.c \
+ *       blackbox_reader.c ../../utils/src/blackbox_codec.c -lm
+ *
+ *   ./blackbox_bench LOG00.BBL          replays the frames of a recording
+ *   ./blackbox_bench -s 120             120s of a synthetic flight at 1kHz
+ *   ./blackbox_bench -s 120 -o SIM.BBL  also writes it as a recording, to
+ *                                       try blackbox_decode
+ *   ./blackbox_bench -s 120 -o SIM.BBL -e 100000
+ *                                       with one corrupted byte every 100000
+ *
+ * The frames are encoded and decoded again with the firmware codec
+ * (utils/src/blackbox_codec.c). The decoded values must be the encoded ones,
+ * the sizes are compared with the raw frames of the version 1 logs (100
+ * bytes of floats) and with plain 32 bit integers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blackbox_reader.h"
+
+#define RAW_FRAME_SIZE   100     // blackboxFrame_t of the version 1 logs
+#define LOOP_RATE        1000
+#define DATA_OFFSET      8192
+
+/* Same layout as the firmware table, utils/src/blackbox.c */
+static const blackboxField_t simFields[] =
+{
+  {"tick", 1, blackboxPredictLinear},
+  {"gyroX", 16, blackboxPredictAverage}, {"gyroY", 16, blackboxPredictAverage},
+  {"gyroZ", 16, blackboxPredictAverage},
+  {"accX", 1000, blackboxPredictAverage}, {"accY", 1000, blackboxPredictAverage},
+  {"accZ", 1000, blackboxPredictAverage},
+  {"magX", 1000, blackboxPredictPrevious}, {"magY", 1000, blackboxPredictPrevious},
+  {"magZ", 1000, blackboxPredictPrevious},
+  {"baroAsl", 100, blackboxPredictPrevious},
+  {"roll", 100, blackboxPredictLinear}, {"pitch", 100, blackboxPredictLinear},
+  {"yaw", 100, blackboxPredictLinear},
+  {"posZ", 1000, blackboxPredictLinear},
+  {"velZ", 1000, blackboxPredictLinear},
+  {"spRoll", 100, blackboxPredictPrevious}, {"spPitch", 100, blackboxPredictPrevious},
+  {"spYaw", 100, blackboxPredictPrevious},
+  {"spThrust", 1, blackboxPredictPrevious},
+  {"ctrlRoll", 1, blackboxPredictAverage}, {"ctrlPitch", 1, blackboxPredictAverage},
+  {"ctrlYaw", 1, blackboxPredictAverage},
+  {"ctrlThrust", 1, blackboxPredictAverage},
+  {"motor1", 1, blackboxPredictAverage}, {"motor2", 1, blackboxPredictAverage},
+  {"motor3", 1, blackboxPredictAverage}, {"motor4", 1, blackboxPredictAverage},
+};
+#define SIM_FIELDS (sizeof(simFields) / sizeof(simFields[0]))
+
+static bbReader_t reader;
+static const blackboxField_t * fields;
+static uint32_t count;
+static int32_t * frames;     // nFrames * count values
+static uint32_t nFrames;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int loadRecording(const char * path)
+{
+  uint32_t capacity = 65536;
+
+  if (bbReaderOpen(&reader, path) < 0)
+    return -1;
+
+  fields = reader.fields;
+  count = reader.count;
+  frames = malloc(capacity * count * sizeof(int32_t));
+
+  while (frames && bbReaderNext(&reader, &frames[nFrames * count]))
+  {
+    if (++nFrames == capacity)
+    {
+      capacity *= 2;
+      frames = realloc(frames, capacity * count * sizeof(int32_t));
+    }
+  }
+  bbReaderClose(&reader);
+
+  return frames ? 0 : -1;
+}
+
+/* Gaussian noise, sum of uniforms */
+static float noise(float sigma)
+{
+  float s = 0;
+  int i;
+
+  for (i=0; i<4; i++)
+    s += rand() / (float)RAND_MAX;
+
+  return (s - 2.0f) * 1.732f * sigma;
+}
+
+static void quantize(int32_t * v, uint32_t i, float value)
+{
+  v[i] = blackboxQuantize(value, simFields[i].scale);
+}
+
+/* Hover with slow attitude changes and sensor noise, 1kHz */
+static void synthesize(uint32_t seconds)
+{
+  float roll = 0, pitch = 0, yaw = 0, z = 0, vz = 0;
+  float spRoll = 0, spPitch = 0, spThrust = 38000;
+  uint32_t t;
+
+  fields = simFields;
+  count = SIM_FIELDS;
+  nFrames = seconds * LOOP_RATE;
+  frames = malloc((size_t)nFrames * count * sizeof(int32_t));
+  srand(1);
+
+  for (t=0; t<nFrames; t++)
+  {
+    int32_t * v = &frames[(size_t)t * count];
+    float dt = 1.0f / LOOP_RATE;
+    float time = t * dt;
+    float rateRoll, ratePitch, rateYaw;
+    int i;
+
+    //New setpoint every 2s
+    if (t % (2 * LOOP_RATE) == 0)
+    {
+      spRoll = (rand() % 21) - 10;
+      spPitch = (rand() % 21) - 10;
+      spThrust = 36000 + rand() % 4000;
+    }
+
+    rateRoll = 5.0f * (spRoll - roll) + 3.0f * sinf(2 * M_PI * 0.7f * time);
+    ratePitch = 5.0f * (spPitch - pitch) + 3.0f * sinf(2 * M_PI * 0.5f * time);
+    rateYaw = 2.0f * sinf(2 * M_PI * 0.1f * time);
+    roll += rateRoll * dt;
+    pitch += ratePitch * dt;
+    yaw += rateYaw * dt;
+    vz = 0.2f * sinf(2 * M_PI * 0.2f * time);
+    z += vz * dt;
+
+    v[0] = t;
+    quantize(v, 1, rateRoll + noise(0.5f));
+    quantize(v, 2, ratePitch + noise(0.5f));
+    quantize(v, 3, rateYaw + noise(0.5f));
+    quantize(v, 4, -sinf(pitch * M_PI / 180) + noise(0.02f));
+    quantize(v, 5, sinf(roll * M_PI / 180) + noise(0.02f));
+    quantize(v, 6, 1.0f + noise(0.02f));
+    quantize(v, 7, 0.2f + noise(0.003f));
+    quantize(v, 8, -0.1f + noise(0.003f));
+    quantize(v, 9, 0.4f + noise(0.003f));
+    quantize(v, 10, 120.0f + z + noise(0.1f));
+    quantize(v, 11, roll);
+    quantize(v, 12, pitch);
+    quantize(v, 13, yaw);
+    quantize(v, 14, z);
+    quantize(v, 15, vz);
+    quantize(v, 16, spRoll);
+    quantize(v, 17, spPitch);
+    quantize(v, 18, 0);
+    quantize(v, 19, spThrust);
+    quantize(v, 20, 300 * rateRoll + noise(200));
+    quantize(v, 21, 300 * ratePitch + noise(200));
+    quantize(v, 22, 300 * rateYaw + noise(200));
+    quantize(v, 23, spThrust + noise(300));
+    for (i=0; i<4; i++)
+      quantize(v, 24 + i, spThrust + ((i & 1) ? 1 : -1) * 300 * rateRoll + noise(300));
+  }
+}
+
+/* Header of the firmware, utils/src/blackbox.c */
+static void writeRecording(const char * path, const uint8_t * data, size_t len,
+                           unsigned long errorPeriod)
+{
+  FILE * f = fopen(path, "wb");
+  char header[DATA_OFFSET];
+  int n;
+  uint32_t i;
+  size_t j;
+
+  if (!f)
+  {
+    perror(path);
+    return;
+  }
+
+  memset(header, 0, sizeof(header));
+  n = sprintf(header, "H Product:Blackbox flight data recorder\nH Version:2\n"
+              "H Data offset:%d\nH Loop rate:%d\nH Rate divider:1\n"
+              "H Keyframe interval:%d\n", DATA_OFFSET, LOOP_RATE,
+              BLACKBOX_KEYFRAME_INTERVAL);
+  n += sprintf(header + n, "H Field name:");
+  for (i=0; i<count; i++)
+    n += sprintf(header + n, "%s%c", fields[i].name, i == count - 1 ? '\n' : ',');
+  n += sprintf(header + n, "H Field scale:");
+  for (i=0; i<count; i++)
+    n += sprintf(header + n, "%d%c", (int)fields[i].scale, i == count - 1 ? '\n' : ',');
+  n += sprintf(header + n, "H Field predictor:");
+  for (i=0; i<count; i++)
+    n += sprintf(header + n, "%d%c", fields[i].predictor, i == count - 1 ? '\n' : ',');
+
+  fwrite(header, 1, DATA_OFFSET, f);
+  for (j=0; j<len; j++)
+  {
+    uint8_t b = data[j];
+    if (errorPeriod && j % errorPeriod == errorPeriod - 1)
+      b ^= 0x5A;
+    fputc(b, f);
+  }
+  fclose(f);
+}
+
+int main(int argc, char ** argv)
+{
+  blackboxCodec_t enc, dec;
+  uint8_t * stream;
+  int32_t values[BLACKBOX_MAX_FIELDS];
+  const char * output = NULL;
+  unsigned long errorPeriod = 0;
+  uint32_t seconds = 0;
+  uint32_t repeat = 1;
+  uint32_t r, t, i;
+  size_t len = 0;
+  size_t pos;
+  double t0, t1, t2;
+  uint64_t keyframeBytes = 0, keyframes = 0;
+  uint32_t maxFrame = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:o:e:")) != -1)
+  {
+    switch (opt)
+    {
+      case 's': seconds = strtoul(optarg, NULL, 0); break;
+      case 'o': output = optarg; break;
+      case 'e': errorPeriod = strtoul(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: %s file.BBL | -s seconds [-o out.BBL [-e period]]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (seconds)
+    synthesize(seconds);
+  else if (optind >= argc || loadRecording(argv[optind]) < 0)
+  {
+    fprintf(stderr, "usage: %s file.BBL | -s seconds [-o out.BBL [-e period]]\n", argv[0]);
+    return 1;
+  }
+  if (nFrames == 0)
+  {
+    fprintf(stderr, "no frame\n");
+    return 1;
+  }
+
+  stream = malloc((size_t)nFrames * (1 + 5 * count));
+
+  //Sizes, on one pass
+  blackboxCodecInit(&enc, fields, count);
+  for (t=0; t<nFrames; t++)
+  {
+    uint32_t n = blackboxEncode(&enc, &frames[(size_t)t * count], &stream[len]);
+    if (stream[len] == BLACKBOX_FRAME_I)
+    {
+      keyframes++;
+      keyframeBytes += n;
+    }
+    if (n > maxFrame)
+      maxFrame = n;
+    len += n;
+  }
+
+  //Speed, on at least ~1s of work
+  repeat = 1 + 20000000 / nFrames;
+  t0 = now();
+  for (r=0; r<repeat; r++)
+  {
+    blackboxCodecInit(&enc, fields, count);
+    for (t=0, pos=0; t<nFrames; t++)
+      pos += blackboxEncode(&enc, &frames[(size_t)t * count], &stream[pos]);
+  }
+  t1 = now();
+  for (r=0; r<repeat; r++)
+  {
+    blackboxCodecInit(&dec, fields, count);
+    for (t=0, pos=0; t<nFrames; t++)
+      pos += blackboxDecode(&dec, &stream[pos], len - pos, values);
+  }
+  t2 = now();
+
+  //Exactness
+  blackboxCodecInit(&dec, fields, count);
+  for (t=0, pos=0; t<nFrames; t++)
+  {
+    int32_t n = blackboxDecode(&dec, &stream[pos], len - pos, values);
+    if (n <= 0 || memcmp(values, &frames[(size_t)t * count], count * sizeof(int32_t)) != 0)
+    {
+      for (i=0; i<count && n > 0; i++)
+        if (values[i] != frames[(size_t)t * count + i])
+          break;
+      fprintf(stderr, "frame %u: decoded value differs (field %u)\n", t, i);
+      return 1;
+    }
+    pos += n;
+  }
+
+  printf("%u frames, %u fields\n", nFrames, count);
+  printf("encoded: %.1f bytes/frame (keyframes %.1f, max %u), %zu bytes\n",
+         (double)len / nFrames, keyframes ? (double)keyframeBytes / keyframes : 0.0,
+         maxFrame, len);
+  printf("ratio: %.2fx raw floats (%d bytes), %.2fx int32 (%u bytes)\n",
+         (double)nFrames * RAW_FRAME_SIZE / len, RAW_FRAME_SIZE,
+         (double)nFrames * 4 * count / len, 4 * count);
+  printf("at %d Hz: %.1f kB/s, raw %.1f kB/s\n", LOOP_RATE,
+         (double)len / nFrames * LOOP_RATE / 1000, RAW_FRAME_SIZE * LOOP_RATE / 1000.0);
+  printf("encode: %.1f ns/frame, %.1f MB/s\n", (t1 - t0) * 1e9 / repeat / nFrames,
+         (double)len * repeat / (t1 - t0) / 1e6);
+  printf("decode: %.1f ns/frame, %.1f MB/s\n", (t2 - t1) * 1e9 / repeat / nFrames,
+         (double)len * repeat / (t2 - t1) / 1e6);
+
+  if (output)
+    writeRecording(output, stream, len, errorPeriod);
+
+  return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ * blackbox_decode.c - Blackbox recording to CSV
+ *
+ *   gcc -O2 -I../../utils/inc -o blackbox_decode blackbox_decode.c \
+ *       blackbox_reader.c ../../utils/src/blackbox_codec.c
+ *   ./blackbox_decode LOG00.BBL > LOG00.csv
+ *   ./blackbox_decode -r LOG00.BBL       quantized integers, not scaled back
+ *
+ * One line per frame, one column per field, in the units of the firmware.
+ * The frame and error counts go to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "blackbox_reader.h"
+
+static bbReader_t reader;
+
+int main(int argc, char ** argv)
+{
+  int32_t values[BLACKBOX_MAX_FIELDS];
+  int raw = 0;
+  uint32_t i;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r")) != -1)
+  {
+    switch (opt)
+    {
+      case 'r': raw = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-r] file.BBL\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc)
+  {
+    fprintf(stderr, "usage: %s [-r] file.BBL\n", argv[0]);
+    return 1;
+  }
+
+  if (bbReaderOpen(&reader, argv[optind]) < 0)
+    return 1;
+
+  for (i=0; i<reader.count; i++)
+    printf("%s%c", reader.names[i], i == reader.count - 1 ? '\n' : ',');
+
+  while (bbReaderNext(&reader, values))
+  {
+    for (i=0; i<reader.count; i++)
+    {
+      char sep = i == reader.count - 1 ? '\n' : ',';
+
+      if (raw || reader.fields[i].scale == 1.0f)
+        printf("%d%c", values[i], sep);
+      else
+        printf("%.6g%c", values[i] / reader.fields[i].scale, sep);
+    }
+  }
+
+  fprintf(stderr, "%llu frames (%llu keyframes), %.1f bytes/frame\n",
+          (unsigned long long)reader.frames, (unsigned long long)reader.keyframes,
+          reader.frames ? (double)reader.bytes / reader.frames : 0.0);
+  if (reader.skippedBytes)
+    fprintf(stderr, "%llu bytes skipped, %llu resyncs\n",
+            (unsigned long long)reader.skippedBytes, (unsigned long long)reader.resyncs);
+
+  bbReaderClose(&reader);
+
+  return 0;
+}
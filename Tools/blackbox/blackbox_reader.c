@@ -0,0 +1,185 @@
+/**
+ * blackbox_reader.c - Host reader of the blackbox recordings (LOGnn.BBL)
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "blackbox_reader.h"
+
+/* Split a comma separated header value, returns the item count */
+static uint32_t splitList(char * value, char ** items, uint32_t max)
+{
+  uint32_t n = 0;
+  char * item = strtok(value, ",");
+
+  while (item && n < max)
+  {
+    items[n++] = item;
+    item = strtok(NULL, ",");
+  }
+
+  return n;
+}
+
+static int parseHeader(bbReader_t * reader)
+{
+  char line[1024];
+  char * items[BLACKBOX_MAX_FIELDS];
+  uint32_t scales = 0;
+  uint32_t predictors = 0;
+  uint32_t n;
+  uint32_t i;
+
+  while (fgets(line, sizeof(line), reader->file) && strncmp(line, "H ", 2) == 0)
+  {
+    char * value = strchr(line, ':');
+
+    if (!value)
+      continue;
+    *value++ = '\0';
+    value[strcspn(value, "\r\n")] = '\0';
+
+    if (strcmp(line, "H Version") == 0)
+      reader->version = atoi(value);
+    else if (strcmp(line, "H Data offset") == 0)
+      reader->dataOffset = strtoul(value, NULL, 0);
+    else if (strcmp(line, "H Loop rate") == 0)
+      reader->loopRate = strtoul(value, NULL, 0);
+    else if (strcmp(line, "H Rate divider") == 0)
+      reader->rateDiv = strtoul(value, NULL, 0);
+    else if (strcmp(line, "H Field name") == 0)
+    {
+      reader->count = splitList(value, items, BLACKBOX_MAX_FIELDS);
+      for (i=0; i<reader->count; i++)
+      {
+        strncpy(reader->names[i], items[i], sizeof(reader->names[i]) - 1);
+        reader->fields[i].name = reader->names[i];
+      }
+    }
+    else if (strcmp(line, "H Field scale") == 0)
+    {
+      scales = n = splitList(value, items, BLACKBOX_MAX_FIELDS);
+      for (i=0; i<n; i++)
+        reader->fields[i].scale = (float)atof(items[i]);
+    }
+    else if (strcmp(line, "H Field predictor") == 0)
+    {
+      predictors = n = splitList(value, items, BLACKBOX_MAX_FIELDS);
+      for (i=0; i<n; i++)
+        reader->fields[i].predictor = (uint8_t)atoi(items[i]);
+    }
+  }
+
+  if (reader->version < 2)
+  {
+    fprintf(stderr, "log version %d: not a delta encoded log\n", reader->version);
+    return -1;
+  }
+  if (reader->count == 0 || scales != reader->count || predictors != reader->count ||
+      reader->dataOffset == 0)
+  {
+    fprintf(stderr, "incomplete header\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int bbReaderOpen(bbReader_t * reader, const char * path)
+{
+  memset(reader, 0, sizeof(*reader));
+
+  reader->file = fopen(path, "rb");
+  if (!reader->file)
+  {
+    perror(path);
+    return -1;
+  }
+
+  if (parseHeader(reader) < 0 || fseek(reader->file, reader->dataOffset, SEEK_SET) < 0)
+  {
+    fclose(reader->file);
+    reader->file = NULL;
+    return -1;
+  }
+
+  blackboxCodecInit(&reader->codec, reader->fields, reader->count);
+
+  return 0;
+}
+
+void bbReaderClose(bbReader_t * reader)
+{
+  if (reader->file)
+    fclose(reader->file);
+  reader->file = NULL;
+}
+
+/* Keep at least one whole frame in the buffer, unless at the end of file */
+static void refill(bbReader_t * reader)
+{
+  if (reader->eof || reader->length - reader->position >= BLACKBOX_MAX_FRAME_SIZE)
+    return;
+
+  memmove(reader->buffer, reader->buffer + reader->position, reader->length - reader->position);
+  reader->length -= reader->position;
+  reader->position = 0;
+
+  reader->length += fread(reader->buffer + reader->length, 1,
+                          BB_READER_BUFFER - reader->length, reader->file);
+  if (reader->length < BB_READER_BUFFER)
+    reader->eof = 1;
+}
+
+int bbReaderNext(bbReader_t * reader, int32_t * values)
+{
+  int skipping = 0;
+
+  while (1)
+  {
+    int32_t n;
+
+    refill(reader);
+    if (reader->position >= reader->length)
+      return 0;
+
+    //Zero padding after the last frame
+    if (reader->buffer[reader->position] == 0 && !skipping)
+      return 0;
+
+    n = blackboxDecode(&reader->codec, &reader->buffer[reader->position],
+                       reader->length - reader->position, values);
+    if (n > 0)
+    {
+      if (reader->buffer[reader->position] == BLACKBOX_FRAME_I)
+        reader->keyframes++;
+      reader->position += n;
+      reader->bytes += n;
+      reader->frames++;
+      if (skipping)
+        reader->resyncs++;
+      return 1;
+    }
+
+    //Truncated frame at the end of the file
+    if (n == 0)
+      return 0;
+
+    if (!skipping)
+      blackboxCodecReset(&reader->codec);
+    skipping = 1;
+    reader->position++;
+    reader->skippedBytes++;
+  }
+}
+
+int bbReaderField(const bbReader_t * reader, const char * name)
+{
+  uint32_t i;
+
+  for (i=0; i<reader->count; i++)
+    if (strcmp(reader->names[i], name) == 0)
+      return i;
+
+  return -1;
+}
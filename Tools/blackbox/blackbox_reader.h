@@ -0,0 +1,62 @@
+/**
+ * blackbox_reader.h - Host reader of the blackbox recordings (LOGnn.BBL)
+ *
+ * Parses the text header, then returns the frames one by one with the
+ * firmware codec (utils/src/blackbox_codec.c). The field names, scales and
+ * predictors come from the header, not from the firmware sources, so a
+ * reader built today reads the logs of other field sets.
+ *
+ * A frame which cannot be decoded (corruption, 'P' frame without its
+ * keyframe) is skipped byte by byte up to the next keyframe.
+ */
+#ifndef __BLACKBOX_READER_H__
+#define __BLACKBOX_READER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "blackbox_codec.h"
+
+#define BB_READER_BUFFER  65536
+
+typedef struct
+{
+  FILE * file;
+  int version;
+  uint32_t dataOffset;
+  uint32_t loopRate;
+  uint32_t rateDiv;
+  uint32_t count;
+  blackboxField_t fields[BLACKBOX_MAX_FIELDS];
+  char names[BLACKBOX_MAX_FIELDS][32];
+  blackboxCodec_t codec;
+
+  uint8_t buffer[BB_READER_BUFFER];
+  uint32_t length;
+  uint32_t position;
+  int eof;
+
+  /* Statistics */
+  uint64_t frames;
+  uint64_t keyframes;
+  uint64_t bytes;            // Bytes of the decoded frames
+  uint64_t skippedBytes;
+  uint64_t resyncs;
+} bbReader_t;
+
+/* Returns 0, or -1 with a message on stderr */
+int bbReaderOpen(bbReader_t * reader, const char * path);
+void bbReaderClose(bbReader_t * reader);
+
+/**
+ * Next frame of the log.
+ *
+ * @param[out] values reader->count quantized values
+ * @return 1 when a frame is returned, 0 at the end of the data
+ */
+int bbReaderNext(bbReader_t * reader, int32_t * values);
+
+/* Index of a field, -1 if the log does not have it */
+int bbReaderField(const bbReader_t * reader, const char * name);
+
+#endif //__BLACKBOX_READER_H__
@@ -0,0 +1,240 @@
+/**
+ * bprintf_decode.c - Host decoder of the deferred binary printf
+ *
+ * Rebuilds the text of the BPRINTF() records from the console stream and
+ * the string table extracted from the firmware:
+ *
+ *   arm-none-eabi-objcopy -O binary -j .bprintf firmware.out strings.bin
+ *   gcc -O2 -I../../utils/inc -o bprintf_decode bprintf_decode.c \
+ *       ../../utils/src/bprintf_format.c
+ *   ./bprintf_decode strings.bin < /dev/ttyUSB0
+ *
+ * Bytes which are not part of a record (plain printf before the drain task
+ * runs, for instance) are copied as they are.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bprintf.h"
+
+static char * strings;
+static long stringsLen;
+
+static int loadStrings(const char * path)
+{
+  FILE * f = fopen(path, "rb");
+
+  if (!f)
+    return -1;
+
+  fseek(f, 0, SEEK_END);
+  stringsLen = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  strings = malloc(stringsLen + 1);
+  if (!strings || fread(strings, 1, stringsLen, f) != (size_t)stringsLen)
+  {
+    fclose(f);
+    return -1;
+  }
+  strings[stringsLen] = '\0';
+  fclose(f);
+
+  return 0;
+}
+
+/* A 32bit argument on the host, where long, size_t and pointers are 64bit:
+ * printed as an int, without length modifier, and %p as 0x%08x */
+static void int32Spec(char * spec)
+{
+  char * d = spec;
+  const char * s;
+
+  if (spec[strlen(spec) - 1] == 'p')
+  {
+    strcpy(spec, "0x%08x");
+    return;
+  }
+  for (s = spec; *s; s++)
+  {
+    if (!strchr("lztj", *s))
+      *d++ = *s;
+  }
+  *d = '\0';
+}
+
+/* Print one record. Returns the number of arguments missing from it. */
+static int printRecord(FILE * out, const char * fmt, const uint8_t * payload, int len)
+{
+  const uint8_t * ptr = payload;
+  const uint8_t * end = payload + len;
+  bprintfSite_t site;
+  uint32_t types;
+  int missing = 0;
+  char spec[32];
+
+  bprintfParseFormat(fmt, &site);
+  types = site.types;
+
+  while (*fmt)
+  {
+    const char * start;
+    int stars[2];
+    int nstars = 0;
+    int n;
+
+    if (*fmt != '%')
+    {
+      fputc(*fmt++, out);
+      continue;
+    }
+
+    if (fmt[1] == '%')
+    {
+      fputc('%', out);
+      fmt += 2;
+      continue;
+    }
+
+    start = fmt++;
+    while (*fmt && strchr("-+ #.*0123456789lhztj", *fmt))
+    {
+      if (*fmt == '*')
+      {
+        int32_t v = 0;
+        if (ptr + 4 <= end)
+          memcpy(&v, ptr, 4);
+        ptr += 4;
+        types >>= 2;
+        if (nstars < 2)
+          stars[nstars++] = v;
+      }
+      fmt++;
+    }
+    if (*fmt == '\0')
+      break;
+    fmt++;
+
+    n = fmt - start;
+    if (n >= (int)sizeof(spec))
+      n = sizeof(spec) - 1;
+    memcpy(spec, start, n);
+    spec[n] = '\0';
+
+    switch (types & 0x03)
+    {
+      case BPRINTF_ARG_INT32:
+      {
+        int32_t v;
+        if (ptr + 4 > end) { fputs("?", out); missing++; break; }
+        memcpy(&v, ptr, 4);
+        ptr += 4;
+        int32Spec(spec);
+        if (spec[0] != '%')   fprintf(out, spec, (int)v);
+        else if (nstars == 2) fprintf(out, spec, stars[0], stars[1], (int)v);
+        else if (nstars == 1) fprintf(out, spec, stars[0], (int)v);
+        else                  fprintf(out, spec, (int)v);
+        break;
+      }
+      case BPRINTF_ARG_64BIT:
+      {
+        uint64_t raw;
+        if (ptr + 8 > end) { fputs("?", out); missing++; break; }
+        memcpy(&raw, ptr, 8);
+        ptr += 8;
+        if (strchr("fFeEgG", spec[n-1]))
+        {
+          double v;
+          memcpy(&v, &raw, 8);
+          if (nstars == 2)      fprintf(out, spec, stars[0], stars[1], v);
+          else if (nstars == 1) fprintf(out, spec, stars[0], v);
+          else                  fprintf(out, spec, v);
+        }
+        else
+        {
+          if (nstars == 2)      fprintf(out, spec, stars[0], stars[1], (long long)raw);
+          else if (nstars == 1) fprintf(out, spec, stars[0], (long long)raw);
+          else                  fprintf(out, spec, (long long)raw);
+        }
+        break;
+      }
+      case BPRINTF_ARG_STRING:
+      {
+        const uint8_t * s = ptr;
+        while (ptr < end && *ptr)
+          ptr++;
+        if (ptr >= end) { fputs("?", out); missing++; break; }
+        ptr++;
+        if (nstars == 2)      fprintf(out, spec, stars[0], stars[1], (const char *)s);
+        else if (nstars == 1) fprintf(out, spec, stars[0], (const char *)s);
+        else                  fprintf(out, spec, (const char *)s);
+        break;
+      }
+    }
+    types >>= 2;
+  }
+
+  return missing;
+}
+
+int main(int argc, char ** argv)
+{
+  FILE * in = stdin;
+  uint8_t header[BPRINTF_HEADER_LEN];
+  uint8_t payload[256];
+  unsigned long records = 0;
+  unsigned long bad = 0;
+  int c;
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s strings.bin [stream.bin]\n", argv[0]);
+    return 1;
+  }
+
+  if (loadStrings(argv[1]) < 0)
+  {
+    fprintf(stderr, "cannot read the string table %s\n", argv[1]);
+    return 1;
+  }
+
+  if (argc > 2 && !(in = fopen(argv[2], "rb")))
+  {
+    fprintf(stderr, "cannot open %s\n", argv[2]);
+    return 1;
+  }
+
+  while ((c = fgetc(in)) != EOF)
+  {
+    unsigned int id;
+
+    if (c != BPRINTF_SYNC)
+    {
+      fputc(c, stdout);
+      continue;
+    }
+
+    header[0] = c;
+    if (fread(&header[1], 1, BPRINTF_HEADER_LEN-1, in) != BPRINTF_HEADER_LEN-1)
+      break;
+    if (fread(payload, 1, header[3], in) != header[3])
+      break;
+
+    id = header[1] | (header[2] << 8);
+    if (id >= stringsLen || header[3] > BPRINTF_MAX_PAYLOAD)
+    {
+      bad++;
+      continue;
+    }
+
+    printRecord(stdout, &strings[id], payload, header[3]);
+    fflush(stdout);
+    records++;
+  }
+
+  fprintf(stderr, "%lu records, %lu invalid\n", records, bad);
+
+  return 0;
+}
@@ -0,0 +1,359 @@
+/**
+ * estimator_replay.c - Replays a flight through Control/src/estimator_complementary.c
+ *
+ * A synthetic flight, rates up to 300 deg/s changing at a few Hz, is read
+ * the way the stabilizer task reads it: a 1kHz tick, the IMU read every
+ * second tick, the read late by the injected jitter of the task. After a
+ * stall of the task the ticks missed run back to back, as vTaskDelayUntil()
+ * catches up. Three estimators get the same samples:
+ *
+ *   fixed 250Hz  the previous one: the last sample every fourth tick, with
+ *                dt = 1/250s whatever the time it was read
+ *   fixed 500Hz  each sample once, dt = 1/500s: the rate without the dt
+ *   measured     stateEstimator(): each sample once, dt from the timestamps
+ *
+ * Their attitude error against the motion is measured at each update, at
+ * the time its sample was read. The tilt is held by the accelerometer, the
+ * yaw only integrates the gyro: its error is the integration one. Each
+ * scenario is the mean of SEEDS runs, one run moves by 0.03 deg with dt.
+ *
+ *   gcc -O2 -I. -I../../Control/inc -I../../HAL/inc -I../../utils/inc \
+ *       -o estimator_replay estimator_replay.c \
+ *       ../../Control/src/estimator_complementary.c \
+ *       ../../Control/src/sensfusion6.c \
+ *       ../../Control/src/position_estimator_altitude.c \
+ *       ../../utils/src/num.c -lm
+ *
+ *   ./estimator_replay       the scenarios
+ *   ./estimator_replay -t    self test
+ *
+ * main.h here stands in for the target one.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "estimator.h"
+#include "sensfusion6.h"
+
+#define TICK_S          0.001       // The stabilizer loop
+#define TICKS           60000       // 60s
+#define WARMUP_TICKS    2000        // Not measured
+#define TRUTH_STEP_S    0.00005     // Integration of the motion
+#define GYRO_NOISE      0.2         // deg/s
+#define ACC_NOISE       0.02        // g
+#define SEEDS           4           // Runs of each scenario
+
+/* sensfusion6.c, reset between the runs */
+extern float q0, q1, q2, q3;
+extern float integralFBx, integralFBy, integralFBz;
+
+uint32_t SystemCoreClock = 168000000;
+
+typedef struct
+{
+  const char * name;
+  double jitter;        // s, each tick late by up to it, uniform
+  double stallRate;     // Per tick, a stall starts
+  double stallMax;      // s, up to it, the ticks after it run back to back
+} scenario_t;
+
+typedef enum
+{
+  ESTIMATOR_FIXED_250 = 0,
+  ESTIMATOR_FIXED_500,
+  ESTIMATOR_MEASURED,
+  ESTIMATORS,
+} estimator_t;
+
+typedef struct
+{
+  double rms;           // deg, whole attitude
+  double max;
+  double yawEnd;        // deg, at the end; rms over the seeds
+  uint32_t updates;     // Of the estimator, per run
+} result_t;
+
+static const scenario_t scenarios[] =
+{
+  { "no jitter",                  0.0,      0.0,    0.0 },
+  { "jitter 0.4ms",               0.0004,   0.0,    0.0 },
+  { "jitter 0.4ms, stalls 8ms",   0.0004,   0.005,  0.008 },
+  { "jitter 1ms, stalls 20ms",    0.001,    0.005,  0.02 },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static uint64_t rngState;
+
+static double uniform(void)
+{
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 7;
+  rngState ^= rngState << 17;
+  return ((rngState >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gauss(void)
+{
+  return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+/* Body rates, deg/s */
+static void motionRate(double t, double w[3])
+{
+  w[0] = 250.0 * sin(2 * M_PI * 1.3 * t) + 50.0 * sin(2 * M_PI * 4.1 * t + 0.3);
+  w[1] = 200.0 * sin(2 * M_PI * 0.9 * t + 1.0) + 60.0 * sin(2 * M_PI * 3.7 * t);
+  w[2] = 150.0 * sin(2 * M_PI * 0.6 * t + 2.0) + 40.0 * sin(2 * M_PI * 2.9 * t + 1.2);
+}
+
+static void quatMultiply(const double a[4], const double b[4], double r[4])
+{
+  double t[4];
+
+  t[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+  t[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+  t[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+  t[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+  memcpy(r, t, sizeof(t));
+}
+
+/* The true attitude, body to earth as sensfusion6.c, moved forward to t */
+typedef struct
+{
+  double q[4];
+  double t;
+} truth_t;
+
+static void truthAdvance(truth_t * truth, double t)
+{
+  double w[3], d[4], angle, n;
+  double h;
+
+  while (truth->t < t)
+  {
+    h = t - truth->t;
+    if (h > TRUTH_STEP_S)
+      h = TRUTH_STEP_S;
+    motionRate(truth->t + 0.5 * h, w);
+    n = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+    angle = n * M_PI / 180.0 * h;
+    d[0] = cos(0.5 * angle);
+    d[1] = d[2] = d[3] = 0.0;
+    if (n > 0.0)
+    {
+      d[1] = sin(0.5 * angle) * w[0] / n;
+      d[2] = sin(0.5 * angle) * w[1] / n;
+      d[3] = sin(0.5 * angle) * w[2] / n;
+    }
+    quatMultiply(truth->q, d, truth->q);
+    truth->t += h;
+  }
+}
+
+/* The samples at the time of the read: gyro deg/s, acc g (gravity only) */
+static void sample(const truth_t * truth, sensorData_t * s)
+{
+  const double * q = truth->q;
+  double w[3];
+
+  motionRate(truth->t, w);
+  s->gyro.x = (float)(w[0] + GYRO_NOISE * gauss());
+  s->gyro.y = (float)(w[1] + GYRO_NOISE * gauss());
+  s->gyro.z = (float)(w[2] + GYRO_NOISE * gauss());
+  // Earth z in the body frame
+  s->acc.x = (float)(2 * (q[1] * q[3] - q[0] * q[2]) + ACC_NOISE * gauss());
+  s->acc.y = (float)(2 * (q[0] * q[1] + q[2] * q[3]) + ACC_NOISE * gauss());
+  s->acc.z = (float)(q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3] + ACC_NOISE * gauss());
+}
+
+/* Angle of the estimate from the truth, and its yaw part, deg */
+static void attitudeError(const truth_t * truth, double * angle, double * yaw)
+{
+  double qe[4] = { q0, -q1, -q2, -q3 };
+  double d[4];
+  double yawTrue, yawEst;
+  const double * q = truth->q;
+
+  // invSqrt() leaves the estimate off unit norm by up to 0.2%
+  quatMultiply(qe, q, d);
+  *angle = 2.0 * atan2(sqrt(d[1] * d[1] + d[2] * d[2] + d[3] * d[3]), fabs(d[0])) * 180.0 / M_PI;
+
+  yawTrue = atan2(2 * (q[0] * q[3] + q[1] * q[2]), q[0] * q[0] + q[1] * q[1] - q[2] * q[2] - q[3] * q[3]);
+  yawEst = atan2(2 * (q0 * q3 + q1 * q2), q0 * q0 + q1 * q1 - q2 * q2 - q3 * q3);
+  *yaw = remainder(yawEst - yawTrue, 2 * M_PI) * 180.0 / M_PI;
+}
+
+static void sensfusionReset(void)
+{
+  q0 = 1.0f;
+  q1 = q2 = q3 = 0.0f;
+  integralFBx = integralFBy = integralFBz = 0.0f;
+}
+
+/* The start of the measured run, stateEstimator() goes on from the previous one's last sample */
+static double timeBase;
+
+static void run(const scenario_t * s, estimator_t estimator, uint64_t seed, result_t * res)
+{
+  static sensorData_t sensorData;
+  static state_t state;
+  truth_t truth = { {1.0, 0.0, 0.0, 0.0}, 0.0 };
+  double stallEnd = 0.0;
+  double readAt = 0.0;
+  double t, angle, yaw, sq = 0.0;
+  uint32_t tick, count = 0;
+
+  memset(res, 0, sizeof(*res));
+  memset(&sensorData, 0, sizeof(sensorData));
+  rngState = seed;
+  sensfusionReset();
+
+  for (tick = 0; tick < TICKS; tick++)
+  {
+    // The task runs late by its jitter, after a stall the missed ticks back to back
+    t = tick * TICK_S + s->jitter * uniform();
+    if (s->stallRate > 0.0 && uniform() < s->stallRate && stallEnd < t)
+      stallEnd = t + s->stallMax * uniform();
+    if (t < stallEnd)
+      t = stallEnd;
+
+    if ((tick % 2) == 0)
+    {
+      truthAdvance(&truth, t);
+      sample(&truth, &sensorData);
+      sensorData.imuTimestamp = (uint32_t)(uint64_t)llround((timeBase + t) * SystemCoreClock);
+      readAt = t;
+    }
+
+    if (estimator == ESTIMATOR_MEASURED)
+    {
+      stateEstimator(&state, &sensorData, tick);
+      if ((tick % 2) != 0)
+        continue;
+    }
+    else if (estimator == ESTIMATOR_FIXED_500)
+    {
+      if ((tick % 2) != 0)
+        continue;
+      sensfusion6UpdateQ(sensorData.gyro.x, sensorData.gyro.y, sensorData.gyro.z,
+                         sensorData.acc.x, sensorData.acc.y, sensorData.acc.z,
+                         1.0f / 500);
+    }
+    else
+    {
+      if ((tick % 4) != 0)
+        continue;
+      sensfusion6UpdateQ(sensorData.gyro.x, sensorData.gyro.y, sensorData.gyro.z,
+                         sensorData.acc.x, sensorData.acc.y, sensorData.acc.z,
+                         1.0f / 250);
+    }
+    res->updates++;
+
+    // The estimate is for the last read, where the truth is
+    if (tick < WARMUP_TICKS)
+      continue;
+    attitudeError(&truth, &angle, &yaw);
+    sq += angle * angle;
+    if (angle > res->max)
+      res->max = angle;
+    res->yawEnd = yaw;
+    count++;
+  }
+
+  res->rms = count ? sqrt(sq / count) : 0.0;
+  // The next run's first sample one read period after this one's last
+  if (estimator == ESTIMATOR_MEASURED)
+    timeBase += readAt + 2 * TICK_S;
+}
+
+/* The mean rms, the largest error, over SEEDS runs */
+static void runSeeds(const scenario_t * s, estimator_t estimator, result_t * res)
+{
+  result_t one;
+  double rms = 0.0, yaw = 0.0;
+  uint32_t i;
+
+  memset(res, 0, sizeof(*res));
+  for (i = 0; i < SEEDS; i++)
+  {
+    run(s, estimator, 0x1234567 + 7919 * i, &one);
+    rms += one.rms;
+    yaw += one.yawEnd * one.yawEnd;
+    if (one.max > res->max)
+      res->max = one.max;
+    res->updates = one.updates;
+  }
+  res->rms = rms / SEEDS;
+  res->yawEnd = sqrt(yaw / SEEDS);
+}
+
+static void report(void)
+{
+  result_t res[ESTIMATORS];
+  uint32_t i, e;
+
+  printf("%-26s %20s %20s %20s\n", "", "fixed dt 250Hz", "fixed dt 500Hz", "measured dt");
+  printf("%-26s", "scenario (deg)");
+  for (e = 0; e < ESTIMATORS; e++)
+    printf(" %6s %6s %6s", "rms", "max", "yaw");
+  printf("\n");
+  for (i = 0; i < SCENARIOS; i++)
+  {
+    printf("%-26s", scenarios[i].name);
+    for (e = 0; e < ESTIMATORS; e++)
+    {
+      runSeeds(&scenarios[i], (estimator_t)e, &res[e]);
+      printf(" %6.3f %6.3f %6.2f", res[e].rms, res[e].max, res[e].yawEnd);
+    }
+    printf("\n");
+  }
+}
+
+static int selfTest(void)
+{
+  result_t fixed250, fixed500, measured;
+  int fails = 0;
+  uint32_t i;
+
+  for (i = 0; i < SCENARIOS; i++)
+  {
+    runSeeds(&scenarios[i], ESTIMATOR_FIXED_250, &fixed250);
+    runSeeds(&scenarios[i], ESTIMATOR_FIXED_500, &fixed500);
+    runSeeds(&scenarios[i], ESTIMATOR_MEASURED, &measured);
+
+    // Every sample taken once
+    if (measured.updates != TICKS / 2)
+    {
+      printf("FAIL %s: %u updates\n", scenarios[i].name, (unsigned)measured.updates);
+      fails++;
+    }
+    // No worse than a fixed dt at the same rate, better than the divider
+    if (measured.rms > 1.1 * fixed500.rms || measured.rms > fixed250.rms)
+    {
+      printf("FAIL %s: rms %.3f deg, fixed dt %.3f at 500Hz, %.3f at 250Hz\n",
+             scenarios[i].name, measured.rms, fixed500.rms, fixed250.rms);
+      fails++;
+    }
+    // The late reads, the stalls most, no longer show in the largest error
+    if (measured.max > (scenarios[i].stallRate > 0.0 ? 0.7 : 1.05) * fixed500.max)
+    {
+      printf("FAIL %s: max %.3f deg, fixed dt %.3f\n", scenarios[i].name, measured.max, fixed500.max);
+      fails++;
+    }
+  }
+
+  printf(fails ? "self test FAILED\n" : "self test passed\n");
+  return fails ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  stateEstimatorInit();
+
+  if (argc > 1 && strcmp(argv[1], "-t") == 0)
+    return selfTest();
+
+  report();
+  return 0;
+}
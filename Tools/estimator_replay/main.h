@@ -0,0 +1,30 @@
+/**
+ * main.h - Stands in for User/inc/main.h in estimator_replay.c
+ *
+ * Only what Control/src/estimator_complementary.c, sensfusion6.c and
+ * position_estimator_altitude.c use: the core clock and the tick of the
+ * target, the log and param tables left out.
+ */
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "num.h"
+
+extern uint32_t SystemCoreClock;
+
+#define configTICK_RATE_HZ  1000
+#define T2M(X) ((unsigned int)((X)*(1000.0/configTICK_RATE_HZ)))
+
+#define LOG_GROUP_START(NAME)
+#define LOG_ADD(TYPE, NAME, ADDRESS)
+#define LOG_GROUP_STOP(NAME)
+#define PARAM_GROUP_START(NAME)
+#define PARAM_ADD(TYPE, NAME, ADDRESS)
+#define PARAM_GROUP_STOP(NAME)
+
+#endif //__MAIN_H
@@ -0,0 +1,315 @@
+/**
+ * diskio_host.c - FatFs disk backend for Linux
+ *
+ * Also provides what the firmware gets from elsewhere: get_fattime(),
+ * ff_memalloc()/ff_memfree() and a plain ASCII ff_convert()/ff_wtoupper()
+ * for the long file names (the firmware links the code page tables).
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ff.h"
+#include "diskio_host.h"
+#include "diskcache.h"
+
+#define DEV_TF		0
+#define SECTOR_SIZE	512
+
+const diskHostLatency_t diskHostNoLatency = {0};
+
+const diskHostLatency_t diskHostSdLatency =
+{
+  .commandUs = 150,
+  .readSectorUs = 25,
+  .writeSectorUs = 60,
+  .programUs = 700,
+  .randomWriteUs = 1500,
+  .eraseBlockSectors = 8192,   // 4MB allocation unit
+  .eraseUs = 3000,
+  .syncUs = 0,
+  .stallEvery = 500,
+  .stallUs = 40000,
+};
+
+static int fd = -1;
+static BYTE * ram;
+static DWORD sectorCount;
+static diskHostLatency_t latency;
+static DSTATUS status = STA_NOINIT;
+
+static uint64_t timeUs;
+static DWORD nextWriteSector = (DWORD)-1;
+static DWORD writeCommands;
+static DSTATS stats;
+static DCACHE cache;
+
+int diskHostOpenImage(const char * path, DWORD sectors)
+{
+  off_t size;
+
+  diskHostClose();
+
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return -1;
+
+  size = lseek(fd, 0, SEEK_END);
+  if (sectors == 0)
+    sectors = size / SECTOR_SIZE;
+  else if (size < (off_t)sectors * SECTOR_SIZE && ftruncate(fd, (off_t)sectors * SECTOR_SIZE) < 0)
+  {
+    close(fd);
+    fd = -1;
+    return -1;
+  }
+
+  sectorCount = sectors;
+  return 0;
+}
+
+int diskHostOpenRam(DWORD sectors)
+{
+  diskHostClose();
+
+  ram = calloc(sectors, SECTOR_SIZE);
+  if (!ram)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  sectorCount = sectors;
+  return 0;
+}
+
+void diskHostClose(void)
+{
+  if (fd >= 0)
+    close(fd);
+  fd = -1;
+  free(ram);
+  ram = NULL;
+  sectorCount = 0;
+  status = STA_NOINIT;
+  timeUs = 0;
+  nextWriteSector = (DWORD)-1;
+  writeCommands = 0;
+  memset(&stats, 0, sizeof(stats));
+  memset(&cache, 0, sizeof(cache));
+}
+
+void diskHostSetLatency(const diskHostLatency_t * l)
+{
+  latency = *l;
+}
+
+void diskHostClearStats(void)
+{
+  memset(&stats, 0, sizeof(stats));
+  memset(&cache.stats, 0, sizeof(cache.stats));
+}
+
+uint64_t diskHostTimeUs(void)
+{
+  return timeUs;
+}
+
+/* Charge a latency to the device clock, returns it */
+static DWORD spend(DWORD us)
+{
+  timeUs += us;
+
+  if (latency.realtime && us)
+  {
+    struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+      ;
+  }
+
+  return us;
+}
+
+static DWORD writeCost(DWORD sector, UINT count)
+{
+  DWORD us = latency.commandUs + count * latency.writeSectorUs + latency.programUs;
+
+  if (sector != nextWriteSector)
+    us += latency.randomWriteUs;
+
+  //Entering a new erase block
+  if (latency.eraseBlockSectors &&
+      (sector != nextWriteSector || sector % latency.eraseBlockSectors == 0 ||
+       sector / latency.eraseBlockSectors != (sector + count - 1) / latency.eraseBlockSectors))
+    us += latency.eraseUs;
+
+  if (latency.stallEvery && ++writeCommands % latency.stallEvery == 0)
+    us += latency.stallUs;
+
+  nextWriteSector = sector + count;
+
+  return us;
+}
+
+static void updateTime (DWORD *total, DWORD *max, DWORD t)
+{
+  *total += t;
+  if (t > *max)
+    *max = t;
+}
+
+DSTATUS disk_status (BYTE pdrv)
+{
+  return pdrv == DEV_TF ? status : STA_NOINIT;
+}
+
+/* Driver side of the cache: the image or RAM disk */
+static DRESULT devRead (BYTE *buff, DWORD sector, UINT count);
+static DRESULT devWrite (const BYTE *buff, DWORD sector, UINT count);
+
+DSTATUS disk_initialize (BYTE pdrv)
+{
+  if (pdrv != DEV_TF || (fd < 0 && !ram))
+    return STA_NOINIT;
+
+  disk_cache_init(&cache, devRead, devWrite);
+
+  status = 0;
+  return status;
+}
+
+static DRESULT devRead (BYTE *buff, DWORD sector, UINT count)
+{
+  size_t len = (size_t)count * SECTOR_SIZE;
+
+  if (sector + count > sectorCount)
+    return RES_PARERR;
+
+  if (ram)
+    memcpy(buff, ram + (size_t)sector * SECTOR_SIZE, len);
+  else if (pread(fd, buff, len, (off_t)sector * SECTOR_SIZE) != (ssize_t)len)
+  {
+    stats.errors++;
+    return RES_ERROR;
+  }
+
+  stats.reads++;
+  stats.sectorsRead += count;
+  updateTime(&stats.readTimeTotal, &stats.readTimeMax,
+             spend(latency.commandUs + count * latency.readSectorUs));
+
+  return RES_OK;
+}
+
+static DRESULT devWrite (const BYTE *buff, DWORD sector, UINT count)
+{
+  size_t len = (size_t)count * SECTOR_SIZE;
+
+  if (sector + count > sectorCount)
+    return RES_PARERR;
+
+  if (ram)
+    memcpy(ram + (size_t)sector * SECTOR_SIZE, buff, len);
+  else if (pwrite(fd, buff, len, (off_t)sector * SECTOR_SIZE) != (ssize_t)len)
+  {
+    stats.errors++;
+    return RES_ERROR;
+  }
+
+  stats.writes++;
+  stats.sectorsWritten += count;
+  updateTime(&stats.writeTimeTotal, &stats.writeTimeMax, spend(writeCost(sector, count)));
+
+  return RES_OK;
+}
+
+DRESULT disk_read (BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+  if (pdrv != DEV_TF || (status & STA_NOINIT))
+    return RES_NOTRDY;
+
+  return disk_cache_read(&cache, buff, sector, count);
+}
+
+DRESULT disk_write (BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+  if (pdrv != DEV_TF || (status & STA_NOINIT))
+    return RES_NOTRDY;
+
+  return disk_cache_write(&cache, buff, sector, count);
+}
+
+DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void *buff)
+{
+  if (pdrv != DEV_TF || (status & STA_NOINIT))
+    return RES_NOTRDY;
+
+  switch (cmd)
+  {
+    case CTRL_SYNC:
+      spend(latency.syncUs);
+      return disk_cache_sync(&cache);
+    case GET_SECTOR_SIZE:
+      *(WORD *)buff = SECTOR_SIZE;
+      return RES_OK;
+    case GET_BLOCK_SIZE:
+      *(DWORD *)buff = latency.eraseBlockSectors ? latency.eraseBlockSectors : 1;
+      return RES_OK;
+    case GET_SECTOR_COUNT:
+      *(DWORD *)buff = sectorCount;
+      return RES_OK;
+    default:
+      return RES_PARERR;
+  }
+}
+
+void disk_get_stats (BYTE pdrv, DSTATS *st)
+{
+  if (pdrv == DEV_TF)
+    *st = stats;
+  else
+    memset(st, 0, sizeof(DSTATS));
+}
+
+void disk_get_cache_stats (BYTE pdrv, DCSTATS *st)
+{
+  if (pdrv == DEV_TF)
+    *st = cache.stats;
+  else
+    memset(st, 0, sizeof(DCSTATS));
+}
+
+DWORD get_fattime (void)
+{
+  time_t t = time(NULL);
+  struct tm * tm = localtime(&t);
+
+  return ((DWORD)(tm->tm_year - 80) << 25) | ((DWORD)(tm->tm_mon + 1) << 21) |
+         ((DWORD)tm->tm_mday << 16) | ((DWORD)tm->tm_hour << 11) |
+         ((DWORD)tm->tm_min << 5) | ((DWORD)tm->tm_sec >> 1);
+}
+
+void * ff_memalloc (UINT size)
+{
+  return malloc(size);
+}
+
+void ff_memfree (void * mf)
+{
+  free(mf);
+}
+
+WCHAR ff_convert (WCHAR chr, UINT dir)
+{
+  (void)dir;
+  return chr < 0x80 ? chr : 0;
+}
+
+WCHAR ff_wtoupper (WCHAR chr)
+{
+  return (chr >= 'a' && chr <= 'z') ? chr - 0x20 : chr;
+}
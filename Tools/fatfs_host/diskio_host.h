@@ -0,0 +1,63 @@
+/**
+ * diskio_host.h - FatFs disk backend for Linux
+ *
+ * Replaces FatFs/src/diskio.c in host builds: drive 0 (DEV_TF) is a disk
+ * image file or a RAM disk instead of the SD card. Each access may be
+ * charged a latency modelled on an SD card, so storage code (FatFs options,
+ * cluster size, the blackbox write pattern) is measured off-target.
+ *
+ * The latency is added to a simulated device clock, read with
+ * diskHostTimeUs(). With realtime set the calling thread also sleeps for it.
+ * disk_get_stats() returns the simulated times, as the firmware returns the
+ * measured ones. As in the firmware the drive goes through the sector cache
+ * (FatFs/src/diskcache.c), DISK_CACHE_SECTORS may be set on the gcc line.
+ */
+#ifndef __DISKIO_HOST_H__
+#define __DISKIO_HOST_H__
+
+#include <stdint.h>
+
+#include "diskio.h"
+
+/* SD card timing model, all times in us */
+typedef struct
+{
+  uint32_t commandUs;          // Each read or write command
+  uint32_t readSectorUs;       // Each sector read
+  uint32_t writeSectorUs;      // Each sector written
+  uint32_t programUs;          // Busy time at the end of each write command
+  uint32_t randomWriteUs;      // Write not following the previous one
+  uint32_t eraseBlockSectors;  // Erase block (GET_BLOCK_SIZE), in sectors
+  uint32_t eraseUs;            // First write in an erase block
+  uint32_t syncUs;             // CTRL_SYNC
+  uint32_t stallEvery;         // Every N write commands the card stalls...
+  uint32_t stallUs;            // ...for that long (internal garbage collection)
+  int realtime;                // Also sleep for the latency
+} diskHostLatency_t;
+
+/* No latency: raw speed of the host */
+extern const diskHostLatency_t diskHostNoLatency;
+/* A class 10 microSD card: ~20MB/s read, ~8MB/s sequential write */
+extern const diskHostLatency_t diskHostSdLatency;
+
+/**
+ * Map drive 0 to an image file, created or extended to sectors * 512 bytes.
+ * sectors 0 keeps the size of an existing image.
+ * @return 0, or -1 with errno set
+ */
+int diskHostOpenImage(const char * path, DWORD sectors);
+
+/* Map drive 0 to a zeroed RAM disk */
+int diskHostOpenRam(DWORD sectors);
+
+void diskHostClose(void);
+
+void diskHostSetLatency(const diskHostLatency_t * latency);
+
+/* Restart the disk_get_stats() and disk_get_cache_stats() counters */
+void diskHostClearStats(void);
+
+/* Simulated device time since the open */
+uint64_t diskHostTimeUs(void);
+
+#endif //__DISKIO_HOST_H__
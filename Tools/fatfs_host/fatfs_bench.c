@@ -0,0 +1,283 @@
+/**
+ * fatfs_bench.c - FatFs storage throughput on Linux
+ *
+ * Runs the firmware FatFs (FatFs/src/ff.c, FatFs/inc/ffconf.h) on the host
+ * disk backend (diskio_host.c):
+ *
+ *   gcc -O2 -I../../FatFs/inc -o fatfs_bench fatfs_bench.c diskio_host.c \
+ *       ../../FatFs/src/ff.c ../../FatFs/src/diskcache.c
+ *   ./fatfs_bench                     blackbox pattern on a 256MB RAM disk
+ *   ./fatfs_bench -l sd -a 32768      SD card latency model, 32KB clusters
+ *   ./fatfs_bench -l sd -w 100 -x 0   100 byte writes, no preallocation
+ *   ./fatfs_bench -i card.img -S 1024 on a 1GB image file (kept, it can be
+ *                                     mounted on Linux afterwards)
+ *
+ * _FS_TINY, _USE_FASTSEEK and DISK_CACHE_SECTORS are taken from the command
+ * line when given, for instance -D_FS_TINY=1 -DDISK_CACHE_SECTORS=0 on the
+ * gcc line.
+ *
+ * Phases: format, sequential write of one file in chunks (preallocated with
+ * f_expand as the blackbox does, unless -x 0), sequential read back with
+ * content check, random 512 byte reads (through the fast seek map when
+ * enabled). The throughput is computed on the simulated device time when a
+ * latency model is used, on the host time otherwise.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ff.h"
+#include "diskio_host.h"
+#include "diskcache.h"
+
+#define FILE_NAME   "0:BENCH.BIN"
+
+static FATFS fs;
+static FIL file;
+static BYTE work[4096];
+#if _USE_FASTSEEK
+static DWORD linkMap[256];
+#endif
+
+static const diskHostLatency_t * latency = &diskHostNoLatency;
+static uint32_t chunk = 8192;
+static uint32_t totalMb = 16;
+static int expand = 1;
+static uint32_t syncEvery = 0;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void fill(BYTE * buf, uint32_t len, uint64_t offset)
+{
+  uint32_t i;
+
+  for (i=0; i<len; i++)
+    buf[i] = (BYTE)((offset + i) * 7 + ((offset + i) >> 9));
+}
+
+typedef struct
+{
+  double wall;
+  uint64_t deviceUs;
+} phase_t;
+
+static void phaseStart(phase_t * p)
+{
+  p->wall = now();
+  p->deviceUs = diskHostTimeUs();
+  diskHostClearStats();
+}
+
+static void phaseEnd(phase_t * p, const char * name, uint64_t bytes)
+{
+  DSTATS st;
+  DCSTATS cst;
+  double wall = now() - p->wall;
+  double device = (diskHostTimeUs() - p->deviceUs) * 1e-6;
+  double seconds = latency == &diskHostNoLatency ? wall : device;
+  unsigned reads, writes, sectors;
+
+  disk_get_stats(0, &st);
+  disk_get_cache_stats(0, &cst);
+  reads = st.reads;
+  writes = st.writes;
+  sectors = st.sectorsRead + st.sectorsWritten;
+
+  printf("%-8s %8.3fs host %8.3fs device", name, wall, device);
+  if (bytes)
+    printf(" %8.2f MB/s", seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+  else
+    printf("             ");
+  printf("  %6u rd %6u wr  %5.1f sect/cmd  max wr %6u us", reads, writes,
+         reads + writes ? (double)sectors / (reads + writes) : 0.0, (unsigned)st.writeTimeMax);
+  if (cst.readHits + cst.readMisses)
+    printf("  hits %5.1f%%", 100.0 * cst.readHits / (cst.readHits + cst.readMisses));
+  if (cst.sectorsIn)
+    printf("  write amp %.2f (%u/%u)", (double)cst.sectorsOut / cst.sectorsIn, (unsigned)cst.sectorsOut, (unsigned)cst.sectorsIn);
+  printf("\n");
+}
+
+static int check(FRESULT res, const char * what)
+{
+  if (res != FR_OK)
+    fprintf(stderr, "%s: error %d\n", what, res);
+  return res != FR_OK;
+}
+
+static int writePhase(uint64_t size)
+{
+  BYTE * buf = malloc(chunk);
+  uint64_t offset;
+  uint32_t n = 0;
+  UINT bw;
+  phase_t p;
+
+  phaseStart(&p);
+  if (check(f_open(&file, FILE_NAME, FA_CREATE_ALWAYS | FA_WRITE), "open"))
+    return -1;
+  if (expand && (check(f_expand(&file, size, 1), "expand") || check(f_sync(&file), "sync")))
+    return -1;
+
+  for (offset=0; offset<size; offset+=bw)
+  {
+    uint32_t len = size - offset < chunk ? size - offset : chunk;
+
+    fill(buf, len, offset);
+    if (check(f_write(&file, buf, len, &bw), "write") || bw != len)
+      return -1;
+    if (syncEvery && ++n % syncEvery == 0 && check(f_sync(&file), "sync"))
+      return -1;
+  }
+  if (check(f_close(&file), "close"))
+    return -1;
+  phaseEnd(&p, "write", size);
+
+  free(buf);
+  return 0;
+}
+
+static int readPhase(uint64_t size)
+{
+  BYTE * buf = malloc(chunk);
+  BYTE * expect = malloc(chunk);
+  uint64_t offset;
+  UINT br;
+  phase_t p;
+
+  phaseStart(&p);
+  if (check(f_open(&file, FILE_NAME, FA_READ), "open"))
+    return -1;
+  for (offset=0; offset<size; offset+=br)
+  {
+    if (check(f_read(&file, buf, chunk, &br), "read") || br == 0)
+      return -1;
+    fill(expect, br, offset);
+    if (memcmp(buf, expect, br) != 0)
+    {
+      fprintf(stderr, "read: bad content at %llu\n", (unsigned long long)offset);
+      return -1;
+    }
+  }
+  f_close(&file);
+  phaseEnd(&p, "read", size);
+
+  free(buf);
+  free(expect);
+  return 0;
+}
+
+static int seekPhase(uint64_t size, uint32_t count)
+{
+  BYTE buf[512];
+  BYTE expect[512];
+  uint32_t i;
+  UINT br;
+  phase_t p;
+
+  srand(1);
+  phaseStart(&p);
+  if (check(f_open(&file, FILE_NAME, FA_READ), "open"))
+    return -1;
+#if _USE_FASTSEEK
+  file.cltbl = linkMap;
+  linkMap[0] = sizeof(linkMap) / sizeof(linkMap[0]);
+  if (f_lseek(&file, CREATE_LINKMAP) != FR_OK)
+    file.cltbl = NULL;     //Too fragmented for the map: plain seeks
+#endif
+  for (i=0; i<count; i++)
+  {
+    uint64_t offset = ((uint64_t)rand() * RAND_MAX + rand()) % (size - sizeof(buf));
+
+    if (check(f_lseek(&file, offset), "seek") ||
+        check(f_read(&file, buf, sizeof(buf), &br), "read"))
+      return -1;
+    fill(expect, sizeof(buf), offset);
+    if (br != sizeof(buf) || memcmp(buf, expect, sizeof(buf)) != 0)
+    {
+      fprintf(stderr, "seek: bad content at %llu\n", (unsigned long long)offset);
+      return -1;
+    }
+  }
+  f_close(&file);
+  phaseEnd(&p, "seek", (uint64_t)count * sizeof(buf));
+
+  return 0;
+}
+
+int main(int argc, char ** argv)
+{
+  const char * image = NULL;
+  uint32_t diskMb = 256;
+  uint32_t au = 0;
+  int realtime = 0;
+  diskHostLatency_t l;
+  uint64_t size;
+  phase_t p;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:S:a:m:w:x:l:ry:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'i': image = optarg; break;
+      case 'S': diskMb = strtoul(optarg, NULL, 0); break;
+      case 'a': au = strtoul(optarg, NULL, 0); break;
+      case 'm': totalMb = strtoul(optarg, NULL, 0); break;
+      case 'w': chunk = strtoul(optarg, NULL, 0); break;
+      case 'x': expand = atoi(optarg); break;
+      case 'l': latency = strcmp(optarg, "sd") == 0 ? &diskHostSdLatency : &diskHostNoLatency; break;
+      case 'r': realtime = 1; break;
+      case 'y': syncEvery = strtoul(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: %s [-i image] [-S disk MB] [-a cluster bytes] [-m MB]\n"
+                        "       [-w chunk bytes] [-x 0|1] [-l none|sd] [-r] [-y sync period]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (chunk == 0 || totalMb == 0 || totalMb >= diskMb)
+  {
+    fprintf(stderr, "bad sizes\n");
+    return 1;
+  }
+
+  if ((image ? diskHostOpenImage(image, diskMb * 2048) : diskHostOpenRam(diskMb * 2048)) < 0)
+  {
+    perror(image ? image : "ram disk");
+    return 1;
+  }
+  l = *latency;
+  l.realtime = realtime;
+  diskHostSetLatency(&l);
+
+  printf("%s %uMB, cluster %s%u, %uMB in %u byte writes, %s, _FS_TINY %d, _USE_FASTSEEK %d,\n"
+         "cache %d sectors, latency %s\n",
+         image ? image : "RAM disk", diskMb, au ? "" : "auto ", au, totalMb, chunk,
+         expand ? "preallocated" : "growing", _FS_TINY, _USE_FASTSEEK, DISK_CACHE_SECTORS,
+         latency == &diskHostNoLatency ? "none" : "SD");
+
+  phaseStart(&p);
+  if (check(f_mkfs("0:", FM_ANY, au, work, sizeof(work)), "mkfs") ||
+      check(f_mount(&fs, "0:", 1), "mount"))
+    return 1;
+  phaseEnd(&p, "format", 0);
+  printf("         %u bytes per cluster\n", fs.csize * 512);
+
+  size = (uint64_t)totalMb * 1024 * 1024;
+  if (writePhase(size) < 0 || readPhase(size) < 0 || seekPhase(size, 2000) < 0)
+    return 1;
+
+  f_mount(NULL, "0:", 0);
+  diskHostClose();
+
+  return 0;
+}
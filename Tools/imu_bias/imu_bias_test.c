@@ -0,0 +1,218 @@
+/**
+ * imu_bias_test.c - Runs the bias windows of HAL/src/IMU.c on the host
+ *
+ * imu6Read() is fed a board at rest, the gyro with its bias and one LSB of
+ * noise, the temperature ramping up. The boot window finds the bias and
+ * gives its memory back. The following windows run without window memory:
+ * each one at rest must teach the temperature model once, at the mean
+ * temperature of the window, and a window in motion not at all:
+ *
+ *   gcc -std=c99 -O2 -Wall -I. -I../../HAL/inc -I../../utils/inc \
+ *       -I../../Algorithm/inc -o imu_bias_test imu_bias_test.c \
+ *       ../../HAL/src/IMU.c ../../Algorithm/src/filter.c -lm
+ *
+ *   ./imu_bias_test       the learn calls, one line each
+ *   ./imu_bias_test -t    self test
+ *
+ * main.h here stands in for the target one.
+ */
+#define _POSIX_C_SOURCE 200112L     // getopt() with -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "IMU.h"
+
+#define WINDOW          1024        // IMU_NBR_OF_BIAS_SAMPLES
+#define WINDOWS         6           // The boot one first
+#define MOVING_WINDOW   3           // 0 based, the gyro swings in it
+#define TEMP_START      30.0f       // Celsius
+#define TEMP_SLOPE      0.002f      // Celsius per sample, 2 C per window
+#define MAX_LEARNS      16
+
+static const int16_t gyroBiasRaw[3] = { 10, -20, 5 };
+
+typedef struct
+{
+  uint32_t sample;
+  float temperature;
+} learn_t;
+
+DWT_Type hostDwt;
+ledseq_t seq_calibrated[1];
+ledseq_t seq_linkup[1];
+
+static uint32_t sample;             // imu6Read() calls so far
+static uint32_t rng = 12345;
+static learn_t learns[MAX_LEARNS];
+static uint32_t learnCount;
+static uint32_t atRestCount;
+static int32_t allocated;           // Windows not given back
+static uint32_t allocCount;
+
+/* The stubs of the drivers, the RTOS and the config block */
+uint32_t xTaskGetTickCount(void) { return sample * 2; }
+void *mymalloc(uint8_t memx, uint32_t size) { allocated++; allocCount++; return malloc(size); }
+void myfree(uint8_t memx, void *ptr) { if (ptr) allocated--; free(ptr); }
+void LedseqRun(Led_TypeDef led, ledseq_t * sequence) {}
+int ICM20601_TestConnection(void) { return SUCCESS; }
+int32_t ICM20601_InitStep(uint32_t step) { return INIT_SEQ_DONE; }
+bool HMC5983_TestConnection(void) { return false; }
+int32_t HMC5983_InitStep(uint32_t step) { return INIT_SEQ_DONE; }
+void spiBusInit(void) {}
+uint32_t SENSOR_POWER_ON_TICK(void) { return 0; }
+uint32_t initSeqRun(initSeqDevice_t * devices, uint32_t count) { return 0; }
+bool configblockGetImuCalib(configImuCalib_t * calib) { return false; }
+bool configblockSetImuCalib(const configImuCalib_t * calib) { return true; }
+bool configblockGetGyroTempModel(gyroTempModel_t * model) { return false; }
+bool configblockSetGyroTempModel(const gyroTempModel_t * model) { return true; }
+void magSamplerInit(void) {}
+bool magSamplerRead(Axis3f * mag, uint32_t * tick) { return false; }
+bool magSamplerIsCalibrated(void) { return false; }
+void magSamplerAtRest(void) { atRestCount++; }
+void gyroTempModelReset(gyroTempModel_t * model) {}
+bool gyroTempModelGet(const gyroTempModel_t * model, float temperature, float bias[3]) { return false; }
+uint32_t gyroTempModelBins(const gyroTempModel_t * model) { return learnCount; }
+
+bool gyroTempModelUpdate(gyroTempModel_t * model, float temperature, const float bias[3])
+{
+  if (learnCount < MAX_LEARNS)
+  {
+    learns[learnCount].sample = sample;
+    learns[learnCount].temperature = temperature;
+  }
+  learnCount++;
+  return false;
+}
+
+static int16_t tempRaw(uint32_t n)
+{
+  return (int16_t)lroundf((TEMP_START + TEMP_SLOPE * n - 25.0f) * 326.8f);
+}
+
+float ICM20601_GetTemperature(void)
+{
+  return ICM20601_TEMP_DEGC(tempRaw(0));
+}
+
+static int16_t noise(int16_t amplitude)
+{
+  rng = rng * 1103515245u + 12345u;
+  return (int16_t)((int32_t)((rng >> 16) % (2 * amplitude + 1)) - amplitude);
+}
+
+bool ICM20601GetSixAxisData(int16_t *ax,int16_t *ay,int16_t *az,int16_t *gx,int16_t *gy,int16_t *gz,
+                            int16_t *temp)
+{
+  int16_t amplitude = (sample / WINDOW == MOVING_WINDOW) ? 400 : 1;
+
+  *gx = gyroBiasRaw[0] + noise(amplitude);
+  *gy = gyroBiasRaw[1] + noise(amplitude);
+  *gz = gyroBiasRaw[2] + noise(amplitude);
+  *ax = noise(1);
+  *ay = noise(1);
+  *az = 2048 + noise(1);
+  *temp = tempRaw(sample);
+  return true;
+}
+
+/* Runs the windows, the mean filtered temperature of each in windowTemp */
+static void run(float windowTemp[WINDOWS])
+{
+  Axis3f gyro;
+  Axis3f acc;
+  double sum = 0.0;
+  float filtered;
+
+  IMU_Init();
+  filtered = ICM20601_GetTemperature();
+  for (sample=0; sample<WINDOWS * WINDOW; sample++)
+  {
+    imu6Read(&gyro, &acc);
+    //As imu6Read() filters it
+    filtered += (ICM20601_TEMP_DEGC(tempRaw(sample)) - filtered) * 0.01f;
+    sum += filtered;
+    if ((sample + 1) % WINDOW == 0)
+    {
+      windowTemp[sample / WINDOW] = (float)(sum / WINDOW);
+      sum = 0.0;
+    }
+  }
+}
+
+static int selfTest(void)
+{
+  float windowTemp[WINDOWS];
+  uint32_t expected = 0;
+  uint32_t w;
+  uint32_t k;
+  int errors = 0;
+
+  run(windowTemp);
+
+  //The boot window: the bias found, at the last temperature
+  if (!imu6IsCalibrated() || learnCount < 1 || learns[0].sample != WINDOW - 1)
+  {
+    printf("FAIL boot window\n");
+    errors++;
+  }
+  //Both windows given back, none taken again
+  if (allocated != 0 || allocCount != 2)
+  {
+    printf("FAIL %d windows held, %u allocated\n", (int)allocated, (unsigned)allocCount);
+    errors++;
+  }
+
+  //One learn per window at rest after the release, at its mean temperature
+  k = 1;
+  for (w=1; w<WINDOWS; w++)
+  {
+    if (w == MOVING_WINDOW)
+      continue;
+    expected++;
+    if (k >= learnCount || learns[k].sample != (w + 1) * WINDOW - 1 ||
+        fabsf(learns[k].temperature - windowTemp[w]) > 0.01f)
+    {
+      printf("FAIL window %u\n", (unsigned)w);
+      errors++;
+    }
+    k++;
+  }
+  if (learnCount != expected + 1 || atRestCount != learnCount)
+  {
+    printf("FAIL %u learns, %u at rest, %u expected\n", (unsigned)learnCount,
+           (unsigned)atRestCount, (unsigned)(expected + 1));
+    errors++;
+  }
+
+  printf("%s, %d errors\n", errors ? "FAIL" : "pass", errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  float windowTemp[WINDOWS];
+  uint32_t k;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': return selfTest();
+      default:
+        fprintf(stderr, "usage: %s [-t]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  run(windowTemp);
+  printf("%u learns, %d windows held\n", (unsigned)learnCount, (int)allocated);
+  for (k=0; k<learnCount && k<MAX_LEARNS; k++)
+  {
+    printf("sample %5u  %.3f C  window mean %.3f C\n", (unsigned)learns[k].sample,
+           learns[k].temperature, windowTemp[learns[k].sample / WINDOW]);
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * main.h - Stands in for User/inc/main.h in imu_bias_test.c
+ *
+ * Only what HAL/src/IMU.c uses: the sensor drivers, the RTOS, the pool,
+ * the config block and the LEDs are declared here and stubbed by the test,
+ * the log and param tables left out.
+ */
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "imu_types.h"
+#include "mag_sampler.h"
+#include "filter.h"
+#include "configblock.h"
+#include "initseq.h"
+
+#define configTICK_RATE_HZ  1000
+#define M2T(X) ((unsigned int)((X)*(configTICK_RATE_HZ/1000.0)))
+#define pdMS_TO_TICKS(X) ((uint32_t)(X))
+uint32_t xTaskGetTickCount(void);
+
+#define SUCCESS 1
+
+/* DWT->CYCCNT */
+typedef struct
+{
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+extern DWT_Type hostDwt;
+#define DWT (&hostDwt)
+
+#define SRAMIN 0
+void *mymalloc(uint8_t memx, uint32_t size);
+void myfree(uint8_t memx, void *ptr);
+
+typedef enum
+{
+  LEDL = 0,
+  LEDR
+} Led_TypeDef;
+typedef struct {
+ bool value;
+ int action;
+} ledseq_t;
+extern ledseq_t seq_calibrated[];
+extern ledseq_t seq_linkup[];
+void LedseqRun(Led_TypeDef led, ledseq_t * sequence);
+
+#define ICM20601_STARTUP_MS       100
+#define ICM20601_TEMP_DEGC(raw)   (25.0f + (raw) / 326.8f)
+#define ICM20602_DEG_PER_LSB_2000 (float)((2 * 2000.0) / 65536.0f)
+#define ICM20602_G_PER_LSB_16     (float)((2 * 16) / 65536.0f)
+int ICM20601_TestConnection(void);
+int32_t ICM20601_InitStep(uint32_t step);
+float ICM20601_GetTemperature(void);
+bool ICM20601GetSixAxisData(int16_t *ax,int16_t *ay,int16_t *az,int16_t *gx,int16_t *gy,int16_t *gz,
+                            int16_t *temp);
+bool HMC5983_TestConnection(void);
+int32_t HMC5983_InitStep(uint32_t step);
+
+void spiBusInit(void);
+uint32_t SENSOR_POWER_ON_TICK(void);
+
+#define BPRINTF(FMT, ...) printf(FMT, ##__VA_ARGS__)
+
+#define LOG_GROUP_START(NAME)
+#define LOG_ADD(TYPE, NAME, ADDRESS)
+#define LOG_GROUP_STOP(NAME)
+#define PARAM_GROUP_START(NAME)
+#define PARAM_ADD(TYPE, NAME, ADDRESS)
+#define PARAM_GROUP_STOP(NAME)
+
+#endif //__MAIN_H
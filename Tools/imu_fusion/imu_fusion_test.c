@@ -0,0 +1,445 @@
+/**
+ * imu_fusion_test.c - Replays two IMUs through HAL/src/imu_fusion.c
+ *
+ * A synthetic replay gives both units the same motion (gyro and accel, in
+ * raw LSB at 500Hz), each with its own bias and white noise, rounded to the
+ * LSB. The noise of the fused stream is measured against the motion, with
+ * equal and unequal units, and with one unit failing:
+ *
+ *   gcc -O2 -I../../HAL/inc -o imu_fusion_test imu_fusion_test.c \
+ *       ../../HAL/src/imu_fusion.c -lm
+ *
+ *   ./imu_fusion_test                the scenarios
+ *   ./imu_fusion_test -g > imu.csv   the equal units replay, one line per
+ *                                    sample: the 6 channels of unit 0 then
+ *                                    the 6 of unit 1
+ *   ./imu_fusion_test -f imu.csv     replays a log of that format, unit 1
+ *                                    aligned: the noise from the first
+ *                                    differences, motion must be slow
+ *   ./imu_fusion_test -t             self test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "imu_fusion.h"
+
+#define SAMPLES         30000       // 60s at 500Hz
+#define WARMUP          3000        // Not measured
+#define FAULT_AT        10000
+#define GYRO_LIMIT      328.0f      // 20 deg/s at 2000 deg/s full scale
+#define ACC_LIMIT       614.0f      // 0.3g at 16g full scale
+#define ACC_1G          2048.0
+
+typedef enum
+{
+  FAULT_NONE = 0,
+  FAULT_STUCK,          // Unit 1 repeats one sample
+  FAULT_DRIFT,          // Unit 1 gyro x bias ramps, no noise change
+  FAULT_NOISY,          // Unit 0 gyro x goes to 1000 LSB noise
+  FAULT_READ,           // Unit 0 reads fail
+  FAULT_GLITCH,         // Unit 1 stuck for 2000 samples, then fine
+} fault_t;
+
+/* How the fusion gets n0 */
+#define NOISE_NONE      0
+#define NOISE_GIVEN     1
+#define NOISE_AT_REST   2           // No motion before WARMUP, imuFusionAtRest()
+
+typedef struct
+{
+  const char * name;
+  double sigma[IMU_FUSION_UNITS];   // LSB
+  int noise;                        // n0: NOISE_x
+  fault_t fault;
+} scenario_t;
+
+typedef struct
+{
+  double var0[IMU_FUSION_CHANNELS];     // Unit 0 against the motion
+  double varOut[IMU_FUSION_CHANNELS];   // Fused against the motion
+  double meanOut[IMU_FUSION_CHANNELS];
+  double maxOut;                        // Largest error, after the fault
+  double maxExcluded;                   // Largest error, after the exclusion
+  uint32_t excludedAt;                  // First sample without both units
+  uint32_t usedAgainAt;                 // Back to both units after that
+  uint8_t fault[IMU_FUSION_UNITS];
+  uint8_t inUse;                        // At the end
+  double weight;                        // Of unit 1 on gyro x, at the end
+} result_t;
+
+static const scenario_t scenarios[] =
+{
+  { "equal, weights from the difference", {3.0, 3.0}, NOISE_NONE,    FAULT_NONE },
+  { "equal, n0 given",                    {3.0, 3.0}, NOISE_GIVEN,   FAULT_NONE },
+  { "unit 1 twice as noisy, n0 given",    {2.0, 4.0}, NOISE_GIVEN,   FAULT_NONE },
+  { "unit 1 twice as noisy, n0 at rest",  {2.0, 4.0}, NOISE_AT_REST, FAULT_NONE },
+  { "unit 1 stuck",                       {3.0, 3.0}, NOISE_GIVEN,   FAULT_STUCK },
+  { "unit 1 drifting",                    {3.0, 3.0}, NOISE_GIVEN,   FAULT_DRIFT },
+  { "unit 0 noisy",                       {3.0, 3.0}, NOISE_GIVEN,   FAULT_NOISY },
+  { "unit 0 read failing",                {3.0, 3.0}, NOISE_GIVEN,   FAULT_READ },
+  { "unit 1 stuck 4s, recovers",          {3.0, 3.0}, NOISE_GIVEN,   FAULT_GLITCH },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static uint64_t rngState;
+
+static double uniform(void)
+{
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 7;
+  rngState ^= rngState << 17;
+  return ((rngState >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gauss(void)
+{
+  return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+/* Slow attitude changes and a vibration, the same on both units */
+static void motion(uint32_t n, double truth[IMU_FUSION_CHANNELS])
+{
+  double t = n / 500.0;
+
+  truth[0] = 1500.0 * sin(2 * M_PI * 0.7 * t) + 40.0 * sin(2 * M_PI * 83.0 * t);
+  truth[1] = 1100.0 * sin(2 * M_PI * 0.45 * t + 1.0) + 40.0 * sin(2 * M_PI * 83.0 * t + 0.5);
+  truth[2] = 600.0 * sin(2 * M_PI * 0.2 * t + 2.0);
+  truth[3] = 300.0 * sin(2 * M_PI * 0.45 * t) + 150.0 * sin(2 * M_PI * 83.0 * t);
+  truth[4] = 300.0 * sin(2 * M_PI * 0.7 * t + 1.0) + 150.0 * sin(2 * M_PI * 83.0 * t + 1.0);
+  truth[5] = ACC_1G + 200.0 * sin(2 * M_PI * 1.3 * t);
+}
+
+static const double bias[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS] =
+{
+  {  12.0, -7.0,  3.0,  40.0, -25.0,  60.0 },
+  { -31.0, 18.0, -9.0, -80.0,  15.0, -45.0 },
+};
+
+static void run(const scenario_t * s, uint64_t seed, result_t * res)
+{
+  static imuFusion_t fusion;
+  float x[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS];
+  float stuck[IMU_FUSION_CHANNELS];
+  bool isRead[IMU_FUSION_UNITS];
+  double truth[IMU_FUSION_CHANNELS];
+  double sum0[IMU_FUSION_CHANNELS] = {0}, sq0[IMU_FUSION_CHANNELS] = {0};
+  double sumOut[IMU_FUSION_CHANNELS] = {0}, sqOut[IMU_FUSION_CHANNELS] = {0};
+  float out[IMU_FUSION_CHANNELS];
+  float noise[3];
+  double e, sigma;
+  uint32_t count = 0;
+  uint32_t n, u, i;
+  uint8_t inUse = 0;
+
+  memset(res, 0, sizeof(*res));
+  rngState = seed;
+  imuFusionReset(&fusion, GYRO_LIMIT, ACC_LIMIT);
+  if (s->noise == NOISE_GIVEN)
+  {
+    //What the rest windows give: the noise and the rounding
+    for (i=0; i<3; i++)
+      noise[i] = (float)(s->sigma[0] * s->sigma[0] + 1.0 / 12);
+    imuFusionSetNoise(&fusion, IMU_FUSION_GYRO, noise);
+    imuFusionSetNoise(&fusion, IMU_FUSION_ACC, noise);
+  }
+
+  for (n=0; n<SAMPLES; n++)
+  {
+    motion(n, truth);
+    if (s->noise == NOISE_AT_REST && n < WARMUP)
+      for (i=0; i<IMU_FUSION_CHANNELS; i++)
+        truth[i] = i == 5 ? ACC_1G : 0.0;
+    for (u=0; u<IMU_FUSION_UNITS; u++)
+    {
+      isRead[u] = true;
+      for (i=0; i<IMU_FUSION_CHANNELS; i++)
+      {
+        sigma = s->sigma[u];
+        if (s->fault == FAULT_NOISY && u == 0 && i == 0 && n >= FAULT_AT)
+          sigma = 1000.0;
+        x[u][i] = (float)nearbyint(truth[i] + bias[u][i] + sigma * gauss());
+      }
+    }
+    if (n >= FAULT_AT)
+    {
+      if (s->fault == FAULT_STUCK || (s->fault == FAULT_GLITCH && n < FAULT_AT + 2000))
+      {
+        if (n == FAULT_AT)
+          memcpy(stuck, x[1], sizeof(stuck));
+        memcpy(x[1], stuck, sizeof(stuck));
+      }
+      else if (s->fault == FAULT_DRIFT)
+      {
+        x[1][0] += 0.5f * (n - FAULT_AT);
+      }
+      else if (s->fault == FAULT_READ)
+      {
+        isRead[0] = false;
+        memset(x[0], 0, sizeof(x[0]));
+      }
+    }
+
+    inUse = imuFusionUpdate(&fusion, (const float (*)[IMU_FUSION_CHANNELS])x, isRead, out);
+    if (s->noise == NOISE_AT_REST && n == WARMUP - 1)
+      imuFusionAtRest(&fusion);
+
+    if (n >= WARMUP && inUse != 0x03 && res->excludedAt == 0)
+      res->excludedAt = n;
+    if (res->excludedAt && inUse == 0x03 && res->usedAgainAt == 0)
+      res->usedAgainAt = n;
+
+    if (n < WARMUP)
+      continue;
+    count++;
+    for (i=0; i<IMU_FUSION_CHANNELS; i++)
+    {
+      e = (x[0][i] - truth[i] - bias[0][i]);
+      sum0[i] += e;
+      sq0[i] += e * e;
+      e = out[i] - truth[i] - bias[0][i];
+      sumOut[i] += e;
+      sqOut[i] += e * e;
+      if (n >= FAULT_AT && fabs(e) > res->maxOut)
+        res->maxOut = fabs(e);
+      if (res->excludedAt && fabs(e) > res->maxExcluded)
+        res->maxExcluded = fabs(e);
+    }
+  }
+
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+  {
+    res->var0[i] = sq0[i] / count - (sum0[i] / count) * (sum0[i] / count);
+    res->meanOut[i] = sumOut[i] / count;
+    res->varOut[i] = sqOut[i] / count - res->meanOut[i] * res->meanOut[i];
+  }
+  res->fault[0] = fusion.fault[0];
+  res->fault[1] = fusion.fault[1];
+  res->inUse = inUse;
+  res->weight = imuFusionWeight(&fusion, 0);
+}
+
+/* Noise of unit 0 over the fused one, mean of the channels */
+static double reduction(const result_t * res)
+{
+  double sum = 0;
+  uint32_t i;
+
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+    sum += sqrt(res->var0[i] / res->varOut[i]);
+
+  return sum / IMU_FUSION_CHANNELS;
+}
+
+static double maxBias(const result_t * res)
+{
+  double worst = 0;
+  uint32_t i;
+
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+    if (fabs(res->meanOut[i]) > worst)
+      worst = fabs(res->meanOut[i]);
+
+  return worst;
+}
+
+static void printScenarios(void)
+{
+  result_t res;
+  uint32_t k;
+
+  printf("%-36s %9s %9s %8s %10s %10s %6s\n", "", "noise/", "mean", "w1", "excluded", "again", "fault");
+  printf("%-36s %9s %9s %8s %10s %10s %6s\n", "", "fused", "LSB", "gyro x", "sample", "sample", "0/1");
+  for (k=0; k<SCENARIOS; k++)
+  {
+    run(&scenarios[k], 0x9E3779B97F4A7C15ull + k, &res);
+    printf("%-36s %9.3f %9.3f %8.3f %10u %10u %3x/%x\n", scenarios[k].name, reduction(&res),
+           maxBias(&res), res.weight, res.excludedAt, res.usedAgainAt, res.fault[0], res.fault[1]);
+  }
+  printf("\nsqrt(2) = %.3f. Unit 1 twice as noisy, inverse-variance optimum: %.3f\n",
+         sqrt(2.0), sqrt((4.0 + 1.0 / 12) / ((4.0 + 1.0 / 12) * (16.0 + 1.0 / 12) / (20.0 + 2.0 / 12))));
+}
+
+static void generate(void)
+{
+  double truth[IMU_FUSION_CHANNELS];
+  uint32_t n, u, i;
+
+  rngState = 0x9E3779B97F4A7C15ull;
+  for (n=0; n<SAMPLES; n++)
+  {
+    motion(n, truth);
+    for (u=0; u<IMU_FUSION_UNITS; u++)
+      for (i=0; i<IMU_FUSION_CHANNELS; i++)
+        printf("%.0f%c", nearbyint(truth[i] + bias[u][i] + 3.0 * gauss()),
+               u == 1 && i == IMU_FUSION_CHANNELS - 1 ? '\n' : ',');
+  }
+}
+
+/* The noise of each stream from its first differences: var(dx) / 2 */
+static int replay(const char * path)
+{
+  static imuFusion_t fusion;
+  float x[IMU_FUSION_UNITS][IMU_FUSION_CHANNELS];
+  float last[3][IMU_FUSION_CHANNELS];
+  float out[IMU_FUSION_CHANNELS];
+  bool isRead[IMU_FUSION_UNITS] = {true, true};
+  double sq[3][IMU_FUSION_CHANNELS] = {{0}};
+  const char * names[3] = {"unit 0", "unit 1", "fused"};
+  char line[512];
+  char * p;
+  uint32_t n = 0;
+  uint32_t used = 0;
+  uint32_t u, i;
+  FILE * f = fopen(path, "r");
+
+  if (f == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  imuFusionReset(&fusion, GYRO_LIMIT, ACC_LIMIT);
+  while (fgets(line, sizeof(line), f))
+  {
+    p = line;
+    for (u=0; u<IMU_FUSION_UNITS; u++)
+      for (i=0; i<IMU_FUSION_CHANNELS; i++)
+      {
+        x[u][i] = strtof(p, &p);
+        if (*p == ',')
+          p++;
+      }
+    if (imuFusionUpdate(&fusion, (const float (*)[IMU_FUSION_CHANNELS])x, isRead, out) == 0x03)
+      used++;
+
+    if (n >= WARMUP)
+      for (i=0; i<IMU_FUSION_CHANNELS; i++)
+      {
+        sq[0][i] += (x[0][i] - last[0][i]) * (x[0][i] - last[0][i]);
+        sq[1][i] += (x[1][i] - last[1][i]) * (x[1][i] - last[1][i]);
+        sq[2][i] += (out[i] - last[2][i]) * (out[i] - last[2][i]);
+      }
+    memcpy(last[0], x[0], sizeof(last[0]));
+    memcpy(last[1], x[1], sizeof(last[1]));
+    memcpy(last[2], out, sizeof(last[2]));
+    n++;
+  }
+  fclose(f);
+
+  if (n <= WARMUP)
+  {
+    fprintf(stderr, "%s: %u samples, %u needed\n", path, n, WARMUP + 1);
+    return 1;
+  }
+
+  printf("%u samples, both units used in %u. Noise, LSB rms:\n", n, used);
+  printf("  %-8s %8s %8s %8s %8s %8s %8s\n", "", "gx", "gy", "gz", "ax", "ay", "az");
+  for (u=0; u<3; u++)
+  {
+    printf("  %-8s", names[u]);
+    for (i=0; i<IMU_FUSION_CHANNELS; i++)
+      printf(" %8.3f", sqrt(sq[u][i] / (n - WARMUP) / 2));
+    printf("\n");
+  }
+  printf("  weight of unit 1:");
+  for (i=0; i<IMU_FUSION_CHANNELS; i++)
+    printf(" %.3f", imuFusionWeight(&fusion, i));
+  printf("\n");
+
+  return 0;
+}
+
+static int selfTest(void)
+{
+  result_t res;
+  double optimum;
+  int errors = 0;
+  uint32_t k;
+
+  for (k=0; k<SCENARIOS; k++)
+  {
+    const scenario_t * s = &scenarios[k];
+    int failed = 0;
+
+    run(s, 0x9E3779B97F4A7C15ull + k, &res);
+
+    //The bias of unit 0 is kept, within the noise
+    if (maxBias(&res) > 0.5)
+      failed++;
+
+    switch (s->fault)
+    {
+      case FAULT_NONE:
+        //sqrt(2) with equal units, the inverse-variance optimum otherwise
+        optimum = sqrt(1.0 + (s->sigma[0] * s->sigma[0] + 1.0 / 12) / (s->sigma[1] * s->sigma[1] + 1.0 / 12));
+        if (fabs(reduction(&res) - optimum) > 0.03 * optimum || res.excludedAt != 0 || res.inUse != 0x03)
+          failed++;
+        break;
+
+      case FAULT_STUCK:
+        if (!(res.fault[1] & IMU_FUSION_FAULT_STUCK) || res.fault[0] != 0 ||
+            res.excludedAt > FAULT_AT + IMU_FUSION_STUCK_SAMPLES || res.inUse != 0x01)
+          failed++;
+        break;
+
+      case FAULT_DRIFT:
+        //Excluded before the drift reaches twice the limit
+        if (!(res.fault[1] & IMU_FUSION_FAULT_DISAGREE) || res.fault[0] != 0 ||
+            res.excludedAt > FAULT_AT + 2 * GYRO_LIMIT / 0.5f || res.maxOut > GYRO_LIMIT)
+          failed++;
+        break;
+
+      case FAULT_NOISY:
+        if (!(res.fault[0] & IMU_FUSION_FAULT_DISAGREE) || res.fault[1] != 0 ||
+            res.excludedAt > FAULT_AT + 500 || res.inUse != 0x02 || res.maxExcluded > 30.0)
+          failed++;
+        break;
+
+      case FAULT_READ:
+        //The noise of unit 1 alone after the fault, so no reduction overall
+        if (!(res.fault[0] & IMU_FUSION_FAULT_READ) || res.fault[1] != 0 ||
+            res.excludedAt != FAULT_AT || res.inUse != 0x02 || res.maxExcluded > 30.0)
+          failed++;
+        break;
+
+      case FAULT_GLITCH:
+        if (res.excludedAt > FAULT_AT + IMU_FUSION_STUCK_SAMPLES ||
+            res.usedAgainAt != FAULT_AT + 2000 + IMU_FUSION_RECOVER_SAMPLES - 1 ||
+            res.inUse != 0x03 || res.fault[0] != 0 || res.fault[1] != 0)
+          failed++;
+        break;
+    }
+
+    if (failed)
+      printf("FAIL %s\n", s->name);
+    errors += failed;
+  }
+
+  printf("%s, %d errors\n", errors ? "FAIL" : "pass", errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "tgf:")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': return selfTest();
+      case 'g': generate(); return 0;
+      case 'f': return replay(optarg);
+      default:
+        fprintf(stderr, "usage: %s [-t | -g | -f file]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  printScenarios();
+  return 0;
+}
@@ -0,0 +1,445 @@
+/**
+ * mag_calib_test.c - Replays magnetometer samples through HAL/src/mag_calib.c
+ *
+ * A synthetic replay turns a board in the field of the place, the HMC5983
+ * at 220Hz: each sample is S h + c plus white noise, rounded to the LSB of
+ * the 2.5G gain, h the field in the board frame, S and c the soft and hard
+ * iron. The calibrated field is compared with h, in angle and in norm, for
+ * the motions a calibration gets in use:
+ *
+ *   gcc -O2 -I../../HAL/inc -o mag_calib_test mag_calib_test.c \
+ *       ../../HAL/src/mag_calib.c -lm
+ *
+ *   ./mag_calib_test        the scenarios, with the cost of an update
+ *   ./mag_calib_test -t     self test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mag_calib.h"
+
+#define RATE_HZ         220.0
+#define LSB_GAUSS       0.00152     // HMC5983 at Mag_Gain_2_5G
+#define NOISE_GAUSS     0.002
+#define SAMPLES         26400       // 2 minutes
+#define MEASURED        2200        // The last 10 seconds
+#define COST_SAMPLES    400000
+
+typedef enum
+{
+  MOTION_TUMBLE = 0,    // Turned by hand in every direction
+  MOTION_FLIGHT,        // Yaw turns, +-25 deg of roll and pitch
+  MOTION_YAW,           // Yaw turns only, level
+  MOTION_STILL,         // Does not move
+} motion_t;
+
+typedef struct
+{
+  const char * name;
+  motion_t motion;
+  double ironScale;     // Of the hard iron
+  double disturbance;   // Gauss, changes every second: motor currents
+  bool isRestored;      // Starts from the true calibration
+} scenario_t;
+
+typedef struct
+{
+  double maxAngle;      // Deg, calibrated against true, over MEASURED
+  double rmsNorm;       // Relative, |h| against its mean, noise not counted
+  uint32_t solutions;
+  uint32_t rejections;
+  uint32_t added;       // Samples added to the equations
+  float residual;
+  float spread;
+  magCalibResult_t result;
+} result_t;
+
+static const scenario_t scenarios[] =
+{
+  { "tumbled",                     MOTION_TUMBLE, 1.0, 0.0,  false },
+  { "tumbled, offset > field",     MOTION_TUMBLE, 2.5, 0.0,  false },
+  { "flight, yaw and tilt",        MOTION_FLIGHT, 1.0, 0.0,  false },
+  { "yaw only",                    MOTION_YAW,    1.0, 0.0,  false },
+  { "still",                       MOTION_STILL,  1.0, 0.0,  false },
+  { "tumbled, disturbed",          MOTION_TUMBLE, 1.0, 0.15, false },
+  { "yaw only, restored",          MOTION_YAW,    1.0, 0.0,  true  },
+};
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+/* The board: soft iron, hard iron, and the field of the place, world frame */
+static const double softIron[3][3] = { { 1.08,  0.04, -0.02 },
+                                       { 0.04,  0.95,  0.03 },
+                                       { -0.02, 0.03,  1.02 } };
+static const double hardIron[3] = { 0.12, -0.25, 0.31 };
+static const double field[3] = { 0.21, 0.0, 0.43 };
+
+static uint64_t rngState;
+
+static double uniform(void)
+{
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 7;
+  rngState ^= rngState << 17;
+  return (double)(rngState >> 11) / 9007199254740992.0;
+}
+
+static double gaussian(void)
+{
+  double u1 = uniform() + 1e-300;
+  double u2 = uniform();
+
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* q = q * rotation of angle |r| around r, body rates */
+static void quatRotate(double q[4], const double r[3])
+{
+  double angle = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+  double s = angle > 0.0 ? sin(angle / 2) / angle : 0.5;
+  double d[4] = { cos(angle / 2), r[0] * s, r[1] * s, r[2] * s };
+  double p[4];
+  double n;
+  int i;
+
+  p[0] = q[0] * d[0] - q[1] * d[1] - q[2] * d[2] - q[3] * d[3];
+  p[1] = q[0] * d[1] + q[1] * d[0] + q[2] * d[3] - q[3] * d[2];
+  p[2] = q[0] * d[2] - q[1] * d[3] + q[2] * d[0] + q[3] * d[1];
+  p[3] = q[0] * d[3] + q[1] * d[2] - q[2] * d[1] + q[3] * d[0];
+  n = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2] + p[3] * p[3]);
+  for (i=0; i<4; i++)
+    q[i] = p[i] / n;
+}
+
+/* Quaternion of the board to the world from yaw, pitch and roll, rad */
+static void quatFromEuler(double q[4], double yaw, double pitch, double roll)
+{
+  double cy = cos(yaw / 2), sy = sin(yaw / 2);
+  double cp = cos(pitch / 2), sp = sin(pitch / 2);
+  double cr = cos(roll / 2), sr = sin(roll / 2);
+
+  q[0] = cr * cp * cy + sr * sp * sy;
+  q[1] = sr * cp * cy - cr * sp * sy;
+  q[2] = cr * sp * cy + sr * cp * sy;
+  q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+/* The world vector w in the board frame */
+static void toBoard(const double q[4], const double w[3], double b[3])
+{
+  double r[3][3];
+  int i;
+
+  r[0][0] = 1 - 2 * (q[2] * q[2] + q[3] * q[3]);
+  r[0][1] = 2 * (q[1] * q[2] - q[0] * q[3]);
+  r[0][2] = 2 * (q[1] * q[3] + q[0] * q[2]);
+  r[1][0] = 2 * (q[1] * q[2] + q[0] * q[3]);
+  r[1][1] = 1 - 2 * (q[1] * q[1] + q[3] * q[3]);
+  r[1][2] = 2 * (q[2] * q[3] - q[0] * q[1]);
+  r[2][0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+  r[2][1] = 2 * (q[2] * q[3] + q[0] * q[1]);
+  r[2][2] = 1 - 2 * (q[1] * q[1] + q[2] * q[2]);
+
+  for (i=0; i<3; i++)
+    b[i] = r[0][i] * w[0] + r[1][i] * w[1] + r[2][i] * w[2];
+}
+
+static void motionStep(motion_t motion, uint32_t n, double q[4], double rate[3])
+{
+  double t = n / RATE_HZ;
+  int i;
+
+  switch (motion)
+  {
+    case MOTION_TUMBLE:
+      //Body rates wandering, 1.5 rad/s rms, correlated over 2s
+      for (i=0; i<3; i++)
+        rate[i] += -rate[i] * 0.5 / RATE_HZ + 1.5 * sqrt(1.0 / RATE_HZ) * gaussian();
+      {
+        double r[3] = { rate[0] / RATE_HZ, rate[1] / RATE_HZ, rate[2] / RATE_HZ };
+        quatRotate(q, r);
+      }
+      break;
+
+    case MOTION_FLIGHT:
+      quatFromEuler(q, 0.7 * t, 25.0 * M_PI / 180 * sin(0.9 * t), 25.0 * M_PI / 180 * sin(1.3 * t + 1.0));
+      break;
+
+    case MOTION_YAW:
+      quatFromEuler(q, 0.7 * t, 0.0, 0.0);
+      break;
+
+    case MOTION_STILL:
+      quatFromEuler(q, 1.0, 0.05, -0.03);
+      break;
+  }
+}
+
+static void run(const scenario_t * s, uint64_t seed, result_t * res)
+{
+  magCalib_t calib;
+  magCalibResult_t truth;
+  double q[4] = { 1.0, 0.0, 0.0, 0.0 };
+  double rate[3] = { 0.0, 0.0, 0.0 };
+  double disturbance[3] = { 0.0, 0.0, 0.0 };
+  double hb[3];
+  double dot, nh, nb, angle;
+  double sumNorm = 0.0, sqNorm = 0.0;
+  double inv[3][3];
+  double v;
+  float clean[3];
+  float m[3];
+  float h[3];
+  uint32_t n, i, j;
+
+  rngState = seed;
+  memset(res, 0, sizeof(*res));
+  magCalibReset(&calib);
+
+  if (s->isRestored)
+  {
+    //W = S^-1 scaled to the norm of the field, c
+    double det;
+
+    inv[0][0] = softIron[1][1] * softIron[2][2] - softIron[1][2] * softIron[2][1];
+    inv[0][1] = softIron[0][2] * softIron[2][1] - softIron[0][1] * softIron[2][2];
+    inv[0][2] = softIron[0][1] * softIron[1][2] - softIron[0][2] * softIron[1][1];
+    inv[1][0] = softIron[1][2] * softIron[2][0] - softIron[1][0] * softIron[2][2];
+    inv[1][1] = softIron[0][0] * softIron[2][2] - softIron[0][2] * softIron[2][0];
+    inv[1][2] = softIron[0][2] * softIron[1][0] - softIron[0][0] * softIron[1][2];
+    inv[2][0] = softIron[1][0] * softIron[2][1] - softIron[1][1] * softIron[2][0];
+    inv[2][1] = softIron[0][1] * softIron[2][0] - softIron[0][0] * softIron[2][1];
+    inv[2][2] = softIron[0][0] * softIron[1][1] - softIron[0][1] * softIron[1][0];
+    det = softIron[0][0] * inv[0][0] + softIron[0][1] * inv[1][0] + softIron[0][2] * inv[2][0];
+    for (i=0; i<3; i++)
+    {
+      truth.offset[i] = (float)(hardIron[i] * s->ironScale);
+      for (j=0; j<3; j++)
+        truth.soft[i][j] = (float)(inv[i][j] / det);
+    }
+    truth.radius = (float)sqrt(field[0] * field[0] + field[1] * field[1] + field[2] * field[2]);
+    magCalibRestore(&calib, &truth);
+  }
+
+  for (n=0; n<SAMPLES; n++)
+  {
+    motionStep(s->motion, n, q, rate);
+    toBoard(q, field, hb);
+
+    if (s->disturbance > 0.0 && n % (uint32_t)RATE_HZ == 0)
+      for (i=0; i<3; i++)
+        disturbance[i] = s->disturbance * gaussian();
+
+    for (i=0; i<3; i++)
+    {
+      clean[i] = (float)(softIron[i][0] * hb[0] + softIron[i][1] * hb[1] + softIron[i][2] * hb[2] +
+                         hardIron[i] * s->ironScale);
+      v = clean[i] + disturbance[i] + NOISE_GAUSS * gaussian();
+      m[i] = (float)(lround(v / LSB_GAUSS) * LSB_GAUSS);
+    }
+
+    magCalibUpdate(&calib, m);
+    //The error of the calibration alone, without the noise
+    magCalibApply(&calib.result, clean, h);
+
+    if (n >= SAMPLES - MEASURED && calib.result.radius > 0.0f)
+    {
+      nh = sqrt(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+      nb = sqrt(hb[0] * hb[0] + hb[1] * hb[1] + hb[2] * hb[2]);
+      dot = (h[0] * hb[0] + h[1] * hb[1] + h[2] * hb[2]) / (nh * nb);
+      angle = acos(dot > 1.0 ? 1.0 : dot) * 180.0 / M_PI;
+      if (angle > res->maxAngle)
+        res->maxAngle = angle;
+      sumNorm += nh;
+      sqNorm += nh * nh;
+    }
+  }
+
+  if (sumNorm > 0.0)
+  {
+    double mean = sumNorm / MEASURED;
+    res->rmsNorm = sqrt(fabs(sqNorm / MEASURED - mean * mean)) / mean;
+  }
+  res->solutions = calib.solutions;
+  res->rejections = calib.rejections;
+  res->residual = calib.residual;
+  res->spread = calib.spread;
+  res->result = calib.result;
+}
+
+static uint32_t countAdded(motion_t motion)
+{
+  magCalib_t calib;
+  double q[4] = { 1.0, 0.0, 0.0, 0.0 };
+  double rate[3] = { 0.0, 0.0, 0.0 };
+  double hb[3];
+  float m[3];
+  uint32_t n, i, added = 0;
+  float weight = 0.0f;
+
+  rngState = 1;
+  magCalibReset(&calib);
+  for (n=0; n<SAMPLES; n++)
+  {
+    motionStep(motion, n, q, rate);
+    toBoard(q, field, hb);
+    for (i=0; i<3; i++)
+      m[i] = (float)(lround((hb[i] + hardIron[i] + NOISE_GAUSS * gaussian()) / LSB_GAUSS) * LSB_GAUSS);
+    weight = calib.weight;
+    magCalibUpdate(&calib, m);
+    if (calib.weight != weight)
+      added++;
+  }
+  return added;
+}
+
+/* Ns: an update without a solve, and a solve */
+static void measureCost(double * update, double * solve)
+{
+  static float samples[4096][3];
+  magCalib_t calib;
+  struct timespec t0, t1;
+  double withSolves;
+  uint32_t n, i, solves = 0;
+
+  rngState = 7;
+  for (n=0; n<4096; n++)
+  {
+    double a = uniform() * 2.0 * M_PI;
+    double z = uniform() * 2.0 - 1.0;
+    double r = sqrt(1.0 - z * z);
+    double v[3] = { 0.48 * r * cos(a), 0.48 * r * sin(a), 0.48 * z };
+    for (i=0; i<3; i++)
+      samples[n][i] = (float)(v[i] + hardIron[i]);
+  }
+
+  magCalibReset(&calib);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (n=0; n<COST_SAMPLES; n++)
+  {
+    if (calib.added == MAG_CALIB_SOLVE_SAMPLES - 1 && calib.weight >= MAG_CALIB_MIN_SAMPLES)
+      solves++;
+    magCalibUpdate(&calib, samples[n & 4095]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  withSolves = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+
+  //Kept from solving
+  magCalibReset(&calib);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (n=0; n<COST_SAMPLES; n++)
+  {
+    calib.added = 0;
+    magCalibUpdate(&calib, samples[n & 4095]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  *update = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / COST_SAMPLES;
+  *solve = solves ? (withSolves - *update * COST_SAMPLES) / solves : 0.0;
+}
+
+static void printScenarios(void)
+{
+  result_t res;
+  double update, solve;
+  uint32_t k;
+
+  printf("%-24s %5s %5s %9s %8s %8s %8s\n", "", "taken", "rejec", "angle deg", "norm %",
+         "residual", "spread");
+  for (k=0; k<SCENARIOS; k++)
+  {
+    run(&scenarios[k], 0x9E3779B97F4A7C15ull + k, &res);
+    printf("%-24s %5u %5u %9.3f %8.3f %8.4f %8.3f\n", scenarios[k].name, res.solutions,
+           res.rejections, res.maxAngle, 100.0 * res.rmsNorm, res.residual, res.spread);
+  }
+  printf("samples added in %u: tumbled %u, still %u\n", SAMPLES,
+         countAdded(MOTION_TUMBLE), countAdded(MOTION_STILL));
+
+  measureCost(&update, &solve);
+  printf("host cost: update %.0f ns, solve %.0f ns\n", update, solve);
+}
+
+static int selfTest(void)
+{
+  result_t res;
+  int errors = 0;
+  uint32_t k;
+
+  for (k=0; k<SCENARIOS; k++)
+  {
+    const scenario_t * s = &scenarios[k];
+    int failed = 0;
+
+    run(s, 0x9E3779B97F4A7C15ull + k, &res);
+
+    switch (s->motion)
+    {
+      case MOTION_TUMBLE:
+        if (s->disturbance > 0.0)
+        {
+          //Does not fit an ellipsoid, nothing taken
+          if (res.solutions != 0 || res.result.radius != 0.0f)
+            failed++;
+        }
+        else if (res.solutions == 0 || res.maxAngle > 1.0 || res.rmsNorm > 0.01)
+        {
+          failed++;
+        }
+        break;
+
+      case MOTION_FLIGHT:
+        if (res.solutions == 0 || res.maxAngle > 2.0 || res.rmsNorm > 0.02)
+          failed++;
+        break;
+
+      case MOTION_YAW:
+        //No spread on z: the stored calibration, if any, stays
+        if (res.solutions != 0)
+          failed++;
+        if (s->isRestored ? res.maxAngle > 1.0 : res.result.radius != 0.0f)
+          failed++;
+        break;
+
+      case MOTION_STILL:
+        if (res.solutions != 0 || res.result.radius != 0.0f)
+          failed++;
+        break;
+    }
+
+    if (failed)
+      printf("FAIL %s\n", s->name);
+    errors += failed;
+  }
+
+  //At rest the equations do not fill with one direction
+  if (countAdded(MOTION_STILL) > 5)
+  {
+    printf("FAIL still samples added\n");
+    errors++;
+  }
+
+  printf("%s, %d errors\n", errors ? "FAIL" : "pass", errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': return selfTest();
+      default:
+        fprintf(stderr, "usage: %s [-t]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  printScenarios();
+  return 0;
+}
@@ -0,0 +1,341 @@
+/**
+ * malloc_bench.c - TLSF against the previous bitmap allocator
+ *
+ * Runs the same random workload on Malloc/src/tlsf.c and on a copy of the
+ * ALIENTEK allocator it replaced (32 byte blocks, one table entry per block,
+ * linear scan for a run of free blocks), both on a 40KB pool as SRAMIN:
+ *
+ *   gcc -O2 -I../../Malloc/inc -o malloc_bench malloc_bench.c \
+ *       ../../Malloc/src/tlsf.c
+ *   ./malloc_bench                    1M operations, up to 128 live blocks
+ *   ./malloc_bench -l 512 -m 256      many small blocks
+ *   ./malloc_bench -r 0               no realloc
+ *
+ * Each operation is timed alone, clock read included: the tail matters more
+ * than the average for the tasks calling it. The maximum is mostly the host
+ * scheduler, the 99.9th percentile is given too. At the end the pool usage, the largest free
+ * block and the fragmentation, 100 * (1 - largest free / free), are given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tlsf.h"
+
+#define POOL_SIZE   (40 * 1024)
+#define MAX_LIVE    4096
+
+/*------------------------------------------------------------------------*/
+/* Previous allocator                                                     */
+/*------------------------------------------------------------------------*/
+#define BM_BLOCK_SIZE   32
+#define BM_TABLE_SIZE   (POOL_SIZE / BM_BLOCK_SIZE)
+
+static uint8_t bmPool[POOL_SIZE];
+static uint16_t bmMap[BM_TABLE_SIZE];
+static uint32_t bmFailures;
+
+static void *bmMalloc(uint32_t size)
+{
+  long offset;
+  uint16_t nmemb, cmemb = 0;
+  uint32_t i;
+
+  if (size == 0)
+    return NULL;
+  nmemb = (size + BM_BLOCK_SIZE - 1) / BM_BLOCK_SIZE;
+  for (offset = BM_TABLE_SIZE - 1; offset >= 0; offset--)
+  {
+    if (!bmMap[offset]) cmemb++;
+    else cmemb = 0;
+    if (cmemb == nmemb)
+    {
+      for (i = 0; i < nmemb; i++)
+        bmMap[offset + i] = nmemb;
+      return bmPool + offset * BM_BLOCK_SIZE;
+    }
+  }
+  bmFailures++;
+  return NULL;
+}
+
+static void bmFree(void *ptr)
+{
+  int index, nmemb, i;
+
+  if (!ptr)
+    return;
+  index = ((uint8_t *)ptr - bmPool) / BM_BLOCK_SIZE;
+  nmemb = bmMap[index];
+  for (i = 0; i < nmemb; i++)
+    bmMap[index + i] = 0;
+}
+
+/* As the original: always moves. Copies the old size, the original copied
+   the new one and read past the old block */
+static void *bmRealloc(void *ptr, uint32_t size)
+{
+  void *p;
+  uint32_t old;
+
+  if (!ptr)
+    return bmMalloc(size);
+  old = bmMap[((uint8_t *)ptr - bmPool) / BM_BLOCK_SIZE] * BM_BLOCK_SIZE;
+  p = bmMalloc(size);
+  if (p)
+  {
+    memcpy(p, ptr, old < size ? old : size);
+    bmFree(ptr);
+  }
+  return p;
+}
+
+static void bmStats(tlsfStats_t *stats)
+{
+  uint32_t i, run = 0;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->size = POOL_SIZE;
+  for (i = 0; i < BM_TABLE_SIZE; i++)
+  {
+    if (bmMap[i])
+    {
+      stats->used += BM_BLOCK_SIZE;
+      run = 0;
+    }
+    else
+    {
+      if (run == 0)
+        stats->freeBlocks++;
+      run++;
+      if (run * BM_BLOCK_SIZE > stats->largestFree)
+        stats->largestFree = run * BM_BLOCK_SIZE;
+    }
+  }
+  stats->free = stats->size - stats->used;
+  stats->failures = bmFailures;
+  if (stats->free)
+    stats->fragmentation = (uint8_t)(100 - stats->largestFree * 100 / stats->free);
+}
+
+/*------------------------------------------------------------------------*/
+/* TLSF                                                                   */
+/*------------------------------------------------------------------------*/
+static uint64_t tlsfPool[POOL_SIZE / sizeof(uint64_t)];
+static tlsf_t tlsf;
+
+static void *tMalloc(uint32_t size) { return tlsfMalloc(&tlsf, size); }
+static void tFree(void *ptr) { tlsfFree(&tlsf, ptr); }
+static void *tRealloc(void *ptr, uint32_t size) { return tlsfRealloc(&tlsf, ptr, size); }
+static void tStats(tlsfStats_t *stats) { tlsfGetStats(&tlsf, stats); }
+
+/*------------------------------------------------------------------------*/
+/* Workload                                                               */
+/*------------------------------------------------------------------------*/
+typedef struct
+{
+  const char *name;
+  void *(*malloc)(uint32_t size);
+  void (*free)(void *ptr);
+  void *(*realloc)(void *ptr, uint32_t size);
+  void (*stats)(tlsfStats_t *stats);
+} allocator_t;
+
+typedef struct
+{
+  uint64_t count;
+  uint64_t totalNs;
+  uint64_t maxNs;
+  uint64_t histogram[64];      // By power of two of the time
+} timing_t;
+
+static long operations = 1000000;
+static int live = 128;
+static uint32_t maxSize = 1024;
+static int reallocPercent = 10;
+static unsigned seed = 1;
+
+static uint64_t nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void timed(timing_t *t, uint64_t start)
+{
+  uint64_t ns = nowNs() - start;
+
+  t->count++;
+  t->totalNs += ns;
+  if (ns > t->maxNs)
+    t->maxNs = ns;
+  t->histogram[ns ? 63 - __builtin_clzll(ns) : 0]++;
+}
+
+/* Upper bound of the time under which 99.9% of the operations ran */
+static uint64_t p999(const timing_t *t)
+{
+  uint64_t n = 0;
+  int i;
+
+  for (i = 0; i < 64; i++)
+  {
+    n += t->histogram[i];
+    if (n * 1000 >= t->count * 999)
+      break;
+  }
+  return 2ull << i;
+}
+
+static void printTiming(const char *name, const timing_t *t)
+{
+  printf("  %-8s %9llu ops  avg %6.0f ns  p99.9 < %6llu ns  max %7llu ns\n", name,
+         (unsigned long long)t->count, t->count ? (double)t->totalNs / t->count : 0.0,
+         (unsigned long long)(t->count ? p999(t) : 0), (unsigned long long)t->maxNs);
+}
+
+/* Mostly small blocks, some up to maxSize: FatFs LFN buffers, strings */
+static uint32_t randomSize(void)
+{
+  if (rand() % 4)
+    return 1 + rand() % 64;
+  return 1 + rand() % maxSize;
+}
+
+static int run(const allocator_t *a)
+{
+  static void *ptr[MAX_LIVE];
+  static uint32_t size[MAX_LIVE];
+  static uint8_t tag[MAX_LIVE];
+  timing_t tMalloc = {0}, tFree = {0}, tRealloc = {0};
+  tlsfStats_t stats;
+  uint64_t start;
+  long n;
+  uint32_t k;
+  int i, errors = 0;
+
+  memset(ptr, 0, sizeof(ptr));
+  srand(seed);
+
+  for (n = 0; n < operations; n++)
+  {
+    i = rand() % live;
+    if (!ptr[i])
+    {
+      size[i] = randomSize();
+      start = nowNs();
+      ptr[i] = a->malloc(size[i]);
+      timed(&tMalloc, start);
+      if (ptr[i])
+      {
+        tag[i] = (uint8_t)rand();
+        memset(ptr[i], tag[i], size[i]);
+      }
+    }
+    else
+    {
+      for (k = 0; k < size[i]; k++)
+        if (((uint8_t *)ptr[i])[k] != tag[i])
+        {
+          errors++;
+          break;
+        }
+
+      if (rand() % 100 < reallocPercent)
+      {
+        uint32_t newSize = rand() % 2 ? size[i] + 1 + rand() % 128 : randomSize();
+        void *p;
+
+        start = nowNs();
+        p = a->realloc(ptr[i], newSize);
+        timed(&tRealloc, start);
+        if (p)
+        {
+          for (k = 0; k < size[i] && k < newSize; k++)
+            if (((uint8_t *)p)[k] != tag[i])
+            {
+              errors++;
+              break;
+            }
+          ptr[i] = p;
+          size[i] = newSize;
+          memset(p, tag[i], newSize);
+        }
+      }
+      else
+      {
+        start = nowNs();
+        a->free(ptr[i]);
+        timed(&tFree, start);
+        ptr[i] = NULL;
+      }
+    }
+  }
+
+  a->stats(&stats);
+
+  printf("%s\n", a->name);
+  printTiming("malloc", &tMalloc);
+  printTiming("free", &tFree);
+  printTiming("realloc", &tRealloc);
+  printf("  failures %u  used %zu/%zu  free blocks %u  largest free %zu  fragmentation %u%%\n",
+         stats.failures, stats.used, stats.size, stats.freeBlocks, stats.largestFree,
+         stats.fragmentation);
+  if (errors)
+    printf("  %d CORRUPTED BLOCKS\n", errors);
+
+  for (i = 0; i < live; i++)
+    a->free(ptr[i]);
+
+  return errors;
+}
+
+int main(int argc, char *argv[])
+{
+  static const allocator_t allocators[] =
+  {
+    { "bitmap (previous)", bmMalloc, bmFree, bmRealloc, bmStats },
+    { "tlsf", tMalloc, tFree, tRealloc, tStats },
+  };
+  int opt, errors = 0;
+  unsigned i;
+
+  while ((opt = getopt(argc, argv, "n:l:m:r:s:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': operations = atol(optarg); break;
+      case 'l': live = atoi(optarg); break;
+      case 'm': maxSize = atoi(optarg); break;
+      case 'r': reallocPercent = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n operations] [-l live blocks] [-m max size] "
+                "[-r realloc %%] [-s seed]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (live < 1 || live > MAX_LIVE || maxSize < 1)
+  {
+    fprintf(stderr, "live blocks 1..%d, max size > 0\n", MAX_LIVE);
+    return 2;
+  }
+
+  if (!tlsfInit(&tlsf, tlsfPool, sizeof(tlsfPool)))
+  {
+    fprintf(stderr, "tlsfInit failed\n");
+    return 1;
+  }
+
+  printf("%ld operations, %d live blocks, sizes up to %u, %d%% realloc, %d byte pool\n\n",
+         operations, live, maxSize, reallocPercent, POOL_SIZE);
+  for (i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++)
+    errors += run(&allocators[i]);
+
+  return errors ? 1 : 0;
+}
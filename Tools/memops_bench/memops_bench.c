@@ -0,0 +1,201 @@
+/**
+ * memops_bench.c - Word wide copy and fill against the byte loops
+ *
+ * Checks Malloc/src/memops.c against the C library on random lengths and
+ * alignments, then times it against the byte loops it replaced and the C
+ * library:
+ *
+ *   gcc -O2 -fno-tree-loop-distribute-patterns -I../../Malloc/inc \
+ *       -o memops_bench memops_bench.c ../../Malloc/src/memops.c
+ *   ./memops_bench
+ *
+ * -fno-tree-loop-distribute-patterns keeps gcc from turning the loops into
+ * memcpy/memset calls. The times are per call, the best of several runs;
+ * on x86 the time stamp counter cycles are given too. On target the same
+ * comparison is printed at boot with MEMDMA_BENCH (config.h), DMA included.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define HAVE_TSC 1
+#endif
+
+#include "memops.h"
+
+#define MAX_SIZE    (40 * 1024)     // The malloc pool
+#define RUNS        7
+
+static uint8_t bufA[MAX_SIZE + 64];
+static uint8_t bufB[MAX_SIZE + 64];
+static uint8_t ref[MAX_SIZE + 64];
+
+static void byteCopy(void *des, const void *src, uint32_t n)
+{
+  uint8_t *d = des;
+  const uint8_t *s = src;
+  while (n--) *d++ = *s++;
+}
+
+static void byteFill(void *s, uint8_t c, uint32_t n)
+{
+  uint8_t *d = s;
+  while (n--) *d++ = c;
+}
+
+static void libcCopy(void *des, const void *src, uint32_t n) { memcpy(des, src, n); }
+static void libcFill(void *s, uint8_t c, uint32_t n) { memset(s, c, n); }
+
+static int check(void)
+{
+  int i, errors = 0;
+
+  srand(1);
+  for (i = 0; i < 200000; i++)
+  {
+    uint32_t n = (uint32_t)rand() % 5000u;
+    uint32_t da = rand() % 8, sa = rand() % 8;
+    uint8_t c = (uint8_t)rand();
+    uint32_t k;
+
+    if (rand() % 8)
+      n %= 100;
+    for (k = 0; k < n + 16; k++)
+      bufB[k] = (uint8_t)rand();
+    memset(bufA, 0xA5, n + 16);
+    memcpy(ref, bufA, n + 16);
+
+    mymemcpy(bufA + da, bufB + sa, n);
+    memcpy(ref + da, bufB + sa, n);
+    if (memcmp(bufA, ref, n + 16))
+    {
+      printf("mymemcpy wrong: n %u dst +%u src +%u\n", n, da, sa);
+      errors++;
+    }
+
+    mymemset(bufA + da, c, n);
+    memset(ref + da, c, n);
+    if (memcmp(bufA, ref, n + 16))
+    {
+      printf("mymemset wrong: n %u dst +%u\n", n, da);
+      errors++;
+    }
+  }
+  return errors;
+}
+
+static uint64_t nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+typedef struct
+{
+  double ns;
+  double cycles;
+} timing_t;
+
+/* Best of RUNS, each run repeats the call to last about 1ms */
+static timing_t timeCopy(void (*copy)(void *, const void *, uint32_t),
+                         uint32_t n, uint32_t da, uint32_t sa)
+{
+  timing_t best = {1e18, 1e18};
+  uint32_t reps = 1 + 1000000 / (n + 16);
+  uint32_t r, i;
+
+  for (r = 0; r < RUNS; r++)
+  {
+    uint64_t t = nowNs();
+#ifdef HAVE_TSC
+    uint64_t c = __rdtsc();
+#endif
+    for (i = 0; i < reps; i++)
+    {
+      copy(bufA + da, bufB + sa, n);
+      __asm__ volatile("" ::: "memory");
+    }
+    if ((double)(nowNs() - t) / reps < best.ns)
+    {
+      best.ns = (double)(nowNs() - t) / reps;
+#ifdef HAVE_TSC
+      best.cycles = (double)(__rdtsc() - c) / reps;
+#endif
+    }
+  }
+  return best;
+}
+
+static timing_t timeFill(void (*fill)(void *, uint8_t, uint32_t), uint32_t n, uint32_t da)
+{
+  timing_t best = {1e18, 1e18};
+  uint32_t reps = 1 + 1000000 / (n + 16);
+  uint32_t r, i;
+
+  for (r = 0; r < RUNS; r++)
+  {
+    uint64_t t = nowNs();
+#ifdef HAVE_TSC
+    uint64_t c = __rdtsc();
+#endif
+    for (i = 0; i < reps; i++)
+    {
+      fill(bufA + da, (uint8_t)i, n);
+      __asm__ volatile("" ::: "memory");
+    }
+    if ((double)(nowNs() - t) / reps < best.ns)
+    {
+      best.ns = (double)(nowNs() - t) / reps;
+#ifdef HAVE_TSC
+      best.cycles = (double)(__rdtsc() - c) / reps;
+#endif
+    }
+  }
+  return best;
+}
+
+static void print(const char *name, timing_t t)
+{
+#ifdef HAVE_TSC
+  printf("  %-12s %10.1f ns %10.0f cycles\n", name, t.ns, t.cycles);
+#else
+  printf("  %-12s %10.1f ns\n", name, t.ns);
+#endif
+}
+
+int main(void)
+{
+  static const uint32_t sizes[] = {16, 64, 512, 4096, MAX_SIZE};
+  unsigned i;
+
+  if (check())
+    return 1;
+  printf("mymemcpy/mymemset match the C library\n\n");
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    uint32_t n = sizes[i];
+
+    printf("copy %u bytes, aligned\n", n);
+    print("byte loop", timeCopy(byteCopy, n, 0, 0));
+    print("mymemcpy", timeCopy(mymemcpy, n, 0, 0));
+    print("libc", timeCopy(libcCopy, n, 0, 0));
+    printf("copy %u bytes, source +1\n", n);
+    print("byte loop", timeCopy(byteCopy, n, 0, 1));
+    print("mymemcpy", timeCopy(mymemcpy, n, 0, 1));
+    print("libc", timeCopy(libcCopy, n, 0, 1));
+    printf("fill %u bytes\n", n);
+    print("byte loop", timeFill(byteFill, n, 0));
+    print("mymemset", timeFill(mymemset, n, 0));
+    print("libc", timeFill(libcFill, n, 0));
+    printf("\n");
+  }
+
+  return 0;
+}
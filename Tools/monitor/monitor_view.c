@@ -0,0 +1,330 @@
+/**
+ * monitor_view.c - Host viewer of the task monitor records
+ *
+ * Decodes the CRTP_PORT_MONITOR records (utils/inc/monitor_codec.h) from the
+ * UART link stream and prints, each monitor period, the CPU share and the
+ * stack high-water of every task with the heap and mymalloc() pool figures:
+ *
+ *   gcc -O2 -I../../DLL/inc -I../../utils/inc -o monitor_view \
+ *       monitor_view.c ../../DLL/src/UartFrame.c ../../utils/src/monitor_codec.c
+ *
+ *   ./monitor_view -d /dev/ttyUSB0 -b 2000000    from the UART link
+ *   ./monitor_view < capture.bin                 from a capture of the link
+ *   ./monitor_view -c -d /dev/ttyUSB0 > load.csv one line per task and period
+ *   ./monitor_view -t                            codec self test
+ *
+ * Other CRTP ports in the stream are skipped.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+
+#include "UartFrame.h"
+#include "monitor_codec.h"
+
+#define CRTP_PORT_MONITOR   0x09
+#define STACK_WORD          4             // StackType_t on the Cortex-M4
+
+static const char * stateNames[] = {"run", "ready", "block", "susp", "del"};
+
+static monitorSystem_t sys;
+static monitorTask_t tasks[MONITOR_MAX_TASKS];
+static uint32_t received;                 // Bit i: task record i of sys.seq
+static int haveSystem;
+static int csv;
+static unsigned long periods;
+static unsigned long incomplete;
+
+static int setRaw(int fd, int baud)
+{
+  struct termios tio;
+  speed_t speed;
+
+  if (tcgetattr(fd, &tio) < 0)
+    return -1;
+
+  switch (baud)
+  {
+    case 115200:  speed = B115200;  break;
+    case 921600:  speed = B921600;  break;
+    case 1000000: speed = B1000000; break;
+    case 1500000: speed = B1500000; break;
+    case 2000000: speed = B2000000; break;
+    default:
+      fprintf(stderr, "unsupported baudrate %d\n", baud);
+      return -1;
+  }
+
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+
+  return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static const char * stateName(uint8_t state)
+{
+  return state < sizeof(stateNames) / sizeof(stateNames[0]) ? stateNames[state] : "?";
+}
+
+/* The table of the period of sys.seq, with what was received of it */
+static void printPeriod(void)
+{
+  uint32_t i;
+
+  periods++;
+  if (received != (sys.taskCount >= 32 ? ~0u : (1u << sys.taskCount) - 1))
+    incomplete++;
+
+  if (csv)
+  {
+    for (i=0; i<sys.taskCount; i++)
+    {
+      if (!(received & (1u << i)))
+        continue;
+      printf("%u,%u,%s,%u,%s,%.1f,%u,%u,%u,%u,%u\n", sys.seq, tasks[i].number,
+             tasks[i].name, tasks[i].priority, stateName(tasks[i].state),
+             tasks[i].cpu / 10.0, tasks[i].stackFree * STACK_WORD,
+             sys.cpuLoad, sys.heapFree, sys.heapMinFree, sys.memFragmentation);
+    }
+    fflush(stdout);
+    return;
+  }
+
+  printf("\n#%u  cpu %.1f%%  heap %u free, %u min  malloc %u free, %u largest, "
+         "%u%% frag, %u fails  (%u ms)\n",
+         sys.seq, sys.cpuLoad / 10.0, sys.heapFree, sys.heapMinFree, sys.memFree,
+         sys.memLargest, sys.memFragmentation, sys.memFailures, sys.periodMs);
+  printf("  %3s %-10s %4s %-6s %6s %11s\n", "#", "task", "prio", "state", "cpu", "stack free");
+  for (i=0; i<sys.taskCount; i++)
+  {
+    if (!(received & (1u << i)))
+    {
+      printf("  %3s %-10s (record lost)\n", "-", "-");
+      continue;
+    }
+    printf("  %3u %-10s %4u %-6s %5.1f%% %5u bytes\n", tasks[i].number, tasks[i].name,
+           tasks[i].priority, stateName(tasks[i].state), tasks[i].cpu / 10.0,
+           tasks[i].stackFree * STACK_WORD);
+  }
+  fflush(stdout);
+}
+
+static void handleRecord(const uint8_t * payload, uint32_t len)
+{
+  monitorSystem_t s;
+  monitorTask_t t;
+
+  if (len < 1 || (payload[0] >> 4) != CRTP_PORT_MONITOR)
+    return;
+
+  switch (payload[0] & 0x03)
+  {
+    case MONITOR_CH_SYSTEM:
+      if (!monitorDecodeSystem(payload + 1, len - 1, &s))
+        return;
+      //The previous period lost its last task records
+      if (haveSystem && received)
+        printPeriod();
+      if (s.taskCount > MONITOR_MAX_TASKS)
+        s.taskCount = MONITOR_MAX_TASKS;
+      sys = s;
+      received = 0;
+      haveSystem = 1;
+      break;
+
+    case MONITOR_CH_TASK:
+      if (!monitorDecodeTask(payload + 1, len - 1, &t))
+        return;
+      if (!haveSystem || t.seq != sys.seq || t.index >= sys.taskCount)
+        return;
+      tasks[t.index] = t;
+      received |= 1u << t.index;
+      if (t.index == sys.taskCount - 1)
+      {
+        printPeriod();
+        received = 0;
+        haveSystem = 0;
+      }
+      break;
+  }
+}
+
+/* Frame one record of a period, as the firmware sends it */
+static uint32_t frameRecord(uint8_t * out, int channel, const void * record)
+{
+  uint8_t payload[1 + MONITOR_RECORD_SIZE];
+  uint32_t len;
+
+  payload[0] = (CRTP_PORT_MONITOR << 4) | channel;
+  if (channel == MONITOR_CH_SYSTEM)
+    len = monitorEncodeSystem(payload + 1, record);
+  else
+    len = monitorEncodeTask(payload + 1, record);
+
+  return uartFrameEncode(out, payload, len + 1);
+}
+
+static void decodeStream(uartFrameDecoder_t * dec, const uint8_t * in, uint32_t len)
+{
+  uint32_t i;
+
+  for (i=0; i<len; i++)
+  {
+    uint32_t n = uartFrameDecode(dec, in[i]);
+
+    if (n)
+      handleRecord(dec->payload, n);
+  }
+}
+
+/* Codec round trip, then two periods through the framing, one record lost */
+static int selfTest(void)
+{
+  uartFrameDecoder_t dec;
+  uint8_t record[MONITOR_RECORD_SIZE];
+  uint8_t stream[8 * UART_FRAME_MAX_LENGTH];
+  monitorSystem_t s, s2;
+  monitorTask_t t[3], t2;
+  int errors = 0;
+  uint32_t len;
+  uint32_t i;
+
+  //Wrapped counters: only the differences count
+  if (monitorPermille(0x00000010u - 0xFFFFFFF0u, 0x40u) != 500)
+    errors++;
+  if (monitorPermille(168000000u, 168000000u) != 1000 || monitorPermille(1, 0) != 0)
+    errors++;
+  if (monitorPermille(84000000u, 168000000u) != 500 || monitorPermille(2u, 1u) != 1000)
+    errors++;
+
+  memset(&s, 0, sizeof(s));
+  s.seq = 0xBEEF;
+  s.cpuLoad = 734;
+  s.taskCount = 3;
+  s.heapFree = 0x12345678;
+  s.heapMinFree = 1024;
+  s.memFree = 40000;
+  s.memLargest = 39000;
+  s.memFragmentation = 3;
+  s.memFailures = 7;
+  s.periodMs = 1000;
+
+  //Compared with memcmp: the padding must match too
+  memset(&s2, 0, sizeof(s2));
+  memset(&t2, 0, sizeof(t2));
+
+  len = monitorEncodeSystem(record, &s);
+  if (len > MONITOR_RECORD_SIZE || !monitorDecodeSystem(record, len, &s2) ||
+      memcmp(&s, &s2, sizeof(s)) != 0 || monitorDecodeSystem(record, len - 1, &s2))
+    errors++;
+
+  for (i=0; i<3; i++)
+  {
+    memset(&t[i], 0, sizeof(t[i]));
+    t[i].seq = s.seq;
+    t[i].index = i;
+    t[i].number = 10 + i;
+    t[i].state = i;
+    t[i].priority = 4 - i;
+    t[i].cpu = 100 * i + 17;
+    t[i].stackFree = 33 + i;
+    //A name of the full 10 chars: not terminated in the record
+    strcpy(t[i].name, i == 1 ? "STABILIZER" : "IDLE");
+
+    len = monitorEncodeTask(record, &t[i]);
+    if (len > MONITOR_RECORD_SIZE || !monitorDecodeTask(record, len, &t2) ||
+        memcmp(&t[i], &t2, sizeof(t2)) != 0 || monitorDecodeTask(record, len - 1, &t2))
+      errors++;
+  }
+
+  //A complete period, then one missing its second task record
+  uartFrameDecoderInit(&dec);
+  len = frameRecord(stream, MONITOR_CH_SYSTEM, &s);
+  for (i=0; i<3; i++)
+    len += frameRecord(stream + len, MONITOR_CH_TASK, &t[i]);
+  decodeStream(&dec, stream, len);
+  if (periods != 1 || incomplete != 0 || strcmp(tasks[1].name, "STABILIZER") != 0 ||
+      sys.heapFree != s.heapFree)
+    errors++;
+
+  s.seq++;
+  t[0].seq = t[2].seq = s.seq;
+  len = frameRecord(stream, MONITOR_CH_SYSTEM, &s);
+  len += frameRecord(stream + len, MONITOR_CH_TASK, &t[0]);
+  len += frameRecord(stream + len, MONITOR_CH_TASK, &t[2]);
+  decodeStream(&dec, stream, len);
+  if (periods != 2 || incomplete != 1 || dec.crcErrors != 0)
+    errors++;
+
+  printf("%s, %d errors\n", errors ? "FAIL" : "pass", errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  const char * device = NULL;
+  int baud = 2000000;
+  uartFrameDecoder_t dec;
+  uint8_t buf[4096];
+  int fd = STDIN_FILENO;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:b:ct")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd': device = optarg; break;
+      case 'b': baud = atoi(optarg); break;
+      case 'c': csv = 1; break;
+      case 't': return selfTest();
+      default:
+        fprintf(stderr, "usage: %s [-c] [-d device [-b baud]] | -t\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (device)
+  {
+    fd = open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0 || setRaw(fd, baud) < 0)
+    {
+      perror(device);
+      return 1;
+    }
+    tcflush(fd, TCIFLUSH);
+  }
+
+  if (csv)
+    printf("seq,task,name,prio,state,cpu,stackFree,cpuLoad,heapFree,heapMin,memFrag\n");
+
+  uartFrameDecoderInit(&dec);
+  while (1)
+  {
+    ssize_t n = read(fd, buf, sizeof(buf));
+
+    if (n <= 0)
+    {
+      if (n < 0 && errno == EINTR)
+        continue;
+      break;
+    }
+
+    decodeStream(&dec, buf, n);
+  }
+
+  if (haveSystem && received)
+    printPeriod();
+  fprintf(stderr, "%lu periods, %lu incomplete, %lu crc errors\n", periods, incomplete,
+          (unsigned long)dec.crcErrors);
+
+  return 0;
+}
@@ -0,0 +1,500 @@
+/**
+ * ram_budget.c - RAM used by each module of the firmware
+ *
+ * Reads the linked firmware (the IAR .out, or any ELF file) and sums the
+ * size of the data objects of the RAM sections (.data, .bss and the other
+ * writable sections) per source file, and per subsystem: the top directory
+ * of the file in the source tree (DLL, utils, FreeRTOS...).
+ *
+ *   gcc -O2 -o ram_budget ram_budget.c
+ *   ./ram_budget -r ../.. firmware.out      report
+ *   ./ram_budget -r ../.. -c firmware.out   CSV: subsystem,file,symbol,bytes
+ *   ./ram_budget -n 40 firmware.out         40 largest objects
+ *
+ * As a post-build step of the IAR project it regenerates the report at
+ * each link:
+ *   ram_budget -r $PROJ_DIR$ $TARGET_PATH$ > ram_budget.txt
+ *
+ * Since the RTOS objects are static (utils/inc/static_mem.h) the stacks
+ * and queues show under the module that creates them. The FreeRTOS heap
+ * (ucHeap) and the malloc pool (mem1base) show as what they are: blocks
+ * still handed out at run time.
+ *
+ * Static objects follow the STT_FILE symbol of their source file in the
+ * symbol table. The global objects are not tied to a file in ELF: their
+ * definition is looked for in the .c files of the source tree (-r), at
+ * file scope. What is found nowhere is reported as "?".
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_SOURCES   4096
+#define MAX_NAME      256
+
+/*------------------------------------------------------------------------*/
+/* ELF                                                                    */
+/*------------------------------------------------------------------------*/
+#define EI_CLASS      4
+#define EI_DATA       5
+#define ELFCLASS32    1
+#define ELFCLASS64    2
+#define ELFDATA2LSB   1
+#define SHT_SYMTAB    2
+#define SHT_NOBITS    8
+#define SHF_WRITE     0x1
+#define SHF_ALLOC     0x2
+#define STT_OBJECT    1
+#define STT_FILE      4
+#define STB_LOCAL     0
+
+typedef struct
+{
+  char name[MAX_NAME];
+  uint64_t addr;
+  uint64_t size;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t offset;
+  uint32_t link;
+  uint64_t entsize;
+  int ram;
+} section_t;
+
+typedef struct
+{
+  char *name;
+  char *file;           // Source file, NULL when not known
+  uint64_t size;
+  int section;
+} object_t;
+
+static uint8_t *image;
+static size_t imageSize;
+static int elf64;
+static section_t *sections;
+static int sectionCount;
+static object_t *objects;
+static int objectCount;
+
+static uint64_t rd(const uint8_t *p, int n)
+{
+  uint64_t v = 0;
+  int i;
+
+  for (i = n - 1; i >= 0; i--)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+/* Field of a structure whose layout differs between ELF32 and ELF64 */
+#define FIELD(P, OFF32, OFF64, SIZE32, SIZE64) \
+  (elf64 ? rd((P) + (OFF64), (SIZE64)) : rd((P) + (OFF32), (SIZE32)))
+
+static int inImage(uint64_t offset, uint64_t size)
+{
+  return offset <= imageSize && size <= imageSize - offset;
+}
+
+static int loadSections(void)
+{
+  uint64_t shoff;
+  uint32_t shentsize, shnum, shstrndx;
+  const uint8_t *strtab;
+  uint64_t strSize;
+  int i;
+
+  if (imageSize < 64 || memcmp(image, "\177ELF", 4))
+  {
+    fprintf(stderr, "not an ELF file\n");
+    return -1;
+  }
+  if (image[EI_DATA] != ELFDATA2LSB)
+  {
+    fprintf(stderr, "big endian ELF not supported\n");
+    return -1;
+  }
+  elf64 = image[EI_CLASS] == ELFCLASS64;
+
+  shoff = FIELD(image, 0x20, 0x28, 4, 8);
+  shentsize = (uint32_t)FIELD(image, 0x2E, 0x3A, 2, 2);
+  shnum = (uint32_t)FIELD(image, 0x30, 0x3C, 2, 2);
+  shstrndx = (uint32_t)FIELD(image, 0x32, 0x3E, 2, 2);
+  if (shnum == 0 || !inImage(shoff, (uint64_t)shentsize * shnum) || shstrndx >= shnum)
+  {
+    fprintf(stderr, "no section table\n");
+    return -1;
+  }
+
+  sections = calloc(shnum, sizeof(section_t));
+  sectionCount = shnum;
+  for (i = 0; i < (int)shnum; i++)
+  {
+    const uint8_t *sh = image + shoff + (uint64_t)i * shentsize;
+    section_t *s = &sections[i];
+
+    s->type = (uint32_t)rd(sh + 4, 4);
+    s->flags = FIELD(sh, 0x08, 0x08, 4, 8);
+    s->addr = FIELD(sh, 0x0C, 0x10, 4, 8);
+    s->offset = FIELD(sh, 0x10, 0x18, 4, 8);
+    s->size = FIELD(sh, 0x14, 0x20, 4, 8);
+    s->link = (uint32_t)FIELD(sh, 0x18, 0x28, 4, 4);
+    s->entsize = FIELD(sh, 0x24, 0x38, 4, 8);
+    s->ram = (s->flags & (SHF_ALLOC | SHF_WRITE)) == (SHF_ALLOC | SHF_WRITE);
+  }
+
+  strtab = image + sections[shstrndx].offset;
+  strSize = sections[shstrndx].size;
+  if (!inImage(sections[shstrndx].offset, strSize))
+    return -1;
+  for (i = 0; i < (int)shnum; i++)
+  {
+    uint32_t nameOff = (uint32_t)rd(image + shoff + (uint64_t)i * shentsize, 4);
+
+    if (nameOff < strSize)
+      snprintf(sections[i].name, MAX_NAME, "%.*s", (int)(strSize - nameOff), strtab + nameOff);
+  }
+  return 0;
+}
+
+static const char *baseName(const char *path)
+{
+  const char *p = strrchr(path, '/');
+  const char *q = strrchr(path, '\\');
+
+  if (q > p)
+    p = q;
+  return p ? p + 1 : path;
+}
+
+static int loadObjects(void)
+{
+  const section_t *symtab = NULL;
+  const section_t *strtab;
+  const char *file = NULL;
+  uint64_t entsize, count, i;
+  int k;
+
+  for (k = 0; k < sectionCount; k++)
+    if (sections[k].type == SHT_SYMTAB)
+      symtab = &sections[k];
+  if (!symtab || symtab->link >= (uint32_t)sectionCount)
+  {
+    fprintf(stderr, "no symbol table: link without stripping the symbols\n");
+    return -1;
+  }
+  strtab = &sections[symtab->link];
+  if (!inImage(symtab->offset, symtab->size) || !inImage(strtab->offset, strtab->size))
+    return -1;
+
+  entsize = symtab->entsize ? symtab->entsize : (elf64 ? 24 : 16);
+  count = symtab->size / entsize;
+  objects = calloc(count, sizeof(object_t));
+
+  for (i = 0; i < count; i++)
+  {
+    const uint8_t *sym = image + symtab->offset + i * entsize;
+    uint32_t nameOff = (uint32_t)rd(sym, 4);
+    uint8_t info = elf64 ? sym[4] : sym[12];
+    uint32_t shndx = (uint32_t)(elf64 ? rd(sym + 6, 2) : rd(sym + 14, 2));
+    uint64_t size = elf64 ? rd(sym + 16, 8) : rd(sym + 8, 4);
+    const char *name = nameOff < strtab->size ? (const char *)image + strtab->offset + nameOff : "";
+
+    if ((info & 0xF) == STT_FILE)
+    {
+      file = *name ? baseName(name) : NULL;
+      continue;
+    }
+    if ((info & 0xF) != STT_OBJECT || size == 0 || shndx == 0 ||
+        shndx >= (uint32_t)sectionCount || !sections[shndx].ram)
+      continue;
+
+    objects[objectCount].name = strdup(name);
+    //The file symbol only covers the local symbols that follow it
+    objects[objectCount].file = ((info >> 4) == STB_LOCAL && file) ? strdup(file) : NULL;
+    objects[objectCount].size = size;
+    objects[objectCount].section = (int)shndx;
+    objectCount++;
+  }
+  return 0;
+}
+
+/*------------------------------------------------------------------------*/
+/* Source tree                                                            */
+/*------------------------------------------------------------------------*/
+static char *sources[MAX_SOURCES];   // Paths relative to the root
+static int sourceCount;
+static const char *root;
+
+static void scanTree(const char *dir)
+{
+  char path[2048];
+  struct dirent *e;
+  struct stat st;
+  DIR *d;
+
+  snprintf(path, sizeof(path), "%s/%s", root, dir);
+  d = opendir(path);
+  if (!d)
+    return;
+
+  while ((e = readdir(d)) != NULL && sourceCount < MAX_SOURCES)
+  {
+    char rel[1024];
+    size_t len = strlen(e->d_name);
+
+    if (e->d_name[0] == '.')
+      continue;
+    snprintf(rel, sizeof(rel), "%s%s%s", dir, *dir ? "/" : "", e->d_name);
+    //The FreeRTOS demos and the host tools are not linked in the firmware
+    if (!strcmp(rel, "FreeRTOS/Demo") || !strcmp(rel, "Tools") || !strcmp(rel, "Temp"))
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    if (stat(path, &st))
+      continue;
+    if (S_ISDIR(st.st_mode))
+      scanTree(rel);
+    else if (len > 2 && !strcmp(e->d_name + len - 2, ".c"))
+      sources[sourceCount++] = strdup(rel);
+  }
+  closedir(d);
+}
+
+static const char *sourcePath(const char *file)
+{
+  int i;
+
+  for (i = 0; i < sourceCount; i++)
+    if (!strcmp(baseName(sources[i]), file))
+      return sources[i];
+  return NULL;
+}
+
+static int isIdent(int c)
+{
+  return isalnum(c) || c == '_';
+}
+
+/* A file scope definition of name in the line: not extern, not a
+   prototype, the name followed by an array, an initialiser or the end */
+static int definesObject(const char *line, const char *name)
+{
+  size_t n = strlen(name);
+  const char *p = line;
+  const char *q;
+
+  if (isspace((unsigned char)line[0]) || line[0] == '#' || line[0] == '/' ||
+      line[0] == '*' || !strncmp(line, "extern", 6) || !strncmp(line, "static", 6))
+    return 0;
+
+  while ((p = strstr(p, name)) != NULL)
+  {
+    if ((p == line || !isIdent((unsigned char)p[-1])) && !isIdent((unsigned char)p[n]))
+    {
+      for (q = p + n; *q == ' ' || *q == '\t'; q++) ;
+      if (*q == '[' || *q == '=' || *q == ';' || *q == ',')
+        return 1;
+    }
+    p += n;
+  }
+  return 0;
+}
+
+static char *findDefinition(const char *name)
+{
+  char path[2048];
+  char line[1024];
+  char *found = NULL;
+  int i;
+
+  for (i = 0; i < sourceCount && !found; i++)
+  {
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", root, sources[i]);
+    f = fopen(path, "r");
+    if (!f)
+      continue;
+    while (fgets(line, sizeof(line), f))
+      if (definesObject(line, name))
+      {
+        found = strdup(baseName(sources[i]));
+        break;
+      }
+    fclose(f);
+  }
+  return found;
+}
+
+/* Subsystem of a source file: its top directory */
+static void subsystemOf(const char *file, char *out, size_t outSize)
+{
+  const char *path = file ? sourcePath(file) : NULL;
+  const char *slash;
+
+  if (!file)
+    snprintf(out, outSize, "?");
+  else if (!path)
+    snprintf(out, outSize, "(libraries)");
+  else if ((slash = strchr(path, '/')) != NULL)
+    snprintf(out, outSize, "%.*s", (int)(slash - path), path);
+  else
+    snprintf(out, outSize, ".");
+}
+
+/*------------------------------------------------------------------------*/
+/* Report                                                                 */
+/*------------------------------------------------------------------------*/
+typedef struct
+{
+  char subsystem[MAX_NAME];
+  char file[MAX_NAME];
+  uint64_t bytes;
+  int objects;
+} module_t;
+
+static int bySize(const void *a, const void *b)
+{
+  const object_t *x = a, *y = b;
+  return x->size < y->size ? 1 : x->size > y->size ? -1 : strcmp(x->name, y->name);
+}
+
+static int byModule(const void *a, const void *b)
+{
+  const module_t *x = a, *y = b;
+  int c = strcmp(x->subsystem, y->subsystem);
+
+  if (c)
+    return c;
+  return x->bytes < y->bytes ? 1 : x->bytes > y->bytes ? -1 : strcmp(x->file, y->file);
+}
+
+int main(int argc, char *argv[])
+{
+  module_t *modules;
+  int moduleCount = 0;
+  int top = 20, csv = 0;
+  uint64_t ramTotal = 0, objectTotal = 0;
+  FILE *f;
+  int opt, i, j;
+
+  while ((opt = getopt(argc, argv, "r:n:c")) != -1)
+  {
+    switch (opt)
+    {
+      case 'r': root = optarg; break;
+      case 'n': top = atoi(optarg); break;
+      case 'c': csv = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-r source root] [-n largest objects] [-c] firmware.out\n", argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    fprintf(stderr, "usage: %s [-r source root] [-n largest objects] [-c] firmware.out\n", argv[0]);
+    return 2;
+  }
+
+  f = fopen(argv[optind], "rb");
+  if (!f)
+  {
+    perror(argv[optind]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  imageSize = (size_t)ftell(f);
+  fseek(f, 0, SEEK_SET);
+  image = malloc(imageSize);
+  if (!image || fread(image, 1, imageSize, f) != imageSize)
+  {
+    perror(argv[optind]);
+    return 1;
+  }
+  fclose(f);
+
+  if (loadSections() || loadObjects())
+    return 1;
+
+  if (root)
+  {
+    scanTree("");
+    for (i = 0; i < objectCount; i++)
+      if (!objects[i].file)
+        objects[i].file = findDefinition(objects[i].name);
+  }
+
+  //One module per file
+  modules = calloc(objectCount + 1, sizeof(module_t));
+  for (i = 0; i < objectCount; i++)
+  {
+    const char *file = objects[i].file ? objects[i].file : "?";
+
+    for (j = 0; j < moduleCount; j++)
+      if (!strcmp(modules[j].file, file))
+        break;
+    if (j == moduleCount)
+    {
+      snprintf(modules[j].file, MAX_NAME, "%s", file);
+      subsystemOf(objects[i].file, modules[j].subsystem, MAX_NAME);
+      moduleCount++;
+    }
+    modules[j].bytes += objects[i].size;
+    modules[j].objects++;
+    objectTotal += objects[i].size;
+  }
+  qsort(modules, moduleCount, sizeof(module_t), byModule);
+  qsort(objects, objectCount, sizeof(object_t), bySize);
+
+  if (csv)
+  {
+    printf("subsystem,file,symbol,bytes\n");
+    for (i = 0; i < objectCount; i++)
+    {
+      char subsystem[MAX_NAME];
+
+      subsystemOf(objects[i].file, subsystem, sizeof(subsystem));
+      printf("%s,%s,%s,%llu\n", subsystem, objects[i].file ? objects[i].file : "?",
+             objects[i].name, (unsigned long long)objects[i].size);
+    }
+    return 0;
+  }
+
+  printf("RAM sections of %s\n", argv[optind]);
+  for (i = 0; i < sectionCount; i++)
+    if (sections[i].ram && sections[i].size)
+    {
+      printf("  %-20s 0x%08llx %8llu%s\n", sections[i].name, (unsigned long long)sections[i].addr,
+             (unsigned long long)sections[i].size, sections[i].type == SHT_NOBITS ? "  (zeroed)" : "");
+      ramTotal += sections[i].size;
+    }
+  printf("  %-31s %8llu\n", "total", (unsigned long long)ramTotal);
+  printf("  %-31s %8llu\n", "in named objects", (unsigned long long)objectTotal);
+  printf("  %-31s %8llu\n\n", "rest: stack, padding", (unsigned long long)(ramTotal - objectTotal));
+
+  printf("Per subsystem and file\n");
+  for (i = 0; i < moduleCount; i = j)
+  {
+    uint64_t sum = 0;
+
+    for (j = i; j < moduleCount && !strcmp(modules[j].subsystem, modules[i].subsystem); j++)
+      sum += modules[j].bytes;
+    printf("  %-31s %8llu  %5.1f%%\n", modules[i].subsystem, (unsigned long long)sum,
+           ramTotal ? 100.0 * sum / ramTotal : 0.0);
+    for (j = i; j < moduleCount && !strcmp(modules[j].subsystem, modules[i].subsystem); j++)
+      printf("    %-29s %8llu  %3d objects\n", modules[j].file,
+             (unsigned long long)modules[j].bytes, modules[j].objects);
+  }
+
+  printf("\nLargest objects\n");
+  for (i = 0; i < objectCount && i < top; i++)
+    printf("  %-31s %8llu  %s\n", objects[i].name, (unsigned long long)objects[i].size,
+           objects[i].file ? objects[i].file : "?");
+
+  return 0;
+}
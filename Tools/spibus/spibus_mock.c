@@ -0,0 +1,355 @@
+/**
+ * spibus_mock.c - Host mock of the sensor SPI bus, bus occupancy per tick
+ *
+ * Implements the interface of Hardware/inc/SpiBus.h without the hardware:
+ * each transaction is timed from the clock profile of its device, with the
+ * chip select, polling and DMA overheads of the firmware, and recorded. A
+ * replay of the accesses the sensor drivers make each 500Hz control tick
+ * (imu6Read(), the HMC5983 samples at 220Hz, the MS5611 conversions at
+ * 100Hz) gives the bus and CPU time per tick:
+ *
+ *   gcc -O2 -I../../Hardware/inc -o spibus_mock spibus_mock.c
+ *
+ *   ./spibus_mock                  1s with the profiles of SpiBus.h
+ *   ./spibus_mock -s               every device at PCLK / 256, as before
+ *   ./spibus_mock -d               with SPI_BUS_DMA
+ *   ./spibus_mock -b -n 5000       with the MS5611, 10s
+ *   ./spibus_mock -m               the MPU9250 9-axis burst instead of the
+ *                                  ICM20601 and HMC5983 reads
+ *   ./spibus_mock -c > bus.csv     one line per transaction
+ *   ./spibus_mock -t               self test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "SpiBus.h"
+
+#define CPU_HZ            168000000
+#define TICK_US           2000.0      // IMU_UPDATE_FREQ 500Hz
+#define BARO_TICKS        5           // BARO_RATE 100Hz
+#define MAG_PERIOD_US     (1e6 / 220) // HMC5983 DOR_220HZ
+
+/* Estimated firmware overheads at 168MHz */
+#define CS_US             0.3         // Profile check, chip select down and up
+#define CONFIG_US         0.2         // Profile change, SPE off and on
+#define POLL_GAP_US       0.12        // SPI1_RW() between two polled bytes
+#define DMA_SETUP_US      3.0         // Streams setup, CPU side
+#define DMA_WAKE_US       6.0         // Sleep on the semaphore, interrupt, switch back
+
+/* ICM20601, HMC5983 and MS5611 commands of the drivers */
+#define ICM_READ_SENSORS  (0x80 | 0x3B)
+#define HMC_READ_DATA     (0xC0 | 0x03)
+#define MPU_READ_SENSORS  (0x80 | 0x3B)
+#define MPU_BURST_SIZE    22          // MPU9250_BURST_SIZE
+#define MS5611_ADC_READ   0x00
+#define MS5611_D1_4096    0x48
+
+static const char * deviceNames[SPI_BUS_DEVICES] = {"ICM20601", "HMC5983", "MS5611", "MPU9250"};
+
+static const uint16_t profileDivs[SPI_BUS_DEVICES][2] =
+{
+  {SPI_BUS_ICM20601_DIV, SPI_BUS_ICM20601_FAST_DIV},
+  {SPI_BUS_HMC5983_DIV, SPI_BUS_HMC5983_DIV},
+  {SPI_BUS_MS5611_DIV, SPI_BUS_MS5611_DIV},
+  {SPI_BUS_MPU9250_DIV, SPI_BUS_MPU9250_FAST_DIV},
+};
+
+static uint16_t divs[SPI_BUS_DEVICES][2];
+static int useDma;
+static int useMpu9250;
+static int csv;
+static spiBusStats_t stats;
+static uint16_t currentDiv;
+
+/* Time of the replay and busy time of the current tick */
+static uint32_t tick;
+static double now;
+static double tickBusUs;
+static double tickCpuUs;
+
+static double byteUs(uint16_t div)
+{
+  return 8.0 * div * 1e6 / SPI_BUS_PCLK_HZ;
+}
+
+void spiBusInit(void)
+{
+  memset(&stats, 0, sizeof(stats));
+  currentDiv = 256;
+}
+
+bool spiBusTest(void)
+{
+  return true;
+}
+
+void spiBusDmaIsr(void)
+{
+}
+
+static void spiBusRunOne(const spiBusTransaction_t * t)
+{
+  uint16_t div = divs[t->device][(t->flags & SPI_BUS_FAST) ? 1 : 0];
+  double bus = CS_US;
+  double cpu;
+  double start = now;
+
+  if (div != currentDiv)
+  {
+    bus += CONFIG_US;
+    currentDiv = div;
+  }
+
+  //The command bytes are always polled
+  bus += t->cmdLen * (byteUs(div) + POLL_GAP_US);
+  if (useDma && t->len >= SPI_BUS_DMA_MIN_SIZE)
+  {
+    bus += DMA_SETUP_US + t->len * byteUs(div) + DMA_WAKE_US;
+    cpu = bus - t->len * byteUs(div) - DMA_WAKE_US;
+    stats.dmaTransfers++;
+  }
+  else
+  {
+    bus += t->len * (byteUs(div) + POLL_GAP_US);
+    cpu = bus;
+  }
+
+  if (t->rx)
+    memset(t->rx, 0, t->len);
+
+  now += bus;
+  tickBusUs += bus;
+  tickCpuUs += cpu;
+
+  stats.device[t->device].transactions++;
+  stats.device[t->device].bytes += t->cmdLen + t->len;
+  stats.device[t->device].busyCycles += (uint32_t)(bus * (CPU_HZ / 1e6));
+
+  if (csv)
+    printf("%u,%.2f,%s,%u,%u,%u,%.2f,%.2f\n", tick, start, deviceNames[t->device],
+           t->cmdLen + t->len, (unsigned)(SPI_BUS_PCLK_HZ / div),
+           useDma && t->len >= SPI_BUS_DMA_MIN_SIZE, bus, cpu);
+}
+
+bool spiBusRun(const spiBusTransaction_t * t, uint32_t count)
+{
+  uint32_t i;
+
+  for (i=0; i<count; i++)
+    if (t[i].device < SPI_BUS_DEVICES && t[i].cmdLen <= SPI_BUS_CMD_MAX)
+      spiBusRunOne(&t[i]);
+
+  return true;
+}
+
+bool spiBusTransfer(uint8_t device, uint8_t flags, uint8_t cmd,
+                    const uint8_t * tx, uint8_t * rx, uint16_t len)
+{
+  spiBusTransaction_t t;
+
+  t.device = device;
+  t.flags = flags;
+  t.cmdLen = 1;
+  t.cmd[0] = cmd;
+  t.tx = tx;
+  t.rx = rx;
+  t.len = len;
+
+  return spiBusRun(&t, 1);
+}
+
+void spiBusGetStats(spiBusStats_t * s)
+{
+  *s = stats;
+}
+
+/* The accesses of one control tick, as the drivers make them */
+static void replayTick(int withBaro)
+{
+  uint8_t data[MPU_BURST_SIZE];
+
+  if (useMpu9250)
+  {
+    //MPU9250_GetNineAxisData(): the magnetometer comes with the rest
+    spiBusTransfer(SPI_BUS_MPU9250, SPI_BUS_FAST, MPU_READ_SENSORS, NULL, data, MPU_BURST_SIZE);
+  }
+  else
+  {
+    //imu6Read(): ICM20601GetSixAxisData()
+    spiBusTransfer(SPI_BUS_ICM20601, SPI_BUS_FAST, ICM_READ_SENSORS, NULL, data, 14);
+
+    //The magnetometer task: HMC5983_ReadRaw() on each DRDY, no status read
+    if ((uint32_t)((tick + 1) * TICK_US / MAG_PERIOD_US) != (uint32_t)(tick * TICK_US / MAG_PERIOD_US))
+      spiBusTransfer(SPI_BUS_HMC5983, 0, HMC_READ_DATA, NULL, data, 6);
+  }
+
+  //MS5611_GetData(): the conversion done, the next one started
+  if (withBaro && tick % BARO_TICKS == 0)
+  {
+    spiBusTransfer(SPI_BUS_MS5611, 0, MS5611_ADC_READ, NULL, data, 3);
+    spiBusTransfer(SPI_BUS_MS5611, 0, MS5611_D1_4096, NULL, NULL, 0);
+  }
+}
+
+typedef struct
+{
+  double busMean, busMax;
+  double cpuMean, cpuMax;
+} occupancy_t;
+
+static void replay(uint32_t ticks, int withBaro, occupancy_t * o)
+{
+  memset(o, 0, sizeof(*o));
+  spiBusInit();
+
+  for (tick=0; tick<ticks; tick++)
+  {
+    now = tick * TICK_US;
+    tickBusUs = 0;
+    tickCpuUs = 0;
+
+    replayTick(withBaro);
+
+    o->busMean += tickBusUs / ticks;
+    o->cpuMean += tickCpuUs / ticks;
+    if (tickBusUs > o->busMax)
+      o->busMax = tickBusUs;
+    if (tickCpuUs > o->cpuMax)
+      o->cpuMax = tickCpuUs;
+  }
+}
+
+static void setSlow(int slow)
+{
+  int i;
+
+  for (i=0; i<SPI_BUS_DEVICES; i++)
+  {
+    divs[i][0] = slow ? 256 : profileDivs[i][0];
+    divs[i][1] = slow ? 256 : profileDivs[i][1];
+  }
+}
+
+static int near(double a, double b)
+{
+  return a - b < 0.01 && b - a < 0.01;
+}
+
+static int selfTest(void)
+{
+  spiBusTransaction_t batch[3];
+  occupancy_t slow, fast, dma, mpu;
+  uint8_t rx[14];
+  int errors = 0;
+  double expected;
+
+  setSlow(0);
+  //One 15 byte read at 5.25MHz: profile change, chip select, polled bytes
+  spiBusInit();
+  tick = 0;
+  now = tickBusUs = tickCpuUs = 0;
+  spiBusTransfer(SPI_BUS_ICM20601, SPI_BUS_FAST, ICM_READ_SENSORS, NULL, rx, 14);
+  expected = CS_US + CONFIG_US + 15 * (byteUs(SPI_BUS_ICM20601_FAST_DIV) + POLL_GAP_US);
+  if (!near(tickBusUs, expected) || !near(tickCpuUs, expected))
+    errors++;
+  if (stats.device[SPI_BUS_ICM20601].transactions != 1 ||
+      stats.device[SPI_BUS_ICM20601].bytes != 15)
+    errors++;
+
+  //A batch: each transaction counted, the invalid one skipped, no fast
+  //clock on the HMC5983. Same clock as the read above: no profile change
+  memset(batch, 0, sizeof(batch));
+  batch[0].device = SPI_BUS_HMC5983;
+  batch[0].flags = SPI_BUS_FAST;
+  batch[0].cmdLen = 1;
+  batch[0].len = 6;
+  batch[1] = batch[0];
+  batch[1].device = SPI_BUS_DEVICES;
+  batch[2] = batch[0];
+  batch[2].cmdLen = 2;
+  tickBusUs = 0;
+  spiBusRun(batch, 3);
+  expected = 2 * CS_US + 15 * (byteUs(SPI_BUS_HMC5983_DIV) + POLL_GAP_US);
+  if (stats.device[SPI_BUS_HMC5983].transactions != 2 ||
+      stats.device[SPI_BUS_HMC5983].bytes != 15 || !near(tickBusUs, expected))
+    errors++;
+
+  //The profiles take far less of the tick than the former clock, the DMA
+  //frees the CPU of the ICM20601 reads
+  setSlow(1);
+  replay(500, 1, &slow);
+  setSlow(0);
+  replay(500, 1, &fast);
+  useDma = 1;
+  replay(500, 1, &dma);
+  useDma = 0;
+  if (!(fast.busMax * 8 < slow.busMax) || !(dma.cpuMean < fast.cpuMean) ||
+      !(slow.busMax < TICK_US))
+    errors++;
+  if (stats.device[SPI_BUS_ICM20601].transactions != 500 ||
+      stats.device[SPI_BUS_MS5611].transactions != 200 || stats.dmaTransfers != 500)
+    errors++;
+
+  //The 9 axes of the MPU9250 in one burst take less of the bus than the
+  //ICM20601 and HMC5983 reads
+  useMpu9250 = 1;
+  replay(500, 1, &mpu);
+  useMpu9250 = 0;
+  if (!(mpu.busMax < fast.busMax) || stats.device[SPI_BUS_MPU9250].transactions != 500 ||
+      stats.device[SPI_BUS_HMC5983].transactions != 0)
+    errors++;
+
+  printf("%s, %d errors\n", errors ? "FAIL" : "pass", errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  uint32_t ticks = 500;
+  int withBaro = 0;
+  occupancy_t o;
+  int opt;
+  int i;
+
+  setSlow(0);
+  while ((opt = getopt(argc, argv, "sdbmn:ct")) != -1)
+  {
+    switch (opt)
+    {
+      case 's': setSlow(1); break;
+      case 'd': useDma = 1; break;
+      case 'b': withBaro = 1; break;
+      case 'm': useMpu9250 = 1; break;
+      case 'n': ticks = (uint32_t)atoi(optarg); break;
+      case 'c': csv = 1; break;
+      case 't': return selfTest();
+      default:
+        fprintf(stderr, "usage: %s [-s] [-d] [-b] [-m] [-n ticks] [-c] | -t\n", argv[0]);
+        return 1;
+    }
+  }
+  if (ticks == 0)
+    ticks = 1;
+
+  if (csv)
+    printf("tick,startUs,device,bytes,clockHz,dma,busUs,cpuUs\n");
+
+  replay(ticks, withBaro, &o);
+
+  fprintf(stderr, "%u ticks of %.0f us: bus %.1f us mean (%.1f%%), %.1f us max; "
+          "CPU %.1f us mean, %.1f us max\n", ticks, TICK_US, o.busMean,
+          100.0 * o.busMean / TICK_US, o.busMax, o.cpuMean, o.cpuMax);
+  for (i=0; i<SPI_BUS_DEVICES; i++)
+  {
+    if (stats.device[i].transactions == 0)
+      continue;
+    fprintf(stderr, "  %-8s %7u transactions %8u bytes %8.1f us per tick\n",
+            deviceNames[i], stats.device[i].transactions, stats.device[i].bytes,
+            stats.device[i].busyCycles / (CPU_HZ / 1e6) / ticks);
+  }
+
+  return 0;
+}
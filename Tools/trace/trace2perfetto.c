@@ -0,0 +1,882 @@
+/**
+ * trace2perfetto.c - Converter of the trace recorder dumps to a timeline
+ *
+ * Reads a dump of the trace recorder (utils/inc/trace_format.h) and writes
+ * a Chrome trace event JSON file, opened by chrome://tracing or
+ * https://ui.perfetto.dev: one track per task with its run slices, one
+ * track per interrupt, the queue and semaphore operations as instant
+ * events on the track of the task or interrupt doing them.
+ *
+ *   gcc -O2 -I../../DLL/inc -I../../utils/inc -o trace2perfetto \
+ *       trace2perfetto.c ../../DLL/src/UartFrame.c
+ *
+ *   ./trace2perfetto TRACE00.BIN > trace.json       SD card file
+ *   ./trace2perfetto console.bin > trace.json       capture of the console
+ *                                                   UART (dump 2)
+ *   ./trace2perfetto -l -d /dev/ttyUSB0 -b 2000000 > trace.json
+ *                                                   CRTP chunks from the UART
+ *                                                   link (dump 1)
+ *   ./trace2perfetto -t                             self test
+ *
+ * The raw inputs are searched for the dump magic: console text around it is
+ * skipped. A summary per task and per interrupt is printed on stderr: run
+ * time share, slices, longest run, interrupt count and durations.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+
+#include "UartFrame.h"
+#include "trace_format.h"
+
+#define CRTP_PORT_TRACE     0x0A
+#define HEADER_SIZE         24
+#define NAME_SIZE           (4 + TRACE_NAME_LEN)
+#define EVENT_SIZE          8
+#define MAX_IDS             256
+#define MAX_NESTING         16
+
+/* Cortex-M system exceptions then the STM32F40x interrupts, IRQn + 16 */
+static const char * systemNames[16] =
+{
+  "", "Reset", "NMI", "HardFault", "MemManage", "BusFault", "UsageFault", "",
+  "", "", "", "SVCall", "DebugMon", "", "PendSV", "SysTick"
+};
+static const char * irqNames[] =
+{
+  "WWDG", "PVD", "TAMP_STAMP", "RTC_WKUP", "FLASH", "RCC", "EXTI0", "EXTI1",
+  "EXTI2", "EXTI3", "EXTI4", "DMA1_Stream0", "DMA1_Stream1", "DMA1_Stream2",
+  "DMA1_Stream3", "DMA1_Stream4", "DMA1_Stream5", "DMA1_Stream6", "ADC",
+  "CAN1_TX", "CAN1_RX0", "CAN1_RX1", "CAN1_SCE", "EXTI9_5", "TIM1_BRK_TIM9",
+  "TIM1_UP_TIM10", "TIM1_TRG_COM_TIM11", "TIM1_CC", "TIM2", "TIM3", "TIM4",
+  "I2C1_EV", "I2C1_ER", "I2C2_EV", "I2C2_ER", "SPI1", "SPI2", "USART1",
+  "USART2", "USART3", "EXTI15_10", "RTC_Alarm", "OTG_FS_WKUP",
+  "TIM8_BRK_TIM12", "TIM8_UP_TIM13", "TIM8_TRG_COM_TIM14", "TIM8_CC",
+  "DMA1_Stream7", "FSMC", "SDIO", "TIM5", "SPI3", "UART4", "UART5",
+  "TIM6_DAC", "TIM7", "DMA2_Stream0", "DMA2_Stream1", "DMA2_Stream2",
+  "DMA2_Stream3", "DMA2_Stream4", "ETH", "ETH_WKUP", "CAN2_TX", "CAN2_RX0",
+  "CAN2_RX1", "CAN2_SCE", "OTG_FS", "DMA2_Stream5", "DMA2_Stream6",
+  "DMA2_Stream7", "USART6", "I2C3_EV", "I2C3_ER", "OTG_HS_EP1_OUT",
+  "OTG_HS_EP1_IN", "OTG_HS_WKUP", "OTG_HS", "DCMI", "CRYP", "HASH_RNG",
+  "FPU"
+};
+static const char * queueTypeNames[] =
+{
+  "queue", "mutex", "counting semaphore", "binary semaphore", "recursive mutex"
+};
+
+/* A dump as read, little endian fields decoded */
+typedef struct
+{
+  traceHeader_t header;
+  traceName_t * names;
+  traceEvent_t * events;
+} dump_t;
+
+/* Summary */
+typedef struct
+{
+  double time;                  // us
+  double longest;
+  unsigned long count;
+} stat_t;
+
+static char taskNames[MAX_IDS][TRACE_NAME_LEN + 1];
+static char queueNames[MAX_IDS][TRACE_NAME_LEN + 24];
+static stat_t taskStats[MAX_IDS];
+static stat_t isrStats[MAX_IDS];
+static int taskSeen[MAX_IDS];
+static int isrSeen[MAX_IDS];
+
+static uint16_t get16(const uint8_t * p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t * p)
+{
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint32_t dumpSize(const uint8_t * p)
+{
+  return HEADER_SIZE + (get16(p + 20) + get16(p + 22)) * NAME_SIZE + get32(p + 12) * EVENT_SIZE;
+}
+
+/* Decode a dump starting at its magic, with len bytes available */
+static int parseDump(const uint8_t * p, size_t len, dump_t * d)
+{
+  uint32_t names;
+  uint32_t i;
+
+  if (len < HEADER_SIZE || memcmp(p, TRACE_MAGIC, 4) != 0)
+    return -1;
+
+  memcpy(d->header.magic, p, 4);
+  d->header.version = get16(p + 4);
+  d->header.eventSize = get16(p + 6);
+  d->header.cpuHz = get32(p + 8);
+  d->header.events = get32(p + 12);
+  d->header.lost = get32(p + 16);
+  d->header.tasks = get16(p + 20);
+  d->header.queues = get16(p + 22);
+
+  if (d->header.version != TRACE_VERSION || d->header.eventSize != EVENT_SIZE ||
+      d->header.cpuHz == 0)
+  {
+    fprintf(stderr, "unsupported dump: version %u, event size %u\n",
+            d->header.version, d->header.eventSize);
+    return -1;
+  }
+  if (len < dumpSize(p))
+  {
+    fprintf(stderr, "truncated dump: %zu of %u bytes\n", len, dumpSize(p));
+    return -1;
+  }
+
+  names = d->header.tasks + d->header.queues;
+  d->names = calloc(names + 1, sizeof(traceName_t));
+  d->events = calloc(d->header.events + 1, sizeof(traceEvent_t));
+  if (!d->names || !d->events)
+    return -1;
+
+  p += HEADER_SIZE;
+  for (i=0; i<names; i++, p += NAME_SIZE)
+  {
+    d->names[i].id = p[0];
+    d->names[i].kind = p[1];
+    d->names[i].type = p[2];
+    memcpy(d->names[i].name, p + 4, TRACE_NAME_LEN);
+  }
+  for (i=0; i<d->header.events; i++, p += EVENT_SIZE)
+  {
+    d->events[i].time = get32(p);
+    d->events[i].type = p[4];
+    d->events[i].id = p[5];
+    d->events[i].arg = get16(p + 6);
+  }
+
+  return 0;
+}
+
+static void freeDump(dump_t * d)
+{
+  free(d->names);
+  free(d->events);
+  d->names = NULL;
+  d->events = NULL;
+}
+
+static const char * isrName(uint8_t exception)
+{
+  if (exception < 16)
+    return systemNames[exception];
+  if (exception - 16 < (int)(sizeof(irqNames) / sizeof(irqNames[0])))
+    return irqNames[exception - 16];
+  return "";
+}
+
+static void setNames(const dump_t * d)
+{
+  uint32_t i;
+
+  for (i=0; i<MAX_IDS; i++)
+  {
+    snprintf(taskNames[i], sizeof(taskNames[i]), "task %u", i);
+    snprintf(queueNames[i], sizeof(queueNames[i]), "queue %u", i);
+  }
+
+  for (i=0; i<(uint32_t)d->header.tasks + d->header.queues; i++)
+  {
+    const traceName_t * n = &d->names[i];
+    char name[TRACE_NAME_LEN + 1];
+
+    memcpy(name, n->name, TRACE_NAME_LEN);
+    name[TRACE_NAME_LEN] = '\0';
+
+    if (n->kind == TRACE_NAME_TASK)
+      strcpy(taskNames[n->id], name);
+    else if (name[0])
+      strcpy(queueNames[n->id], name);
+    else if (n->type < sizeof(queueTypeNames) / sizeof(queueTypeNames[0]))
+      snprintf(queueNames[n->id], sizeof(queueNames[n->id]), "%s %u",
+               queueTypeNames[n->type], n->id);
+  }
+}
+
+/* JSON string, the names come from the firmware */
+static void putString(FILE * out, const char * s)
+{
+  fputc('"', out);
+  for (; *s; s++)
+  {
+    if (*s == '"' || *s == '\\')
+      fprintf(out, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      fprintf(out, "\\u%04x", *s);
+    else
+      fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+static int firstEvent;
+
+static void eventStart(FILE * out)
+{
+  fprintf(out, firstEvent ? "\n  {" : ",\n  {");
+  firstEvent = 0;
+}
+
+static void emitSlice(FILE * out, int pid, int tid, const char * name, double start, double end)
+{
+  eventStart(out);
+  fprintf(out, "\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+          pid, tid, start, end - start);
+  putString(out, name);
+  fputc('}', out);
+}
+
+static void emitInstant(FILE * out, int pid, int tid, double ts, const char * what,
+                        const char * name, const char * argName, unsigned arg)
+{
+  char label[96];
+
+  snprintf(label, sizeof(label), "%s %s", what, name);
+  eventStart(out);
+  fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"name\":", pid, tid, ts);
+  putString(out, label);
+  if (argName)
+    fprintf(out, ",\"args\":{\"%s\":%u}", argName, arg);
+  fputc('}', out);
+}
+
+static void emitTrackName(FILE * out, int pid, int tid, const char * name)
+{
+  eventStart(out);
+  if (tid < 0)
+    fprintf(out, "\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":", pid);
+  else
+    fprintf(out, "\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":",
+            pid, tid);
+  putString(out, name);
+  fputs("}}", out);
+}
+
+static void addStat(stat_t * s, double duration)
+{
+  s->time += duration;
+  s->count++;
+  if (duration > s->longest)
+    s->longest = duration;
+}
+
+#define PID_TASKS   1
+#define PID_ISRS    2
+
+/* The whole dump as Chrome trace events. Returns the events converted */
+static uint32_t convert(const dump_t * d, FILE * out)
+{
+  const traceHeader_t * h = &d->header;
+  int stackId[MAX_NESTING];
+  double stackStart[MAX_NESTING];
+  int depth = 0;
+  int task = -1;                // Running task, -1 before the first switch
+  double taskStart = 0;
+  uint64_t time = 0;
+  uint32_t last = 0;
+  uint32_t converted = 0;
+  double ts = 0;
+  double end;
+  uint32_t i;
+
+  setNames(d);
+  memset(taskStats, 0, sizeof(taskStats));
+  memset(isrStats, 0, sizeof(isrStats));
+  memset(taskSeen, 0, sizeof(taskSeen));
+  memset(isrSeen, 0, sizeof(isrSeen));
+
+  firstEvent = 1;
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  emitTrackName(out, PID_TASKS, -1, "tasks");
+  emitTrackName(out, PID_ISRS, -1, "interrupts");
+
+  for (i=0; i<h->events; i++)
+  {
+    const traceEvent_t * ev = &d->events[i];
+    int pid = depth ? PID_ISRS : PID_TASKS;
+    int tid = depth ? stackId[depth - 1] : task;
+
+    if (ev->type == TRACE_EV_NONE || ev->type >= TRACE_EV_COUNT)
+      continue;
+
+    //Unwrapped cycle counter, us from the first event
+    if (converted)
+      time += (uint32_t)(ev->time - last);
+    last = ev->time;
+    ts = time * 1e6 / h->cpuHz;
+    converted++;
+
+    switch (ev->type)
+    {
+      case TRACE_EV_TASK_IN:
+        if (task >= 0 && depth == 0)
+        {
+          emitSlice(out, PID_TASKS, task, taskNames[task], taskStart, ts);
+          addStat(&taskStats[task], ts - taskStart);
+        }
+        task = ev->id;
+        taskStart = ts;
+        taskSeen[task] = 1;
+        break;
+
+      case TRACE_EV_ISR_ENTER:
+        //The task, or the interrupt below, is preempted
+        if (depth == 0 && task >= 0)
+        {
+          emitSlice(out, PID_TASKS, task, taskNames[task], taskStart, ts);
+          addStat(&taskStats[task], ts - taskStart);
+        }
+        if (depth < MAX_NESTING)
+        {
+          stackId[depth] = ev->id;
+          stackStart[depth] = ts;
+          depth++;
+        }
+        isrSeen[ev->id] = 1;
+        break;
+
+      case TRACE_EV_ISR_EXIT:
+        //An exit without its entry: the entry was overwritten in the ring
+        if (depth == 0 || stackId[depth - 1] != ev->id)
+          break;
+        depth--;
+        emitSlice(out, PID_ISRS, ev->id, isrName(ev->id), stackStart[depth], ts);
+        addStat(&isrStats[ev->id], ts - stackStart[depth]);
+        if (depth == 0)
+          taskStart = ts;
+        break;
+
+      case TRACE_EV_QUEUE_SEND:
+        if (tid >= 0)
+          emitInstant(out, pid, tid, ts, "send", queueNames[ev->id], "items", ev->arg);
+        break;
+
+      case TRACE_EV_QUEUE_RECEIVE:
+        if (tid >= 0)
+          emitInstant(out, pid, tid, ts, "receive", queueNames[ev->id], "items", ev->arg);
+        break;
+
+      case TRACE_EV_QUEUE_BLOCK:
+        if (tid >= 0)
+          emitInstant(out, pid, tid, ts, ev->arg ? "block on receive" : "block on send",
+                      queueNames[ev->id], NULL, 0);
+        break;
+
+      case TRACE_EV_QUEUE_FAILED:
+        if (tid >= 0)
+          emitInstant(out, pid, tid, ts, ev->arg ? "receive failed" : "send failed",
+                      queueNames[ev->id], NULL, 0);
+        break;
+
+      case TRACE_EV_TASK_CREATE:
+        if (tid >= 0)
+          emitInstant(out, pid, tid, ts, "create", taskNames[ev->id], "priority", ev->arg);
+        break;
+
+      case TRACE_EV_QUEUE_CREATE:
+        if (tid >= 0)
+          emitInstant(out, pid, tid, ts, "create", queueNames[ev->id], "type", ev->arg);
+        break;
+
+      case TRACE_EV_MARK:
+      {
+        char name[16];
+
+        snprintf(name, sizeof(name), "%u", ev->id);
+        if (tid >= 0)
+          emitInstant(out, pid, tid, ts, "mark", name, "value", ev->arg);
+        break;
+      }
+    }
+  }
+
+  //Close what runs at the end of the dump
+  end = ts;
+  while (depth > 0)
+  {
+    depth--;
+    emitSlice(out, PID_ISRS, stackId[depth], isrName(stackId[depth]), stackStart[depth], end);
+  }
+  if (task >= 0)
+  {
+    emitSlice(out, PID_TASKS, task, taskNames[task], taskStart, end);
+    addStat(&taskStats[task], end - taskStart);
+  }
+
+  for (i=0; i<MAX_IDS; i++)
+  {
+    if (taskSeen[i])
+      emitTrackName(out, PID_TASKS, i, taskNames[i]);
+    if (isrSeen[i])
+      emitTrackName(out, PID_ISRS, i, isrName(i));
+  }
+  fprintf(out, "\n]}\n");
+
+  return converted;
+}
+
+static void printSummary(const dump_t * d, double total)
+{
+  uint32_t i;
+
+  fprintf(stderr, "%u events, %u lost, %.3f ms at %u Hz\n", d->header.events,
+          d->header.lost, total / 1000, d->header.cpuHz);
+  fprintf(stderr, "%-16s %7s %8s %10s\n", "task", "cpu", "slices", "longest");
+  for (i=0; i<MAX_IDS; i++)
+    if (taskSeen[i])
+      fprintf(stderr, "%-16s %6.1f%% %8lu %8.1fus\n", taskNames[i],
+              total > 0 ? 100 * taskStats[i].time / total : 0, taskStats[i].count,
+              taskStats[i].longest);
+  fprintf(stderr, "%-16s %7s %8s %10s %10s\n", "interrupt", "cpu", "count", "mean", "longest");
+  for (i=0; i<MAX_IDS; i++)
+    if (isrSeen[i])
+      fprintf(stderr, "%-16s %6.1f%% %8lu %8.2fus %8.2fus\n", isrName(i),
+              total > 0 ? 100 * isrStats[i].time / total : 0, isrStats[i].count,
+              isrStats[i].count ? isrStats[i].time / isrStats[i].count : 0,
+              isrStats[i].longest);
+}
+
+/* Duration of the dump, us */
+static double dumpDuration(const dump_t * d)
+{
+  uint64_t time = 0;
+  uint32_t last = 0;
+  int started = 0;
+  uint32_t i;
+
+  for (i=0; i<d->header.events; i++)
+  {
+    if (d->events[i].type == TRACE_EV_NONE)
+      continue;
+    if (started)
+      time += (uint32_t)(d->events[i].time - last);
+    last = d->events[i].time;
+    started = 1;
+  }
+
+  return time * 1e6 / d->header.cpuHz;
+}
+
+/* Reassembly of the CRTP chunks of one dump */
+typedef struct
+{
+  uint8_t * data;
+  uint8_t * have;               // Per chunk
+  uint32_t capacity;            // Chunks
+  uint32_t received;
+  int started;
+} chunks_t;
+
+static void chunksAdd(chunks_t * c, uint16_t chunk, const uint8_t * data, uint32_t len)
+{
+  if (chunk == 0 && c->capacity)
+  {
+    //A new dump
+    memset(c->have, 0, c->capacity);
+    memset(c->data, 0, (size_t)c->capacity * TRACE_CHUNK_SIZE);
+    c->received = 0;
+  }
+  if (chunk == 0)
+    c->started = 1;
+  if (!c->started)
+    return;
+
+  if (chunk >= c->capacity)
+  {
+    uint32_t n = chunk * 2 + 64;
+
+    c->data = realloc(c->data, (size_t)n * TRACE_CHUNK_SIZE);
+    c->have = realloc(c->have, n);
+    memset(c->data + (size_t)c->capacity * TRACE_CHUNK_SIZE, 0,
+           (size_t)(n - c->capacity) * TRACE_CHUNK_SIZE);
+    memset(c->have + c->capacity, 0, n - c->capacity);
+    c->capacity = n;
+  }
+  if (len > TRACE_CHUNK_SIZE)
+    len = TRACE_CHUNK_SIZE;
+  memcpy(c->data + (size_t)chunk * TRACE_CHUNK_SIZE, data, len);
+  if (!c->have[chunk])
+    c->received++;
+  c->have[chunk] = 1;
+}
+
+/* Bytes of the dump if complete, 0 otherwise */
+static uint32_t chunksComplete(const chunks_t * c)
+{
+  uint32_t size;
+  uint32_t needed;
+
+  if (!c->started || !c->have[0])
+    return 0;
+  size = dumpSize(c->data);
+  needed = (size + TRACE_CHUNK_SIZE - 1) / TRACE_CHUNK_SIZE;
+
+  return c->received >= needed && needed <= c->capacity ? size : 0;
+}
+
+static uint32_t chunksMissing(const chunks_t * c)
+{
+  uint32_t needed;
+
+  if (!c->started || !c->have[0])
+    return 0;
+  needed = (dumpSize(c->data) + TRACE_CHUNK_SIZE - 1) / TRACE_CHUNK_SIZE;
+
+  return needed > c->received ? needed - c->received : 0;
+}
+
+static void chunksFree(chunks_t * c)
+{
+  free(c->data);
+  free(c->have);
+  memset(c, 0, sizeof(*c));
+}
+
+static int setRaw(int fd, int baud)
+{
+  struct termios tio;
+  speed_t speed;
+
+  if (tcgetattr(fd, &tio) < 0)
+    return -1;
+
+  switch (baud)
+  {
+    case 115200:  speed = B115200;  break;
+    case 921600:  speed = B921600;  break;
+    case 1000000: speed = B1000000; break;
+    case 1500000: speed = B1500000; break;
+    case 2000000: speed = B2000000; break;
+    default:
+      fprintf(stderr, "unsupported baudrate %d\n", baud);
+      return -1;
+  }
+
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+
+  return tcsetattr(fd, TCSANOW, &tio);
+}
+
+/* Feed link bytes, returns the dump size once one is complete */
+static uint32_t linkFeed(uartFrameDecoder_t * dec, chunks_t * c, const uint8_t * in, size_t len)
+{
+  size_t i;
+
+  for (i=0; i<len; i++)
+  {
+    uint32_t n = uartFrameDecode(dec, in[i]);
+    uint32_t size;
+
+    //CRTP header, chunk number, data
+    if (n < 3 || (dec->payload[0] >> 4) != CRTP_PORT_TRACE)
+      continue;
+    chunksAdd(c, get16(&dec->payload[1]), &dec->payload[3], n - 3);
+    size = chunksComplete(c);
+    if (size)
+      return size;
+  }
+
+  return 0;
+}
+
+static uint8_t * readAll(int fd, size_t * len)
+{
+  size_t capacity = 1 << 16;
+  uint8_t * buf = malloc(capacity);
+  ssize_t n;
+
+  *len = 0;
+  while (buf && (n = read(fd, buf + *len, capacity - *len)) != 0)
+  {
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    *len += n;
+    if (*len == capacity)
+    {
+      capacity *= 2;
+      buf = realloc(buf, capacity);
+    }
+  }
+
+  return buf;
+}
+
+/* Position of the first dump in raw bytes */
+static const uint8_t * findDump(const uint8_t * buf, size_t len)
+{
+  return memmem(buf, len, TRACE_MAGIC, 4);
+}
+
+/*
+ * Self test: a synthetic dump, with a wrap of the cycle counter, nested
+ * interrupts and queue events, through the CRTP chunks and the link
+ * framing, once complete then with a chunk lost.
+ */
+static uint32_t putEvent(uint8_t * p, uint32_t time, uint8_t type, uint8_t id, uint16_t arg)
+{
+  p[0] = time; p[1] = time >> 8; p[2] = time >> 16; p[3] = time >> 24;
+  p[4] = type; p[5] = id; p[6] = arg; p[7] = arg >> 8;
+  return EVENT_SIZE;
+}
+
+static uint32_t putName(uint8_t * p, uint8_t id, uint8_t kind, uint8_t type, const char * name)
+{
+  memset(p, 0, NAME_SIZE);
+  p[0] = id; p[1] = kind; p[2] = type;
+  strncpy((char *)p + 4, name, TRACE_NAME_LEN);
+  return NAME_SIZE;
+}
+
+static uint32_t buildTestDump(uint8_t * buf)
+{
+  //168 cycles per us, starting 10us before the wrap
+  uint32_t t0 = 0xFFFFFFFFu - 168 * 10 + 1;
+  uint8_t * p = buf + HEADER_SIZE;
+  uint32_t events = 9;
+
+  memcpy(buf, TRACE_MAGIC, 4);
+  buf[4] = TRACE_VERSION; buf[5] = 0;
+  buf[6] = EVENT_SIZE; buf[7] = 0;
+  buf[8] = (uint8_t)168000000; buf[9] = (uint8_t)(168000000 >> 8);
+  buf[10] = (uint8_t)(168000000 >> 16); buf[11] = (uint8_t)(168000000 >> 24);
+  buf[12] = events; buf[13] = buf[14] = buf[15] = 0;
+  buf[16] = 3; buf[17] = buf[18] = buf[19] = 0;
+  buf[20] = 2; buf[21] = 0;
+  buf[22] = 1; buf[23] = 0;
+
+  p += putName(p, 1, TRACE_NAME_TASK, 0, "IDLE");
+  p += putName(p, 5, TRACE_NAME_TASK, 0, "STABILIZER");
+  p += putName(p, 3, TRACE_NAME_QUEUE, TRACE_QUEUE_BASE, "txQueue");
+
+  p += putEvent(p, t0, TRACE_EV_TASK_IN, 1, 0);
+  p += putEvent(p, t0 + 168 * 20, TRACE_EV_ISR_ENTER, 56, 0);           // EXTI15_10
+  p += putEvent(p, t0 + 168 * 22, TRACE_EV_ISR_ENTER, 72, 0);           // DMA2_Stream0, nested
+  p += putEvent(p, t0 + 168 * 23, TRACE_EV_QUEUE_SEND, 3, 2);
+  p += putEvent(p, t0 + 168 * 25, TRACE_EV_ISR_EXIT, 72, 0);
+  p += putEvent(p, t0 + 168 * 30, TRACE_EV_ISR_EXIT, 56, 0);
+  p += putEvent(p, t0 + 168 * 31, TRACE_EV_TASK_IN, 5, 3);
+  p += putEvent(p, t0 + 168 * 40, TRACE_EV_QUEUE_BLOCK, 3, 1);
+  p += putEvent(p, t0 + 168 * 41, TRACE_EV_TASK_IN, 1, 0);
+
+  return (uint32_t)(p - buf);
+}
+
+static uint32_t frameChunks(uint8_t * out, const uint8_t * dump, uint32_t len, int skip)
+{
+  uint8_t payload[3 + TRACE_CHUNK_SIZE];
+  uint32_t total = 0;
+  uint32_t chunk;
+
+  for (chunk=0; chunk * TRACE_CHUNK_SIZE < len; chunk++)
+  {
+    uint32_t n = len - chunk * TRACE_CHUNK_SIZE;
+
+    if (n > TRACE_CHUNK_SIZE)
+      n = TRACE_CHUNK_SIZE;
+    if ((int)chunk == skip)
+      continue;
+    payload[0] = CRTP_PORT_TRACE << 4;
+    payload[1] = chunk;
+    payload[2] = chunk >> 8;
+    memcpy(&payload[3], dump + chunk * TRACE_CHUNK_SIZE, n);
+    total += uartFrameEncode(out + total, payload, 3 + n);
+  }
+
+  return total;
+}
+
+static int selfTest(void)
+{
+  uint8_t dumpBuf[1024];
+  uint8_t link[4096];
+  uartFrameDecoder_t dec;
+  chunks_t c;
+  dump_t d;
+  FILE * devnull = fopen("/dev/null", "w");
+  uint32_t len;
+  uint32_t size;
+  int errors = 0;
+
+  len = buildTestDump(dumpBuf);
+  if (dumpSize(dumpBuf) != len)
+    errors++;
+
+  //Straight from the bytes, console text around
+  {
+    uint8_t raw[2048];
+    const uint8_t * start;
+
+    memcpy(raw, "boot ok\r\nFC", 11);
+    memcpy(raw + 11, dumpBuf, len);
+    start = findDump(raw, 11 + len);
+    if (!start || parseDump(start, raw + 11 + len - start, &d) != 0)
+      errors++;
+    else
+    {
+      if (convert(&d, devnull) != 9)
+        errors++;
+      //IDLE 0-20us and 30-31us, STABILIZER 31-41us, the ISR on top of IDLE
+      if (taskStats[1].count != 3 || taskStats[5].count != 1 ||
+          (int)(taskStats[5].time + 0.5) != 10 || (int)(taskStats[1].time + 0.5) != 21)
+        errors++;
+      if (isrStats[56].count != 1 || (int)(isrStats[56].time + 0.5) != 10 ||
+          isrStats[72].count != 1 || (int)(isrStats[72].time + 0.5) != 3)
+        errors++;
+      if (strcmp(taskNames[5], "STABILIZER") != 0 || strcmp(queueNames[3], "txQueue") != 0)
+        errors++;
+      if ((int)(dumpDuration(&d) + 0.5) != 41)
+        errors++;
+      freeDump(&d);
+    }
+  }
+
+  //Through the link, complete
+  memset(&c, 0, sizeof(c));
+  uartFrameDecoderInit(&dec);
+  size = linkFeed(&dec, &c, link, frameChunks(link, dumpBuf, len, -1));
+  if (size != len || memcmp(c.data, dumpBuf, len) != 0)
+    errors++;
+  chunksFree(&c);
+
+  //Chunk 3 lost: incomplete, one chunk missing
+  memset(&c, 0, sizeof(c));
+  uartFrameDecoderInit(&dec);
+  size = linkFeed(&dec, &c, link, frameChunks(link, dumpBuf, len, 3));
+  if (size != 0 || chunksMissing(&c) != 1)
+    errors++;
+  chunksFree(&c);
+
+  fclose(devnull);
+  printf("%s, %d errors\n", errors ? "FAIL" : "pass", errors);
+  return errors ? 1 : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  const char * device = NULL;
+  int baud = 2000000;
+  int linkInput = 0;
+  uint8_t * buf = NULL;
+  const uint8_t * start;
+  size_t len = 0;
+  int fd = STDIN_FILENO;
+  dump_t d;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "ld:b:t")) != -1)
+  {
+    switch (opt)
+    {
+      case 'l': linkInput = 1; break;
+      case 'd': device = optarg; break;
+      case 'b': baud = atoi(optarg); break;
+      case 't': return selfTest();
+      default:
+        fprintf(stderr, "usage: %s [-l] [-d device [-b baud]] [dump file] > trace.json\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (device)
+  {
+    fd = open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0 || setRaw(fd, baud) < 0)
+    {
+      perror(device);
+      return 1;
+    }
+    tcflush(fd, TCIFLUSH);
+  }
+  else if (optind < argc)
+  {
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0)
+    {
+      perror(argv[optind]);
+      return 1;
+    }
+  }
+
+  if (linkInput)
+  {
+    uartFrameDecoder_t dec;
+    chunks_t c;
+    uint8_t in[4096];
+    uint32_t size = 0;
+    ssize_t n;
+
+    memset(&c, 0, sizeof(c));
+    uartFrameDecoderInit(&dec);
+    //Until a complete dump, or the end of the input
+    while (!size && (n = read(fd, in, sizeof(in))) != 0)
+    {
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        break;
+      }
+      size = linkFeed(&dec, &c, in, n);
+    }
+    if (!size)
+    {
+      if (!c.started)
+      {
+        fprintf(stderr, "no dump in the input\n");
+        return 1;
+      }
+      //Convert what arrived, the lost chunks read as TRACE_EV_NONE
+      fprintf(stderr, "%u chunks missing\n", chunksMissing(&c));
+      size = dumpSize(c.data);
+      if (size > c.capacity * TRACE_CHUNK_SIZE)
+        size = c.capacity * TRACE_CHUNK_SIZE;
+    }
+    buf = c.data;
+    len = size;
+    free(c.have);
+  }
+  else
+    buf = readAll(fd, &len);
+
+  start = buf ? findDump(buf, len) : NULL;
+  if (!start)
+  {
+    fprintf(stderr, "no dump in the input\n");
+    return 1;
+  }
+  if (parseDump(start, buf + len - start, &d) != 0)
+    return 1;
+
+  convert(&d, stdout);
+  printSummary(&d, dumpDuration(&d));
+
+  freeDump(&d);
+  free(buf);
+
+  return 0;
+}
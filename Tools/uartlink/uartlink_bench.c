@@ -0,0 +1,321 @@
+/**
+ * uartlink_bench.c - Host test and benchmark of the UART CRTP link framing
+ *
+ * Builds the firmware framing code (DLL/src/UartFrame.c) on Linux:
+ *
+ *   gcc -O2 -I../../DLL/inc -o uartlink_bench uartlink_bench.c \
+ *       ../../DLL/src/UartFrame.c -lpthread
+ *
+ *   ./uartlink_bench -c                 encode/decode cost, no I/O
+ *   ./uartlink_bench                    through a pseudo-terminal pair
+ *   ./uartlink_bench -e 10000           same, one corrupted byte every 10000
+ *   ./uartlink_bench -d /dev/ttyUSB0 -b 2000000
+ *                                       through a serial adapter with TX
+ *                                       wired to RX
+ *
+ * A writer thread sends full size CRTP frames with a sequence number, the
+ * reader decodes them and checks the content, the sequence and the CRC
+ * error count. With -e every corrupted frame must be dropped by the CRC and
+ * the decoder must resynchronise on the next frame.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "UartFrame.h"
+
+#define CRTP_PAYLOAD   31     // CRTP header + 30 data bytes
+
+static int txFd = -1;
+static int rxFd = -1;
+static unsigned long packets = 100000;
+static unsigned long errorPeriod = 0;
+static volatile int writerDone = 0;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Content of packet seq: a log port header, the sequence and a pattern */
+static void makePacket(uint8_t * p, uint32_t seq)
+{
+  int i;
+
+  p[0] = (5 << 4) | 2;
+  memcpy(&p[1], &seq, 4);
+  for (i=5; i<CRTP_PAYLOAD; i++)
+    p[i] = (uint8_t)(seq * 31 + i);
+}
+
+static int setRaw(int fd, int baud)
+{
+  struct termios tio;
+
+  if (tcgetattr(fd, &tio) < 0)
+    return -1;
+
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  if (baud)
+  {
+    speed_t speed;
+    switch (baud)
+    {
+      case 115200:  speed = B115200;  break;
+      case 921600:  speed = B921600;  break;
+      case 1000000: speed = B1000000; break;
+      case 1500000: speed = B1500000; break;
+      case 2000000: speed = B2000000; break;
+      default:
+        fprintf(stderr, "unsupported baudrate %d\n", baud);
+        return -1;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  }
+
+  return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static int writeAll(int fd, const uint8_t * buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static void * writer(void * arg)
+{
+  uint8_t payload[CRTP_PAYLOAD];
+  uint8_t frames[64 * UART_FRAME_MAX_LENGTH];
+  unsigned long bytes = 0;
+  uint32_t seq;
+
+  (void)arg;
+
+  //Batch the frames to keep the syscall cost out of the measure
+  for (seq=0; seq<packets; )
+  {
+    uint32_t len = 0;
+    uint32_t i;
+
+    for (i=0; i<64 && seq<packets; i++, seq++)
+    {
+      makePacket(payload, seq);
+      len += uartFrameEncode(&frames[len], payload, CRTP_PAYLOAD);
+    }
+
+    if (errorPeriod)
+    {
+      for (i=0; i<len; i++)
+        if ((bytes + i) % errorPeriod == errorPeriod - 1)
+          frames[i] ^= 0x5A;
+    }
+
+    if (writeAll(txFd, frames, len) < 0)
+    {
+      perror("write");
+      break;
+    }
+    bytes += len;
+  }
+
+  writerDone = 1;
+  return NULL;
+}
+
+static int benchCpu(void)
+{
+  uint8_t payload[CRTP_PAYLOAD];
+  uint8_t frame[UART_FRAME_MAX_LENGTH];
+  uartFrameDecoder_t dec;
+  unsigned long n = packets * 10;
+  unsigned long bytes = 0;
+  unsigned long i;
+  double t0, t1, t2;
+  uint32_t len = 0;
+
+  uartFrameDecoderInit(&dec);
+  makePacket(payload, 1);
+
+  t0 = now();
+  for (i=0; i<n; i++)
+  {
+    payload[1] = i;
+    len = uartFrameEncode(frame, payload, CRTP_PAYLOAD);
+    bytes += len;
+  }
+  t1 = now();
+  for (i=0; i<n; i++)
+  {
+    uint32_t j;
+    for (j=0; j<len; j++)
+      uartFrameDecode(&dec, frame[j]);
+  }
+  t2 = now();
+
+  printf("encode: %.1f ns/frame, %.2f ns/byte\n", (t1-t0)*1e9/n, (t1-t0)*1e9/bytes);
+  printf("decode: %.1f ns/frame, %.2f ns/byte\n", (t2-t1)*1e9/n, (t2-t1)*1e9/bytes);
+  printf("%lu frames decoded, %lu crc errors\n", (unsigned long)dec.frames,
+         (unsigned long)dec.crcErrors);
+
+  return dec.frames == n && dec.crcErrors == 0 ? 0 : 1;
+}
+
+static int openPty(void)
+{
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    return -1;
+
+  rxFd = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (rxFd < 0)
+    return -1;
+
+  txFd = master;
+  //Raw on both sides, no echo nor line discipline on the slave
+  if (setRaw(rxFd, 0) < 0 || setRaw(txFd, 0) < 0)
+    return -1;
+
+  return 0;
+}
+
+int main(int argc, char ** argv)
+{
+  const char * device = NULL;
+  int baud = 2000000;
+  int cpuOnly = 0;
+  uartFrameDecoder_t dec;
+  uint8_t expect[CRTP_PAYLOAD];
+  uint8_t buf[4096];
+  unsigned long received = 0;
+  unsigned long bad = 0;
+  unsigned long lost = 0;
+  unsigned long bytes = 0;
+  uint32_t nextSeq = 0;
+  pthread_t thread;
+  double t0, t1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "cd:b:n:e:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'c': cpuOnly = 1; break;
+      case 'd': device = optarg; break;
+      case 'b': baud = atoi(optarg); break;
+      case 'n': packets = strtoul(optarg, NULL, 0); break;
+      case 'e': errorPeriod = strtoul(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: %s [-c] [-d device [-b baud]] [-n packets] [-e period]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (cpuOnly)
+    return benchCpu();
+
+  if (device)
+  {
+    txFd = rxFd = open(device, O_RDWR | O_NOCTTY);
+    if (txFd < 0 || setRaw(txFd, baud) < 0)
+    {
+      perror(device);
+      return 1;
+    }
+    tcflush(txFd, TCIOFLUSH);
+  }
+  else if (openPty() < 0)
+  {
+    perror("pty");
+    return 1;
+  }
+
+  uartFrameDecoderInit(&dec);
+
+  t0 = now();
+  pthread_create(&thread, NULL, writer, NULL);
+
+  while (received + lost < packets)
+  {
+    ssize_t n;
+    ssize_t i;
+
+    n = read(rxFd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+      if (n < 0 && errno == EINTR)
+        continue;
+      break;
+    }
+    bytes += n;
+
+    for (i=0; i<n; i++)
+    {
+      uint32_t len = uartFrameDecode(&dec, buf[i]);
+      uint32_t seq;
+
+      if (len == 0)
+        continue;
+
+      memcpy(&seq, &dec.payload[1], 4);
+      makePacket(expect, seq);
+      if (len != CRTP_PAYLOAD || memcmp(expect, dec.payload, CRTP_PAYLOAD) != 0)
+      {
+        bad++;
+        continue;
+      }
+      if (seq < nextSeq)
+      {
+        bad++;
+        continue;
+      }
+      lost += seq - nextSeq;
+      nextSeq = seq + 1;
+      received++;
+    }
+
+    //Frames corrupted at the end of the stream are never completed
+    if (writerDone && errorPeriod && received + lost + dec.crcErrors + dec.lengthErrors >= packets)
+      break;
+  }
+  t1 = now();
+  pthread_join(thread, NULL);
+
+  printf("%lu frames, %lu lost, %lu bad content\n", received, lost, bad);
+  printf("%lu crc errors, %lu length errors\n", (unsigned long)dec.crcErrors,
+         (unsigned long)dec.lengthErrors);
+  printf("%.0f frames/s, %.1f kB/s payload, %.1f kB/s on the wire\n",
+         received / (t1 - t0), received * CRTP_PAYLOAD / (t1 - t0) / 1000,
+         bytes / (t1 - t0) / 1000);
+  if (device)
+    printf("line rate %d baud: %.1f kB/s max\n", baud, baud / 10.0 / 1000);
+
+  //No undetected corruption, and no loss unless errors were injected
+  return (bad == 0 && (errorPeriod || lost == 0)) ? 0 : 1;
+}
@@ -96,7 +96,11 @@
 #define configTICK_RATE_HZ				( ( TickType_t ) 1000 )
 #define configMAX_PRIORITIES			( 5 )
 #define configMINIMAL_STACK_SIZE		( ( unsigned short ) 130 )
-#define configTOTAL_HEAP_SIZE			( ( size_t ) ( 75 * 1024 ) )
+/* The tasks, queues, semaphores and timers are static (static_mem.h): the
+heap only serves objects still created dynamically, none at the moment */
+#define configSUPPORT_STATIC_ALLOCATION	1
+#define configSUPPORT_DYNAMIC_ALLOCATION	1
+#define configTOTAL_HEAP_SIZE			( ( size_t ) ( 4 * 1024 ) )
 #define configMAX_TASK_NAME_LEN			( 10 )
 #define configUSE_TRACE_FACILITY		1
 #define configUSE_16_BIT_TICKS			0
@@ -108,7 +112,15 @@
 #define configUSE_MALLOC_FAILED_HOOK	1
 #define configUSE_APPLICATION_TASK_TAG	1
 #define configUSE_COUNTING_SEMAPHORES	1
-#define configGENERATE_RUN_TIME_STATS	0
+/* Run time stats clock: the DWT cycle counter, started by monitorTimerInit().
+It wraps every 25s at 168MHz, monitor.c only uses differences over shorter
+periods */
+#define configGENERATE_RUN_TIME_STATS	1
+#ifdef __ICCARM__
+	extern void monitorTimerInit( void );
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()	monitorTimerInit()
+#define portGET_RUN_TIME_COUNTER_VALUE()	( *( volatile uint32_t * ) 0xE0001004 )
 
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES 		0
@@ -129,6 +141,9 @@ to exclude the API function. */
 #define INCLUDE_vTaskSuspend			1
 #define INCLUDE_vTaskDelayUntil			1
 #define INCLUDE_vTaskDelay				1
+#define INCLUDE_xTaskGetSchedulerState	1
+#define INCLUDE_xTaskGetIdleTaskHandle	1
+#define INCLUDE_uxTaskGetStackHighWaterMark	1
 
 /* Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
@@ -165,8 +180,17 @@ standard names. */
 #define xPortPendSVHandler PendSV_Handler
 #define xPortSysTickHandler SysTick_Handler
 
+/* Trace recorder (trace.h): context switches, the interrupts calling
+TRACE_ISR_ENTER/EXIT and the queue operations in a RAM ring, dumped for
+Tools/trace. Uncomment to record, 16KB of RAM and ~40 cycles per event */
+//#define TRACE_RECORDER
+#if defined(TRACE_RECORDER) && defined(__ICCARM__)
+	#include "trace.h"
+#endif
+
 //Milliseconds to OS Ticks
 #define M2T(X) ((unsigned int)((X)*(configTICK_RATE_HZ/1000.0)))
+#define T2M(X) ((unsigned int)((X)*(1000.0/configTICK_RATE_HZ)))
 #define F2T(X) ((unsigned int)((configTICK_RATE_HZ/(X))))
 
 #define TASK_LED_ID_NBR         1
@@ -38,11 +38,15 @@
 /* configure file */
 #include "BoardDefine.h"
 #include "config.h"
+#include "UartDma.h"
+#include "MemDma.h"
+#include "SpiBus.h"
     
 /* Module File include */
 #include "HMC5983.h"
 #include "ICM20601.h"
 #include "ms5611.h"
+#include "baro_altitude.h"
 #include "nRF24L01.h"
 #include "PPM_Encode.h" 
 #include "motors.h"
@@ -58,6 +62,8 @@
 #include "task.h"
 #include "timers.h"
 #include "semphr.h"
+#include "static_mem.h"
+#include "trace.h"
 
 /* Application File */
 #include "system.h"    
@@ -65,6 +71,7 @@
     
 /*DLL = data link layer*/
 #include "RadioLink.h"
+#include "UartLink.h"
 #include "CRTP.h"
 #include "commander.h"
 #include "ComModule.h"
@@ -72,10 +79,18 @@
 /*HAL = Hardware Aplication Level*/
 #include "IMU.h"
 #include "imu_types.h"
+#include "mag_sampler.h"
     
 /* Utils file */
 #include "num.h"
 #include "filter.h"
+#include "log.h"
+#include "param.h"
+#include "bprintf.h"
+#include "blackbox.h"
+#include "monitor.h"
+#include "configblock.h"
+#include "initseq.h"
     
 /*Cintrol*/
 #include "stabilizer.h"
@@ -36,7 +36,7 @@
 #include "stm32f4xx_dbgmcu.h"
 #include "stm32f4xx_dma.h"
 #include "stm32f4xx_exti.h"
-//#include "stm32f4xx_flash.h"
+#include "stm32f4xx_flash.h"
 #include "stm32f4xx_gpio.h"
 //#include "stm32f4xx_i2c.h"
 //#include "stm32f4xx_iwdg.h"
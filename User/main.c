@@ -33,16 +33,8 @@
   */ 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
-#define FAT_ENABLE  0
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-#if FAT_ENABLE 
-FIL *fil;
-FATFS *fs;
-FRESULT res;
-char my_char[20];
-char buf[512];
-#endif
 /* Private function prototypes -----------------------------------------------*/
 //portTASK_FUNCTION(LedTest,pvParameters)
 //{
@@ -85,33 +77,8 @@ int main(void)
 //  Motor_Start_Test();
 
 //  TIM_Cmd(TIM1 , ENABLE);
-//#if FAT_ENABLE  
-//  /* NVIC Configuration */
-//  SDIO_NVIC_Configuration();
-//  mem_init(SRAMIN);
-//  res = f_mkfs ("",FM_FAT,0,buf,sizeof buf);
-//  fs  = (FATFS*)mymalloc(SRAMIN,sizeof(FATFS));
-//  fil = (FIL*)mymalloc(SRAMIN,sizeof(FIL));
-//  res = f_mount (fs,"0:",1);
-//  res = f_open (fil,"0:zgh.txt", FA_CREATE_ALWAYS | FA_WRITE);	
-//  if(res == FR_OK)
-//  {
-//    res = f_lseek(fil,f_size(fil));
-//    res = f_close (fil);
-//  }
-//#endif
 //  while (1)
 //  {
-//    #if FAT_ENABLE
-//    res = f_open (fil,"0:zgh.txt", FA_OPEN_APPEND | FA_WRITE);	
-//    if(res == FR_OK)
-//    {
-//      res = f_lseek(fil,f_size(fil));
-//      sprintf(my_char,"%f %f %f",m_PITCH,m_ROLL,m_YAW);
-//      res = f_printf(fil, "%s\n", my_char);            /* "1234" */
-//      res = f_close (fil);
-//    }
-//    #endif
 //    Delay(100);
 //    STM_LED_Toggle(LED2);  
 //
@@ -178,6 +145,27 @@ void vApplicationIdleHook( void )
 	memory allocated by the kernel to any task that has since been deleted. */
 }
 
+/* configSUPPORT_STATIC_ALLOCATION: memory of the idle and timer tasks */
+void vApplicationGetIdleTaskMemory( StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize )
+{
+	static StaticTask_t xIdleTaskTCB;
+	static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ];
+
+	*ppxIdleTaskTCBBuffer = &xIdleTaskTCB;
+	*ppxIdleTaskStackBuffer = uxIdleTaskStack;
+	*pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationGetTimerTaskMemory( StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer, uint32_t *pulTimerTaskStackSize )
+{
+	static StaticTask_t xTimerTaskTCB;
+	static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+
+	*ppxTimerTaskTCBBuffer = &xTimerTaskTCB;
+	*ppxTimerTaskStackBuffer = uxTimerTaskStack;
+	*pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
+
 void vApplicationStackOverflowHook( TaskHandle_t pxTask, char *pcTaskName )
 {
 	( void ) pcTaskName;
@@ -176,11 +176,91 @@ void TIM1_UP_TIM10_IRQHandler(void)
   */
 void EXTI15_10_IRQHandler(void)
 {
+  TRACE_ISR_ENTER();
   if(EXTI_GetITStatus(nRF24L01_SPI_IRQ_LINE) != RESET)
   {   
     nrfIsr();
     EXTI_ClearITPendingBit(nRF24L01_SPI_IRQ_LINE);
   }
+  TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief  This function handles the HMC5983 data ready interrupt request.
+  * @param  None
+  * @retval None
+  */
+void HMC5983_DRDY_IRQHandler(void)
+{
+  TRACE_ISR_ENTER();
+  if(EXTI_GetITStatus(HMC5983_DRDY_LINE) != RESET)
+  {
+    EXTI_ClearITPendingBit(HMC5983_DRDY_LINE);
+    magSamplerIsr();
+  }
+  TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief  This function handles the console UART TX DMA interrupt request.
+  * @param  None
+  * @retval None
+  */
+void PRINTF_COM1_TX_DMA_IRQHandler(void)
+{
+  TRACE_ISR_ENTER();
+  uartDmaIsr();
+  TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief  This function handles the CRTP UART link interrupt requests.
+  * @param  None
+  * @retval None
+  */
+void UARTLINK_COM_IRQHandler(void)
+{
+  TRACE_ISR_ENTER();
+  uartlinkIsr();
+  TRACE_ISR_EXIT();
+}
+
+void UARTLINK_COM_RX_DMA_IRQHandler(void)
+{
+  TRACE_ISR_ENTER();
+  uartlinkRxDmaIsr();
+  TRACE_ISR_EXIT();
+}
+
+void UARTLINK_COM_TX_DMA_IRQHandler(void)
+{
+  TRACE_ISR_ENTER();
+  uartlinkTxDmaIsr();
+  TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief  This function handles the memory to memory DMA interrupt request.
+  * @param  None
+  * @retval None
+  */
+void MEMDMA_IRQHandler(void)
+{
+  TRACE_ISR_ENTER();
+  memDmaIsr();
+  TRACE_ISR_EXIT();
+}
+
+/**
+  * @brief  This function handles the SPI1 receive DMA interrupt request.
+  * @param  None
+  * @retval None
+  */
+void SPIBUS_DMA_RX_IRQHandler(void)
+{
+  TRACE_ISR_ENTER();
+  spiBusDmaIsr();
+  TRACE_ISR_EXIT();
 }
 
 /**
@@ -190,8 +270,10 @@ void EXTI15_10_IRQHandler(void)
   */
 void SDIO_IRQHandler(void)
 {
+  TRACE_ISR_ENTER();
   /* Process All SDIO Interrupt Sources */
   SD_ProcessIRQSrc();
+  TRACE_ISR_EXIT();
 }
 
 /**
@@ -202,7 +284,9 @@ void SDIO_IRQHandler(void)
   */
 void SD_SDIO_DMA_IRQHANDLER(void)
 {
+  TRACE_ISR_ENTER();
   /* Process DMA2 Stream3 or DMA2 Stream6 Interrupt Sources */
   SD_ProcessDMAIRQ();
+  TRACE_ISR_EXIT();
 }
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,74 @@
+/**
+ * blackbox.h - SD card flight recorder
+ *
+ * The stabilizer appends one frame per loop (or per rateDiv loops) to one of
+ * two sector sized buffers. A full buffer is handed to the blackbox task,
+ * which writes it to the card with one multi-sector write while the
+ * stabilizer fills the other one. The stabilizer never waits for the card:
+ * when both buffers are busy the frame is dropped and counted.
+ *
+ * Each recording is a new file, LOGnn.BBL, preallocated contiguous with
+ * f_expand(). Its size is already in the directory entry while flying, so
+ * the data written before a power loss stays readable. The file is cut to
+ * the recorded length when the recording stops.
+ *
+ * File layout:
+ *   one header block of BLACKBOX_DATA_OFFSET bytes: "H name:value" text
+ *   lines with the version, the field names, scales and predictors, zero
+ *   padded
+ *   the frames, delta encoded by blackbox_codec.c
+ * A zero byte where a frame is expected marks the end of the data.
+ *
+ * At 1kHz a raw float frame is 100 bytes, 100kB/s. Quantized and delta
+ * encoded, a frame is ~35 bytes in flight.
+ *
+ * Recording is controlled by the "blackbox" parameter group.
+ */
+#ifndef __BLACKBOX_H__
+#define __BLACKBOX_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "stabilizer_types.h"
+#include "blackbox_codec.h"
+
+#define BLACKBOX_VERSION          2
+#define BLACKBOX_SECTOR_SIZE      512
+#define BLACKBOX_BUFFER_SECTORS   16          // 8KB per buffer, ~80ms at 1kHz
+#define BLACKBOX_BUFFER_SIZE      (BLACKBOX_BUFFER_SECTORS * BLACKBOX_SECTOR_SIZE)
+#define BLACKBOX_FILE_SIZE        (32UL * 1024 * 1024)   // ~15 minutes at 1kHz
+
+#define BLACKBOX_DATA_OFFSET      BLACKBOX_BUFFER_SIZE   // Keeps the buffers cluster aligned
+
+/* Fields of a frame, in file order. Scales and predictors in blackbox.c */
+typedef enum
+{
+  BB_TICK,
+  BB_GYRO_X, BB_GYRO_Y, BB_GYRO_Z,
+  BB_ACC_X, BB_ACC_Y, BB_ACC_Z,
+  BB_MAG_X, BB_MAG_Y, BB_MAG_Z,
+  BB_BARO_ASL,
+  BB_ROLL, BB_PITCH, BB_YAW,
+  BB_POSITION_Z,
+  BB_VELOCITY_Z,
+  BB_SP_ROLL, BB_SP_PITCH, BB_SP_YAW,
+  BB_SP_THRUST,
+  BB_CTRL_ROLL, BB_CTRL_PITCH, BB_CTRL_YAW,
+  BB_CTRL_THRUST,
+  BB_MOTOR_1, BB_MOTOR_2, BB_MOTOR_3, BB_MOTOR_4,
+  BB_FIELD_COUNT
+} blackboxFieldIndex_t;
+
+void blackboxInit(void);
+bool blackboxTest(void);
+
+/**
+ * Record the state of the stabilizer loop. Called once per stabilizer tick,
+ * only copies memory and never blocks.
+ */
+void blackboxRecord(const sensorData_t *sensorData, const state_t *state,
+                    const setpoint_t *setpoint, const control_t *control,
+                    uint32_t tick);
+
+#endif //__BLACKBOX_H__
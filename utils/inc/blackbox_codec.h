@@ -0,0 +1,88 @@
+/**
+ * blackbox_codec.h - Delta encoding of the blackbox frames
+ *
+ * A frame is a set of integer fields: the stabilizer values quantized with a
+ * per field scale. Two frame types, as the Betaflight blackbox logs:
+ *
+ *   'I' keyframe:     every field, zig-zag varint of its value
+ *   'P' inter frame:  every field, zig-zag varint of the difference between
+ *                     its value and the prediction from the previous frames
+ *
+ * A keyframe is written every BLACKBOX_KEYFRAME_INTERVAL frames and after
+ * any frame the decoder cannot have seen (dropped by the recorder), so a
+ * decoder resynchronises on the next 'I' after a lost or corrupted frame.
+ *
+ * Varint: 7 bits per byte, least significant group first, bit 7 set on all
+ * bytes but the last. Zig-zag: 0, -1, 1, -2... are coded 0, 1, 2, 3...
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host tools (Tools/blackbox).
+ */
+#ifndef __BLACKBOX_CODEC_H__
+#define __BLACKBOX_CODEC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BLACKBOX_MAX_FIELDS         32
+#define BLACKBOX_KEYFRAME_INTERVAL  32
+#define BLACKBOX_FRAME_I            'I'
+#define BLACKBOX_FRAME_P            'P'
+#define BLACKBOX_MAX_FRAME_SIZE     (1 + 5 * BLACKBOX_MAX_FIELDS)
+
+/* Prediction of a field in the 'P' frames, from the two previous values */
+typedef enum
+{
+  blackboxPredictPrevious = 0,    // p1: slow or stepping values
+  blackboxPredictLinear   = 1,    // 2*p1 - p2: smooth values, the tick
+  blackboxPredictAverage  = 2,    // (p1 + p2) / 2: noisy values
+} blackboxPredictor_t;
+
+typedef struct
+{
+  const char * name;
+  float scale;                    // Stored value = round(value * scale)
+  uint8_t predictor;              // blackboxPredictor_t
+} blackboxField_t;
+
+/* History of one side of the stream, the encoder or the decoder */
+typedef struct
+{
+  const blackboxField_t * fields;
+  uint32_t count;
+  int32_t previous[BLACKBOX_MAX_FIELDS];
+  int32_t previous2[BLACKBOX_MAX_FIELDS];
+  uint32_t sinceKeyframe;
+  bool valid;                     // false: the next frame must be a keyframe
+} blackboxCodec_t;
+
+void blackboxCodecInit(blackboxCodec_t * codec, const blackboxField_t * fields, uint32_t count);
+
+/* Force a keyframe next, to call when an encoded frame is not stored */
+void blackboxCodecReset(blackboxCodec_t * codec);
+
+/* Quantize a value with the scale of its field, saturated to int32 */
+int32_t blackboxQuantize(float value, float scale);
+
+/**
+ * Encode one frame.
+ *
+ * @param[in]  values  codec->count quantized values
+ * @param[out] out     At least 1 + 5 * count bytes
+ * @return The frame length
+ */
+uint32_t blackboxEncode(blackboxCodec_t * codec, const int32_t * values, uint8_t * out);
+
+/**
+ * Decode one frame.
+ *
+ * @param[in]  in      The frame, starting with its type byte
+ * @param[in]  len     Bytes available from in
+ * @param[out] values  codec->count values, set when a frame is returned
+ * @return The frame length, 0 if more bytes are needed, -1 if in is not the
+ *         start of a decodable frame ('P' without a previous keyframe,
+ *         unknown type, overlong varint)
+ */
+int32_t blackboxDecode(blackboxCodec_t * codec, const uint8_t * in, uint32_t len, int32_t * values);
+
+#endif //__BLACKBOX_CODEC_H__
@@ -0,0 +1,92 @@
+/**
+ * bprintf.h - Deferred binary printf
+ *
+ * BPRINTF() does not format anything on the copter. It pushes the id of the
+ * format string and the raw argument bytes into a ring buffer which is
+ * drained by a low priority task. The text is rebuilt on the host by
+ * Tools/bprintf/bprintf_decode.c.
+ *
+ * The format strings are placed in the ".bprintf" section and their id is
+ * their offset in it, so the string table is the section itself:
+ *   arm-none-eabi-objcopy -O binary -j .bprintf firmware.out strings.bin
+ * (works on IAR ELF outputs too). As for ".log", the linker file must keep
+ * the section and GCC builds need _bprintf_start.
+ *
+ * Record on the wire, little endian:
+ *   BPRINTF_SYNC, id (2 bytes), payload length (1 byte), payload
+ * The payload holds the arguments in order: 4 bytes for integers, chars and
+ * pointers, 8 bytes for doubles and "long long", and a NUL terminated copy
+ * of the string for %s.
+ *
+ * When BPRINTF_DEFERRED is not defined in config.h BPRINTF() is printf().
+ */
+#ifndef __BPRINTF_H__
+#define __BPRINTF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eprintf.h"
+
+#define BPRINTF_SYNC         0xB5
+#define BPRINTF_HEADER_LEN   4
+#define BPRINTF_MAX_PAYLOAD  64
+#define BPRINTF_MAX_ARGS     16
+#define BPRINTF_MAX_STRING   24   // Longest %s argument copied, NUL included
+
+/* Argument classes, 2 bits per argument in bprintfSite_t.types */
+#define BPRINTF_ARG_INT32   0
+#define BPRINTF_ARG_64BIT   1
+#define BPRINTF_ARG_STRING  2
+
+/* Per call site cache of the argument classes, parsed at the first call */
+typedef struct {
+  uint8_t  parsed;
+  uint8_t  nargs;
+  uint32_t types;
+} bprintfSite_t;
+
+/**
+ * Parse the conversions of a format string.
+ * Shared with the host decoder so both sides agree on the record layout.
+ *
+ * @param[in]  fmt  The format string
+ * @param[out] site The argument count and classes
+ */
+void bprintfParseFormat(const char * fmt, bprintfSite_t * site);
+
+#if defined(__ICCARM__)
+  #define BPRINTF_FMT(NAME, FMT) __root static const char NAME[] @ ".bprintf" = FMT
+#else
+  #define BPRINTF_FMT(NAME, FMT) static const char NAME[] \
+                                   __attribute__((section(".bprintf"), used)) = FMT
+#endif
+
+#ifdef BPRINTF_DEFERRED
+  #define BPRINTF(FMT, ...) do { \
+      BPRINTF_FMT(bprintfFmt, FMT); \
+      static bprintfSite_t bprintfSite; \
+      bprintfEmit(bprintfFmt, &bprintfSite, ##__VA_ARGS__); \
+    } while(0)
+#else
+  #define BPRINTF(FMT, ...) printf(FMT, ##__VA_ARGS__)
+#endif
+
+void bprintfInit(void);
+bool bprintfTest(void);
+
+/**
+ * Queue one record. Safe from tasks and interrupts, never blocks: the
+ * record is dropped if the ring buffer is full.
+ */
+void bprintfEmit(const char * fmt, bprintfSite_t * site, ...);
+
+/**
+ * Set the function used by the drain task to output the records.
+ * Defaults to putchar().
+ */
+void bprintfSetSink(putc_t sink);
+
+uint32_t bprintfGetDropped(void);
+
+#endif /* __BPRINTF_H__ */
@@ -25,6 +25,10 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "gyro_temp_model.h"
+#include "mag_calib.h"
 
 #ifndef __CONFIGBLOCK_H__
 #define __CONFIGBLOCK_H__
@@ -40,4 +44,27 @@ uint64_t configblockGetRadioAddress(void);
 float configblockGetCalibPitch(void);
 float configblockGetCalibRoll(void);
 
+/* IMU calibration found at rest, and the sensor temperature then */
+typedef struct
+{
+  int16_t gyroBias[3];          // Raw LSB
+  int16_t accelBias[3];
+  float temperature;            // Celsius
+} configImuCalib_t;
+
+/* False when none was stored */
+bool configblockGetImuCalib(configImuCalib_t * calib);
+/* Stores it in the flash: blocks, call at rest only */
+bool configblockSetImuCalib(const configImuCalib_t * calib);
+
+/* False when no bin was learnt */
+bool configblockGetGyroTempModel(gyroTempModel_t * model);
+/* Stores it in the flash: blocks, call at rest only */
+bool configblockSetGyroTempModel(const gyroTempModel_t * model);
+
+/* False when no calibration was learnt */
+bool configblockGetMagCalib(magCalibResult_t * calib);
+/* Stores it in the flash: blocks, call at rest only */
+bool configblockSetMagCalib(const magCalibResult_t * calib);
+
 #endif //__CONFIGBLOCK_H__
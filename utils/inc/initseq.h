@@ -0,0 +1,38 @@
+/**
+ * initseq.h - Overlapped bring-up of the devices
+ *
+ * A device bring-up is a step function called with the step number, from 0,
+ * until it returns INIT_SEQ_DONE. Otherwise it returns the time, in ms, the
+ * device needs before its next step: the datasheet minimum. initSeqRun()
+ * interleaves the steps of all the devices and sleeps only when none is
+ * due, so that the waits of independent devices overlap instead of adding
+ * up. The steps run in the calling task: devices sharing a bus are safe.
+ */
+#ifndef __INITSEQ_H__
+#define __INITSEQ_H__
+
+#include <stdint.h>
+
+#define INIT_SEQ_DONE   (-1)
+
+typedef int32_t (*initSeqStep_t)(uint32_t step);
+
+typedef struct
+{
+  const char * name;
+  initSeqStep_t step;
+  uint32_t notBefore;           // Tick of the first step, power on time
+  /* Set by initSeqRun() */
+  uint32_t nextStep;
+  uint32_t due;                 // Tick of the next step
+  uint32_t readyTick;           // Tick of the end of the bring-up
+  uint8_t isReady;
+} initSeqDevice_t;
+
+/**
+ * Brings up the devices, blocking.
+ * @return The ms from the call to the last device ready
+ */
+uint32_t initSeqRun(initSeqDevice_t * devices, uint32_t count);
+
+#endif //__INITSEQ_H__
@@ -0,0 +1,100 @@
+/**
+ *    ||          ____  _ __
+ * +------+      / __ )(_) /_______________ _____  ___
+ * | 0xBC |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * +------+    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *  ||  ||    /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2011-2012 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * log.h - Dynamic log system
+ */
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Public functions */
+void logInit(void);
+bool logTest(void);
+
+/**
+ * Sample every started log block whose period has elapsed and queue the
+ * resulting packets on CRTP_PORT_LOG. Called once per stabilizer tick
+ * (RATE_MAIN_LOOP), never blocks and never allocates.
+ *
+ * @param[in] tick The stabilizer tick counter
+ */
+void logRunBlocks(uint32_t tick);
+
+/* Internal access of log variables */
+int logGetVarId(char* group, char* name);
+float logGetFloat(int varid);
+int logGetInt(int varid);
+unsigned int logGetUint(int varid);
+
+/* Basic log structure */
+struct log_s {
+  uint8_t type;
+  char * name;
+  void * address;
+};
+
+/* Possible variable types */
+#define LOG_UINT8  1
+#define LOG_UINT16 2
+#define LOG_UINT32 3
+#define LOG_INT8   4
+#define LOG_INT16  5
+#define LOG_INT32  6
+#define LOG_FLOAT  7
+#define LOG_FP16   8
+
+/* Internal defines */
+#define LOG_GROUP 0x80
+#define LOG_START 1
+#define LOG_STOP  0
+
+/* The table of content lives in the ".log" section. The IAR linker file must
+ * keep it: "keep { section .log };" and "place in ROM_region { ro section .log };"
+ * A GCC linker script has to provide _log_start and _log_stop around it.
+ */
+#if defined(__ICCARM__)
+  #define LOG_SECTION(NAME) __root static const struct log_s __logs_##NAME[] @ ".log"
+#else
+  #define LOG_SECTION(NAME) static const struct log_s __logs_##NAME[] \
+                              __attribute__((section(".log"), used))
+#endif
+
+/* Macros */
+#define LOG_ADD(TYPE, NAME, ADDRESS) \
+   { .type = TYPE, .name = #NAME, .address = (void*)(ADDRESS), },
+
+#define LOG_ADD_GROUP(TYPE, NAME, ADDRESS) \
+   { \
+  .type = TYPE, .name = #NAME, .address = (void*)(ADDRESS), },
+
+#define LOG_GROUP_START(NAME)  \
+  LOG_SECTION(NAME) = { \
+  LOG_ADD_GROUP(LOG_GROUP | LOG_START, NAME, 0x0)
+
+#define LOG_GROUP_STOP(NAME) \
+  LOG_ADD_GROUP(LOG_GROUP | LOG_STOP, stop_##NAME, 0x0) \
+  };
+
+#endif /* __LOG_H__ */
@@ -0,0 +1,41 @@
+/**
+ * monitor.h - Per task CPU load and stack high-water telemetry
+ *
+ * The FreeRTOS run time counter is the DWT cycle counter
+ * (portGET_RUN_TIME_COUNTER_VALUE in FreeRTOSConfig.h): the kernel adds to
+ * the counter of a task the cycles it ran at each context switch. Every
+ * period the monitor task reads them with uxTaskGetSystemState() and turns
+ * the differences with the previous period into per task CPU shares. The
+ * same call gives the stack high-water of each task, the words never used
+ * since it started, the margin to check before shrinking a
+ * xxx_TASK_STACKSIZE.
+ *
+ * With the heap and mymalloc() pool figures, the result is:
+ *   - sent as records on CRTP_PORT_MONITOR (monitor_codec.h), read on the
+ *     host with Tools/monitor,
+ *   - the "monitor" log group for the totals, the CPU load, the heap and
+ *     the smallest stack margin.
+ *
+ * uxTaskGetSystemState() walks the free part of every stack with the
+ * scheduler suspended: a few tens of us each period, interrupts still run.
+ *
+ * Controlled by the "monitor" parameter group: enable, period in ms.
+ */
+#ifndef __MONITOR_H__
+#define __MONITOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "monitor_codec.h"
+
+#define MONITOR_PERIOD_MS       1000
+#define MONITOR_MIN_PERIOD_MS   100   // Wraps of the cycle counter: under 25s
+
+void monitorInit(void);
+bool monitorTest(void);
+
+/* portCONFIGURE_TIMER_FOR_RUN_TIME_STATS, at the scheduler start */
+void monitorTimerInit(void);
+
+#endif //__MONITOR_H__
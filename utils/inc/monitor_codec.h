@@ -0,0 +1,85 @@
+/**
+ * monitor_codec.h - Records of the task monitor on CRTP_PORT_MONITOR
+ *
+ * Each monitor period the firmware sends one system record then one task
+ * record per task, all with the same sequence number:
+ *
+ *   channel 0, system:  seq u16, cpu load u16 (permille), task count u8,
+ *                       heap free u32, heap min-ever free u32, malloc free
+ *                       u32, malloc largest free block u32, malloc
+ *                       fragmentation u8 (%), malloc failures u16, period u16
+ *                       (ms)
+ *   channel 1, task:    seq u16, index u8, task number u8, state u8,
+ *                       priority u8, cpu u16 (permille), stack high-water
+ *                       u16 (words never used), name up to 10 chars
+ *
+ * Little endian. A record dropped by the link leaves a hole in the table of
+ * that period only.
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host viewer (Tools/monitor).
+ */
+#ifndef __MONITOR_CODEC_H__
+#define __MONITOR_CODEC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MONITOR_CH_SYSTEM     0
+#define MONITOR_CH_TASK       1
+
+#define MONITOR_NAME_LEN      10            // configMAX_TASK_NAME_LEN
+#define MONITOR_MAX_TASKS     20
+#define MONITOR_RECORD_SIZE   30            // CRTP_MAX_DATA_SIZE
+
+/* Task states, as eTaskState */
+#define MONITOR_STATE_RUNNING   0
+#define MONITOR_STATE_READY     1
+#define MONITOR_STATE_BLOCKED   2
+#define MONITOR_STATE_SUSPENDED 3
+#define MONITOR_STATE_DELETED   4
+
+typedef struct
+{
+  uint16_t seq;
+  uint16_t cpuLoad;                 // Permille of the time out of the idle task
+  uint8_t taskCount;
+  uint32_t heapFree;                // FreeRTOS heap
+  uint32_t heapMinFree;
+  uint32_t memFree;                 // mymalloc() pool
+  uint32_t memLargest;
+  uint8_t memFragmentation;
+  uint16_t memFailures;
+  uint16_t periodMs;
+} monitorSystem_t;
+
+typedef struct
+{
+  uint16_t seq;
+  uint8_t index;                    // 0 to taskCount - 1
+  uint8_t number;                   // FreeRTOS task number, unique
+  uint8_t state;
+  uint8_t priority;
+  uint16_t cpu;                     // Permille
+  uint16_t stackFree;               // Stack words never used since the start
+  char name[MONITOR_NAME_LEN + 1];
+} monitorTask_t;
+
+/**
+ * Share of a run time counter difference in an elapsed time difference.
+ * Both are differences of 32 bit counters: wrapping is harmless as long as
+ * the period is shorter than the counter period.
+ *
+ * @return The share in permille, saturated to 1000
+ */
+uint16_t monitorPermille(uint32_t part, uint32_t total);
+
+/* Both return the record length */
+uint32_t monitorEncodeSystem(uint8_t * out, const monitorSystem_t * sys);
+uint32_t monitorEncodeTask(uint8_t * out, const monitorTask_t * task);
+
+/* Both return false if the record is too short */
+bool monitorDecodeSystem(const uint8_t * in, uint32_t len, monitorSystem_t * sys);
+bool monitorDecodeTask(const uint8_t * in, uint32_t len, monitorTask_t * task);
+
+#endif //__MONITOR_CODEC_H__
@@ -0,0 +1,73 @@
+/**
+ * static_mem.h - Static allocation of the RTOS objects
+ *
+ * The tasks, queues, semaphores and timers are not taken from the FreeRTOS
+ * heap: STATIC_MEM_xxx_ALLOC(NAME, ...) at file scope reserves the object
+ * and its storage as static variables named after NAME, then
+ * STATIC_MEM_xxx_CREATE(NAME, ...) creates the object in them. The RAM
+ * then shows in the link map under the module using it, and
+ * Tools/ram_budget reports it per module.
+ *
+ * Example:
+ *   STATIC_MEM_TASK_ALLOC(logTask, LOG_TASK_STACKSIZE);
+ *   STATIC_MEM_QUEUE_ALLOC(txQueue, 16, sizeof(CRTPPacket));
+ *   ...
+ *   STATIC_MEM_TASK_CREATE(logTask, logTask, LOG_TASK_NAME, NULL, LOG_TASK_PRI);
+ *   queue = STATIC_MEM_QUEUE_CREATE(txQueue);
+ *
+ * The queues, semaphores and mutexes are named after NAME in the dumps of
+ * the trace recorder (trace.h).
+ */
+#ifndef STATIC_MEM_H_
+#define STATIC_MEM_H_
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "timers.h"
+#include "trace.h"
+
+#if configSUPPORT_STATIC_ALLOCATION == 0
+  #error "static_mem.h needs configSUPPORT_STATIC_ALLOCATION"
+#endif
+
+/* Tasks. STACK_DEPTH in words, as for xTaskCreate */
+#define STATIC_MEM_TASK_ALLOC(NAME, STACK_DEPTH) \
+  static StaticTask_t NAME ## TaskBuffer; \
+  static StackType_t NAME ## StackBuffer[STACK_DEPTH]
+
+#define STATIC_MEM_TASK_CREATE(NAME, FUNCTION, TASK_NAME, PARAMETERS, PRIORITY) \
+  xTaskCreateStatic((FUNCTION), (TASK_NAME), \
+                    sizeof(NAME ## StackBuffer) / sizeof(StackType_t), \
+                    (PARAMETERS), (PRIORITY), NAME ## StackBuffer, &NAME ## TaskBuffer)
+
+/* Queues */
+#define STATIC_MEM_QUEUE_ALLOC(NAME, LENGTH, ITEM_SIZE) \
+  static StaticQueue_t NAME ## QueueBuffer; \
+  static uint8_t NAME ## Storage[(LENGTH) * (ITEM_SIZE)]; \
+  enum { NAME ## Length = (LENGTH), NAME ## ItemSize = (ITEM_SIZE) }
+
+#define STATIC_MEM_QUEUE_CREATE(NAME) \
+  TRACE_QUEUE_NAMED(xQueueCreateStatic(NAME ## Length, NAME ## ItemSize, \
+                                       NAME ## Storage, &NAME ## QueueBuffer), #NAME)
+
+/* Binary semaphores and mutexes */
+#define STATIC_MEM_SEMAPHORE_ALLOC(NAME) \
+  static StaticSemaphore_t NAME ## SemaphoreBuffer
+
+/* Created empty, as xSemaphoreCreateBinary. vSemaphoreCreateBinary gave it */
+#define STATIC_MEM_BINARY_CREATE(NAME) \
+  TRACE_QUEUE_NAMED(xSemaphoreCreateBinaryStatic(&NAME ## SemaphoreBuffer), #NAME)
+
+#define STATIC_MEM_MUTEX_CREATE(NAME) \
+  TRACE_QUEUE_NAMED(xSemaphoreCreateMutexStatic(&NAME ## SemaphoreBuffer), #NAME)
+
+/* Software timers */
+#define STATIC_MEM_TIMER_ALLOC(NAME) \
+  static StaticTimer_t NAME ## TimerBuffer
+
+#define STATIC_MEM_TIMER_CREATE(NAME, TIMER_NAME, PERIOD, AUTO_RELOAD, ID, CALLBACK) \
+  xTimerCreateStatic((TIMER_NAME), (PERIOD), (AUTO_RELOAD), (ID), (CALLBACK), &NAME ## TimerBuffer)
+
+#endif /* STATIC_MEM_H_ */
@@ -0,0 +1,131 @@
+/**
+ * trace.h - Context switch, interrupt and queue trace recorder
+ *
+ * With TRACE_RECORDER defined in FreeRTOSConfig.h, the FreeRTOS trace
+ * macros below and the TRACE_ISR_ENTER()/TRACE_ISR_EXIT() calls of the
+ * interrupt handlers write 8 byte events (trace_format.h) in a RAM ring,
+ * stamped with the DWT cycle counter. Each event costs ~40 cycles, with the
+ * interrupts masked for the ring write only.
+ *
+ * A task slice starts at its switch in event and ends at the next switch
+ * in or interrupt entry: the switch out hook is not recorded, it would
+ * double the events for no information.
+ *
+ * The tasks are named at their creation, the queues, semaphores and mutexes
+ * created with static_mem.h after their NAME. The others show as numbers.
+ *
+ * The "trace" parameter group controls it:
+ *   enable   record (default 1: from the boot)
+ *   oneShot  stop when the ring is full instead of overwriting the oldest
+ *   dump     write the ring then restart it: TRACE_DUMP_CRTP on
+ *            CRTP_PORT_TRACE, TRACE_DUMP_UART raw on the console UART,
+ *            TRACE_DUMP_SD as TRACEnn.BIN by the blackbox task, between two
+ *            recordings. Set back to 0 when done.
+ * Tools/trace converts a dump to a Chrome / Perfetto trace.
+ *
+ * This header is included by FreeRTOSConfig.h: it must not include the
+ * FreeRTOS headers.
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOSConfig.h"
+#include "trace_format.h"
+
+#define TRACE_BUFFER_EVENTS   2048      // Power of two, 16KB
+#define TRACE_MAX_TASKS       32        // Task numbers 1 to 31
+#define TRACE_MAX_QUEUES      64
+#define TRACE_POLL_MS         100
+
+/* Values of the trace.dump parameter */
+#define TRACE_DUMP_NONE       0
+#define TRACE_DUMP_CRTP       1
+#define TRACE_DUMP_UART       2
+#define TRACE_DUMP_SD         3
+
+/* Output of a dump. Called with len 0 at the end, to flush */
+typedef bool (*traceSink_t)(void * ctx, const void * data, uint32_t len);
+
+#ifdef TRACE_RECORDER
+
+void traceInit(void);
+bool traceTest(void);
+
+void traceRecord(uint8_t type, uint8_t id, uint16_t arg);
+
+/* Exception number from IPSR, to call first and last in a handler */
+void traceIsrEnter(void);
+void traceIsrExit(void);
+
+/* A user event, to mark a point of a loop for instance */
+void traceMark(uint8_t id, uint16_t arg);
+
+void traceTaskCreate(uint8_t number, const char * name, uint16_t priority);
+/* The number of the new queue */
+uint8_t traceQueueCreate(uint8_t type);
+/* Name a queue or semaphore in the dumps, returns it. name is not copied */
+void * traceQueueNamed(void * queue, const char * name);
+
+/**
+ * Write the ring, oldest event first, then restart it. Recording is paused
+ * during the dump.
+ * @return The bytes written, 0 if the sink failed
+ */
+uint32_t traceDump(traceSink_t sink, void * ctx);
+
+/* Pending trace.dump value, and its reset by the task serving it */
+uint8_t traceDumpRequest(void);
+void traceDumpDone(void);
+
+/* Kernel hooks. Expanded in tasks.c and queue.c, where the fields of the
+TCB and of the queue are visible */
+#define traceTASK_SWITCHED_IN() \
+  traceRecord(TRACE_EV_TASK_IN, (uint8_t)pxCurrentTCB->uxTCBNumber, \
+              (uint16_t)(uintptr_t)pxCurrentTCB->pxTaskTag)
+#define traceTASK_CREATE(pxNewTCB) \
+  traceTaskCreate((uint8_t)(pxNewTCB)->uxTCBNumber, (pxNewTCB)->pcTaskName, \
+                  (uint16_t)(pxNewTCB)->uxPriority)
+
+#define traceQUEUE_CREATE(pxNewQueue) \
+  (pxNewQueue)->uxQueueNumber = traceQueueCreate((pxNewQueue)->ucQueueType)
+
+#define TRACE_QUEUE(TYPE, Q, ARG) \
+  traceRecord((TYPE), (uint8_t)(Q)->uxQueueNumber, (uint16_t)(ARG))
+
+#define traceQUEUE_SEND(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_SEND, pxQueue, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_SEND, pxQueue, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_RECEIVE, pxQueue, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE_FROM_ISR(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_RECEIVE, pxQueue, (pxQueue)->uxMessagesWaiting)
+#define traceBLOCKING_ON_QUEUE_SEND(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_BLOCK, pxQueue, 0)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_BLOCK, pxQueue, 1)
+#define traceQUEUE_SEND_FAILED(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_FAILED, pxQueue, 0)
+#define traceQUEUE_SEND_FROM_ISR_FAILED(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_FAILED, pxQueue, 0)
+#define traceQUEUE_RECEIVE_FAILED(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_FAILED, pxQueue, 1)
+#define traceQUEUE_RECEIVE_FROM_ISR_FAILED(pxQueue) \
+  TRACE_QUEUE(TRACE_EV_QUEUE_FAILED, pxQueue, 1)
+
+#define TRACE_ISR_ENTER()           traceIsrEnter()
+#define TRACE_ISR_EXIT()            traceIsrExit()
+#define TRACE_QUEUE_NAMED(Q, NAME)  traceQueueNamed((Q), (NAME))
+
+#else
+
+#define TRACE_ISR_ENTER()
+#define TRACE_ISR_EXIT()
+#define TRACE_QUEUE_NAMED(Q, NAME)  (Q)
+
+#endif //TRACE_RECORDER
+
+#endif //__TRACE_H__
@@ -0,0 +1,85 @@
+/**
+ * trace_format.h - Events and dump layout of the trace recorder
+ *
+ * An event is 8 bytes: the DWT cycle counter, a type, the task, queue or
+ * exception number it is about and a 16 bit argument. The counter wraps
+ * every 25s at 168MHz, a reader unwraps it assuming less than one wrap
+ * between two consecutive events.
+ *
+ * A dump, whatever the transport (CRTP, console UART, SD file), is:
+ *   traceHeader_t
+ *   traceName_t x (tasks + queues)
+ *   traceEvent_t x events, oldest first
+ * all little endian.
+ *
+ * Over CRTP the dump is cut in chunks on CRTP_PORT_TRACE, channel 0: a u16
+ * chunk number then up to TRACE_CHUNK_SIZE bytes. Chunk 0 starts a dump.
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host converter (Tools/trace).
+ */
+#ifndef __TRACE_FORMAT_H__
+#define __TRACE_FORMAT_H__
+
+#include <stdint.h>
+
+#define TRACE_MAGIC         "FCTR"
+#define TRACE_VERSION       1
+#define TRACE_NAME_LEN      16
+#define TRACE_CHUNK_SIZE    28          // CRTP_MAX_DATA_SIZE - chunk number
+
+/* Event types */
+#define TRACE_EV_NONE           0       // Never recorded, a hole in a CRTP dump
+#define TRACE_EV_TASK_IN        1       // id: task, arg: application task tag
+#define TRACE_EV_ISR_ENTER      2       // id: exception number, IRQn + 16
+#define TRACE_EV_ISR_EXIT       3       // id: exception number
+#define TRACE_EV_QUEUE_SEND     4       // id: queue, arg: items before the send
+#define TRACE_EV_QUEUE_RECEIVE  5       // id: queue, arg: items before the receive
+#define TRACE_EV_QUEUE_BLOCK    6       // id: queue, arg: 0 on send, 1 on receive
+#define TRACE_EV_QUEUE_FAILED   7       // id: queue, arg: 0 on send, 1 on receive
+#define TRACE_EV_TASK_CREATE    8       // id: task, arg: priority
+#define TRACE_EV_QUEUE_CREATE   9       // id: queue, arg: queue type
+#define TRACE_EV_MARK           10      // id, arg: user values, traceMark()
+#define TRACE_EV_COUNT          11
+
+/* Queue types, as queueQUEUE_TYPE_xxx in queue.h */
+#define TRACE_QUEUE_BASE                0
+#define TRACE_QUEUE_MUTEX               1
+#define TRACE_QUEUE_COUNTING_SEMAPHORE  2
+#define TRACE_QUEUE_BINARY_SEMAPHORE    3
+#define TRACE_QUEUE_RECURSIVE_MUTEX     4
+
+/* Kinds of traceName_t */
+#define TRACE_NAME_TASK     0
+#define TRACE_NAME_QUEUE    1
+
+typedef struct
+{
+  uint32_t time;                  // DWT cycle counter
+  uint8_t type;
+  uint8_t id;
+  uint16_t arg;
+} traceEvent_t;
+
+typedef struct
+{
+  char magic[4];                  // TRACE_MAGIC, not terminated
+  uint16_t version;
+  uint16_t eventSize;             // sizeof(traceEvent_t)
+  uint32_t cpuHz;                 // Cycle counter frequency
+  uint32_t events;
+  uint32_t lost;                  // Overwritten or not recorded, ring full
+  uint16_t tasks;
+  uint16_t queues;
+} traceHeader_t;
+
+typedef struct
+{
+  uint8_t id;
+  uint8_t kind;                   // TRACE_NAME_TASK or TRACE_NAME_QUEUE
+  uint8_t type;                   // Queue type
+  uint8_t reserved;
+  char name[TRACE_NAME_LEN];      // Zero padded, not terminated at 16 chars
+} traceName_t;
+
+#endif //__TRACE_FORMAT_H__
@@ -0,0 +1,463 @@
+/**
+ * blackbox.c - SD card flight recorder
+ *
+ * Producer: blackboxRecord(), in the stabilizer task. Consumer: the
+ * blackbox task, the only one to touch the card. They share two buffers:
+ * bufferLength[i] != 0 means buffer i belongs to the task.
+ */
+#include <string.h>
+
+#include "main.h"
+#include "blackbox.h"
+
+#define BLACKBOX_FILE_NAME      "0:LOG%02d.BBL"
+#define TRACE_FILE_NAME         "0:TRACE%02d.BIN"
+#define BLACKBOX_MAX_FILES      100
+#define BLACKBOX_POLL_MS        100
+
+static bool isInit = false;
+
+/* Units: deg/s, g, gauss, m, deg, m/s, motor and thrust ratios */
+static const blackboxField_t fields[BB_FIELD_COUNT] =
+{
+  [BB_TICK]       = {"tick",      1,    blackboxPredictLinear},
+  [BB_GYRO_X]     = {"gyroX",     16,   blackboxPredictAverage},
+  [BB_GYRO_Y]     = {"gyroY",     16,   blackboxPredictAverage},
+  [BB_GYRO_Z]     = {"gyroZ",     16,   blackboxPredictAverage},
+  [BB_ACC_X]      = {"accX",      1000, blackboxPredictAverage},
+  [BB_ACC_Y]      = {"accY",      1000, blackboxPredictAverage},
+  [BB_ACC_Z]      = {"accZ",      1000, blackboxPredictAverage},
+  [BB_MAG_X]      = {"magX",      1000, blackboxPredictPrevious},
+  [BB_MAG_Y]      = {"magY",      1000, blackboxPredictPrevious},
+  [BB_MAG_Z]      = {"magZ",      1000, blackboxPredictPrevious},
+  [BB_BARO_ASL]   = {"baroAsl",   100,  blackboxPredictPrevious},
+  [BB_ROLL]       = {"roll",      100,  blackboxPredictLinear},
+  [BB_PITCH]      = {"pitch",     100,  blackboxPredictLinear},
+  [BB_YAW]        = {"yaw",       100,  blackboxPredictLinear},
+  [BB_POSITION_Z] = {"posZ",      1000, blackboxPredictLinear},
+  [BB_VELOCITY_Z] = {"velZ",      1000, blackboxPredictLinear},
+  [BB_SP_ROLL]    = {"spRoll",    100,  blackboxPredictPrevious},
+  [BB_SP_PITCH]   = {"spPitch",   100,  blackboxPredictPrevious},
+  [BB_SP_YAW]     = {"spYaw",     100,  blackboxPredictPrevious},
+  [BB_SP_THRUST]  = {"spThrust",  1,    blackboxPredictPrevious},
+  [BB_CTRL_ROLL]  = {"ctrlRoll",  1,    blackboxPredictAverage},
+  [BB_CTRL_PITCH] = {"ctrlPitch", 1,    blackboxPredictAverage},
+  [BB_CTRL_YAW]   = {"ctrlYaw",   1,    blackboxPredictAverage},
+  [BB_CTRL_THRUST]= {"ctrlThrust",1,    blackboxPredictAverage},
+  [BB_MOTOR_1]    = {"motor1",    1,    blackboxPredictAverage},
+  [BB_MOTOR_2]    = {"motor2",    1,    blackboxPredictAverage},
+  [BB_MOTOR_3]    = {"motor3",    1,    blackboxPredictAverage},
+  [BB_MOTOR_4]    = {"motor4",    1,    blackboxPredictAverage},
+};
+
+static blackboxCodec_t codec;
+
+/* Parameters */
+#ifdef BLACKBOX_AUTOSTART
+static uint8_t enable = 1;
+#else
+static uint8_t enable = 0;
+#endif
+static uint8_t rateDiv = 1;
+
+/* uint32_t: the SDIO DMA needs 4 bytes aligned buffers */
+static uint32_t buffers[2][BLACKBOX_BUFFER_SIZE / 4];
+static volatile uint32_t bufferLength[2];
+static uint32_t fillIndex;
+static uint32_t fillPos;
+
+static volatile bool recording;   // Set by the task, cleared by the producer
+static volatile bool fileFull;    // Set by the task, stops the producer
+static xSemaphoreHandle bufferReady;
+
+static FATFS fs;
+static FIL file;
+static bool mounted;
+static uint32_t dataLength;
+
+/* Statistics */
+static uint32_t framesRecorded;
+static uint32_t framesDropped;
+static uint32_t bytesRecorded;
+static uint32_t writeErrors;
+static uint32_t writeTimeMax;     // ms
+
+static void blackboxTask(void * prm);
+
+STATIC_MEM_SEMAPHORE_ALLOC(bufferReady);
+STATIC_MEM_TASK_ALLOC(blackboxTask, BLACKBOX_TASK_STACKSIZE);
+
+void blackboxInit(void)
+{
+  if(isInit)
+    return;
+
+  blackboxCodecInit(&codec, fields, BB_FIELD_COUNT);
+
+  bufferReady = STATIC_MEM_BINARY_CREATE(bufferReady);
+
+  STATIC_MEM_TASK_CREATE(blackboxTask, blackboxTask, BLACKBOX_TASK_NAME,
+                         NULL, BLACKBOX_TASK_PRI);
+
+  isInit = true;
+}
+
+bool blackboxTest(void)
+{
+  return isInit;
+}
+
+/* Hand the fill buffer to the task and switch to the other one */
+static void blackboxHandOff(void)
+{
+  bufferLength[fillIndex] = fillPos;
+  xSemaphoreGive(bufferReady);
+  fillIndex ^= 1;
+  fillPos = 0;
+}
+
+static bool blackboxAppend(const uint8_t * data, uint32_t len)
+{
+  uint32_t first;
+
+  //A frame that fills the buffer needs the other one to continue
+  if (fillPos + len >= BLACKBOX_BUFFER_SIZE && bufferLength[fillIndex ^ 1] != 0)
+    return false;
+
+  first = BLACKBOX_BUFFER_SIZE - fillPos;
+  if (first > len)
+    first = len;
+
+  memcpy((uint8_t *)buffers[fillIndex] + fillPos, data, first);
+  fillPos += first;
+
+  if (fillPos == BLACKBOX_BUFFER_SIZE)
+  {
+    blackboxHandOff();
+    memcpy((uint8_t *)buffers[fillIndex], data + first, len - first);
+    fillPos = len - first;
+  }
+
+  return true;
+}
+
+void blackboxRecord(const sensorData_t *sensorData, const state_t *state,
+                    const setpoint_t *setpoint, const control_t *control,
+                    uint32_t tick)
+{
+  int32_t values[BB_FIELD_COUNT];
+  uint8_t frame[1 + 5 * BB_FIELD_COUNT];
+  uint32_t len;
+  int i;
+
+  if (!recording)
+    return;
+
+  if (!enable || fileFull)
+  {
+    //Last, partial, buffer. Always free: it is the one being filled
+    if (fillPos)
+      blackboxHandOff();
+    recording = false;
+    xSemaphoreGive(bufferReady);
+    return;
+  }
+
+  if (rateDiv > 1 && (tick % rateDiv) != 0)
+    return;
+
+  values[BB_TICK] = (int32_t)tick;
+  values[BB_GYRO_X] = blackboxQuantize(sensorData->gyro.x, fields[BB_GYRO_X].scale);
+  values[BB_GYRO_Y] = blackboxQuantize(sensorData->gyro.y, fields[BB_GYRO_Y].scale);
+  values[BB_GYRO_Z] = blackboxQuantize(sensorData->gyro.z, fields[BB_GYRO_Z].scale);
+  values[BB_ACC_X] = blackboxQuantize(sensorData->acc.x, fields[BB_ACC_X].scale);
+  values[BB_ACC_Y] = blackboxQuantize(sensorData->acc.y, fields[BB_ACC_Y].scale);
+  values[BB_ACC_Z] = blackboxQuantize(sensorData->acc.z, fields[BB_ACC_Z].scale);
+  values[BB_MAG_X] = blackboxQuantize(sensorData->mag.x, fields[BB_MAG_X].scale);
+  values[BB_MAG_Y] = blackboxQuantize(sensorData->mag.y, fields[BB_MAG_Y].scale);
+  values[BB_MAG_Z] = blackboxQuantize(sensorData->mag.z, fields[BB_MAG_Z].scale);
+  values[BB_BARO_ASL] = blackboxQuantize(sensorData->baro.asl, fields[BB_BARO_ASL].scale);
+  values[BB_ROLL] = blackboxQuantize(state->attitude.roll, fields[BB_ROLL].scale);
+  values[BB_PITCH] = blackboxQuantize(state->attitude.pitch, fields[BB_PITCH].scale);
+  values[BB_YAW] = blackboxQuantize(state->attitude.yaw, fields[BB_YAW].scale);
+  values[BB_POSITION_Z] = blackboxQuantize(state->position.z, fields[BB_POSITION_Z].scale);
+  values[BB_VELOCITY_Z] = blackboxQuantize(state->velocity.z, fields[BB_VELOCITY_Z].scale);
+  values[BB_SP_ROLL] = blackboxQuantize(setpoint->attitude.roll, fields[BB_SP_ROLL].scale);
+  values[BB_SP_PITCH] = blackboxQuantize(setpoint->attitude.pitch, fields[BB_SP_PITCH].scale);
+  values[BB_SP_YAW] = blackboxQuantize(setpoint->attitude.yaw, fields[BB_SP_YAW].scale);
+  values[BB_SP_THRUST] = blackboxQuantize(setpoint->thrust, fields[BB_SP_THRUST].scale);
+  values[BB_CTRL_ROLL] = control->roll;
+  values[BB_CTRL_PITCH] = control->pitch;
+  values[BB_CTRL_YAW] = control->yaw;
+  values[BB_CTRL_THRUST] = blackboxQuantize(control->thrust, fields[BB_CTRL_THRUST].scale);
+  for (i=0; i<4; i++)
+    values[BB_MOTOR_1 + i] = motorsGetRatio(MOTOR_M1 + i);
+
+  len = blackboxEncode(&codec, values, frame);
+
+  if (blackboxAppend(frame, len))
+  {
+    framesRecorded++;
+    bytesRecorded += len;
+  }
+  else
+  {
+    //The decoder will not see this frame: restart from a keyframe
+    blackboxCodecReset(&codec);
+    framesDropped++;
+  }
+}
+
+/* Comma separated list of a field property */
+static int blackboxHeaderList(char * buf, const char * name, int property)
+{
+  int n = sprintf(buf, "H Field %s:", name);
+  int i;
+
+  for (i=0; i<BB_FIELD_COUNT; i++)
+  {
+    if (property == 0)
+      n += sprintf(buf + n, "%s", fields[i].name);
+    else if (property == 1)
+      n += sprintf(buf + n, "%d", (int)fields[i].scale);
+    else
+      n += sprintf(buf + n, "%d", fields[i].predictor);
+    buf[n++] = (i == BB_FIELD_COUNT - 1) ? '\n' : ',';
+  }
+
+  return n;
+}
+
+/* Header block, "H name:value" text lines as the Betaflight logs */
+static uint32_t blackboxBuildHeader(char * buf)
+{
+  int n;
+
+  memset(buf, 0, BLACKBOX_DATA_OFFSET);
+  n = sprintf(buf,
+              "H Product:Blackbox flight data recorder\n"
+              "H Version:%d\n"
+              "H Data offset:%d\n"
+              "H Loop rate:%d\n"
+              "H Rate divider:%d\n"
+              "H Keyframe interval:%d\n",
+              BLACKBOX_VERSION, BLACKBOX_DATA_OFFSET, RATE_MAIN_LOOP, rateDiv,
+              BLACKBOX_KEYFRAME_INTERVAL);
+  n += blackboxHeaderList(buf + n, "name", 0);
+  n += blackboxHeaderList(buf + n, "scale", 1);
+  n += blackboxHeaderList(buf + n, "predictor", 2);
+
+  return n;
+}
+
+static FRESULT blackboxMount(void)
+{
+  FRESULT res;
+
+  if (mounted)
+    return FR_OK;
+
+  //SDIO interrupts, then SD_Init() through disk_initialize()
+  SDIO_NVIC_Configuration();
+  res = f_mount(&fs, "0:", 1);
+  if (res == FR_OK)
+    mounted = true;
+
+  return res;
+}
+
+/* Create the next LOGnn.BBL, preallocate it and write its header */
+static FRESULT blackboxOpen(void)
+{
+  char name[16];
+  FRESULT res;
+  UINT bw;
+  int i;
+
+  res = blackboxMount();
+  if (res != FR_OK)
+    return res;
+
+  res = FR_EXIST;
+  for (i=0; i<BLACKBOX_MAX_FILES && res == FR_EXIST; i++)
+  {
+    sprintf(name, BLACKBOX_FILE_NAME, i);
+    res = f_open(&file, name, FA_CREATE_NEW | FA_WRITE);
+  }
+  if (res != FR_OK)
+    return res;
+
+  //Contiguous clusters: no FAT update nor allocation while recording
+  res = f_expand(&file, BLACKBOX_FILE_SIZE, 1);
+  if (res == FR_OK)
+  {
+    blackboxBuildHeader((char *)buffers[0]);
+    res = f_write(&file, buffers[0], BLACKBOX_DATA_OFFSET, &bw);
+    if (res == FR_OK && bw != BLACKBOX_DATA_OFFSET)
+      res = FR_DENIED;
+  }
+  if (res == FR_OK)
+    res = f_sync(&file);
+
+  if (res != FR_OK)
+  {
+    f_close(&file);
+    f_unlink(name);
+  }
+
+  return res;
+}
+
+/* Write a handed buffer, as whole sectors */
+static void blackboxWrite(uint32_t index)
+{
+  uint32_t len = bufferLength[index];
+  uint32_t padded = (len + BLACKBOX_SECTOR_SIZE - 1) & ~(BLACKBOX_SECTOR_SIZE - 1);
+  TickType_t start = xTaskGetTickCount();
+  uint32_t time;
+  UINT bw;
+
+  //Only the last buffer of a recording is partial
+  if (padded > len)
+    memset((uint8_t *)buffers[index] + len, 0, padded - len);
+
+  if (f_write(&file, buffers[index], padded, &bw) != FR_OK || bw != padded)
+    writeErrors++;
+
+  dataLength += len;
+  if (BLACKBOX_DATA_OFFSET + dataLength + 2 * BLACKBOX_BUFFER_SIZE > BLACKBOX_FILE_SIZE)
+    fileFull = true;
+
+  time = T2M(xTaskGetTickCount() - start);
+  if (time > writeTimeMax)
+    writeTimeMax = time;
+}
+
+/* Cut the preallocated file to the recorded length */
+static void blackboxClose(void)
+{
+  f_lseek(&file, BLACKBOX_DATA_OFFSET + dataLength);
+  f_truncate(&file);
+  f_close(&file);
+}
+
+#ifdef TRACE_RECORDER
+static bool blackboxTraceSink(void * ctx, const void * data, uint32_t len)
+{
+  UINT bw;
+
+  return len == 0 || (f_write((FIL *)ctx, data, len, &bw) == FR_OK && bw == len);
+}
+
+/* Write the trace recorder ring to the next TRACEnn.BIN */
+static void blackboxDumpTrace(void)
+{
+  char name[16];
+  FRESULT res;
+  int i;
+
+  res = blackboxMount();
+  if (res == FR_OK)
+  {
+    res = FR_EXIST;
+    for (i=0; i<BLACKBOX_MAX_FILES && res == FR_EXIST; i++)
+    {
+      sprintf(name, TRACE_FILE_NAME, i);
+      res = f_open(&file, name, FA_CREATE_NEW | FA_WRITE);
+    }
+  }
+  if (res == FR_OK)
+  {
+    if (traceDump(blackboxTraceSink, &file) == 0)
+      writeErrors++;
+    f_close(&file);
+  }
+  else
+    writeErrors++;
+}
+#endif
+
+/*****************************************************************
+ *@brief  open the recordings and write the full buffers
+ *@param  *prm: not used
+ *@retval None
+ *****************************************************************/
+static void blackboxTask(void * prm)
+{
+  uint32_t writeIndex = 0;
+  bool fileOpen = false;
+  bool stop;
+
+  systemWaitStart();
+
+  while(1)
+  {
+    if (!fileOpen)
+    {
+      vTaskDelay(M2T(BLACKBOX_POLL_MS));
+
+#ifdef TRACE_RECORDER
+      //The card is only touched by this task
+      if (traceDumpRequest() == TRACE_DUMP_SD)
+      {
+        blackboxDumpTrace();
+        traceDumpDone();
+      }
+#endif
+
+      //After a full file, wait for enable to be cleared
+      if (!enable)
+        fileFull = false;
+      if (!enable || fileFull)
+        continue;
+
+      if (blackboxOpen() != FR_OK)
+      {
+        //No card or no room: do not retry until enabled again
+        writeErrors++;
+        enable = 0;
+        continue;
+      }
+
+      fileOpen = true;
+      writeIndex = 0;
+      dataLength = 0;
+      fillIndex = 0;
+      fillPos = 0;
+      blackboxCodecReset(&codec);
+      recording = true;
+      continue;
+    }
+
+    xSemaphoreTake(bufferReady, M2T(BLACKBOX_POLL_MS));
+
+    //Read first: the last buffer is handed before recording is cleared
+    stop = !recording;
+
+    while (bufferLength[writeIndex] != 0)
+    {
+      blackboxWrite(writeIndex);
+      bufferLength[writeIndex] = 0;
+      writeIndex ^= 1;
+    }
+
+    if (stop)
+    {
+      blackboxClose();
+      fileOpen = false;
+    }
+  }
+}
+
+PARAM_GROUP_START(blackbox)
+PARAM_ADD(PARAM_UINT8, enable, &enable)
+PARAM_ADD(PARAM_UINT8, rateDiv, &rateDiv)
+PARAM_GROUP_STOP(blackbox)
+
+LOG_GROUP_START(blackbox)
+LOG_ADD(LOG_UINT32, frames, &framesRecorded)
+LOG_ADD(LOG_UINT32, dropped, &framesDropped)
+LOG_ADD(LOG_UINT32, bytes, &bytesRecorded)
+LOG_ADD(LOG_UINT32, wrErrors, &writeErrors)
+LOG_ADD(LOG_UINT32, wrMaxMs, &writeTimeMax)
+LOG_GROUP_STOP(blackbox)
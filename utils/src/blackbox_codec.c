@@ -0,0 +1,159 @@
+/**
+ * blackbox_codec.c - Delta encoding of the blackbox frames
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host tools (Tools/blackbox). The differences are computed modulo 2^32 on
+ * both sides, the decoder gets back the exact values even on overflow.
+ */
+#include <string.h>
+
+#include "blackbox_codec.h"
+
+void blackboxCodecInit(blackboxCodec_t * codec, const blackboxField_t * fields, uint32_t count)
+{
+  memset(codec, 0, sizeof(*codec));
+  codec->fields = fields;
+  codec->count = count > BLACKBOX_MAX_FIELDS ? BLACKBOX_MAX_FIELDS : count;
+}
+
+void blackboxCodecReset(blackboxCodec_t * codec)
+{
+  codec->valid = false;
+}
+
+int32_t blackboxQuantize(float value, float scale)
+{
+  float v = value * scale;
+
+  //Also catches NaN, which fails both tests
+  if (!(v < 2147483520.0f))
+    return v > 0 ? INT32_MAX : 0;
+  if (!(v > -2147483520.0f))
+    return INT32_MIN;
+
+  return (int32_t)(v >= 0 ? v + 0.5f : v - 0.5f);
+}
+
+static uint32_t zigzag(int32_t v)
+{
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t u)
+{
+  return (int32_t)((u >> 1) ^ (0u - (u & 1)));
+}
+
+static uint32_t writeVarint(uint8_t * out, uint32_t u)
+{
+  uint32_t n = 0;
+
+  while (u >= 0x80)
+  {
+    out[n++] = (uint8_t)(u | 0x80);
+    u >>= 7;
+  }
+  out[n++] = (uint8_t)u;
+
+  return n;
+}
+
+/* Bytes used, 0 if more bytes are needed, -1 if longer than 5 bytes */
+static int32_t readVarint(const uint8_t * in, uint32_t len, uint32_t * u)
+{
+  uint32_t value = 0;
+  uint32_t i;
+
+  for (i=0; i<5; i++)
+  {
+    if (i >= len)
+      return 0;
+    value |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+    if ((in[i] & 0x80) == 0)
+    {
+      *u = value;
+      return i + 1;
+    }
+  }
+
+  return -1;
+}
+
+static uint32_t predict(const blackboxCodec_t * codec, uint32_t i)
+{
+  int32_t p1 = codec->previous[i];
+  int32_t p2 = codec->previous2[i];
+
+  switch (codec->fields[i].predictor)
+  {
+    case blackboxPredictLinear:
+      return 2u * (uint32_t)p1 - (uint32_t)p2;
+    case blackboxPredictAverage:
+      return (uint32_t)(int32_t)(((int64_t)p1 + p2) >> 1);
+    default:
+      return (uint32_t)p1;
+  }
+}
+
+static void pushHistory(blackboxCodec_t * codec, const int32_t * values, bool keyframe)
+{
+  //After a keyframe the two previous values are the same: linear and
+  //average both predict the previous value
+  memcpy(codec->previous2, keyframe ? values : codec->previous, codec->count * sizeof(int32_t));
+  memcpy(codec->previous, values, codec->count * sizeof(int32_t));
+  codec->sinceKeyframe = keyframe ? 1 : codec->sinceKeyframe + 1;
+  codec->valid = true;
+}
+
+uint32_t blackboxEncode(blackboxCodec_t * codec, const int32_t * values, uint8_t * out)
+{
+  bool keyframe = !codec->valid || codec->sinceKeyframe >= BLACKBOX_KEYFRAME_INTERVAL;
+  uint32_t n = 1;
+  uint32_t i;
+
+  out[0] = keyframe ? BLACKBOX_FRAME_I : BLACKBOX_FRAME_P;
+
+  for (i=0; i<codec->count; i++)
+  {
+    uint32_t delta = keyframe ? (uint32_t)values[i] : (uint32_t)values[i] - predict(codec, i);
+    n += writeVarint(&out[n], zigzag((int32_t)delta));
+  }
+
+  pushHistory(codec, values, keyframe);
+
+  return n;
+}
+
+int32_t blackboxDecode(blackboxCodec_t * codec, const uint8_t * in, uint32_t len, int32_t * values)
+{
+  bool keyframe;
+  uint32_t n = 1;
+  uint32_t i;
+
+  if (len == 0)
+    return 0;
+
+  if (in[0] == BLACKBOX_FRAME_I)
+    keyframe = true;
+  else if (in[0] == BLACKBOX_FRAME_P && codec->valid)
+    keyframe = false;
+  else
+    return -1;
+
+  for (i=0; i<codec->count; i++)
+  {
+    uint32_t u;
+    int32_t used = readVarint(&in[n], len - n, &u);
+
+    if (used <= 0)
+      return used;
+    n += used;
+
+    u = (uint32_t)unzigzag(u);
+    values[i] = (int32_t)(keyframe ? u : u + predict(codec, i));
+  }
+
+  pushHistory(codec, values, keyframe);
+
+  return n;
+}
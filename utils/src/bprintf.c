@@ -0,0 +1,173 @@
+/**
+ * bprintf.c - Deferred binary printf
+ *
+ * The producers only copy a few words into the ring buffer with the
+ * interrupts masked. The formatting cost is moved to the host and the UART
+ * cost to the lowest priority task.
+ */
+#include <stdarg.h>
+#include <string.h>
+
+#include "main.h"
+#include "bprintf.h"
+
+#define BPRINTF_BUFFER_SIZE  1024    // Power of two
+#define BPRINTF_DRAIN_MS     10
+
+#if defined(__ICCARM__)
+#pragma section = ".bprintf"
+#define BPRINTF_SECTION_START ((const char *)__section_begin(".bprintf"))
+#else
+extern const char _bprintf_start;
+#define BPRINTF_SECTION_START (&_bprintf_start)
+#endif
+
+static uint8_t ring[BPRINTF_BUFFER_SIZE];
+static volatile uint32_t ringHead;   // written by the producers
+static volatile uint32_t ringTail;   // written by the drain task
+
+static putc_t bprintfSink = putchar;
+static uint32_t bprintfDropped;
+static bool isInit = false;
+
+static void bprintfTask(void * prm);
+
+STATIC_MEM_TASK_ALLOC(bprintfTask, BPRINTF_TASK_STACKSIZE);
+
+/*****************************************************************
+ *@brief  launch the drain task
+ *@param  None
+ *@retval None
+ *****************************************************************/
+void bprintfInit(void)
+{
+  if(isInit)
+    return;
+
+  STATIC_MEM_TASK_CREATE(bprintfTask, bprintfTask, BPRINTF_TASK_NAME,
+                         NULL, BPRINTF_TASK_PRI);
+
+  isInit = true;
+}
+
+bool bprintfTest(void)
+{
+  return isInit;
+}
+
+void bprintfSetSink(putc_t sink)
+{
+  bprintfSink = sink;
+}
+
+uint32_t bprintfGetDropped(void)
+{
+  return bprintfDropped;
+}
+
+/*****************************************************************
+ *@brief  queue the format id and the raw arguments
+ *@param  fmt: the format string, placed in the .bprintf section
+ *@param  site: the argument classes of the call site
+ *@retval None
+ *****************************************************************/
+void bprintfEmit(const char * fmt, bprintfSite_t * site, ...)
+{
+  uint8_t record[BPRINTF_HEADER_LEN + BPRINTF_MAX_PAYLOAD];
+  uint8_t * ptr = &record[BPRINTF_HEADER_LEN];
+  uint32_t id = fmt - BPRINTF_SECTION_START;
+  uint32_t types;
+  uint32_t len;
+  uint32_t head;
+  uint32_t i;
+  uint32_t mask;
+  va_list ap;
+
+  if (!site->parsed)
+    bprintfParseFormat(fmt, site);
+
+  types = site->types;
+
+  va_start(ap, site);
+  for (i=0; i<site->nargs; i++, types >>= 2)
+  {
+    //Drop the trailing arguments which do not fit, the host prints "?"
+    if ((ptr - record) + BPRINTF_MAX_STRING > sizeof(record))
+      break;
+
+    switch (types & 0x03)
+    {
+      case BPRINTF_ARG_INT32:
+      {
+        int32_t v = va_arg(ap, int32_t);
+        memcpy(ptr, &v, 4);
+        ptr += 4;
+        break;
+      }
+      case BPRINTF_ARG_64BIT:
+      {
+        //double and long long have the same size and alignment on the M4
+        uint64_t v = va_arg(ap, uint64_t);
+        memcpy(ptr, &v, 8);
+        ptr += 8;
+        break;
+      }
+      case BPRINTF_ARG_STRING:
+      {
+        const char * s = va_arg(ap, const char *);
+        uint32_t n = 0;
+        while (s[n] && n < BPRINTF_MAX_STRING-1)
+        {
+          ptr[n] = s[n];
+          n++;
+        }
+        ptr[n] = '\0';
+        ptr += n + 1;
+        break;
+      }
+    }
+  }
+  va_end(ap);
+
+  len = ptr - record;
+  record[0] = BPRINTF_SYNC;
+  record[1] = id & 0xFF;
+  record[2] = (id >> 8) & 0xFF;
+  record[3] = len - BPRINTF_HEADER_LEN;
+
+  //Reserve and copy with the interrupts masked, works from tasks and ISRs
+  mask = portSET_INTERRUPT_MASK_FROM_ISR();
+  head = ringHead;
+  if (BPRINTF_BUFFER_SIZE - (head - ringTail) < len)
+  {
+    bprintfDropped++;
+  }
+  else
+  {
+    for (i=0; i<len; i++)
+      ring[(head + i) & (BPRINTF_BUFFER_SIZE-1)] = record[i];
+    ringHead = head + len;
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+/*****************************************************************
+ *@brief  output the queued records on the sink
+ *@param  *prm: not used
+ *@retval None
+ *****************************************************************/
+static void bprintfTask(void * prm)
+{
+  uint32_t lastWakeTime = xTaskGetTickCount();
+
+  while(1)
+  {
+    vTaskDelayUntil(&lastWakeTime, M2T(BPRINTF_DRAIN_MS));
+
+    while (ringTail != ringHead)
+    {
+      bprintfSink(ring[ringTail & (BPRINTF_BUFFER_SIZE-1)]);
+      ringTail++;
+    }
+  }
+}
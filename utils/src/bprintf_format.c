@@ -0,0 +1,71 @@
+/**
+ * bprintf_format.c - Format string parsing of the deferred binary printf
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host decoder (Tools/bprintf).
+ */
+#include <stddef.h>
+
+#include "bprintf.h"
+
+void bprintfParseFormat(const char * fmt, bprintfSite_t * site)
+{
+  uint8_t nargs = 0;
+  uint32_t types = 0;
+  int longs;
+
+  while (*fmt)
+  {
+    if (*fmt++ != '%')
+      continue;
+
+    if (*fmt == '%')
+    {
+      fmt++;
+      continue;
+    }
+
+    //Flags, width and precision. '*' takes an int argument
+    while (*fmt && (*fmt=='-' || *fmt=='+' || *fmt==' ' || *fmt=='#' ||
+                    *fmt=='.' || *fmt=='*' || (*fmt>='0' && *fmt<='9')))
+    {
+      if (*fmt == '*' && nargs < BPRINTF_MAX_ARGS)
+        types |= BPRINTF_ARG_INT32 << (2*nargs++);
+      fmt++;
+    }
+
+    //Length modifiers
+    longs = 0;
+    while (*fmt=='l' || *fmt=='h' || *fmt=='z' || *fmt=='t' || *fmt=='j')
+    {
+      if (*fmt == 'l')
+        longs++;
+      fmt++;
+    }
+
+    if (*fmt == '\0' || nargs >= BPRINTF_MAX_ARGS)
+      break;
+
+    switch (*fmt++)
+    {
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+        types |= BPRINTF_ARG_64BIT << (2*nargs++);
+        break;
+      case 's':
+        types |= BPRINTF_ARG_STRING << (2*nargs++);
+        break;
+      case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+        types |= (longs >= 2 ? BPRINTF_ARG_64BIT : BPRINTF_ARG_INT32) << (2*nargs++);
+        break;
+      case 'c': case 'p':
+        types |= BPRINTF_ARG_INT32 << (2*nargs++);
+        break;
+      default:
+        break;
+    }
+  }
+
+  site->nargs = nargs;
+  site->types = types;
+  site->parsed = 1;
+}
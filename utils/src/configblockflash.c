@@ -21,21 +21,24 @@
  * You should have received a copy of the GNU General Public License
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  *
- * configblock.c - Simple static implementation of the config block
+ * configblock.c - Config block in the internal flash
+ *
+ * The block is a log of fixed size records in the flash sector
+ * CONFIG_BLOCK_FLASH_SECTOR: a write appends a record, the last valid one is
+ * the current block. The sector is erased only when full, which stalls the
+ * flash, and so the CPU, for about a second: the writers only save at rest.
+ * A record cut by a power loss fails its checksum and is skipped.
  */
-#define DEBUG_MODULE "CFGBLK"
-
 #include <stdint.h>
 #include <stdbool.h>
-#include <unistd.h>
+#include <string.h>
 
-#include "config.h"
+#include "main.h"
 #include "configblock.h"
-#include "debug.h"
 
 /* Internal format of the config block */
 #define MAGIC 0x43427830
-#define VERSION 0
+#define VERSION 3
 struct configblock_s {
   /* header */
   uint32_t magic;
@@ -45,11 +48,32 @@ struct configblock_s {
   uint8_t radioSpeed;
   float calibPitch;
   float calibRoll;
+  /* IMU calibration, version 1 */
+  uint8_t imuCalibValid;
+  int16_t gyroBias[3];
+  int16_t accelBias[3];
+  float imuCalibTemperature;
+  /* Gyro bias against temperature, version 2 */
+  gyroTempModel_t gyroTempModel;
+  /* Magnetometer hard and soft iron, version 3 */
+  magCalibResult_t magCalib;
   /* Simple modulo 256 checksum */
   uint8_t cksum;
-} __attribute__((__packed__));
+} __packed;
+
+#define RECORD_WORDS    ((sizeof(struct configblock_s) + 3) / 4)
+#define RECORD_SIZE     (RECORD_WORDS * 4)
+#define RECORD_COUNT    (CONFIG_BLOCK_FLASH_SIZE / RECORD_SIZE)
+#define ERASED_WORD     0xFFFFFFFF
+
+typedef union
+{
+  struct configblock_s block;
+  uint32_t words[RECORD_WORDS];
+} configRecord_t;
 
-static struct configblock_s *configblock;
+static configRecord_t configblock;
+static uint32_t nextRecord;     // First erased record, RECORD_COUNT: full
 
 static bool cb_ok=false;
 
@@ -65,24 +89,59 @@ static uint8_t calculate_cksum(void* data, size_t len)
   return cksum;
 }
 
+static const uint32_t * recordAddress(uint32_t index)
+{
+  return (const uint32_t *)(CONFIG_BLOCK_FLASH_ADDRESS + index * RECORD_SIZE);
+}
+
+static bool recordIsErased(uint32_t index)
+{
+  const uint32_t * words = recordAddress(index);
+  uint32_t i;
+
+  for (i=0; i<RECORD_WORDS; i++)
+    if (words[i] != ERASED_WORD)
+      return false;
+
+  return true;
+}
+
+static bool recordIsValid(const struct configblock_s * block)
+{
+  return block->magic == MAGIC && block->version == VERSION &&
+         calculate_cksum((void *)block, sizeof(*block)) == 0;
+}
+
 int configblockInit(void)
 {
-  configblock = (void*)CONFIG_BLOCK_ADDRESS;
+  const struct configblock_s * block;
+  uint32_t i;
 
-  //Verify the config block
-  if (configblock->magic!=MAGIC || configblock->version!= VERSION || 
-      calculate_cksum(configblock, sizeof(*configblock)) )
+  //Verify the records, the last valid one is the config block
+  cb_ok = false;
+  nextRecord = RECORD_COUNT;
+  for (i=0; i<RECORD_COUNT; i++)
   {
-    DEBUG_PRINT("Verification [FAIL]\n");
-    return -1;
+    if (recordIsErased(i))
+    {
+      nextRecord = i;
+      break;
+    }
+    block = (const struct configblock_s *)recordAddress(i);
+    if (recordIsValid(block))
+    {
+      memcpy(&configblock, block, sizeof(*block));
+      cb_ok = true;
+    }
   }
-  else
+
+  if (!cb_ok)
   {
-    DEBUG_PRINT("v%d, verification [OK]\n", configblock->version);
-    cb_ok = true;
+    BPRINTF("Config block verification [FAIL]\n");
+    return -1;
   }
 
-  
+  BPRINTF("Config block v%d, verification [OK]\n", configblock.block.version);
   return 0;
 }
 
@@ -91,11 +150,62 @@ bool configblockTest(void)
   return true;
 }
 
+/* A new block from the defaults, kept when a field is set */
+static void configblockDefaults(void)
+{
+  memset(&configblock, 0, sizeof(configblock));
+  configblock.block.magic = MAGIC;
+  configblock.block.version = VERSION;
+  configblock.block.radioChannel = RADIO_CHANNEL;
+  configblock.block.radioSpeed = RADIO_DATARATE;
+}
+
+/**
+ * Appends the config block to the log, after an erase of the sector when
+ * it is full. Blocks the caller, and the CPU when erasing.
+ */
+static bool configblockWrite(void)
+{
+  const uint32_t * written;
+  FLASH_Status status = FLASH_COMPLETE;
+  uint32_t i;
+
+  configblock.block.cksum = 0;
+  configblock.block.cksum = (uint8_t)(0 - calculate_cksum(&configblock.block,
+                                                          sizeof(configblock.block)));
+
+  FLASH_Unlock();
+  FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                  FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+
+  //Skips what a power loss left half written
+  while (nextRecord < RECORD_COUNT && !recordIsErased(nextRecord))
+    nextRecord++;
+  if (nextRecord >= RECORD_COUNT)
+  {
+    status = FLASH_EraseSector(CONFIG_BLOCK_FLASH_SECTOR, VoltageRange_3);
+    nextRecord = 0;
+  }
+
+  written = recordAddress(nextRecord);
+  for (i=0; i<RECORD_WORDS && status == FLASH_COMPLETE; i++)
+    status = FLASH_ProgramWord((uint32_t)&written[i], configblock.words[i]);
+
+  FLASH_Lock();
+  nextRecord++;
+
+  //The block in RAM is valid whatever the flash did
+  cb_ok = true;
+
+  return status == FLASH_COMPLETE &&
+         memcmp(written, configblock.words, sizeof(configblock.words)) == 0;
+}
+
 /* Static accessors */
 int configblockGetRadioChannel(void)
 {
   if (cb_ok)
-    return configblock->radioChannel;
+    return configblock.block.radioChannel;
   else
     return RADIO_CHANNEL;
 }
@@ -103,15 +213,20 @@ int configblockGetRadioChannel(void)
 int configblockGetRadioSpeed(void)
 {
   if (cb_ok)
-    return configblock->radioSpeed;
+    return configblock.block.radioSpeed;
   else
     return RADIO_DATARATE;
 }
 
+uint64_t configblockGetRadioAddress(void)
+{
+  return RADIO_ADDRESS;
+}
+
 float configblockGetCalibPitch(void)
 {
   if (cb_ok)
-    return configblock->calibPitch;
+    return configblock.block.calibPitch;
   else
     return 0;
 }
@@ -119,8 +234,72 @@ float configblockGetCalibPitch(void)
 float configblockGetCalibRoll(void)
 {
   if (cb_ok)
-    return configblock->calibRoll;
+    return configblock.block.calibRoll;
   else
     return 0;
 }
 
+bool configblockGetImuCalib(configImuCalib_t * calib)
+{
+  if (!cb_ok || !configblock.block.imuCalibValid)
+    return false;
+
+  memcpy(calib->gyroBias, configblock.block.gyroBias, sizeof(calib->gyroBias));
+  memcpy(calib->accelBias, configblock.block.accelBias, sizeof(calib->accelBias));
+  calib->temperature = configblock.block.imuCalibTemperature;
+
+  return true;
+}
+
+bool configblockSetImuCalib(const configImuCalib_t * calib)
+{
+  if (!cb_ok)
+    configblockDefaults();
+
+  configblock.block.imuCalibValid = 1;
+  memcpy(configblock.block.gyroBias, calib->gyroBias, sizeof(calib->gyroBias));
+  memcpy(configblock.block.accelBias, calib->accelBias, sizeof(calib->accelBias));
+  configblock.block.imuCalibTemperature = calib->temperature;
+
+  return configblockWrite();
+}
+
+bool configblockGetGyroTempModel(gyroTempModel_t * model)
+{
+  if (!cb_ok)
+    return false;
+
+  memcpy(model, &configblock.block.gyroTempModel, sizeof(*model));
+
+  return gyroTempModelBins(model) > 0;
+}
+
+bool configblockSetGyroTempModel(const gyroTempModel_t * model)
+{
+  if (!cb_ok)
+    configblockDefaults();
+
+  memcpy(&configblock.block.gyroTempModel, model, sizeof(*model));
+
+  return configblockWrite();
+}
+
+bool configblockGetMagCalib(magCalibResult_t * calib)
+{
+  if (!cb_ok || !(configblock.block.magCalib.radius > 0.0f))
+    return false;
+
+  memcpy(calib, &configblock.block.magCalib, sizeof(*calib));
+
+  return true;
+}
+
+bool configblockSetMagCalib(const magCalibResult_t * calib)
+{
+  if (!cb_ok)
+    configblockDefaults();
+
+  memcpy(&configblock.block.magCalib, calib, sizeof(*calib));
+
+  return configblockWrite();
+}
@@ -0,0 +1,66 @@
+/**
+ * initseq.c - Overlapped bring-up of the devices
+ */
+#include "main.h"
+#include "initseq.h"
+
+/* Ticks from a to b, negative when b is before a */
+static int32_t initSeqTicksTo(uint32_t a, uint32_t b)
+{
+  return (int32_t)(b - a);
+}
+
+uint32_t initSeqRun(initSeqDevice_t * devices, uint32_t count)
+{
+  uint32_t start = xTaskGetTickCount();
+  uint32_t remaining = count;
+  uint32_t i;
+
+  for (i=0; i<count; i++)
+  {
+    devices[i].nextStep = 0;
+    devices[i].due = devices[i].notBefore;
+    devices[i].isReady = 0;
+  }
+
+  while (remaining)
+  {
+    int32_t sleep = INT32_MAX;
+
+    for (i=0; i<count; i++)
+    {
+      initSeqDevice_t * dev = &devices[i];
+      int32_t wait;
+
+      if (dev->isReady)
+        continue;
+
+      wait = initSeqTicksTo(xTaskGetTickCount(), dev->due);
+      if (wait > 0)
+      {
+        if (wait < sleep)
+          sleep = wait;
+        continue;
+      }
+
+      wait = dev->step(dev->nextStep++);
+      if (wait == INIT_SEQ_DONE)
+      {
+        dev->isReady = 1;
+        dev->readyTick = xTaskGetTickCount();
+        remaining--;
+        BPRINTF("%s ready in %d ms\n", dev->name, (int)T2M(dev->readyTick - start));
+        continue;
+      }
+
+      //At least wait ms: the current tick is already partly gone
+      dev->due = xTaskGetTickCount() + (wait ? M2T(wait) + 1 : 0);
+      sleep = 0;
+    }
+
+    if (remaining && sleep > 0)
+      vTaskDelay(sleep);
+  }
+
+  return T2M(xTaskGetTickCount() - start);
+}
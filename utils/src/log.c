@@ -0,0 +1,705 @@
+/**
+ *    ||          ____  _ __
+ * +------+      / __ )(_) /_______________ _____  ___
+ * | 0xBC |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * +------+    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *  ||  ||    /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2011-2012 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * log.c - Dynamic log system
+ *
+ * Blocks are configured by the ground station over CRTP_PORT_LOG and are
+ * sampled from the stabilizer loop by logRunBlocks(). Blocks and operations
+ * come from static pools, so nothing is allocated while flying.
+ */
+#include <string.h>
+
+#include "main.h"
+#include "log.h"
+#include "crc.h"
+
+#define LOG_MAX_OPS     128
+#define LOG_MAX_BLOCKS  16
+
+/* Data packet: block id + 24bit timestamp + variables */
+#define LOG_HEADER_LEN  4
+#define LOG_MAX_LEN     (CRTP_MAX_DATA_SIZE - LOG_HEADER_LEN)
+
+/* Channels */
+#define TOC_CH      0
+#define CONTROL_CH  1
+#define LOG_CH      2
+
+/* Commands used when accessing the Table Of Content */
+#define CMD_GET_ITEM 0
+#define CMD_GET_INFO 1
+
+/* Commands used when controlling the log blocks */
+#define CONTROL_CREATE_BLOCK    0
+#define CONTROL_APPEND_BLOCK    1
+#define CONTROL_DELETE_BLOCK    2
+#define CONTROL_START_BLOCK     3   // period in 10ms unit, cfclient compatible
+#define CONTROL_STOP_BLOCK      4
+#define CONTROL_RESET           5
+#define CONTROL_START_BLOCK_MS  6   // 16bit period in ms (stabilizer ticks)
+
+/* Error codes returned to the ground, same values as errno */
+#define LOG_ENOENT  2
+#define LOG_E2BIG   7
+#define LOG_ENOMEM  12
+#define LOG_EEXIST  17
+#define LOG_EINVAL  22
+
+#define BLOCK_ID_FREE -1
+
+struct log_ops {
+  struct log_ops * next;
+  uint8_t storageType : 4;
+  uint8_t logType     : 4;
+  void * variable;
+};
+
+struct log_block {
+  int id;
+  volatile bool running;
+  uint16_t period;      // in stabilizer ticks
+  uint16_t countdown;
+  uint8_t  length;      // bytes of variable data in one packet
+  struct log_ops * ops;
+};
+
+struct ops_setting {
+  uint8_t logType;
+  uint8_t id;
+} __packed;
+
+static const uint8_t typeLength[] = {
+  [LOG_UINT8]  = 1,
+  [LOG_UINT16] = 2,
+  [LOG_UINT32] = 4,
+  [LOG_INT8]   = 1,
+  [LOG_INT16]  = 2,
+  [LOG_INT32]  = 4,
+  [LOG_FLOAT]  = 4,
+  [LOG_FP16]   = 2,
+};
+
+/* The log table of content, placed by the linker */
+#if defined(__ICCARM__)
+#pragma section = ".log"
+#else
+extern struct log_s _log_start;
+extern struct log_s _log_stop;
+#endif
+
+static struct log_s * logs;
+static int logsLen;
+static uint32_t logsCrc;
+static int logsCount = 0;
+
+static struct log_block logBlocks[LOG_MAX_BLOCKS];
+static struct log_ops logOps[LOG_MAX_OPS];
+static struct log_ops * opsFreeList;
+
+static CRTPPacket p;
+static bool isInit = false;
+
+STATIC_MEM_TASK_ALLOC(logTask, LOG_TASK_STACKSIZE);
+
+/* Statistics */
+static uint32_t logDroppedPacket;
+
+/* Private functions */
+static void logTask(void * prm);
+static void logTOCProcess(int command);
+static void logControlProcess(void);
+static int logCreateBlock(unsigned char id, struct ops_setting * settings, int len);
+static int logAppendBlock(int id, struct ops_setting * settings, int len);
+static int logDeleteBlock(int id);
+static int logStartBlock(int id, unsigned int period);
+static int logStopBlock(int id);
+static void logReset(void);
+static void logBlockSample(struct log_block * blk);
+static struct log_block * blockFind(int id);
+static struct log_ops * opsMalloc(void);
+static void opsFree(struct log_ops * ops);
+static int variableGetIndex(int id);
+static char * logGetGroupName(int index);
+
+/*****************************************************************
+ *@brief  find the log table of content and launch the log task
+ *@param  None
+ *@retval None
+ *****************************************************************/
+void logInit(void)
+{
+  int i;
+
+  if(isInit)
+    return;
+
+#if defined(__ICCARM__)
+  logs = (struct log_s *)__section_begin(".log");
+  logsLen = (struct log_s *)__section_end(".log") - logs;
+#else
+  logs = &_log_start;
+  logsLen = &_log_stop - &_log_start;
+#endif
+  logsCrc = crcSlow(logs, logsLen * sizeof(struct log_s));
+
+  // Big lookup loop
+  for (i=0; i<logsLen; i++)
+  {
+    if(!(logs[i].type & LOG_GROUP))
+      logsCount++;
+  }
+
+  //Build the free list of the operation pool
+  opsFreeList = NULL;
+  for (i=LOG_MAX_OPS-1; i>=0; i--)
+    opsFree(&logOps[i]);
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+  {
+    logBlocks[i].id = BLOCK_ID_FREE;
+    logBlocks[i].running = false;
+    logBlocks[i].ops = NULL;
+  }
+
+  //Start the log task
+  crtpInitTaskQueue(CRTP_PORT_LOG);
+  STATIC_MEM_TASK_CREATE(logTask, logTask, LOG_TASK_NAME,
+                         NULL, LOG_TASK_PRI);
+
+  isInit = true;
+}
+
+bool logTest(void)
+{
+  return isInit;
+}
+
+/*****************************************************************
+ *@brief  the log task, serves the TOC and the block configuration
+ *@param  *prm: not used
+ *@retval None
+ *****************************************************************/
+static void logTask(void * prm)
+{
+  while(1)
+  {
+    crtpReceivePacketBlock(CRTP_PORT_LOG, &p);
+
+    if (p.channel==TOC_CH)
+      logTOCProcess(p.data[0]);
+    if (p.channel==CONTROL_CH)
+      logControlProcess();
+  }
+}
+
+static void logTOCProcess(int command)
+{
+  int ptr = 0;
+  char * group = "plop";
+  int n=0;
+
+  switch (command)
+  {
+  case CMD_GET_INFO: //Get info packet about the log implementation
+    ptr = 0;
+    group = "";
+    p.header=CRTP_HEADER(CRTP_PORT_LOG, TOC_CH);
+    p.size=8;
+    p.data[0]=CMD_GET_INFO;
+    p.data[1]=logsCount;
+    memcpy(&p.data[2], &logsCrc, 4);
+    p.data[6]=LOG_MAX_BLOCKS;
+    p.data[7]=LOG_MAX_OPS;
+    crtpSendPacket(&p);
+    break;
+  case CMD_GET_ITEM:  //Get log variable
+    for (ptr=0; ptr<logsLen; ptr++) //Ptr points a group
+    {
+      if (logs[ptr].type & LOG_GROUP)
+      {
+        if (logs[ptr].type & LOG_START)
+          group = logs[ptr].name;
+      }
+      else                          //Ptr points a variable
+      {
+        if (n==p.data[1])
+          break;
+        n++;
+      }
+    }
+
+    if (ptr<logsLen && (3+2+strlen(group)+strlen(logs[ptr].name)) <= CRTP_MAX_DATA_SIZE)
+    {
+      p.header=CRTP_HEADER(CRTP_PORT_LOG, TOC_CH);
+      p.data[0]=CMD_GET_ITEM;
+      p.data[1]=n;
+      p.data[2]=logs[ptr].type;
+      p.size=3+2+strlen(group)+strlen(logs[ptr].name);
+      memcpy(p.data+3, group, strlen(group)+1);
+      memcpy(p.data+3+strlen(group)+1, logs[ptr].name, strlen(logs[ptr].name)+1);
+      crtpSendPacket(&p);
+    }
+    else
+    {
+      p.header=CRTP_HEADER(CRTP_PORT_LOG, TOC_CH);
+      p.data[0]=CMD_GET_ITEM;
+      p.size=1;
+      crtpSendPacket(&p);
+    }
+    break;
+  }
+}
+
+static void logControlProcess(void)
+{
+  int ret = LOG_ENOENT;
+
+  switch(p.data[0])
+  {
+    case CONTROL_CREATE_BLOCK:
+      //The command and the block id at least, the count below is unsigned
+      if (p.size < 2)
+      {
+        ret = LOG_EINVAL;
+        break;
+      }
+      ret = logCreateBlock( p.data[1],
+                            (struct ops_setting*)&p.data[2],
+                            (p.size-2)/sizeof(struct ops_setting) );
+      break;
+    case CONTROL_APPEND_BLOCK:
+      if (p.size < 2)
+      {
+        ret = LOG_EINVAL;
+        break;
+      }
+      ret = logAppendBlock( p.data[1],
+                            (struct ops_setting*)&p.data[2],
+                            (p.size-2)/sizeof(struct ops_setting) );
+      break;
+    case CONTROL_DELETE_BLOCK:
+      ret = logDeleteBlock( p.data[1] );
+      break;
+    case CONTROL_START_BLOCK:
+      ret = logStartBlock( p.data[1], p.data[2]*10);
+      break;
+    case CONTROL_START_BLOCK_MS:
+      ret = logStartBlock( p.data[1], p.data[2] | (p.data[3]<<8));
+      break;
+    case CONTROL_STOP_BLOCK:
+      ret = logStopBlock( p.data[1] );
+      break;
+    case CONTROL_RESET:
+      logReset();
+      ret = 0;
+      break;
+  }
+
+  //Commands answer
+  p.data[2] = ret;
+  p.size = 3;
+  crtpSendPacket(&p);
+}
+
+static int logCreateBlock(unsigned char id, struct ops_setting * settings, int len)
+{
+  int i;
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+    if (id == logBlocks[i].id) return LOG_EEXIST;
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+    if (logBlocks[i].id == BLOCK_ID_FREE) break;
+
+  if (i == LOG_MAX_BLOCKS)
+    return LOG_ENOMEM;
+
+  logBlocks[i].ops = NULL;
+  logBlocks[i].length = 0;
+  logBlocks[i].running = false;
+  logBlocks[i].id = id;
+
+  return logAppendBlock(id, settings, len);
+}
+
+static int logAppendBlock(int id, struct ops_setting * settings, int len)
+{
+  int i;
+  struct log_block * block;
+  struct log_ops * ops;
+  struct log_ops * tail;
+
+
+  block = blockFind(id);
+  if (!block)
+    return LOG_ENOENT;
+
+  for (i=0; i<len; i++)
+  {
+    int varId;
+    uint8_t logType = settings[i].logType & 0x0F;
+    uint8_t sendType = settings[i].logType >> 4;
+
+    //The upper nibble asks to send the variable as another type (ie. fp16)
+    if (sendType == 0)
+      sendType = logType;
+
+    if (logType < LOG_UINT8 || logType > LOG_FLOAT ||
+        sendType < LOG_UINT8 || sendType > LOG_FP16)
+      return LOG_EINVAL;
+
+    if ((block->length + typeLength[sendType]) > LOG_MAX_LEN)
+      return LOG_E2BIG;
+
+    varId = variableGetIndex(settings[i].id);
+    if (varId<0)
+      return LOG_ENOENT;
+
+    ops = opsMalloc();
+    if(!ops)
+      return LOG_ENOMEM;
+
+    ops->variable    = logs[varId].address;
+    ops->storageType = logs[varId].type;
+    ops->logType     = sendType;
+    ops->next        = NULL;
+
+    //The block may be running: link the fully built operation atomically
+    taskENTER_CRITICAL();
+    if (block->ops == NULL)
+    {
+      block->ops = ops;
+    }
+    else
+    {
+      for (tail = block->ops; tail->next; tail = tail->next);
+      tail->next = ops;
+    }
+    block->length += typeLength[sendType];
+    taskEXIT_CRITICAL();
+  }
+
+  return 0;
+}
+
+static int logDeleteBlock(int id)
+{
+  struct log_block * block;
+  struct log_ops * ops;
+  struct log_ops * next;
+
+  block = blockFind(id);
+  if (!block)
+    return LOG_ENOENT;
+
+  //Unhook the block from the sampler before releasing its operations
+  taskENTER_CRITICAL();
+  block->running = false;
+  ops = block->ops;
+  block->ops = NULL;
+  block->length = 0;
+  block->id = BLOCK_ID_FREE;
+  taskEXIT_CRITICAL();
+
+  while (ops)
+  {
+    next = ops->next;
+    opsFree(ops);
+    ops = next;
+  }
+
+  return 0;
+}
+
+static int logStartBlock(int id, unsigned int period)
+{
+  struct log_block * block;
+
+  block = blockFind(id);
+  if (!block)
+    return LOG_ENOENT;
+
+  //One stabilizer tick is the fastest the blocks can be sampled
+  period = period * RATE_MAIN_LOOP / 1000;
+  if (period == 0 || period > UINT16_MAX)
+    return LOG_EINVAL;
+
+
+  taskENTER_CRITICAL();
+  block->period = period;
+  block->countdown = 1;
+  block->running = true;
+  taskEXIT_CRITICAL();
+
+  return 0;
+}
+
+static int logStopBlock(int id)
+{
+  struct log_block * block;
+
+  block = blockFind(id);
+  if (!block)
+    return LOG_ENOENT;
+
+  block->running = false;
+
+  return 0;
+}
+
+static void logReset(void)
+{
+  int i;
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+  {
+    if (logBlocks[i].id != BLOCK_ID_FREE)
+      logDeleteBlock(logBlocks[i].id);
+  }
+}
+
+/*****************************************************************
+ *@brief  sample the started log blocks which period has elapsed
+ *@param  tick: the stabilizer tick counter
+ *@retval None
+ *@note   run from the stabilizer task, it must never block
+ *****************************************************************/
+void logRunBlocks(uint32_t tick)
+{
+  int i;
+
+  if (!isInit)
+    return;
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+  {
+    struct log_block * blk = &logBlocks[i];
+
+    if (!blk->running)
+      continue;
+
+    if (--blk->countdown)
+      continue;
+
+    blk->countdown = blk->period;
+    logBlockSample(blk);
+  }
+}
+
+static void logBlockSample(struct log_block * blk)
+{
+  struct log_ops * ops;
+  CRTPPacket pk;
+  int valuei = 0;
+  float valuef = 0;
+  uint16_t valueh;
+  uint8_t * ptr;
+  uint32_t timestamp;
+
+  timestamp = xTaskGetTickCount();
+
+  pk.header = CRTP_HEADER(CRTP_PORT_LOG, LOG_CH);
+  pk.data[0] = blk->id;
+  pk.data[1] = timestamp & 0x0ff;
+  pk.data[2] = (timestamp>>8) & 0x0ff;
+  pk.data[3] = (timestamp>>16) & 0x0ff;
+  ptr = &pk.data[LOG_HEADER_LEN];
+
+  for (ops = blk->ops; ops; ops = ops->next)
+  {
+    switch(ops->storageType)
+    {
+      case LOG_UINT8:  valuei = *(uint8_t *)ops->variable;  break;
+      case LOG_INT8:   valuei = *(int8_t *)ops->variable;   break;
+      case LOG_UINT16: valuei = *(uint16_t *)ops->variable; break;
+      case LOG_INT16:  valuei = *(int16_t *)ops->variable;  break;
+      case LOG_UINT32: valuei = *(uint32_t *)ops->variable; break;
+      case LOG_INT32:  valuei = *(int32_t *)ops->variable;  break;
+      case LOG_FLOAT:  valuef = *(float *)ops->variable;    break;
+    }
+
+    if (ops->storageType == LOG_FLOAT)
+    {
+      if (ops->logType == LOG_FLOAT)
+      {
+        memcpy(ptr, &valuef, 4);
+        ptr += 4;
+        continue;
+      }
+      if (ops->logType == LOG_FP16)
+      {
+        valueh = single2half(valuef);
+        memcpy(ptr, &valueh, 2);
+        ptr += 2;
+        continue;
+      }
+      valuei = (int)valuef;
+    }
+    else if (ops->logType == LOG_FLOAT || ops->logType == LOG_FP16)
+    {
+      valuef = (float)valuei;
+      if (ops->logType == LOG_FLOAT)
+      {
+        memcpy(ptr, &valuef, 4);
+        ptr += 4;
+      }
+      else
+      {
+        valueh = single2half(valuef);
+        memcpy(ptr, &valueh, 2);
+        ptr += 2;
+      }
+      continue;
+    }
+
+    //Little endian: the low bytes of valuei are the truncated value
+    memcpy(ptr, &valuei, typeLength[ops->logType]);
+    ptr += typeLength[ops->logType];
+  }
+
+  pk.size = ptr - pk.data;
+  if (crtpSendPacket(&pk) != pdTRUE)
+    logDroppedPacket++;
+}
+
+static struct log_block * blockFind(int id)
+{
+  int i;
+
+  for (i=0; i<LOG_MAX_BLOCKS; i++)
+  {
+    if (logBlocks[i].id == id)
+      return &logBlocks[i];
+  }
+
+  return NULL;
+}
+
+static struct log_ops * opsMalloc(void)
+{
+  struct log_ops * ops;
+
+  taskENTER_CRITICAL();
+  ops = opsFreeList;
+  if (ops)
+    opsFreeList = ops->next;
+  taskEXIT_CRITICAL();
+
+  return ops;
+}
+
+static void opsFree(struct log_ops * ops)
+{
+  taskENTER_CRITICAL();
+  ops->variable = NULL;
+  ops->next = opsFreeList;
+  opsFreeList = ops;
+  taskEXIT_CRITICAL();
+}
+
+/* Return the index in logs[] of the variable number 'id' */
+static int variableGetIndex(int id)
+{
+  int i;
+  int n=0;
+
+  for (i=0; i<logsLen; i++)
+  {
+    if(!(logs[i].type & LOG_GROUP))
+    {
+      if(n==id)
+        break;
+      n++;
+    }
+  }
+
+  if (i>=logsLen)
+    return -1;
+
+  return i;
+}
+
+static char * logGetGroupName(int index)
+{
+  int i;
+
+  for (i=index; i>=0; i--)
+  {
+    if ((logs[i].type & LOG_GROUP) && (logs[i].type & LOG_START))
+      return logs[i].name;
+  }
+
+  return "";
+}
+
+/* Public API to access log TOC from within the copter */
+int logGetVarId(char* group, char* name)
+{
+  int i;
+
+  for(i=0; i<logsLen; i++)
+  {
+    if (logs[i].type & LOG_GROUP)
+      continue;
+
+    if (!strcmp(group, logGetGroupName(i)) && !strcmp(name, logs[i].name))
+      return i;
+  }
+
+  return -1;
+}
+
+int logGetInt(int varid)
+{
+  int valuei = 0;
+
+  configASSERT(varid >= 0);
+
+  switch(logs[varid].type)
+  {
+    case LOG_UINT8:  valuei = *(uint8_t *)logs[varid].address;  break;
+    case LOG_INT8:   valuei = *(int8_t *)logs[varid].address;   break;
+    case LOG_UINT16: valuei = *(uint16_t *)logs[varid].address; break;
+    case LOG_INT16:  valuei = *(int16_t *)logs[varid].address;  break;
+    case LOG_UINT32: valuei = *(uint32_t *)logs[varid].address; break;
+    case LOG_INT32:  valuei = *(int32_t *)logs[varid].address;  break;
+    case LOG_FLOAT:  valuei = *(float *)logs[varid].address;    break;
+  }
+
+  return valuei;
+}
+
+float logGetFloat(int varid)
+{
+  configASSERT(varid >= 0);
+
+  if (logs[varid].type == LOG_FLOAT)
+    return *(float *)logs[varid].address;
+
+  return logGetInt(varid);
+}
+
+unsigned int logGetUint(int varid)
+{
+  return (unsigned int)logGetInt(varid);
+}
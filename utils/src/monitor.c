@@ -0,0 +1,218 @@
+/**
+ * monitor.c - Per task CPU load and stack high-water telemetry
+ *
+ * The run time counters are matched to the previous period by task number:
+ * uxTaskGetSystemState() lists the tasks in state order, not creation order.
+ */
+#include <string.h>
+
+#include "main.h"
+#include "monitor.h"
+
+static bool isInit = false;
+
+/* Parameters */
+static uint8_t enable = 1;
+static uint16_t period = MONITOR_PERIOD_MS;
+
+/* Static: 36 bytes per task, too much for the stack of the task */
+static TaskStatus_t status[MONITOR_MAX_TASKS];
+static monitorTask_t tasks[MONITOR_MAX_TASKS];
+static monitorSystem_t sys;
+
+/* Counters of the previous period */
+static UBaseType_t lastNumber[MONITOR_MAX_TASKS];
+static uint32_t lastRunTime[MONITOR_MAX_TASKS];
+static uint32_t lastCount;
+static uint32_t lastTotal;
+
+/* Log variables */
+static uint16_t stackMin;         // Smallest high-water of all the tasks, words
+static uint8_t stackMinTask;      // Its task number
+static uint32_t dropped;          // Records not queued, CRTP TX queue full
+static uint32_t overflows;        // Periods with more than MONITOR_MAX_TASKS tasks
+
+STATIC_MEM_TASK_ALLOC(monitorTask, MONITOR_TASK_STACKSIZE);
+
+static void monitorTask(void * prm);
+
+/*****************************************************************
+ *@brief  start the DWT cycle counter, the run time stats clock
+ *@param  None
+ *@retval None
+ *****************************************************************/
+void monitorTimerInit(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void monitorInit(void)
+{
+  if (isInit)
+    return;
+
+  STATIC_MEM_TASK_CREATE(monitorTask, monitorTask, MONITOR_TASK_NAME,
+                         NULL, MONITOR_TASK_PRI);
+
+  isInit = true;
+}
+
+bool monitorTest(void)
+{
+  return isInit;
+}
+
+/* Cycles run by a task since the previous period, 0 for a new task */
+static uint32_t monitorRunTime(const TaskStatus_t * task)
+{
+  uint32_t i;
+
+  for (i=0; i<lastCount; i++)
+    if (lastNumber[i] == task->xTaskNumber)
+      return task->ulRunTimeCounter - lastRunTime[i];
+
+  return 0;
+}
+
+/*****************************************************************
+ *@brief  read the task counters, fill the records of the period
+ *@param  None
+ *@retval false if there are more tasks than MONITOR_MAX_TASKS
+ *****************************************************************/
+static bool monitorSample(void)
+{
+  TaskHandle_t idle = xTaskGetIdleTaskHandle();
+  tlsfStats_t mem;
+  uint32_t count;
+  uint32_t total;
+  uint32_t elapsed;
+  uint32_t i;
+
+  //0 when the array is too small
+  count = uxTaskGetSystemState(status, MONITOR_MAX_TASKS, &total);
+  if (count == 0)
+  {
+    overflows++;
+    return false;
+  }
+
+  elapsed = total - lastTotal;
+  sys.seq++;
+  sys.cpuLoad = 1000;
+  sys.taskCount = count;
+  stackMin = 0xFFFF;
+
+  for (i=0; i<count; i++)
+  {
+    monitorTask_t * task = &tasks[i];
+
+    task->seq = sys.seq;
+    task->index = i;
+    task->number = status[i].xTaskNumber;
+    task->state = status[i].eCurrentState;
+    task->priority = status[i].uxCurrentPriority;
+    task->cpu = monitorPermille(monitorRunTime(&status[i]), elapsed);
+    task->stackFree = status[i].usStackHighWaterMark;
+    strncpy(task->name, status[i].pcTaskName, MONITOR_NAME_LEN);
+    task->name[MONITOR_NAME_LEN] = '\0';
+
+    if (status[i].xHandle == idle)
+      sys.cpuLoad = 1000 - task->cpu;
+    if (task->stackFree < stackMin)
+    {
+      stackMin = task->stackFree;
+      stackMinTask = task->number;
+    }
+  }
+
+  for (i=0; i<count; i++)
+  {
+    lastNumber[i] = status[i].xTaskNumber;
+    lastRunTime[i] = status[i].ulRunTimeCounter;
+  }
+  lastCount = count;
+  lastTotal = total;
+
+  sys.heapFree = xPortGetFreeHeapSize();
+  sys.heapMinFree = xPortGetMinimumEverFreeHeapSize();
+  mem_stats(SRAMIN, &mem);
+  sys.memFree = mem.free;
+  sys.memLargest = mem.largestFree;
+  sys.memFragmentation = mem.fragmentation;
+  sys.memFailures = mem.failures > 0xFFFF ? 0xFFFF : mem.failures;
+  sys.periodMs = period;
+
+  return true;
+}
+
+/* The system record then the task records, stops at the first full queue */
+static void monitorSend(void)
+{
+  CRTPPacket p;
+  uint32_t i;
+
+  p.header = CRTP_HEADER(CRTP_PORT_MONITOR, MONITOR_CH_SYSTEM);
+  p.size = monitorEncodeSystem(p.data, &sys);
+  if (crtpSendPacket(&p) != pdTRUE)
+  {
+    dropped++;
+    return;
+  }
+
+  for (i=0; i<sys.taskCount; i++)
+  {
+    p.header = CRTP_HEADER(CRTP_PORT_MONITOR, MONITOR_CH_TASK);
+    p.size = monitorEncodeTask(p.data, &tasks[i]);
+    if (crtpSendPacket(&p) != pdTRUE)
+    {
+      dropped++;
+      return;
+    }
+  }
+}
+
+/*****************************************************************
+ *@brief  sample the tasks every period, send the records
+ *@param  *prm: not used
+ *@retval None
+ *****************************************************************/
+static void monitorTask(void * prm)
+{
+  TickType_t lastWakeTime;
+
+  systemWaitStart();
+
+  //First period: only the reference counters
+  monitorSample();
+  lastWakeTime = xTaskGetTickCount();
+
+  while(1)
+  {
+    if (period < MONITOR_MIN_PERIOD_MS)
+      period = MONITOR_MIN_PERIOD_MS;
+    if (period > 10 * MONITOR_PERIOD_MS)
+      period = 10 * MONITOR_PERIOD_MS;
+    vTaskDelayUntil(&lastWakeTime, M2T(period));
+
+    if (monitorSample() && enable)
+      monitorSend();
+  }
+}
+
+PARAM_GROUP_START(monitor)
+PARAM_ADD(PARAM_UINT8, enable, &enable)
+PARAM_ADD(PARAM_UINT16, period, &period)
+PARAM_GROUP_STOP(monitor)
+
+LOG_GROUP_START(monitor)
+LOG_ADD(LOG_UINT16, cpuLoad, &sys.cpuLoad)
+LOG_ADD(LOG_UINT32, heapFree, &sys.heapFree)
+LOG_ADD(LOG_UINT32, heapMin, &sys.heapMinFree)
+LOG_ADD(LOG_UINT32, memFree, &sys.memFree)
+LOG_ADD(LOG_UINT8, memFrag, &sys.memFragmentation)
+LOG_ADD(LOG_UINT16, stackMin, &stackMin)
+LOG_ADD(LOG_UINT8, stackMinId, &stackMinTask)
+LOG_ADD(LOG_UINT32, dropped, &dropped)
+LOG_ADD(LOG_UINT32, overflows, &overflows)
+LOG_GROUP_STOP(monitor)
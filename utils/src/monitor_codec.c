@@ -0,0 +1,124 @@
+/**
+ * monitor_codec.c - Records of the task monitor on CRTP_PORT_MONITOR
+ *
+ * Has no dependency on the RTOS or the hardware: it is also built in the
+ * host viewer (Tools/monitor).
+ */
+#include <string.h>
+
+#include "monitor_codec.h"
+
+#define SYSTEM_RECORD_SIZE  26
+#define TASK_RECORD_SIZE    (10 + MONITOR_NAME_LEN)
+
+static uint8_t * put16(uint8_t * p, uint16_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  return p + 2;
+}
+
+static uint8_t * put32(uint8_t * p, uint32_t v)
+{
+  p = put16(p, (uint16_t)v);
+  return put16(p, (uint16_t)(v >> 16));
+}
+
+static uint16_t get16(const uint8_t * p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t * p)
+{
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+uint16_t monitorPermille(uint32_t part, uint32_t total)
+{
+  uint32_t permille;
+
+  if (total == 0)
+    return 0;
+
+  //part * 1000 overflows 32 bits after 4.3M cycles, 25ms at 168MHz
+  permille = (uint32_t)(((uint64_t)part * 1000 + total / 2) / total);
+
+  return permille > 1000 ? 1000 : (uint16_t)permille;
+}
+
+uint32_t monitorEncodeSystem(uint8_t * out, const monitorSystem_t * sys)
+{
+  uint8_t * p = out;
+
+  p = put16(p, sys->seq);
+  p = put16(p, sys->cpuLoad);
+  *p++ = sys->taskCount;
+  p = put32(p, sys->heapFree);
+  p = put32(p, sys->heapMinFree);
+  p = put32(p, sys->memFree);
+  p = put32(p, sys->memLargest);
+  *p++ = sys->memFragmentation;
+  p = put16(p, sys->memFailures);
+  p = put16(p, sys->periodMs);
+
+  return (uint32_t)(p - out);
+}
+
+uint32_t monitorEncodeTask(uint8_t * out, const monitorTask_t * task)
+{
+  uint8_t * p = out;
+  uint32_t i;
+
+  p = put16(p, task->seq);
+  *p++ = task->index;
+  *p++ = task->number;
+  *p++ = task->state;
+  *p++ = task->priority;
+  p = put16(p, task->cpu);
+  p = put16(p, task->stackFree);
+  //Zero padded, not terminated when 10 chars long
+  for (i=0; i<MONITOR_NAME_LEN && task->name[i]; i++)
+    *p++ = task->name[i];
+  for (; i<MONITOR_NAME_LEN; i++)
+    *p++ = 0;
+
+  return (uint32_t)(p - out);
+}
+
+bool monitorDecodeSystem(const uint8_t * in, uint32_t len, monitorSystem_t * sys)
+{
+  if (len < SYSTEM_RECORD_SIZE)
+    return false;
+
+  sys->seq = get16(in);
+  sys->cpuLoad = get16(in + 2);
+  sys->taskCount = in[4];
+  sys->heapFree = get32(in + 5);
+  sys->heapMinFree = get32(in + 9);
+  sys->memFree = get32(in + 13);
+  sys->memLargest = get32(in + 17);
+  sys->memFragmentation = in[21];
+  sys->memFailures = get16(in + 22);
+  sys->periodMs = get16(in + 24);
+
+  return true;
+}
+
+bool monitorDecodeTask(const uint8_t * in, uint32_t len, monitorTask_t * task)
+{
+  if (len < TASK_RECORD_SIZE)
+    return false;
+
+  task->seq = get16(in);
+  task->index = in[2];
+  task->number = in[3];
+  task->state = in[4];
+  task->priority = in[5];
+  task->cpu = get16(in + 6);
+  task->stackFree = get16(in + 8);
+  memcpy(task->name, in + 10, MONITOR_NAME_LEN);
+  task->name[MONITOR_NAME_LEN] = '\0';
+
+  return true;
+}
@@ -0,0 +1,497 @@
+/**
+ *    ||          ____  _ __
+ * +------+      / __ )(_) /_______________ _____  ___
+ * | 0xBC |     / __  / / __/ ___/ ___/ __ `/_  / / _ \
+ * +------+    / /_/ / / /_/ /__/ /  / /_/ / / /_/  __/
+ *  ||  ||    /_____/_/\__/\___/_/   \__,_/ /___/\___/
+ *
+ * Crazyflie control firmware
+ *
+ * Copyright (C) 2011-2012 Bitcraze AB
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, in version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * param.c - Crazy parameter system source file.
+ *
+ * Every variable gets a 16bit id hashed from "group.name", so the id of a
+ * parameter does not move when another one is added. The ids are resolved
+ * through an open addressing table built at init. Writes are not applied by
+ * the param task: they are queued and paramApplyPending() copies them from
+ * the stabilizer loop.
+ */
+#include <string.h>
+
+#include "main.h"
+#include "param.h"
+#include "crc.h"
+
+#define PARAM_MAX_VARS           128
+#define PARAM_HASH_SIZE          256    // Power of two, at least twice PARAM_MAX_VARS
+#define PARAM_UPDATE_QUEUE_SIZE  32
+
+#define PARAM_ID_INVALID  0xFFFF
+
+/* Channels */
+#define TOC_CH   0
+#define READ_CH  1
+#define WRITE_CH 2
+#define MISC_CH  3
+
+/* Commands used when accessing the Table Of Content */
+#define CMD_GET_ITEM 0
+#define CMD_GET_INFO 1
+
+/* Misc commands */
+#define MISC_HOLD    0    // Queue the following writes without applying them
+#define MISC_COMMIT  1    // Apply every queued write in the same control loop
+
+/* Error codes returned to the ground, same values as errno */
+#define PARAM_ENOENT  2
+#define PARAM_EACCES  13
+#define PARAM_EBUSY   16
+#define PARAM_EINVAL  22
+
+struct param_update {
+  uint16_t index;
+  uint8_t  value[4];
+};
+
+static const uint8_t paramTypeLength[] = { 1, 2, 4, 8 };
+
+/* The param table of content, placed by the linker */
+#if defined(__ICCARM__)
+#pragma section = ".param"
+#else
+extern struct param_s _param_start;
+extern struct param_s _param_stop;
+#endif
+
+static struct param_s * params;
+static int paramsLen;
+static uint32_t paramsCrc;
+static int paramsCount = 0;
+
+/* Variable number -> index in params[] and its hashed id */
+static uint16_t paramIndex[PARAM_MAX_VARS];
+static uint16_t paramIds[PARAM_MAX_VARS];
+/* Hash slot -> variable number + 1, 0 when empty */
+static uint8_t paramHashTable[PARAM_HASH_SIZE];
+
+static xQueueHandle updateQueue;
+STATIC_MEM_QUEUE_ALLOC(updateQueue, PARAM_UPDATE_QUEUE_SIZE, sizeof(struct param_update));
+static volatile uint8_t paramHoldCount;   // Holds not released yet, they nest
+static bool isGroundHold;                 // MISC_HOLD open, one hold whatever the repeats
+
+static CRTPPacket p;
+static bool isInit = false;
+
+STATIC_MEM_TASK_ALLOC(paramTask, PARAM_TASK_STACKSIZE);
+
+/* Private functions */
+static void paramTask(void * prm);
+static void paramTOCProcess(int command);
+static void paramReadProcess(uint16_t id);
+static void paramWriteProcess(uint16_t id, void* valptr);
+static void paramMiscProcess(int command);
+static uint16_t paramHash(char * group, char * name);
+static int paramFindVar(uint16_t id);
+static char * paramGetGroupName(int index);
+
+/*****************************************************************
+ *@brief  FNV-1a of "group.name" folded to 16bit
+ *@param  group: the group name
+ *@param  name: the variable name
+ *@retval the 16bit hash
+ *****************************************************************/
+static uint16_t paramHash(char * group, char * name)
+{
+  uint32_t h = 2166136261u;
+
+  while (*group)
+    h = (h ^ (uint8_t)*group++) * 16777619u;
+  h = (h ^ '.') * 16777619u;
+  while (*name)
+    h = (h ^ (uint8_t)*name++) * 16777619u;
+
+  return (uint16_t)((h >> 16) ^ h);
+}
+
+/*****************************************************************
+ *@brief  find the variable number of a hashed id
+ *@param  id: the 16bit id
+ *@retval the variable number or -1 if the id is unknown
+ *****************************************************************/
+static int paramFindVar(uint16_t id)
+{
+  unsigned int slot = id & (PARAM_HASH_SIZE-1);
+  int n;
+
+  while (paramHashTable[slot])
+  {
+    n = paramHashTable[slot] - 1;
+    if (paramIds[n] == id)
+      return n;
+    slot = (slot + 1) & (PARAM_HASH_SIZE-1);
+  }
+
+  return -1;
+}
+
+/*****************************************************************
+ *@brief  build the id table and launch the param task
+ *@param  None
+ *@retval None
+ *****************************************************************/
+void paramInit(void)
+{
+  int i;
+  char * group = "";
+  uint16_t id;
+  unsigned int slot;
+
+  if(isInit)
+    return;
+
+#if defined(__ICCARM__)
+  params = (struct param_s *)__section_begin(".param");
+  paramsLen = (struct param_s *)__section_end(".param") - params;
+#else
+  params = &_param_start;
+  paramsLen = &_param_stop - &_param_start;
+#endif
+  paramsCrc = crcSlow(params, paramsLen * sizeof(struct param_s));
+
+  for (i=0; i<paramsLen; i++)
+  {
+    if (params[i].type & PARAM_GROUP)
+    {
+      if (params[i].type & PARAM_START)
+        group = params[i].name;
+      continue;
+    }
+
+    configASSERT(paramsCount < PARAM_MAX_VARS);
+
+    //Two names folding to the same id: the later one takes the next free id.
+    //The ground reads the ids from the TOC so this stays consistent.
+    id = paramHash(group, params[i].name);
+    while (id == PARAM_ID_INVALID || paramFindVar(id) >= 0)
+      id++;
+
+    slot = id & (PARAM_HASH_SIZE-1);
+    while (paramHashTable[slot])
+      slot = (slot + 1) & (PARAM_HASH_SIZE-1);
+
+    paramIndex[paramsCount] = i;
+    paramIds[paramsCount] = id;
+    paramHashTable[slot] = paramsCount + 1;
+    paramsCount++;
+  }
+
+  updateQueue = STATIC_MEM_QUEUE_CREATE(updateQueue);
+
+  //Start the param task
+  crtpInitTaskQueue(CRTP_PORT_PARAM);
+  STATIC_MEM_TASK_CREATE(paramTask, paramTask, PARAM_TASK_NAME,
+                         NULL, PARAM_TASK_PRI);
+
+  isInit = true;
+}
+
+bool paramTest(void)
+{
+  return isInit;
+}
+
+/*****************************************************************
+ *@brief  the param task, serves the TOC, reads and writes
+ *@param  *prm: not used
+ *@retval None
+ *****************************************************************/
+static void paramTask(void * prm)
+{
+  uint16_t id;
+
+  while(1)
+  {
+    crtpReceivePacketBlock(CRTP_PORT_PARAM, &p);
+
+    id = p.data[0] | (p.data[1] << 8);
+
+    if (p.channel==TOC_CH)
+      paramTOCProcess(p.data[0]);
+    else if (p.channel==READ_CH)
+      paramReadProcess(id);
+    else if (p.channel==WRITE_CH)
+      paramWriteProcess(id, &p.data[2]);
+    else if (p.channel==MISC_CH)
+      paramMiscProcess(p.data[0]);
+  }
+}
+
+static void paramTOCProcess(int command)
+{
+  int n;
+  int index;
+  char * group;
+
+  switch (command)
+  {
+  case CMD_GET_INFO: //Get info packet about the param implementation
+    p.header=CRTP_HEADER(CRTP_PORT_PARAM, TOC_CH);
+    p.size=7;
+    p.data[0]=CMD_GET_INFO;
+    p.data[1]=paramsCount & 0xFF;
+    p.data[2]=paramsCount >> 8;
+    memcpy(&p.data[3], &paramsCrc, 4);
+    crtpSendPacket(&p);
+    break;
+  case CMD_GET_ITEM:  //Get param variable by its position in the TOC
+    n = p.data[1] | (p.data[2] << 8);
+    p.header=CRTP_HEADER(CRTP_PORT_PARAM, TOC_CH);
+    p.data[0]=CMD_GET_ITEM;
+
+    if (n < paramsCount)
+    {
+      index = paramIndex[n];
+      group = paramGetGroupName(index);
+
+      if ((6+2+strlen(group)+strlen(params[index].name)) <= CRTP_MAX_DATA_SIZE)
+      {
+        p.data[3]=paramIds[n] & 0xFF;
+        p.data[4]=paramIds[n] >> 8;
+        p.data[5]=params[index].type;
+        p.size=6+2+strlen(group)+strlen(params[index].name);
+        memcpy(p.data+6, group, strlen(group)+1);
+        memcpy(p.data+6+strlen(group)+1, params[index].name, strlen(params[index].name)+1);
+        crtpSendPacket(&p);
+        break;
+      }
+    }
+
+    p.size=3;
+    crtpSendPacket(&p);
+    break;
+  }
+}
+
+static void paramReadProcess(uint16_t id)
+{
+  int n = paramFindVar(id);
+  int len;
+
+  p.data[0] = id & 0xFF;
+  p.data[1] = id >> 8;
+
+  if (n < 0)
+  {
+    p.data[2] = PARAM_ENOENT;
+    p.size = 3;
+    crtpSendPacket(&p);
+    return;
+  }
+
+  len = paramTypeLength[params[paramIndex[n]].type & PARAM_BYTES_MASK];
+  p.data[2] = 0;
+  memcpy(&p.data[3], params[paramIndex[n]].address, len);
+  p.size = 3 + len;
+
+  crtpSendPacket(&p);
+}
+
+static void paramWriteProcess(uint16_t id, void* valptr)
+{
+  int n = paramFindVar(id);
+  int len;
+
+  if (n < 0)
+  {
+    p.data[2] = PARAM_ENOENT;
+    p.size = 3;
+  }
+  else if (params[paramIndex[n]].type & PARAM_RONLY)
+  {
+    p.data[2] = PARAM_EACCES;
+    p.size = 3;
+  }
+  else
+  {
+    len = paramTypeLength[params[paramIndex[n]].type & PARAM_BYTES_MASK];
+    if (len > 4 || p.size < 2 + len)
+    {
+      p.data[2] = PARAM_EINVAL;
+      p.size = 3;
+    }
+    else
+    {
+      //Echo the accepted value after the status byte
+      memmove(&p.data[3], valptr, len);
+      p.data[2] = paramSetValue(id, &p.data[3]) ? 0 : PARAM_EBUSY;
+      p.size = 3 + len;
+    }
+  }
+
+  crtpSendPacket(&p);
+}
+
+static void paramMiscProcess(int command)
+{
+  switch (command)
+  {
+  case MISC_HOLD:
+    if (!isGroundHold)
+    {
+      isGroundHold = true;
+      paramSetHold(true);
+    }
+    break;
+  case MISC_COMMIT:
+    if (isGroundHold)
+    {
+      isGroundHold = false;
+      paramSetHold(false);
+    }
+    break;
+  default:
+    return;
+  }
+
+  p.size = 1;
+  crtpSendPacket(&p);
+}
+
+/*****************************************************************
+ *@brief  apply the queued parameter writes
+ *@param  None
+ *@retval None
+ *@note   run from the stabilizer task between two control loops
+ *****************************************************************/
+void paramApplyPending(void)
+{
+  struct param_update update;
+  const struct param_s * param;
+
+  if (!isInit || paramHoldCount > 0)
+    return;
+
+  while (xQueueReceive(updateQueue, &update, 0) == pdTRUE)
+  {
+    param = &params[update.index];
+    memcpy(param->address, update.value,
+           paramTypeLength[param->type & PARAM_BYTES_MASK]);
+  }
+}
+
+void paramSetHold(bool hold)
+{
+  taskENTER_CRITICAL();
+  if (hold)
+  {
+    configASSERT(paramHoldCount < UINT8_MAX);
+    paramHoldCount++;
+  }
+  else if (paramHoldCount > 0)
+  {
+    paramHoldCount--;
+  }
+  taskEXIT_CRITICAL();
+}
+
+static char * paramGetGroupName(int index)
+{
+  int i;
+
+  for (i=index; i>=0; i--)
+  {
+    if ((params[i].type & PARAM_GROUP) && (params[i].type & PARAM_START))
+      return params[i].name;
+  }
+
+  return "";
+}
+
+/* Public API to access param TOC from within the copter */
+int paramGetVarId(char* group, char* name)
+{
+  int n;
+
+  for (n=0; n<paramsCount; n++)
+  {
+    if (!strcmp(group, paramGetGroupName(paramIndex[n])) &&
+        !strcmp(name, params[paramIndex[n]].name))
+      return paramIds[n];
+  }
+
+  return -1;
+}
+
+/*****************************************************************
+ *@brief  queue a write, applied at the next paramApplyPending()
+ *@param  varid: the 16bit id of the parameter
+ *@param  *value: the new value, in the parameter type
+ *@retval true if the write has been queued
+ *****************************************************************/
+bool paramSetValue(int varid, const void * value)
+{
+  struct param_update update;
+  int n = paramFindVar(varid);
+
+  if (n < 0)
+    return false;
+
+  update.index = paramIndex[n];
+  memcpy(update.value, value,
+         paramTypeLength[params[update.index].type & PARAM_BYTES_MASK]);
+
+  return xQueueSend(updateQueue, &update, 0) == pdTRUE;
+}
+
+int paramGetInt(int varid)
+{
+  int valuei = 0;
+  int n = paramFindVar(varid);
+  struct param_s * param;
+
+  configASSERT(n >= 0);
+  param = &params[paramIndex[n]];
+
+  switch(param->type & ~PARAM_RONLY)
+  {
+    case PARAM_UINT8:  valuei = *(uint8_t *)param->address;  break;
+    case PARAM_INT8:   valuei = *(int8_t *)param->address;   break;
+    case PARAM_UINT16: valuei = *(uint16_t *)param->address; break;
+    case PARAM_INT16:  valuei = *(int16_t *)param->address;  break;
+    case PARAM_UINT32: valuei = *(uint32_t *)param->address; break;
+    case PARAM_INT32:  valuei = *(int32_t *)param->address;  break;
+    case PARAM_FLOAT:  valuei = *(float *)param->address;    break;
+  }
+
+  return valuei;
+}
+
+float paramGetFloat(int varid)
+{
+  int n = paramFindVar(varid);
+
+  configASSERT(n >= 0);
+
+  if ((params[paramIndex[n]].type & ~PARAM_RONLY) == PARAM_FLOAT)
+    return *(float *)params[paramIndex[n]].address;
+
+  return paramGetInt(varid);
+}
+
+unsigned int paramGetUint(int varid)
+{
+  return (unsigned int)paramGetInt(varid);
+}
@@ -0,0 +1,346 @@
+/**
+ * trace.c - Context switch, interrupt and queue trace recorder
+ *
+ * The ring is written by the kernel hooks, in any task or interrupt, with
+ * the interrupts masked. The dump pauses the recording and reads it from
+ * the trace task (CRTP, UART) or the blackbox task (SD).
+ */
+#include <string.h>
+
+#include "main.h"
+#include "trace.h"
+
+#ifdef TRACE_RECORDER
+
+#define RING_MASK   (TRACE_BUFFER_EVENTS - 1)
+
+static bool isInit = false;
+
+static traceEvent_t ring[TRACE_BUFFER_EVENTS];
+static uint32_t ringHead;           // Next event written
+static uint32_t ringCount;
+static uint32_t lost;
+
+/* Names of the dumps */
+static char taskNames[TRACE_MAX_TASKS][TRACE_NAME_LEN];
+static const char * queueNames[TRACE_MAX_QUEUES];
+static uint8_t queueTypes[TRACE_MAX_QUEUES];
+static uint8_t queueCount;          // Queue numbers 1 to queueCount
+
+/* Parameters */
+static uint8_t enable = 1;
+static uint8_t oneShot = 0;
+static uint8_t dump = TRACE_DUMP_NONE;
+
+STATIC_MEM_TASK_ALLOC(traceTask, TRACE_TASK_STACKSIZE);
+
+static void traceTask(void * prm);
+
+void traceInit(void)
+{
+  if (isInit)
+    return;
+
+  STATIC_MEM_TASK_CREATE(traceTask, traceTask, TRACE_TASK_NAME,
+                         NULL, TRACE_TASK_PRI);
+
+  isInit = true;
+}
+
+bool traceTest(void)
+{
+  return isInit;
+}
+
+/*****************************************************************
+ *@brief  append an event to the ring
+ *@param  type: TRACE_EV_xxx
+ *@param  id: the task, queue or exception number
+ *@param  arg: the argument of the event type
+ *@retval None
+ *@note   callable from any context, kernel hooks included
+ *****************************************************************/
+void traceRecord(uint8_t type, uint8_t id, uint16_t arg)
+{
+  traceEvent_t * ev;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (!enable)
+  {
+    __set_PRIMASK(primask);
+    return;
+  }
+
+  if (ringCount == TRACE_BUFFER_EVENTS)
+  {
+    lost++;
+    if (oneShot)
+    {
+      __set_PRIMASK(primask);
+      return;
+    }
+  }
+  else
+    ringCount++;
+
+  ev = &ring[ringHead];
+  ringHead = (ringHead + 1) & RING_MASK;
+  ev->time = DWT->CYCCNT;
+  ev->type = type;
+  ev->id = id;
+  ev->arg = arg;
+
+  __set_PRIMASK(primask);
+}
+
+void traceIsrEnter(void)
+{
+  traceRecord(TRACE_EV_ISR_ENTER, (uint8_t)__get_IPSR(), 0);
+}
+
+void traceIsrExit(void)
+{
+  traceRecord(TRACE_EV_ISR_EXIT, (uint8_t)__get_IPSR(), 0);
+}
+
+void traceMark(uint8_t id, uint16_t arg)
+{
+  traceRecord(TRACE_EV_MARK, id, arg);
+}
+
+void traceTaskCreate(uint8_t number, const char * name, uint16_t priority)
+{
+  if (number < TRACE_MAX_TASKS)
+    strncpy(taskNames[number], name, TRACE_NAME_LEN);
+
+  traceRecord(TRACE_EV_TASK_CREATE, number, priority);
+}
+
+uint8_t traceQueueCreate(uint8_t type)
+{
+  uint8_t number = ++queueCount;
+
+  if (number < TRACE_MAX_QUEUES)
+    queueTypes[number] = type;
+
+  traceRecord(TRACE_EV_QUEUE_CREATE, number, type);
+
+  return number;
+}
+
+void * traceQueueNamed(void * queue, const char * name)
+{
+  UBaseType_t number;
+
+  if (queue)
+  {
+    number = uxQueueGetQueueNumber(queue);
+    if (number < TRACE_MAX_QUEUES)
+      queueNames[number] = name;
+  }
+
+  return queue;
+}
+
+uint8_t traceDumpRequest(void)
+{
+  return dump;
+}
+
+void traceDumpDone(void)
+{
+  dump = TRACE_DUMP_NONE;
+}
+
+static bool traceDumpName(traceSink_t sink, void * ctx, uint8_t id, uint8_t kind,
+                          uint8_t type, const char * name)
+{
+  traceName_t n;
+
+  memset(&n, 0, sizeof(n));
+  n.id = id;
+  n.kind = kind;
+  n.type = type;
+  if (name)
+    strncpy(n.name, name, TRACE_NAME_LEN);
+
+  return sink(ctx, &n, sizeof(n));
+}
+
+uint32_t traceDump(traceSink_t sink, void * ctx)
+{
+  traceHeader_t header;
+  uint8_t wasEnabled = enable;
+  uint32_t start;
+  uint32_t first;
+  uint32_t bytes = 0;
+  uint32_t i;
+  bool ok;
+
+  //Stops the recording: the hooks test it with the interrupts masked
+  enable = 0;
+
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  header.eventSize = sizeof(traceEvent_t);
+  header.cpuHz = SystemCoreClock;
+  header.events = ringCount;
+  header.lost = lost;
+  header.tasks = 0;
+  for (i=0; i<TRACE_MAX_TASKS; i++)
+    if (taskNames[i][0])
+      header.tasks++;
+  header.queues = queueCount < TRACE_MAX_QUEUES ? queueCount : TRACE_MAX_QUEUES - 1;
+
+  ok = sink(ctx, &header, sizeof(header));
+  for (i=0; i<TRACE_MAX_TASKS && ok; i++)
+    if (taskNames[i][0])
+      ok = traceDumpName(sink, ctx, i, TRACE_NAME_TASK, 0, taskNames[i]);
+  for (i=1; i<=header.queues && ok; i++)
+    ok = traceDumpName(sink, ctx, i, TRACE_NAME_QUEUE, queueTypes[i], queueNames[i]);
+
+  //Oldest first: up to the end of the array, then from its start
+  start = (ringHead - ringCount) & RING_MASK;
+  first = ringCount < TRACE_BUFFER_EVENTS - start ? ringCount : TRACE_BUFFER_EVENTS - start;
+  if (ok)
+    ok = sink(ctx, &ring[start], first * sizeof(traceEvent_t));
+  if (ok && ringCount > first)
+    ok = sink(ctx, &ring[0], (ringCount - first) * sizeof(traceEvent_t));
+  if (ok)
+    ok = sink(ctx, NULL, 0);
+
+  bytes = sizeof(header) + (header.tasks + header.queues) * sizeof(traceName_t) +
+          ringCount * sizeof(traceEvent_t);
+
+  ringHead = 0;
+  ringCount = 0;
+  lost = 0;
+  enable = wasEnabled;
+
+  return ok ? bytes : 0;
+}
+
+/* Chunks on CRTP_PORT_TRACE, sent blocking: the dump waits for the link */
+typedef struct
+{
+  CRTPPacket p;
+  uint16_t chunk;
+  uint32_t fill;
+} crtpSinkCtx_t;
+
+static void traceCrtpSend(crtpSinkCtx_t * c)
+{
+  c->p.header = CRTP_HEADER(CRTP_PORT_TRACE, 0);
+  c->p.size = 2 + c->fill;
+  c->p.data[0] = (uint8_t)c->chunk;
+  c->p.data[1] = (uint8_t)(c->chunk >> 8);
+  crtpSendPacketBlock(&c->p);
+  c->chunk++;
+  c->fill = 0;
+}
+
+static bool traceCrtpSink(void * ctx, const void * data, uint32_t len)
+{
+  crtpSinkCtx_t * c = (crtpSinkCtx_t *)ctx;
+  const uint8_t * bytes = (const uint8_t *)data;
+
+  //End of the dump: the last partial chunk
+  if (len == 0)
+  {
+    if (c->fill)
+      traceCrtpSend(c);
+    return true;
+  }
+
+  while (len)
+  {
+    uint32_t n = TRACE_CHUNK_SIZE - c->fill;
+
+    if (n > len)
+      n = len;
+    memcpy(&c->p.data[2 + c->fill], bytes, n);
+    bytes += n;
+    len -= n;
+    c->fill += n;
+
+    if (c->fill == TRACE_CHUNK_SIZE)
+      traceCrtpSend(c);
+  }
+
+  return true;
+}
+
+/* Raw bytes on the console UART, waits while its ring is full */
+static bool traceUartSink(void * ctx, const void * data, uint32_t len)
+{
+  const uint8_t * bytes = (const uint8_t *)data;
+  uint32_t waits = 0;
+
+  while (len)
+  {
+    uint32_t n = uartDmaWrite(bytes, len);
+
+    bytes += n;
+    len -= n;
+    if (n == 0)
+    {
+      if (++waits > M2T(1000))
+        return false;
+      vTaskDelay(1);
+    }
+  }
+
+  return true;
+}
+
+/*****************************************************************
+ *@brief  serve the CRTP and UART dump requests
+ *@param  *prm: not used
+ *@retval None
+ *****************************************************************/
+static void traceTask(void * prm)
+{
+  static crtpSinkCtx_t crtpCtx;
+
+  systemWaitStart();
+
+  while(1)
+  {
+    vTaskDelay(M2T(TRACE_POLL_MS));
+
+    switch (dump)
+    {
+      case TRACE_DUMP_CRTP:
+        memset(&crtpCtx, 0, sizeof(crtpCtx));
+        traceDump(traceCrtpSink, &crtpCtx);
+        traceDumpDone();
+        break;
+      case TRACE_DUMP_UART:
+        traceDump(traceUartSink, NULL);
+        traceDumpDone();
+        break;
+      case TRACE_DUMP_SD:
+        //Served by the blackbox task, the owner of the card
+        break;
+      default:
+        traceDumpDone();
+        break;
+    }
+  }
+}
+
+PARAM_GROUP_START(trace)
+PARAM_ADD(PARAM_UINT8, enable, &enable)
+PARAM_ADD(PARAM_UINT8, oneShot, &oneShot)
+PARAM_ADD(PARAM_UINT8, dump, &dump)
+PARAM_GROUP_STOP(trace)
+
+LOG_GROUP_START(trace)
+LOG_ADD(LOG_UINT32, events, &ringCount)
+LOG_ADD(LOG_UINT32, lost, &lost)
+LOG_GROUP_STOP(trace)
+
+#endif //TRACE_RECORDER